@@ -19,9 +19,23 @@ typedef float2       vec2;
 typedef float4x4     mat4;
 #endif
 
+// matrix of UniformParams which vertex and culling shaders take, selected by push constant
+#define VIEW_LIGHT  0
+#define VIEW_CAMERA 1
+
+// bits of as_uint(boxMax.w) in instance boxes, it is 0 for instances which are not rendered
+#define INSTANCE_RENDERED 1
+#define INSTANCE_DYNAMIC  2
+
+// instances which culling keeps, dynamic ones and the rest have separate shadow maps
+#define CULL_ALL     0
+#define CULL_STATIC  1
+#define CULL_DYNAMIC 2
+
 struct UniformParams
 {
   mat4  lightMatrix;
+  mat4  cameraMatrix;
   vec3  lightPos;
   float time;
   vec3  baseColor;
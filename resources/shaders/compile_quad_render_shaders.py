@@ -3,10 +3,11 @@ import subprocess
 import pathlib
 
 if __name__ == '__main__':
-    glslang_cmd = "glslangValidator"
+    # the build passes glslangValidator it has found, otherwise it is taken from PATH
+    glslang_cmd = os.environ.get("GLSLANG_VALIDATOR", "glslangValidator")
 
     shader_list = ["quad3_vert.vert", "my_quad.frag"]
 
     for shader in shader_list:
-        subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
+        subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)], check=True)
 
@@ -3,10 +3,26 @@ import subprocess
 import pathlib
 
 if __name__ == '__main__':
-    glslang_cmd = "glslangValidator"
+    # the build passes glslangValidator it has found, otherwise it is taken from PATH
+    glslang_cmd = os.environ.get("GLSLANG_VALIDATOR", "glslangValidator")
 
-    shader_list = ["simple.comp","scan1.comp","scan2.comp"]
+    shader_list = ["simple.comp", "radix_histogram.comp", "radix_scatter.comp"]
 
     for shader in shader_list:
-        subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
+        subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)], check=True)
 
+    # scan primitives are compiled once per element type: scan_block_float.comp.spv etc.
+    typed_shader_list = ["scan_block.comp", "scan_add.comp", "compact_scatter.comp", "scan_lookback.comp"]
+    value_types = ["uint", "int", "float"]
+
+    for shader in typed_shader_list:
+        name = pathlib.Path(shader).stem
+        for value_type in value_types:
+            subprocess.run([glslang_cmd, "-V", "-DVALUE_T={}".format(value_type), shader,
+                            "-o", "{}_{}.comp.spv".format(name, value_type)], check=True)
+
+    # look-back scan also has a variant with subgroup arithmetic, it needs SPIR-V 1.3
+    for value_type in value_types:
+        subprocess.run([glslang_cmd, "-V", "--target-env", "vulkan1.1", "-DUSE_SUBGROUPS",
+                        "-DVALUE_T={}".format(value_type), "scan_lookback.comp",
+                        "-o", "scan_lookback_subgroup_{}.comp.spv".format(value_type)], check=True)
@@ -0,0 +1,59 @@
+#ifndef CHIMERA_SCAN_COMMON_H
+#define CHIMERA_SCAN_COMMON_H
+
+// shared by scan kernels and GpuPrimitives (src/render/gpu_primitives.h)
+
+// element type of a shader variant is set from command line: -DVALUE_T=float|int|uint
+#ifndef VALUE_T
+#define VALUE_T float
+#endif
+
+// default workgroup size. scan, compaction and look-back kernels take their size from specialization
+// constants (GpuPrimitives::ScanTiles), radix sort kernels always use this one
+#define SCAN_GROUP_SIZE 256
+// each thread of scan_block.comp scans two elements
+#define SCAN_BLOCK_SIZE (2 * SCAN_GROUP_SIZE)
+
+// ids of specialization constants
+#define SCAN_SPEC_GROUP_SIZE 0
+#define SCAN_SPEC_ITEMS      1
+
+// shared memory arrays get one padding slot every NUM_BANKS elements,
+// so strided accesses of up-sweep and down-sweep hit different banks
+#define LOG_NUM_BANKS 5
+#define CONFLICT_FREE(n) ((n) + ((n) >> LOG_NUM_BANKS))
+
+// wide dispatches are folded into y, 65535 is the guaranteed minimum of maxComputeWorkGroupCount[0]
+#define SCAN_MAX_GROUPS_X 65535
+#define SCAN_GROUP_ID (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x)
+
+// no segment starts in block
+#define SCAN_NO_FLAG 0xFFFFFFFFu
+
+// bits of scan mode
+#define SCAN_MODE_INCLUSIVE    1u
+#define SCAN_MODE_SEGMENTED    2u
+// exclusive prefix of (flag, value) pairs without reset at segment starts, scans block sums of previous level
+#define SCAN_MODE_RAW          4u
+// scans (x != 0 ? 1 : 0) instead of x, used by stream compaction
+#define SCAN_MODE_PREDICATE    8u
+// without this bit only block sums are written, used by reduction
+#define SCAN_MODE_WRITE_RESULT 16u
+
+// single pass scan with decoupled look-back, each thread scans a run of LOOKBACK_ITEMS elements by default
+#define LOOKBACK_ITEMS 8
+
+// states of tiles in look-back scan, tile flags are zeroed before each run
+#define TILE_NOT_READY       0u
+#define TILE_AGGREGATE_READY 1u
+#define TILE_PREFIX_READY    2u
+
+// LSD radix sort of 32 bit keys, SORT_RADIX_BITS per pass, each thread ranks SORT_ITEMS keys
+#define SORT_RADIX_BITS 4
+#define SORT_RADIX      (1 << SORT_RADIX_BITS)
+#define SORT_ITEMS      4
+#define SORT_BLOCK_SIZE (SCAN_GROUP_SIZE * SORT_ITEMS)
+// bit of second push constant, the low bits are shift of digit
+#define SORT_WITH_VALUES 0x100u
+
+#endif//CHIMERA_SCAN_COMMON_H
@@ -2,6 +2,7 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
+#include "common.h"
 #include "unpack_attributes.h"
 
 
@@ -10,10 +11,19 @@ layout(location = 1) in vec4 vTexCoordAndTang;
 
 layout(push_constant) uniform params_t
 {
-    mat4 mProjView;
-    mat4 mModel;
+    uint viewId;
 } params;
 
+layout(binding = 0, set = 0) uniform AppData
+{
+    UniformParams Params;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer InstanceMatrices
+{
+    mat4 instanceMatrices[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -27,13 +37,15 @@ layout (location = 0 ) out VS_OUT
 out gl_PerVertex { vec4 gl_Position; };
 void main(void)
 {
+    const mat4 mModel = instanceMatrices[gl_InstanceIndex];
     const vec4 wNorm = vec4(DecodeNormal(floatBitsToInt(vPosNorm.w)),         0.0f);
     const vec4 wTang = vec4(DecodeNormal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-    vOut.wPos     = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-    vOut.wNorm    = mat3(transpose(inverse(params.mModel))) * wNorm.xyz;
-    vOut.wTangent = mat3(transpose(inverse(params.mModel))) * wTang.xyz;
+    vOut.wPos     = (mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
+    vOut.wNorm    = mat3(transpose(inverse(mModel))) * wNorm.xyz;
+    vOut.wTangent = mat3(transpose(inverse(mModel))) * wTang.xyz;
     vOut.texCoord = vTexCoordAndTang.xy;
 
-    gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+    const mat4 mProjView = params.viewId == VIEW_LIGHT ? Params.lightMatrix : Params.cameraMatrix;
+    gl_Position   = mProjView * vec4(vOut.wPos, 1.0);
 }
@@ -5,6 +5,12 @@
 #include <fstream>
 #include <locale>
 #include <codecvt>
+#include <charconv>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <cwchar>
+#include <string_view>
 
 #if defined(__ANDROID__)
 #define LOGE(...) \
@@ -129,65 +135,176 @@ namespace hydra_xml
 
   void HydraScene::parseInstancedMeshes(pugi::xml_node a_scenelib, pugi::xml_node a_geomlib)
   {
+    // geometry library is indexed once, so each instance costs one hash lookup instead of a scan over all meshes,
+    // and each mesh file is checked for existence once instead of once per instance
+    struct MeshEntry
+    {
+      pugi::xml_node                   node;
+      std::string                      loc;
+      bool                             checked   = false;
+      bool                             exists    = false;
+      std::vector<LiteMath::float4x4>* instances = nullptr;
+    };
+
+    std::vector<MeshEntry> meshes;
+    std::unordered_map<std::wstring_view, size_t> meshById;
+    for(pugi::xml_node meshNode = a_geomlib.first_child(); meshNode != nullptr; meshNode = meshNode.next_sibling())
+    {
+      auto idAttr = meshNode.attribute(L"id");
+      if(idAttr == nullptr)
+        continue;
+
+      // the first node with given id wins, as with find_child_by_attribute
+      if(meshById.emplace(std::wstring_view(idAttr.value()), meshes.size()).second)
+      {
+        MeshEntry entry;
+        entry.node = meshNode;
+        meshes.push_back(entry);
+      }
+    }
+
     auto scene = a_scenelib.first_child();
     for (pugi::xml_node inst = scene.first_child(); inst != nullptr; inst = inst.next_sibling())
     {
-      if (std::wstring(inst.name()) == L"instance_light")
+      if (wcscmp(inst.name(), L"instance_light") == 0)
         break;
 
       auto mesh_id = inst.attribute(L"mesh_id").as_string();
-      auto matrix = std::wstring(inst.attribute(L"matrix").as_string());
+      const wchar_t* matrix = inst.attribute(L"matrix").as_string();
 
-      auto meshNode = a_geomlib.find_child_by_attribute(L"id", mesh_id);
+      auto pFound = meshById.find(std::wstring_view(mesh_id));
+      if(pFound == meshById.end())
+        continue;
 
-      if(meshNode != nullptr)
+      MeshEntry &mesh = meshes[pFound->second];
+      if(!mesh.checked)
       {
-        auto meshLoc = ws2s(std::wstring(meshNode.attribute(L"loc").as_string()));
-        meshLoc = m_libraryRootDir + "/" + meshLoc;
+        mesh.checked = true;
+        mesh.loc     = m_libraryRootDir + "/" + ws2s(std::wstring(mesh.node.attribute(L"loc").as_string()));
 
 #if not defined(__ANDROID__)
-        std::ifstream checkMesh(meshLoc);
-        if(!checkMesh.good())
-        {
-          LogError("Mesh not found at: " + meshLoc + ". Loader will skip it.");
-          continue;
-        }
-        else
-        {
-          checkMesh.close();
-        }
+        std::ifstream checkMesh(mesh.loc);
+        mesh.exists = checkMesh.good();
+        if(!mesh.exists)
+          LogError("Mesh not found at: " + mesh.loc + ". Loader will skip it.");
+#else
+        mesh.exists = true;
 #endif
 
-        if(unique_meshes.find(meshLoc) == unique_meshes.end())
+        if(mesh.exists)
         {
-          unique_meshes.emplace(meshLoc);
-          //m_meshloc.push_back(meshLoc);
+          unique_meshes.emplace(mesh.loc);
+          mesh.instances = &m_instancesPerMeshLoc[mesh.loc];
         }
+      }
 
+      if(mesh.exists)
+        mesh.instances->push_back(float4x4FromString(matrix));
+    }
+  }
+
+  // parses floats the same way as std::wistream >> float does (same accepted characters, same result of conversion,
+  // same values on overflow and on errors), but without constructing a stream and any memory allocations;
+  // returns the number of values read, parsing stops at the first error as stream would set failbit
+  static int ReadFloats(const wchar_t* a_str, float* a_res, int a_count)
+  {
+    auto isSpace = [](wchar_t c) { return c == L' ' || c == L'\t' || c == L'\n' || c == L'\v' || c == L'\f' || c == L'\r'; };
+    auto isDigit = [](wchar_t c) { return c >= L'0' && c <= L'9'; };
 
-        if(m_instancesPerMeshLoc.find(meshLoc) != m_instancesPerMeshLoc.end())
+    constexpr int MAX_TOKEN_LEN = 64;
+    char token[MAX_TOKEN_LEN];
+
+    const wchar_t* ptr = a_str;
+    for(int i = 0; i < a_count; ++i)
+    {
+      while(isSpace(*ptr))
+        ptr++;
+      if(*ptr == L'\0')
+        return i;
+
+      // collect the same characters as std::num_get does for floating point values
+      const wchar_t* begin = ptr;
+      bool mantissa = false;
+      bool dot      = false;
+      bool exponent = false;
+      if(*ptr == L'+' || *ptr == L'-')
+        ptr++;
+      while(true)
+      {
+        if(isDigit(*ptr))
+        {
+          mantissa = mantissa || !exponent;
+          ptr++;
+        }
+        else if(*ptr == L'.' && !dot && !exponent)
         {
-          m_instancesPerMeshLoc[meshLoc].push_back(float4x4FromString(matrix));
+          dot = true;
+          ptr++;
+        }
+        else if((*ptr == L'e' || *ptr == L'E') && mantissa && !exponent)
+        {
+          exponent = true;
+          ptr++;
+          if(*ptr == L'+' || *ptr == L'-')
+            ptr++;
         }
         else
+          break;
+      }
+
+      const int len = static_cast<int>(ptr - begin);
+      if(len >= MAX_TOKEN_LEN)
+      {
+        // too long to be written by any exporter, stream fallback keeps results the same
+        std::wstringstream inputStream(std::wstring(begin, ptr));
+        inputStream >> a_res[i];
+        if(inputStream.fail())
+          return i;
+        continue;
+      }
+
+      // '+' is accepted by streams, but not by from_chars
+      const int skip = (*begin == L'+') ? 1 : 0;
+      for(int j = skip; j < len; ++j)
+        token[j] = static_cast<char>(begin[j]);
+
+      float value = 0.0f;
+      auto res = std::from_chars(token + skip, token + len, value);
+      if(res.ec == std::errc::result_out_of_range && res.ptr == token + len)
+      {
+        // stream clamps overflow to max float with an error, while underflow is just rounded to zero
+        const bool negative = (token[skip] == '-');
+        const double approx = std::strtod(std::string(token + skip, token + len).c_str(), nullptr);
+        if(std::abs(approx) > 1.0)
         {
-          std::vector<LiteMath::float4x4> tmp = { float4x4FromString(matrix) };
-          m_instancesPerMeshLoc[meshLoc] = tmp;
+          a_res[i] = negative ? -std::numeric_limits<float>::max() : std::numeric_limits<float>::max();
+          return i;
         }
+        a_res[i] = negative ? -0.0f : 0.0f;
       }
+      else if(res.ec != std::errc() || res.ptr != token + len || len == skip)
+      {
+        a_res[i] = 0.0f;
+        return i;
+      }
+      else
+        a_res[i] = value;
     }
 
-
+    return a_count;
   }
 
   LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str)
+  {
+    return float4x4FromString(matrix_str.c_str());
+  }
+
+  LiteMath::float4x4 float4x4FromString(const wchar_t* matrix_str)
   {
     LiteMath::float4x4 result;
-    std::wstringstream inputStream(matrix_str);
-    
-    float data[16];
-    for(int i = 0; i < 16; i++)
-      inputStream >> data[i];
+
+    float data[16] = {};
+    ReadFloats(matrix_str, data, 16);
     
     result.set_row(0, LiteMath::float4(data[0],data[1], data[2], data[3]));
     result.set_row(1, LiteMath::float4(data[4],data[5], data[6], data[7]));
@@ -203,8 +320,9 @@ namespace hydra_xml
     const wchar_t* camPosStr = a_attr.as_string();
     if (camPosStr != nullptr)
     {
-      std::wstringstream inputStream(camPosStr);
-      inputStream >> res.x >> res.y >> res.z;
+      float data[3] = {};
+      ReadFloats(camPosStr, data, 3);
+      res = LiteMath::float3(data[0], data[1], data[2]);
     }
     return res;
   }
@@ -215,8 +333,9 @@ namespace hydra_xml
     const wchar_t* camPosStr = a_node.text().as_string();
     if (camPosStr != nullptr)
     {
-      std::wstringstream inputStream(camPosStr);
-      inputStream >> res.x >> res.y >> res.z;
+      float data[3] = {};
+      ReadFloats(camPosStr, data, 3);
+      res = LiteMath::float3(data[0], data[1], data[2]);
     }
     return res;
   }
@@ -20,6 +20,7 @@ namespace hydra_xml
   std::wstring s2ws(const std::string& str);
   std::string  ws2s(const std::wstring& wstr);
   LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str);
+  LiteMath::float4x4 float4x4FromString(const wchar_t* matrix_str);
   LiteMath::float3   read3f(pugi::xml_attribute a_attr);
   LiteMath::float3   read3f(pugi::xml_node a_node);
   LiteMath::float3   readval3f(pugi::xml_node a_node);
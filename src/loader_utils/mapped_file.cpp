@@ -0,0 +1,104 @@
+#include "mapped_file.h"
+
+#ifdef WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+bool MappedFile::Open(const std::string &a_path)
+{
+  Close();
+
+  HANDLE file = CreateFileA(a_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if(mapping == nullptr)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(data == nullptr)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file    = file;
+  m_mapping = mapping;
+  m_data    = static_cast<const uint8_t*>(data);
+  m_size    = static_cast<size_t>(size.QuadPart);
+
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(m_data != nullptr)
+    UnmapViewOfFile(m_data);
+  if(m_mapping != nullptr)
+    CloseHandle(m_mapping);
+  if(m_file != nullptr)
+    CloseHandle(m_file);
+
+  m_data    = nullptr;
+  m_size    = 0;
+  m_mapping = nullptr;
+  m_file    = nullptr;
+}
+#else
+bool MappedFile::Open(const std::string &a_path)
+{
+  Close();
+
+  int fd = open(a_path.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat st = {};
+  if(fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // mapping stays valid after descriptor is closed
+  if(data == MAP_FAILED)
+    return false;
+
+  madvise(data, size_t(st.st_size), MADV_SEQUENTIAL);
+
+  m_data = static_cast<const uint8_t*>(data);
+  m_size = size_t(st.st_size);
+
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(m_data != nullptr)
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+
+  m_data = nullptr;
+  m_size = 0;
+}
+#endif
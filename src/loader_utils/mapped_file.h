@@ -0,0 +1,34 @@
+#ifndef VK_GRAPHICS_BASIC_MAPPED_FILE_H
+#define VK_GRAPHICS_BASIC_MAPPED_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool Open(const std::string &a_path);
+  void Close();
+
+  bool           IsOpen() const { return m_data != nullptr; }
+  const uint8_t* Data()   const { return m_data; }
+  size_t         Size()   const { return m_size; }
+
+private:
+  const uint8_t* m_data = nullptr;
+  size_t         m_size = 0;
+#ifdef WIN32
+  void* m_file    = nullptr;
+  void* m_mapping = nullptr;
+#endif
+};
+
+#endif// VK_GRAPHICS_BASIC_MAPPED_FILE_H
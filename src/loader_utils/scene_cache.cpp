@@ -0,0 +1,201 @@
+#include "scene_cache.h"
+#include "mapped_file.h"
+
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+
+namespace scene_cache
+{
+  static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+  static constexpr uint64_t FNV_PRIME  = 1099511628211ull;
+  static constexpr uint64_t ALIGNMENT  = 16;
+
+  static uint64_t HashBytes(uint64_t a_hash, const void* a_data, size_t a_size)
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(a_data);
+    for(size_t i = 0; i < a_size; ++i)
+    {
+      a_hash ^= bytes[i];
+      a_hash *= FNV_PRIME;
+    }
+    return a_hash;
+  }
+
+  static uint64_t AlignUp(uint64_t a_offset)
+  {
+    return (a_offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  }
+
+  bool ComputeKey(const std::string &a_xmlPath, const std::vector<std::string> &a_chunkPaths, uint64_t a_salt,
+                  uint64_t &a_key)
+  {
+    MappedFile xml;
+    if(!xml.Open(a_xmlPath))
+      return false;
+
+    uint64_t hash = HashBytes(FNV_OFFSET, &a_salt, sizeof(a_salt));
+    hash = HashBytes(hash, xml.Data(), xml.Size());
+
+    // chunk files are identified by size and modification time, hashing their contents would cost as much as loading them
+    for(const auto &path : a_chunkPaths)
+    {
+      std::error_code err;
+      const uint64_t fileSize  = std::filesystem::file_size(path, err);
+      if(err)
+        return false;
+      const int64_t  writeTime = std::filesystem::last_write_time(path, err).time_since_epoch().count();
+      if(err)
+        return false;
+
+      hash = HashBytes(hash, path.data(), path.size());
+      hash = HashBytes(hash, &fileSize, sizeof(fileSize));
+      hash = HashBytes(hash, &writeTime, sizeof(writeTime));
+    }
+
+    a_key = hash;
+    return true;
+  }
+
+  bool GetSceneView(const uint8_t* a_data, size_t a_size, SceneView &a_view)
+  {
+    if(a_data == nullptr || a_size < sizeof(Header))
+      return false;
+
+    memcpy(&a_view.header, a_data, sizeof(Header));
+    const Header &h = a_view.header;
+    if(h.magic != MAGIC || h.version != VERSION || h.meshesNum == 0)
+      return false;
+
+    auto inside = [a_size](uint64_t a_offset, uint64_t a_bytes) {
+      return a_offset <= a_size && a_bytes <= a_size - a_offset && a_offset % ALIGNMENT == 0;
+    };
+
+    if(!inside(h.meshSizesOffset,    uint64_t(h.meshesNum) * sizeof(uint32_t) * 2) ||
+       !inside(h.meshBoxesOffset,    uint64_t(h.meshesNum) * sizeof(float) * 8) ||
+       !inside(h.instMeshIdsOffset,  uint64_t(h.instancesNum) * sizeof(uint32_t)) ||
+       !inside(h.instMatricesOffset, uint64_t(h.instancesNum) * sizeof(float) * 16) ||
+       !inside(h.vertexDataOffset,   h.vertexDataSize) ||
+       !inside(h.indexDataOffset,    h.indexDataSize))
+      return false;
+
+    a_view.chunkPaths.clear();
+    uint64_t offset = h.chunkPathsOffset;
+    for(uint32_t i = 0; i < h.chunksNum; ++i)
+    {
+      uint32_t length = 0;
+      if(offset + sizeof(length) > a_size)
+        return false;
+      memcpy(&length, a_data + offset, sizeof(length));
+      offset += sizeof(length);
+      if(length > a_size - offset)
+        return false;
+      a_view.chunkPaths.emplace_back(reinterpret_cast<const char*>(a_data + offset), length);
+      offset += length;
+    }
+
+    a_view.meshSizes    = reinterpret_cast<const uint32_t*>(a_data + h.meshSizesOffset);
+    a_view.meshBoxes    = reinterpret_cast<const float*>(a_data + h.meshBoxesOffset);
+    a_view.instMeshIds  = reinterpret_cast<const uint32_t*>(a_data + h.instMeshIdsOffset);
+    a_view.instMatrices = reinterpret_cast<const float*>(a_data + h.instMatricesOffset);
+    a_view.vertexData   = a_data + h.vertexDataOffset;
+    a_view.indexData    = a_data + h.indexDataOffset;
+
+    uint64_t totalVertices = 0;
+    uint64_t totalIndices  = 0;
+    for(uint32_t i = 0; i < h.meshesNum; ++i)
+    {
+      totalVertices += a_view.meshSizes[i * 2 + 0];
+      totalIndices  += a_view.meshSizes[i * 2 + 1];
+    }
+    if(totalVertices * h.vertexSize != h.vertexDataSize || totalIndices * sizeof(uint32_t) != h.indexDataSize)
+      return false;
+
+    for(uint32_t i = 0; i < h.instancesNum; ++i)
+    {
+      if(a_view.instMeshIds[i] >= h.meshesNum)
+        return false;
+    }
+
+    return true;
+  }
+
+  bool Write(const std::string &a_path, uint64_t a_key, const SceneData &a_scene)
+  {
+    Header h = {};
+    h.magic        = MAGIC;
+    h.version      = VERSION;
+    h.key          = a_key;
+    h.vertexSize   = a_scene.vertexSize;
+    h.meshesNum    = static_cast<uint32_t>(a_scene.meshSizes.size() / 2);
+    h.instancesNum = static_cast<uint32_t>(a_scene.instMeshIds.size());
+    h.chunksNum    = static_cast<uint32_t>(a_scene.chunkPaths.size());
+
+    uint64_t offset = sizeof(Header);
+    h.chunkPathsOffset = offset;
+    for(const auto &path : a_scene.chunkPaths)
+      offset += sizeof(uint32_t) + path.size();
+
+    h.meshSizesOffset    = AlignUp(offset);
+    h.meshBoxesOffset    = AlignUp(h.meshSizesOffset   + a_scene.meshSizes.size() * sizeof(uint32_t));
+    h.instMeshIdsOffset  = AlignUp(h.meshBoxesOffset   + a_scene.meshBoxes.size() * sizeof(float));
+    h.instMatricesOffset = AlignUp(h.instMeshIdsOffset + a_scene.instMeshIds.size() * sizeof(uint32_t));
+    h.vertexDataOffset   = AlignUp(h.instMatricesOffset + uint64_t(h.instancesNum) * sizeof(float) * 16);
+    h.vertexDataSize     = a_scene.vertexDataSize;
+    h.indexDataOffset    = AlignUp(h.vertexDataOffset + h.vertexDataSize);
+    h.indexDataSize      = a_scene.indexDataSize;
+
+    // written to a temporary file first, so an interrupted write never leaves a broken cache behind
+    const std::string tmpPath = a_path + ".tmp";
+    {
+      std::ofstream output(tmpPath, std::ios::binary | std::ios::trunc);
+      if(!output.is_open())
+        return false;
+
+      uint64_t written = 0;
+      auto write = [&](const void* a_src, uint64_t a_bytes) {
+        output.write(static_cast<const char*>(a_src), static_cast<std::streamsize>(a_bytes));
+        written += a_bytes;
+      };
+      auto padTo = [&](uint64_t a_offset) {
+        const char zeros[ALIGNMENT] = {};
+        write(zeros, a_offset - written);
+      };
+
+      write(&h, sizeof(h));
+      for(const auto &path : a_scene.chunkPaths)
+      {
+        const uint32_t length = static_cast<uint32_t>(path.size());
+        write(&length, sizeof(length));
+        write(path.data(), length);
+      }
+      padTo(h.meshSizesOffset);
+      write(a_scene.meshSizes.data(), a_scene.meshSizes.size() * sizeof(uint32_t));
+      padTo(h.meshBoxesOffset);
+      write(a_scene.meshBoxes.data(), a_scene.meshBoxes.size() * sizeof(float));
+      padTo(h.instMeshIdsOffset);
+      write(a_scene.instMeshIds.data(), a_scene.instMeshIds.size() * sizeof(uint32_t));
+      padTo(h.instMatricesOffset);
+      write(a_scene.instMatrices, uint64_t(h.instancesNum) * sizeof(float) * 16);
+      padTo(h.vertexDataOffset);
+      bool ok = a_scene.writeVertices(write) && written == h.vertexDataOffset + h.vertexDataSize;
+      if(ok)
+      {
+        padTo(h.indexDataOffset);
+        ok = a_scene.writeIndices(write) && written == h.indexDataOffset + h.indexDataSize;
+      }
+
+      if(!ok || !output.good())
+      {
+        output.close();
+        std::error_code err;
+        std::filesystem::remove(tmpPath, err);
+        return false;
+      }
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, a_path, err);
+    return !err;
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef VK_GRAPHICS_BASIC_SCENE_CACHE_H
+#define VK_GRAPHICS_BASIC_SCENE_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+
+// binary cache of a scene with geometry already packed in renderer vertex layout,
+// all sections are 16 byte aligned so they can be used directly from a memory mapped file
+namespace scene_cache
+{
+  constexpr uint32_t MAGIC   = 0x43534b56; // "VKSC"
+  constexpr uint32_t VERSION = 2;
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t vertexSize;
+    uint32_t meshesNum;
+    uint32_t instancesNum;
+    uint32_t chunksNum;
+    uint64_t chunkPathsOffset;  // chunksNum times {uint32_t length; char path[length]}
+    uint64_t meshSizesOffset;   // meshesNum times {uint32_t verticesNum, indicesNum}
+    uint64_t meshBoxesOffset;   // meshesNum times {float4 boxMin, boxMax}
+    uint64_t instMeshIdsOffset; // instancesNum times uint32_t
+    uint64_t instMatricesOffset;// instancesNum times float4x4
+    uint64_t vertexDataOffset;
+    uint64_t vertexDataSize;
+    uint64_t indexDataOffset;
+    uint64_t indexDataSize;
+  };
+
+  // pointers into a memory mapped cache file
+  struct SceneView
+  {
+    Header                   header;
+    std::vector<std::string> chunkPaths;
+    const uint32_t*          meshSizes    = nullptr;
+    const float*             meshBoxes    = nullptr;
+    const uint32_t*          instMeshIds  = nullptr;
+    const float*             instMatrices = nullptr;
+    const uint8_t*           vertexData   = nullptr;
+    const uint8_t*           indexData    = nullptr;
+  };
+
+  // appends a_bytes from a_src to the section being written
+  using WriteFunc = std::function<void(const void* a_src, uint64_t a_bytes)>;
+  // writes the whole section with a_write, returns false if its data can't be produced
+  using SectionFunc = std::function<bool(const WriteFunc &a_write)>;
+
+  // geometry is produced by callbacks, so it doesn't have to be kept in host memory while cache is written
+  struct SceneData
+  {
+    std::vector<std::string> chunkPaths;
+    uint32_t                 vertexSize   = 0;
+    std::vector<uint32_t>    meshSizes;
+    std::vector<float>       meshBoxes;
+    std::vector<uint32_t>    instMeshIds;
+    const float*             instMatrices = nullptr;
+    SectionFunc              writeVertices;
+    uint64_t                 vertexDataSize = 0;
+    SectionFunc              writeIndices;
+    uint64_t                 indexDataSize  = 0;
+  };
+
+  // hash of xml file contents and of size and modification time of every chunk file,
+  // a_salt is for loading options which change cache contents
+  bool ComputeKey(const std::string &a_xmlPath, const std::vector<std::string> &a_chunkPaths, uint64_t a_salt,
+                  uint64_t &a_key);
+
+  bool GetSceneView(const uint8_t* a_data, size_t a_size, SceneView &a_view);
+  bool Write(const std::string &a_path, uint64_t a_key, const SceneData &a_scene);
+}
+
+#endif// VK_GRAPHICS_BASIC_SCENE_CACHE_H
@@ -0,0 +1,66 @@
+#include "vsgf_utils.h"
+
+#include <fstream>
+#include <cstring>
+
+namespace vsgf
+{
+  bool ReadHeader(const std::string &a_path, Header &a_header)
+  {
+    std::ifstream input(a_path, std::ios::binary);
+    if(!input.is_open())
+      return false;
+
+    input.read(reinterpret_cast<char*>(&a_header), sizeof(Header));
+
+    return input.good() && a_header.verticesNum > 0 && a_header.indicesNum > 0;
+  }
+
+  bool GetMeshView(const uint8_t* a_data, size_t a_size, MeshView &a_view)
+  {
+    if(a_data == nullptr || a_size < sizeof(Header))
+      return false;
+
+    memcpy(&a_view.header, a_data, sizeof(Header));
+    const Header &h = a_view.header;
+    if(h.verticesNum == 0 || h.indicesNum == 0)
+      return false;
+
+    const bool hasNormals  = !(h.flags & HAS_NO_NORMALS);
+    const bool hasTangents = (h.flags & HAS_TANGENT);
+
+    size_t expectedSize = sizeof(Header) + size_t(h.verticesNum) * sizeof(float) * (4 + 2);
+    if(hasNormals)
+      expectedSize += size_t(h.verticesNum) * sizeof(float) * 4;
+    if(hasTangents)
+      expectedSize += size_t(h.verticesNum) * sizeof(float) * 4;
+    expectedSize += size_t(h.indicesNum) * sizeof(uint32_t);
+    if(a_size < expectedSize)
+      return false;
+
+    const uint8_t* ptr = a_data + sizeof(Header);
+    a_view.pos4f = reinterpret_cast<const float*>(ptr);
+    ptr += size_t(h.verticesNum) * sizeof(float) * 4;
+
+    a_view.norm4f = nullptr;
+    if(hasNormals)
+    {
+      a_view.norm4f = reinterpret_cast<const float*>(ptr);
+      ptr += size_t(h.verticesNum) * sizeof(float) * 4;
+    }
+
+    a_view.tang4f = nullptr;
+    if(hasTangents)
+    {
+      a_view.tang4f = reinterpret_cast<const float*>(ptr);
+      ptr += size_t(h.verticesNum) * sizeof(float) * 4;
+    }
+
+    a_view.texcoord2f = reinterpret_cast<const float*>(ptr);
+    ptr += size_t(h.verticesNum) * sizeof(float) * 2;
+
+    a_view.indices = reinterpret_cast<const uint32_t*>(ptr);
+
+    return true;
+  }
+}
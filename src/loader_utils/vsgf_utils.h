@@ -0,0 +1,43 @@
+#ifndef VK_GRAPHICS_BASIC_VSGF_UTILS_H
+#define VK_GRAPHICS_BASIC_VSGF_UTILS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace vsgf
+{
+  // header of .vsgf file, followed by pos4f, norm4f, [tang4f], tex2f, indices and material indices
+  struct Header
+  {
+    uint64_t fileSizeInBytes;
+    uint32_t verticesNum;
+    uint32_t indicesNum;
+    uint32_t materialsNum;
+    uint32_t flags;
+  };
+
+  enum GEOM_FLAGS
+  {
+    HAS_TANGENT    = 1,
+    UNUSED2        = 2,
+    UNUSED4        = 4,
+    HAS_NO_NORMALS = 8
+  };
+
+  // pointers into a memory mapped .vsgf file, normals and tangents are nullptr if file doesn't have them
+  struct MeshView
+  {
+    Header          header;
+    const float*    pos4f      = nullptr;
+    const float*    norm4f     = nullptr;
+    const float*    tang4f     = nullptr;
+    const float*    texcoord2f = nullptr;
+    const uint32_t* indices    = nullptr;
+  };
+
+  bool ReadHeader(const std::string &a_path, Header &a_header);
+  bool GetMeshView(const uint8_t* a_data, size_t a_size, MeshView &a_view);
+}
+
+#endif// VK_GRAPHICS_BASIC_VSGF_UTILS_H
@@ -0,0 +1,115 @@
+#include "cmd_recorder.h"
+#include "vk_utils.h"
+
+#include <algorithm>
+
+SecondaryCmdRecorder::SecondaryCmdRecorder(VkDevice a_device, uint32_t a_queueFamilyIdx, uint32_t a_threadsNum,
+                                           uint32_t a_setsNum) : m_device(a_device)
+{
+  m_workers.resize(std::max(a_threadsNum, 1u));
+  for(auto &worker : m_workers)
+  {
+    worker.cmdPool = vk_utils::createCommandPool(m_device, a_queueFamilyIdx, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+    worker.cmdBufs.resize(a_setsNum);
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool        = worker.cmdPool;
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = a_setsNum;
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(m_device, &allocInfo, worker.cmdBufs.data()));
+  }
+
+  for(uint32_t i = 0; i < m_workers.size(); ++i)
+    m_workers[i].thread = std::thread(&SecondaryCmdRecorder::WorkerLoop, this, i);
+}
+
+SecondaryCmdRecorder::~SecondaryCmdRecorder()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cvJob.notify_all();
+
+  for(auto &worker : m_workers)
+  {
+    worker.thread.join();
+    vkDestroyCommandPool(m_device, worker.cmdPool, nullptr);
+  }
+}
+
+std::vector<VkCommandBuffer> SecondaryCmdRecorder::Record(uint32_t a_setId, const VkCommandBufferInheritanceInfo &a_inheritance,
+                                                          uint32_t a_itemsNum, const RecordFunc &a_record)
+{
+  const uint32_t threadsNum = ThreadsNum();
+  const uint32_t chunkSize  = std::max((a_itemsNum + threadsNum - 1) / threadsNum, 1u);
+  const uint32_t chunksNum  = std::max((a_itemsNum + chunkSize - 1) / chunkSize, 1u);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pRecord     = &a_record;
+    m_inheritance = a_inheritance;
+    m_setId       = a_setId;
+    m_itemsNum    = a_itemsNum;
+    m_chunkSize   = chunkSize;
+    m_pending     = threadsNum;
+    m_jobId++;
+  }
+  m_cvJob.notify_all();
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvDone.wait(lock, [this]() { return m_pending == 0; });
+    m_pRecord = nullptr;
+  }
+
+  // workers without items still record empty buffers, they are just not executed
+  std::vector<VkCommandBuffer> cmdBufs(chunksNum);
+  for(uint32_t i = 0; i < chunksNum; ++i)
+    cmdBufs[i] = m_workers[i].cmdBufs[a_setId];
+  return cmdBufs;
+}
+
+void SecondaryCmdRecorder::WorkerLoop(uint32_t a_workerId)
+{
+  uint64_t lastJobId = 0u;
+  while(true)
+  {
+    const RecordFunc* pRecord = nullptr;
+    VkCommandBufferInheritanceInfo inheritance = {};
+    uint32_t setId = 0, first = 0, count = 0;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cvJob.wait(lock, [this, lastJobId]() { return m_stop || m_jobId != lastJobId; });
+      if(m_stop)
+        return;
+
+      lastJobId   = m_jobId;
+      pRecord     = m_pRecord;
+      inheritance = m_inheritance;
+      setId       = m_setId;
+      first       = std::min(a_workerId * m_chunkSize, m_itemsNum);
+      count       = std::min(m_chunkSize, m_itemsNum - first);
+    }
+
+    VkCommandBuffer cmdBuf = m_workers[a_workerId].cmdBufs[setId];
+    vkResetCommandBuffer(cmdBuf, 0);
+
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &beginInfo));
+    if(count > 0)
+      (*pRecord)(cmdBuf, first, count);
+    VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuf));
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending--;
+    }
+    m_cvDone.notify_one();
+  }
+}
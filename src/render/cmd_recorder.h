@@ -0,0 +1,58 @@
+#ifndef CHIMERA_CMD_RECORDER_H
+#define CHIMERA_CMD_RECORDER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "volk.h"
+
+// records secondary command buffers on a pool of persistent worker threads.
+// each worker has its own command pool, so recording needs no synchronization
+struct SecondaryCmdRecorder
+{
+  // a_record writes commands for items [a_first, a_first + a_count) to a_cmdBuff
+  using RecordFunc = std::function<void(VkCommandBuffer a_cmdBuff, uint32_t a_first, uint32_t a_count)>;
+
+  // a_setsNum - number of independent sets of buffers, usually frames in flight times passes recorded per frame
+  SecondaryCmdRecorder(VkDevice a_device, uint32_t a_queueFamilyIdx, uint32_t a_threadsNum, uint32_t a_setsNum);
+  ~SecondaryCmdRecorder();
+
+  // splits a_itemsNum items between threads and waits until all of them are recorded,
+  // buffers of a_setId must not be in use by gpu
+  std::vector<VkCommandBuffer> Record(uint32_t a_setId, const VkCommandBufferInheritanceInfo &a_inheritance,
+                                      uint32_t a_itemsNum, const RecordFunc &a_record);
+
+  uint32_t ThreadsNum() const { return static_cast<uint32_t>(m_workers.size()); }
+
+private:
+  void WorkerLoop(uint32_t a_workerId);
+
+  struct Worker
+  {
+    VkCommandPool cmdPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> cmdBufs; // one per set
+    std::thread thread;
+  };
+
+  std::vector<Worker> m_workers;
+  VkDevice m_device = VK_NULL_HANDLE;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cvJob;
+  std::condition_variable m_cvDone;
+  uint64_t m_jobId    = 0u;
+  uint32_t m_pending  = 0u;
+  bool     m_stop     = false;
+
+  // current job
+  const RecordFunc* m_pRecord = nullptr;
+  VkCommandBufferInheritanceInfo m_inheritance = {};
+  uint32_t m_setId     = 0u;
+  uint32_t m_itemsNum  = 0u;
+  uint32_t m_chunkSize = 0u;
+};
+
+#endif//CHIMERA_CMD_RECORDER_H
@@ -0,0 +1,301 @@
+#include "compute_bench.h"
+#include "compute_common.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+static const char* PATTERN_NAMES[uint32_t(BenchPattern::COUNT)] = {"random", "zeros", "ones", "ascending", "descending"};
+static const char* BACKEND_NAMES[] = {"gpu", "cpu", "both"};
+
+const char* BenchPatternName(BenchPattern a_pattern)
+{
+  return a_pattern < BenchPattern::COUNT ? PATTERN_NAMES[uint32_t(a_pattern)] : "unknown";
+}
+
+uint32_t BenchConfig::MaxSize() const
+{
+  return sizes.empty() ? 0 : *std::max_element(sizes.begin(), sizes.end());
+}
+
+static double Median(std::vector<double> a_values)
+{
+  if(a_values.empty())
+    return 0.0;
+  const size_t mid = a_values.size() / 2;
+  std::nth_element(a_values.begin(), a_values.begin() + mid, a_values.end());
+  return a_values[mid];
+}
+
+void BenchResult::SetTimes(const std::vector<double> &a_totalMs, const std::vector<std::vector<GpuTimer::Scope>> &a_runs)
+{
+  iterations = uint32_t(a_totalMs.size());
+  if(a_totalMs.empty())
+    return;
+  minMs    = *std::min_element(a_totalMs.begin(), a_totalMs.end());
+  maxMs    = *std::max_element(a_totalMs.begin(), a_totalMs.end());
+  meanMs   = std::accumulate(a_totalMs.begin(), a_totalMs.end(), 0.0) / double(a_totalMs.size());
+  medianMs = Median(a_totalMs);
+
+  // every run records the same scopes
+  dispatches.clear();
+  for(size_t s = 0; !a_runs.empty() && s < a_runs[0].size(); ++s)
+  {
+    std::vector<double> ms;
+    for(const auto &run : a_runs)
+      if(s < run.size())
+        ms.push_back(run[s].ms);
+    dispatches.push_back({a_runs[0][s].name, Median(ms), a_runs[0][s].invocations});
+  }
+}
+
+void PrintCheck(const char* a_typeName, const char* a_name, bool a_passed, uint32_t a_mismatch, float a_ms,
+                uint32_t a_length)
+{
+  std::cout << std::left << std::setw(6) << a_typeName << std::setw(26) << a_name << (a_passed ? "PASS " : "FAIL ")
+            << std::right << std::setw(9) << std::fixed << std::setprecision(3) << a_ms << " ms "
+            << std::setw(9) << std::setprecision(1) << (a_ms > 0.0f ? float(a_length) / a_ms * 1e-3f : 0.0f) << " Melem/s";
+  if(!a_passed && a_mismatch != UINT32_MAX)
+    std::cout << "  first mismatch at " << a_mismatch;
+  std::cout << std::endl;
+}
+
+static void PrintBenchUsage()
+{
+  std::cout << "benchmark options: [--sizes n1,n2,...] [--patterns random,zeros,ones,ascending,descending]" << std::endl
+            << "                   [--iterations n] [--warmup n] [--device id] [--backend gpu|cpu|both] [--threads n]"
+            << std::endl
+            << "                   [--csv path] [--json path]" << std::endl;
+}
+
+bool ParseBenchArgs(int argc, const char** argv, BenchConfig &a_config)
+{
+  for(int i = 0; i < argc; ++i)
+  {
+    const std::string option = argv[i];
+    if(i + 1 >= argc)
+    {
+      std::cout << "no value of " << option << std::endl;
+      PrintBenchUsage();
+      return false;
+    }
+    const std::string value = argv[++i];
+
+    std::vector<std::string> items;
+    std::stringstream list(value);
+    for(std::string item; std::getline(list, item, ',');)
+      if(!item.empty())
+        items.push_back(item);
+
+    if(option == "--sizes")
+    {
+      a_config.sizes.clear();
+      for(const auto &item : items)
+        a_config.sizes.push_back(uint32_t(std::strtoul(item.c_str(), nullptr, 10)));
+    }
+    else if(option == "--patterns")
+    {
+      a_config.patterns.clear();
+      for(const auto &item : items)
+      {
+        auto found = std::find(std::begin(PATTERN_NAMES), std::end(PATTERN_NAMES), item);
+        if(found == std::end(PATTERN_NAMES))
+        {
+          std::cout << "unknown pattern " << item << std::endl;
+          PrintBenchUsage();
+          return false;
+        }
+        a_config.patterns.push_back(BenchPattern(found - std::begin(PATTERN_NAMES)));
+      }
+    }
+    else if(option == "--iterations")
+      a_config.iterations = std::max(uint32_t(std::strtoul(value.c_str(), nullptr, 10)), 1u);
+    else if(option == "--warmup")
+      a_config.warmup = uint32_t(std::strtoul(value.c_str(), nullptr, 10));
+    else if(option == "--device")
+      a_config.deviceId = uint32_t(std::strtoul(value.c_str(), nullptr, 10));
+    else if(option == "--backend")
+    {
+      auto found = std::find(std::begin(BACKEND_NAMES), std::end(BACKEND_NAMES), value);
+      if(found == std::end(BACKEND_NAMES))
+      {
+        std::cout << "unknown backend " << value << std::endl;
+        PrintBenchUsage();
+        return false;
+      }
+      a_config.backend = BenchBackend(found - std::begin(BACKEND_NAMES));
+    }
+    else if(option == "--threads")
+      a_config.threads = uint32_t(std::strtoul(value.c_str(), nullptr, 10));
+    else if(option == "--csv")
+      a_config.csvPath = value;
+    else if(option == "--json")
+      a_config.jsonPath = value;
+    else
+    {
+      std::cout << "unknown option " << option << std::endl;
+      PrintBenchUsage();
+      return false;
+    }
+  }
+
+  a_config.sizes.erase(std::remove(a_config.sizes.begin(), a_config.sizes.end(), 0u), a_config.sizes.end());
+  if(a_config.sizes.empty() || a_config.patterns.empty())
+  {
+    std::cout << "no sizes or patterns to run" << std::endl;
+    PrintBenchUsage();
+    return false;
+  }
+  return true;
+}
+
+bool WriteBenchCsv(const std::string &a_path, const std::vector<BenchReport> &a_reports)
+{
+  std::ofstream out(a_path);
+  if(!out)
+  {
+    std::cout << "can't write " << a_path << std::endl;
+    return false;
+  }
+
+  out << "device,kernel,type,size,pattern,passed,iterations,min_ms,median_ms,mean_ms,max_ms,melem_per_s,gb_per_s,"
+         "invocations\n";
+  out << std::fixed;
+  for(const auto &report : a_reports)
+  {
+    // device names may have commas
+    std::string device = report.device;
+    std::replace(device.begin(), device.end(), ',', ';');
+    for(const auto &r : report.results)
+    {
+      uint64_t invocations = 0;
+      for(const auto &d : r.dispatches)
+        invocations += d.invocations;
+      out << device << "," << r.kernel << "," << r.type << "," << r.size << "," << BenchPatternName(r.pattern) << ","
+          << (r.passed ? 1 : 0) << "," << r.iterations << "," << std::setprecision(4) << r.minMs << ","
+          << r.medianMs << "," << r.meanMs << "," << r.maxMs << "," << std::setprecision(2) << r.MelemPerSec() << ","
+          << r.GBPerSec() << "," << invocations << "\n";
+    }
+  }
+  return true;
+}
+
+static std::string JsonString(const std::string &a_str)
+{
+  std::string res = "\"";
+  for(char c : a_str)
+  {
+    if(c == '"' || c == '\\')
+      res += '\\';
+    res += c;
+  }
+  return res + "\"";
+}
+
+bool WriteBenchJson(const std::string &a_path, const BenchConfig &a_config, const std::vector<BenchReport> &a_reports)
+{
+  std::ofstream out(a_path);
+  if(!out)
+  {
+    std::cout << "can't write " << a_path << std::endl;
+    return false;
+  }
+
+  out << std::fixed << std::setprecision(4);
+  out << "{\n  \"iterations\": " << a_config.iterations << ",\n"
+      << "  \"warmup\": " << a_config.warmup << ",\n"
+      << "  \"reports\": [";
+  for(size_t k = 0; k < a_reports.size(); ++k)
+  {
+    const auto &report = a_reports[k];
+    out << (k > 0 ? "," : "") << "\n  {\n  \"device\": " << JsonString(report.device) << ",\n"
+        << "  \"results\": [";
+    for(size_t i = 0; i < report.results.size(); ++i)
+    {
+      const auto &r = report.results[i];
+      out << (i > 0 ? "," : "") << "\n    {\"kernel\": " << JsonString(r.kernel) << ", \"type\": " << JsonString(r.type)
+          << ", \"size\": " << r.size << ", \"pattern\": " << JsonString(BenchPatternName(r.pattern))
+          << ", \"passed\": " << (r.passed ? "true" : "false") << ", \"iterations\": " << r.iterations
+          << ", \"min_ms\": " << r.minMs << ", \"median_ms\": " << r.medianMs << ", \"mean_ms\": " << r.meanMs
+          << ", \"max_ms\": " << r.maxMs << ", \"melem_per_s\": " << r.MelemPerSec()
+          << ", \"gb_per_s\": " << r.GBPerSec() << ",\n     \"dispatches\": [";
+      for(size_t d = 0; d < r.dispatches.size(); ++d)
+        out << (d > 0 ? ", " : "") << "{\"name\": " << JsonString(r.dispatches[d].name)
+            << ", \"median_ms\": " << r.dispatches[d].medianMs << ", \"invocations\": " << r.dispatches[d].invocations << "}";
+      out << "]}";
+    }
+    out << "\n  ]\n  }";
+  }
+  out << "\n  ]\n}\n";
+  return true;
+}
+
+static void PrintReport(const BenchReport &a_report, const BenchConfig &a_config)
+{
+  std::cout << "Device: " << a_report.device << ", " << a_config.iterations << " iterations after "
+            << a_config.warmup << " warm-up runs" << std::endl;
+  std::cout << std::left << std::setw(26) << "kernel" << std::setw(7) << "type" << std::setw(11) << "pattern"
+            << std::right << std::setw(10) << "size" << std::setw(11) << "median ms" << std::setw(10) << "min ms"
+            << std::setw(10) << "max ms" << std::setw(10) << "Melem/s" << std::setw(8) << "GB/s" << std::endl;
+
+  for(const auto &r : a_report.results)
+  {
+    std::cout << std::left << std::setw(26) << r.kernel << std::setw(7) << r.type << std::setw(11)
+              << BenchPatternName(r.pattern) << std::right << std::setw(10) << r.size << std::fixed
+              << std::setprecision(3) << std::setw(11) << r.medianMs << std::setw(10) << r.minMs << std::setw(10)
+              << r.maxMs << std::setprecision(1) << std::setw(10) << r.MelemPerSec() << std::setw(8) << r.GBPerSec()
+              << (r.passed ? "" : "  FAIL") << std::endl;
+  }
+}
+
+// median times of kernels that both reports have, speedup > 1 means a_other is faster
+static void PrintComparison(const BenchReport &a_base, const BenchReport &a_other)
+{
+  std::cout << "Comparison: A = " << a_base.device << ", B = " << a_other.device << std::endl;
+  std::cout << std::left << std::setw(26) << "kernel" << std::setw(7) << "type" << std::setw(11) << "pattern"
+            << std::right << std::setw(10) << "size" << std::setw(11) << "A ms" << std::setw(11) << "B ms"
+            << std::setw(10) << "A / B" << "  faster" << std::endl;
+
+  for(const auto &a : a_base.results)
+  {
+    auto b = std::find_if(a_other.results.begin(), a_other.results.end(), [&a](const BenchResult &r) {
+      return r.kernel == a.kernel && r.type == a.type && r.size == a.size && r.pattern == a.pattern; });
+    if(b == a_other.results.end())
+      continue;
+    const double ratio = b->medianMs > 0.0 ? a.medianMs / b->medianMs : 0.0;
+    std::cout << std::left << std::setw(26) << a.kernel << std::setw(7) << a.type << std::setw(11)
+              << BenchPatternName(a.pattern) << std::right << std::setw(10) << a.size << std::fixed
+              << std::setprecision(3) << std::setw(11) << a.medianMs << std::setw(11) << b->medianMs
+              << std::setprecision(2) << std::setw(10) << ratio << "  " << (ratio > 1.0 ? "B" : "A") << std::endl;
+  }
+  // timestamps don't include submit and wait, CPU wall time has nothing like that to exclude
+  std::cout << "GPU times are from timestamps without submit overhead, CPU times are wall time" << std::endl;
+}
+
+uint32_t RunBenchmark(const std::vector<ICompute*> &a_apps, const BenchConfig &a_config)
+{
+  std::vector<BenchReport> reports;
+  uint32_t failed = 0;
+  for(ICompute* app : a_apps)
+  {
+    reports.push_back(app->Benchmark(a_config));
+    PrintReport(reports.back(), a_config);
+    for(const auto &r : reports.back().results)
+      failed += r.passed ? 0 : 1;
+  }
+  for(size_t k = 1; k < reports.size(); ++k)
+    PrintComparison(reports[0], reports[k]);
+
+  if(!a_config.csvPath.empty() && WriteBenchCsv(a_config.csvPath, reports))
+    std::cout << "results are written to " << a_config.csvPath << std::endl;
+  if(!a_config.jsonPath.empty() && WriteBenchJson(a_config.jsonPath, a_config, reports))
+    std::cout << "results are written to " << a_config.jsonPath << std::endl;
+
+  if(failed > 0)
+    std::cout << failed << " checks failed" << std::endl;
+  return failed;
+}
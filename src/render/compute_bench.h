@@ -0,0 +1,127 @@
+#ifndef CHIMERA_COMPUTE_BENCH_H
+#define CHIMERA_COMPUTE_BENCH_H
+
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "gpu_timer.h"
+
+class ICompute;
+
+// input data of benchmarked kernels, values are limited by the kernel (i.e. small numbers for scans)
+enum class BenchPattern : uint32_t
+{
+  RANDOM     = 0,
+  ZEROS      = 1,
+  ONES       = 2,
+  ASCENDING  = 3,
+  DESCENDING = 4,
+  COUNT      = 5
+};
+
+const char* BenchPatternName(BenchPattern a_pattern);
+
+// a_maxValue limits values of patterns, ascending and descending ones wrap around after it
+template<typename T>
+inline void FillPattern(std::vector<T> &a_values, BenchPattern a_pattern, uint32_t a_maxValue, uint32_t a_seed)
+{
+  std::mt19937 gen(a_seed);
+  const uint64_t period = uint64_t(a_maxValue) + 1;
+  const size_t   count  = a_values.size();
+  for(size_t i = 0; i < count; ++i)
+  {
+    uint64_t value = 0;
+    switch(a_pattern)
+    {
+    case BenchPattern::RANDOM:     value = gen() % period;           break;
+    case BenchPattern::ONES:       value = 1;                        break;
+    case BenchPattern::ASCENDING:  value = i % period;               break;
+    case BenchPattern::DESCENDING: value = (count - 1 - i) % period; break;
+    default:                       value = 0;                        break;
+    }
+    a_values[i] = T(value);
+  }
+}
+
+// implementations of ICompute which are benchmarked, BOTH runs the same kernels on each and compares them
+enum class BenchBackend : uint32_t
+{
+  GPU  = 0,
+  CPU  = 1,
+  BOTH = 2
+};
+
+struct BenchConfig
+{
+  std::vector<uint32_t>     sizes      = {64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+  std::vector<BenchPattern> patterns   = {BenchPattern::RANDOM};
+  uint32_t                  iterations = 20;
+  uint32_t                  warmup     = 3;  // runs before timed ones, not included in results
+  uint32_t                  deviceId   = 0;
+  BenchBackend              backend    = BenchBackend::GPU;
+  uint32_t                  threads    = 0;  // of CPU backend, 0 means one per hardware thread
+  std::string               csvPath;         // files are not written if paths are empty
+  std::string               jsonPath;
+
+  uint32_t MaxSize() const;
+};
+
+// one dispatch, copy or fill inside of benchmarked kernel
+struct BenchDispatch
+{
+  std::string name;
+  double      medianMs    = 0.0;
+  uint64_t    invocations = 0; // compute shader invocations, 0 without pipeline statistics
+};
+
+struct BenchResult
+{
+  std::string  kernel;
+  std::string  type;
+  uint32_t     size    = 0;
+  BenchPattern pattern = BenchPattern::RANDOM;
+  bool         passed  = false;
+  // time of one run, ms: GPU time from timestamps or wall time of CPU backend
+  uint32_t     iterations = 0;
+  double       minMs    = 0.0;
+  double       medianMs = 0.0;
+  double       meanMs   = 0.0;
+  double       maxMs    = 0.0;
+  // memory that kernel has to read and write at least, for effective bandwidth
+  uint64_t     bytes = 0;
+  std::vector<BenchDispatch> dispatches;
+
+  double MelemPerSec() const { return medianMs > 0.0 ? double(size) / medianMs * 1e-3 : 0.0; }
+  double GBPerSec()    const { return medianMs > 0.0 ? double(bytes) / medianMs * 1e-6 : 0.0; }
+
+  // statistics of timed runs, a_runs[i] are scopes of i-th run
+  void SetTimes(const std::vector<double> &a_totalMs, const std::vector<std::vector<GpuTimer::Scope>> &a_runs);
+};
+
+struct BenchReport
+{
+  std::string              device;
+  std::vector<BenchResult> results;
+};
+
+// one line of correctness check of a kernel with its time and throughput, a_mismatch is UINT32_MAX if unknown
+void PrintCheck(const char* a_typeName, const char* a_name, bool a_passed, uint32_t a_mismatch, float a_ms,
+                uint32_t a_length);
+
+// options after the mode argument:
+// --sizes 65536,1048576 --patterns random,zeros,ones,ascending,descending --iterations 20 --warmup 3
+// --device 0 --backend gpu|cpu|both --threads 0 --csv results.csv --json results.json
+// prints usage and returns false if options are wrong
+bool ParseBenchArgs(int argc, const char** argv, BenchConfig &a_config);
+
+// results of all reports, every row has device of its report
+bool WriteBenchCsv(const std::string &a_path, const std::vector<BenchReport> &a_reports);
+bool WriteBenchJson(const std::string &a_path, const BenchConfig &a_config, const std::vector<BenchReport> &a_reports);
+
+// runs benchmark of every app, prints their tables and writes files of a_config, returns number of failed checks.
+// with several apps the same kernels of each are compared to the first one side by side
+uint32_t RunBenchmark(const std::vector<ICompute*> &a_apps, const BenchConfig &a_config);
+
+#endif//CHIMERA_COMPUTE_BENCH_H
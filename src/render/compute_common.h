@@ -3,6 +3,7 @@
 
 #include "volk.h"
 #include "vk_utils.h"
+#include "compute_bench.h"
 #include <cstring>
 //#include <memory>
 
@@ -21,6 +22,9 @@ public:
 
   virtual void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) = 0;
   virtual void Execute() = 0;
+  // timed runs of every kernel of the sample for a_config sizes and patterns, results are checked on CPU.
+  // samples without kernels worth measuring return empty report
+  virtual BenchReport Benchmark(const BenchConfig &a_config) { return {}; }
 
   virtual ~ICompute() = default;
 };
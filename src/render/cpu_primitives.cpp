@@ -0,0 +1,423 @@
+#include "cpu_primitives.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIMERA_X86_64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// AVX2 kernels are compiled for it without changing flags of the whole project, they run only if CPU has it
+#if defined(CHIMERA_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define CHIMERA_AVX2 __attribute__((target("avx2")))
+#else
+#define CHIMERA_AVX2
+#endif
+
+static bool CpuHasAvx2()
+{
+#if defined(CHIMERA_X86_64) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#elif defined(CHIMERA_X86_64) && defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 0);
+  if(info[0] < 7)
+    return false;
+  // OS must save AVX registers
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx     = (info[2] & (1 << 28)) != 0;
+  if(!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return false;
+#endif
+}
+
+// chunk kernels scan from a_carry and return a_carry plus sum of the chunk, a_in and a_out may be the same
+
+template<typename T>
+static T ScanScalar(const T* a_in, T* a_out, size_t a_count, T a_carry, bool a_inclusive)
+{
+  for(size_t i = 0; i < a_count; ++i)
+  {
+    const T x = a_in[i];
+    a_out[i] = a_inclusive ? a_carry + x : a_carry;
+    a_carry += x;
+  }
+  return a_carry;
+}
+
+template<typename T>
+static T SumScalar(const T* a_in, size_t a_count)
+{
+  T sum = T(0);
+  for(size_t i = 0; i < a_count; ++i)
+    sum += a_in[i];
+  return sum;
+}
+
+#ifdef CHIMERA_X86_64
+
+// in-register inclusive prefix of 4 lanes: log2(4) shifted adds
+static uint32_t ScanSse(const uint32_t* a_in, uint32_t* a_out, size_t a_count, uint32_t a_carry, bool a_inclusive)
+{
+  __m128i carry = _mm_set1_epi32(int(a_carry));
+  size_t i = 0;
+  for(; i + 4 <= a_count; i += 4)
+  {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_in + i));
+    __m128i p = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    p = _mm_add_epi32(p, _mm_slli_si128(p, 8));
+    const __m128i res = a_inclusive ? p : _mm_slli_si128(p, 4);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(a_out + i), _mm_add_epi32(res, carry));
+    carry = _mm_add_epi32(carry, _mm_shuffle_epi32(p, 0xFF));
+  }
+  return ScanScalar(a_in + i, a_out + i, a_count - i, uint32_t(_mm_cvtsi128_si32(carry)), a_inclusive);
+}
+
+static float ScanSse(const float* a_in, float* a_out, size_t a_count, float a_carry, bool a_inclusive)
+{
+  __m128 carry = _mm_set1_ps(a_carry);
+  size_t i = 0;
+  for(; i + 4 <= a_count; i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(a_in + i);
+    __m128 p = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+    p = _mm_add_ps(p, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(p), 8)));
+    const __m128 res = a_inclusive ? p : _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(p), 4));
+    _mm_storeu_ps(a_out + i, _mm_add_ps(res, carry));
+    carry = _mm_add_ps(carry, _mm_shuffle_ps(p, p, 0xFF));
+  }
+  return ScanScalar(a_in + i, a_out + i, a_count - i, _mm_cvtss_f32(carry), a_inclusive);
+}
+
+static uint32_t SumSse(const uint32_t* a_in, size_t a_count)
+{
+  __m128i sum = _mm_setzero_si128();
+  size_t i = 0;
+  for(; i + 4 <= a_count; i += 4)
+    sum = _mm_add_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_in + i)));
+  uint32_t lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumScalar(a_in + i, a_count - i);
+}
+
+static float SumSse(const float* a_in, size_t a_count)
+{
+  __m128 sum = _mm_setzero_ps();
+  size_t i = 0;
+  for(; i + 4 <= a_count; i += 4)
+    sum = _mm_add_ps(sum, _mm_loadu_ps(a_in + i));
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + SumScalar(a_in + i, a_count - i);
+}
+
+// prefix of each 128 bit half as in SSE, then total of the low half is added to the high one
+CHIMERA_AVX2 static uint32_t ScanAvx2(const uint32_t* a_in, uint32_t* a_out, size_t a_count, uint32_t a_carry,
+                                      bool a_inclusive)
+{
+  const __m256i shiftIdx = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i lastIdx  = _mm256_set1_epi32(7);
+  __m256i carry = _mm256_set1_epi32(int(a_carry));
+  size_t i = 0;
+  for(; i + 8 <= a_count; i += 8)
+  {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_in + i));
+    __m256i p = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+    p = _mm256_add_epi32(p, _mm256_slli_si256(p, 8));
+    p = _mm256_add_epi32(p, _mm256_shuffle_epi32(_mm256_permute2x128_si256(p, p, 0x08), 0xFF));
+    // exclusive: element i gets inclusive prefix of i - 1, the first one gets 0
+    const __m256i res = a_inclusive ? p : _mm256_blend_epi32(_mm256_permutevar8x32_epi32(p, shiftIdx),
+                                                             _mm256_setzero_si256(), 0x01);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(a_out + i), _mm256_add_epi32(res, carry));
+    carry = _mm256_add_epi32(carry, _mm256_permutevar8x32_epi32(p, lastIdx));
+  }
+  return ScanScalar(a_in + i, a_out + i, a_count - i, uint32_t(_mm_cvtsi128_si32(_mm256_castsi256_si128(carry))),
+                    a_inclusive);
+}
+
+CHIMERA_AVX2 static float ScanAvx2(const float* a_in, float* a_out, size_t a_count, float a_carry, bool a_inclusive)
+{
+  const __m256i shiftIdx = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i lastIdx  = _mm256_set1_epi32(7);
+  __m256 carry = _mm256_set1_ps(a_carry);
+  size_t i = 0;
+  for(; i + 8 <= a_count; i += 8)
+  {
+    const __m256 x = _mm256_loadu_ps(a_in + i);
+    __m256 p = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+    p = _mm256_add_ps(p, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(p), 8)));
+    p = _mm256_add_ps(p, _mm256_permute_ps(_mm256_permute2f128_ps(p, p, 0x08), 0xFF));
+    const __m256 res = a_inclusive ? p : _mm256_blend_ps(_mm256_permutevar8x32_ps(p, shiftIdx), _mm256_setzero_ps(), 0x01);
+    _mm256_storeu_ps(a_out + i, _mm256_add_ps(res, carry));
+    carry = _mm256_add_ps(carry, _mm256_permutevar8x32_ps(p, lastIdx));
+  }
+  return ScanScalar(a_in + i, a_out + i, a_count - i, _mm256_cvtss_f32(carry), a_inclusive);
+}
+
+CHIMERA_AVX2 static uint32_t SumAvx2(const uint32_t* a_in, size_t a_count)
+{
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for(; i + 8 <= a_count; i += 8)
+    sum = _mm256_add_epi32(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_in + i)));
+  uint32_t lanes[8];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+  return SumScalar(lanes, 8) + SumScalar(a_in + i, a_count - i);
+}
+
+CHIMERA_AVX2 static float SumAvx2(const float* a_in, size_t a_count)
+{
+  __m256 sum = _mm256_setzero_ps();
+  size_t i = 0;
+  for(; i + 8 <= a_count; i += 8)
+    sum = _mm256_add_ps(sum, _mm256_loadu_ps(a_in + i));
+  float lanes[8];
+  _mm256_storeu_ps(lanes, sum);
+  return SumScalar(lanes, 8) + SumScalar(a_in + i, a_count - i);
+}
+
+CHIMERA_AVX2 static void AddAvx2(const float* a_a, const float* a_b, float* a_sum, size_t a_count)
+{
+  size_t i = 0;
+  for(; i + 8 <= a_count; i += 8)
+    _mm256_storeu_ps(a_sum + i, _mm256_add_ps(_mm256_loadu_ps(a_a + i), _mm256_loadu_ps(a_b + i)));
+  for(; i < a_count; ++i)
+    a_sum[i] = a_a[i] + a_b[i];
+}
+
+static void AddSse(const float* a_a, const float* a_b, float* a_sum, size_t a_count)
+{
+  size_t i = 0;
+  for(; i + 4 <= a_count; i += 4)
+    _mm_storeu_ps(a_sum + i, _mm_add_ps(_mm_loadu_ps(a_a + i), _mm_loadu_ps(a_b + i)));
+  for(; i < a_count; ++i)
+    a_sum[i] = a_a[i] + a_b[i];
+}
+
+#endif // CHIMERA_X86_64
+
+template<typename T>
+static T ScanChunk(CpuPrimitives::Isa a_isa, const T* a_in, T* a_out, size_t a_count, T a_carry, bool a_inclusive)
+{
+#ifdef CHIMERA_X86_64
+  if(a_isa == CpuPrimitives::Isa::AVX2)
+    return ScanAvx2(a_in, a_out, a_count, a_carry, a_inclusive);
+  if(a_isa == CpuPrimitives::Isa::SSE)
+    return ScanSse(a_in, a_out, a_count, a_carry, a_inclusive);
+#endif
+  return ScanScalar(a_in, a_out, a_count, a_carry, a_inclusive);
+}
+
+template<typename T>
+static T SumChunk(CpuPrimitives::Isa a_isa, const T* a_in, size_t a_count)
+{
+#ifdef CHIMERA_X86_64
+  if(a_isa == CpuPrimitives::Isa::AVX2)
+    return SumAvx2(a_in, a_count);
+  if(a_isa == CpuPrimitives::Isa::SSE)
+    return SumSse(a_in, a_count);
+#endif
+  return SumScalar(a_in, a_count);
+}
+
+CpuPrimitives::CpuPrimitives(ThreadPool &a_pool, Isa a_maxIsa) : m_pool(a_pool)
+{
+#ifdef CHIMERA_X86_64
+  m_isa = CpuHasAvx2() ? Isa::AVX2 : Isa::SSE;
+#endif
+  m_isa = std::min(m_isa, a_maxIsa);
+}
+
+const char* CpuPrimitives::IsaName(Isa a_isa)
+{
+  switch(a_isa)
+  {
+  case Isa::AVX2: return "AVX2";
+  case Isa::SSE:  return "SSE";
+  default:        return "scalar";
+  }
+}
+
+template<typename T>
+void CpuPrimitives::ScanT(const T* a_in, T* a_out, uint32_t a_length, bool a_inclusive) const
+{
+  const size_t chunksNum = (size_t(a_length) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  if(chunksNum <= 1)
+  {
+    ScanChunk(m_isa, a_in, a_out, a_length, T(0), a_inclusive);
+    return;
+  }
+
+  // sums of chunks, then their exclusive prefix is the carry of each chunk
+  std::vector<T> chunkPrefix(chunksNum);
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    chunkPrefix[a_begin / CHUNK_SIZE] = SumChunk(m_isa, a_in + a_begin, a_end - a_begin);
+  });
+  T carry = T(0);
+  for(auto &prefix : chunkPrefix)
+  {
+    const T sum = prefix;
+    prefix = carry;
+    carry += sum;
+  }
+
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    ScanChunk(m_isa, a_in + a_begin, a_out + a_begin, a_end - a_begin, chunkPrefix[a_begin / CHUNK_SIZE], a_inclusive);
+  });
+}
+
+// flags reset the sum, which doesn't map to shifted adds, so chunks are scanned by scalar code
+template<typename T>
+void CpuPrimitives::SegmentedScanT(const T* a_in, T* a_out, uint32_t a_length, bool a_inclusive,
+                                   const uint32_t* a_flags) const
+{
+  const size_t chunksNum = (size_t(a_length) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  // sum after the last segment start of each chunk and whether it has one
+  std::vector<T>    chunkSums(chunksNum);
+  std::vector<char> chunkReset(chunksNum, 0);
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    const size_t chunk = a_begin / CHUNK_SIZE;
+    T sum = T(0);
+    for(size_t i = a_begin; i < a_end; ++i)
+    {
+      if(a_flags[i] != 0)
+      {
+        sum = T(0);
+        chunkReset[chunk] = 1;
+      }
+      sum += a_in[i];
+    }
+    chunkSums[chunk] = sum;
+  });
+
+  std::vector<T> chunkPrefix(chunksNum, T(0));
+  for(size_t c = 1; c < chunksNum; ++c)
+    chunkPrefix[c] = chunkReset[c - 1] ? chunkSums[c - 1] : chunkPrefix[c - 1] + chunkSums[c - 1];
+
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    T sum = chunkPrefix[a_begin / CHUNK_SIZE];
+    for(size_t i = a_begin; i < a_end; ++i)
+    {
+      if(a_flags[i] != 0)
+        sum = T(0);
+      const T x = a_in[i];
+      a_out[i] = a_inclusive ? sum + x : sum;
+      sum += x;
+    }
+  });
+}
+
+template<typename T>
+T CpuPrimitives::ReduceT(const T* a_in, uint32_t a_length) const
+{
+  const size_t chunksNum = (size_t(a_length) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  std::vector<T> chunkSums(chunksNum, T(0));
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    chunkSums[a_begin / CHUNK_SIZE] = SumChunk(m_isa, a_in + a_begin, a_end - a_begin);
+  });
+  return SumScalar(chunkSums.data(), chunkSums.size());
+}
+
+// int and uint sums are the same bits in two's complement, so int arrays go through uint kernels
+void CpuPrimitives::Scan(ScanValueType a_type, const void* a_in, void* a_out, uint32_t a_length, uint32_t a_flags,
+                         const uint32_t* a_segmentFlags) const
+{
+  const bool inclusive = (a_flags & GpuPrimitives::SCAN_INCLUSIVE) != 0;
+  const bool segmented = (a_flags & GpuPrimitives::SCAN_SEGMENTED) != 0 && a_segmentFlags != nullptr;
+  if(a_type == ScanValueType::FLOAT)
+  {
+    const float* in  = static_cast<const float*>(a_in);
+    float*       out = static_cast<float*>(a_out);
+    if(segmented)
+      SegmentedScanT(in, out, a_length, inclusive, a_segmentFlags);
+    else
+      ScanT(in, out, a_length, inclusive);
+  }
+  else
+  {
+    const uint32_t* in  = static_cast<const uint32_t*>(a_in);
+    uint32_t*       out = static_cast<uint32_t*>(a_out);
+    if(segmented)
+      SegmentedScanT(in, out, a_length, inclusive, a_segmentFlags);
+    else
+      ScanT(in, out, a_length, inclusive);
+  }
+}
+
+void CpuPrimitives::Reduce(ScanValueType a_type, const void* a_in, void* a_result, uint32_t a_length) const
+{
+  if(a_type == ScanValueType::FLOAT)
+  {
+    const float sum = ReduceT(static_cast<const float*>(a_in), a_length);
+    memcpy(a_result, &sum, sizeof(sum));
+  }
+  else
+  {
+    const uint32_t sum = ReduceT(static_cast<const uint32_t*>(a_in), a_length);
+    memcpy(a_result, &sum, sizeof(sum));
+  }
+}
+
+// all types are 32 bit, so elements are moved as uint
+uint32_t CpuPrimitives::Compact(ScanValueType a_type, const void* a_in, const uint32_t* a_keep, void* a_out,
+                                uint32_t a_length) const
+{
+  const uint32_t* in  = static_cast<const uint32_t*>(a_in);
+  uint32_t*       out = static_cast<uint32_t*>(a_out);
+
+  const size_t chunksNum = (size_t(a_length) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  std::vector<uint32_t> chunkOffsets(chunksNum, 0);
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    uint32_t count = 0;
+    for(size_t i = a_begin; i < a_end; ++i)
+      count += a_keep[i] != 0 ? 1u : 0u;
+    chunkOffsets[a_begin / CHUNK_SIZE] = count;
+  });
+  uint32_t total = 0;
+  for(auto &offset : chunkOffsets)
+  {
+    const uint32_t count = offset;
+    offset = total;
+    total += count;
+  }
+
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+    uint32_t* dst = out + chunkOffsets[a_begin / CHUNK_SIZE];
+    for(size_t i = a_begin; i < a_end; ++i)
+      if(a_keep[i] != 0)
+        *dst++ = in[i];
+  });
+  (void)a_type;
+  return total;
+}
+
+void CpuPrimitives::Add(const float* a_a, const float* a_b, float* a_sum, uint32_t a_length) const
+{
+  m_pool.ParallelFor(a_length, CHUNK_SIZE, [&](size_t a_begin, size_t a_end) {
+#ifdef CHIMERA_X86_64
+    if(m_isa == Isa::AVX2)
+    {
+      AddAvx2(a_a + a_begin, a_b + a_begin, a_sum + a_begin, a_end - a_begin);
+      return;
+    }
+    if(m_isa == Isa::SSE)
+    {
+      AddSse(a_a + a_begin, a_b + a_begin, a_sum + a_begin, a_end - a_begin);
+      return;
+    }
+#endif
+    for(size_t i = a_begin; i < a_end; ++i)
+      a_sum[i] = a_a[i] + a_b[i];
+  });
+}
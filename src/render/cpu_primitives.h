@@ -0,0 +1,54 @@
+#ifndef CHIMERA_CPU_PRIMITIVES_H
+#define CHIMERA_CPU_PRIMITIVES_H
+
+#include <cstdint>
+
+#include "gpu_primitives.h"
+#include "thread_pool.h"
+
+// CPU versions of GpuPrimitives scan, reduction and compaction plus element-wise add of simple.comp.
+// arrays are split into chunks of ThreadPool: chunk sums first, then every chunk is scanned from prefix of
+// previous ones. chunks are scanned with AVX2 or SSE in-register prefix sums, chosen by CPU at run time.
+// results are the same as of GpuPrimitives, float sums differ only by order of additions
+class CpuPrimitives
+{
+public:
+  enum class Isa : uint32_t
+  {
+    SCALAR = 0,
+    SSE    = 1, // 4 lanes, x86-64 baseline
+    AVX2   = 2  // 8 lanes
+  };
+
+  // a_maxIsa limits instruction set, i.e. to compare kernels on one machine
+  explicit CpuPrimitives(ThreadPool &a_pool, Isa a_maxIsa = Isa::AVX2);
+
+  Isa GetIsa() const { return m_isa; }
+  static const char* IsaName(Isa a_isa);
+
+  // a_flags are GpuPrimitives::ScanFlags, a_segmentFlags is needed only with SCAN_SEGMENTED. a_in and a_out may be the same
+  void Scan(ScanValueType a_type, const void* a_in, void* a_out, uint32_t a_length,
+            uint32_t a_flags = GpuPrimitives::SCAN_EXCLUSIVE, const uint32_t* a_segmentFlags = nullptr) const;
+  // sum of a_in is written to a_result
+  void Reduce(ScanValueType a_type, const void* a_in, void* a_result, uint32_t a_length) const;
+  // elements with nonzero a_keep are packed to a_out in the same order, returns their number
+  uint32_t Compact(ScanValueType a_type, const void* a_in, const uint32_t* a_keep, void* a_out, uint32_t a_length) const;
+  // a_sum[i] = a_a[i] + a_b[i] as in simple.comp
+  void Add(const float* a_a, const float* a_b, float* a_sum, uint32_t a_length) const;
+
+private:
+  // chunks are large enough to hide cost of a task and small enough to be stolen
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  template<typename T>
+  void ScanT(const T* a_in, T* a_out, uint32_t a_length, bool a_inclusive) const;
+  template<typename T>
+  void SegmentedScanT(const T* a_in, T* a_out, uint32_t a_length, bool a_inclusive, const uint32_t* a_flags) const;
+  template<typename T>
+  T ReduceT(const T* a_in, uint32_t a_length) const;
+
+  ThreadPool &m_pool;
+  Isa         m_isa = Isa::SCALAR;
+};
+
+#endif//CHIMERA_CPU_PRIMITIVES_H
@@ -0,0 +1,161 @@
+#ifndef CHIMERA_CPU_REFERENCE_H
+#define CHIMERA_CPU_REFERENCE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// multithreaded CPU versions of GpuPrimitives, used to check GPU results of large arrays
+
+// float references are summed in double, GPU adds in different order anyway
+template<typename T>
+using AccumT = typename std::conditional<std::is_floating_point<T>::value, double, T>::type;
+
+// splits [0, a_count) into one contiguous range per hardware thread, calls a_func(range index, begin, end).
+// returns number of ranges
+template<typename F>
+inline size_t ParallelFor(size_t a_count, F a_func)
+{
+  constexpr size_t MIN_RANGE = 64 * 1024; // threads are not worth starting for less
+  const size_t threadsNum = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(),
+                                                                 (a_count + MIN_RANGE - 1) / MIN_RANGE));
+  const size_t range = (a_count + threadsNum - 1) / threadsNum;
+  std::vector<std::thread> threads;
+  for(size_t t = 1; t < threadsNum; ++t)
+    threads.emplace_back(a_func, t, std::min(a_count, t * range), std::min(a_count, (t + 1) * range));
+  a_func(size_t(0), size_t(0), std::min(a_count, range));
+  for(auto &thread : threads)
+    thread.join();
+  return threadsNum;
+}
+
+// scan of ranges on separate threads, then prefixes of ranges are added on the second pass.
+// a range after a segment start doesn't get prefix of previous ranges
+template<typename T>
+inline std::vector<T> ScanReference(const std::vector<T> &a_in, const std::vector<uint32_t> *a_segmentFlags,
+                                    bool a_inclusive)
+{
+  std::vector<T> res(a_in.size());
+  std::vector<AccumT<T>> rangeSums(std::thread::hardware_concurrency() + 1, AccumT<T>(0));
+  std::vector<char>      rangeReset(rangeSums.size(), 0);
+
+  // sums after the last segment start of each range
+  const size_t rangesNum = ParallelFor(a_in.size(), [&](size_t r, size_t a_begin, size_t a_end) {
+    AccumT<T> sum = 0;
+    for(size_t i = a_begin; i < a_end; ++i)
+    {
+      if(a_segmentFlags != nullptr && (*a_segmentFlags)[i] != 0)
+      {
+        sum = 0;
+        rangeReset[r] = 1;
+      }
+      sum += a_in[i];
+    }
+    rangeSums[r] = sum;
+  });
+
+  std::vector<AccumT<T>> rangePrefix(rangesNum, AccumT<T>(0));
+  for(size_t r = 1; r < rangesNum; ++r)
+    rangePrefix[r] = rangeReset[r - 1] ? rangeSums[r - 1] : rangePrefix[r - 1] + rangeSums[r - 1];
+
+  ParallelFor(a_in.size(), [&](size_t r, size_t a_begin, size_t a_end) {
+    AccumT<T> sum = rangePrefix[r];
+    for(size_t i = a_begin; i < a_end; ++i)
+    {
+      if(a_segmentFlags != nullptr && (*a_segmentFlags)[i] != 0)
+        sum = 0;
+      if(a_inclusive)
+        sum += a_in[i];
+      res[i] = T(sum);
+      if(!a_inclusive)
+        sum += a_in[i];
+    }
+  });
+  return res;
+}
+
+template<typename T>
+inline T ReduceReference(const std::vector<T> &a_in)
+{
+  std::vector<AccumT<T>> rangeSums(std::thread::hardware_concurrency() + 1, AccumT<T>(0));
+  const size_t rangesNum = ParallelFor(a_in.size(), [&](size_t r, size_t a_begin, size_t a_end) {
+    AccumT<T> sum = 0;
+    for(size_t i = a_begin; i < a_end; ++i)
+      sum += a_in[i];
+    rangeSums[r] = sum;
+  });
+
+  AccumT<T> sum = 0;
+  for(size_t r = 0; r < rangesNum; ++r)
+    sum += rangeSums[r];
+  return T(sum);
+}
+
+// elements with nonzero a_keep in the same order
+template<typename T>
+inline std::vector<T> CompactReference(const std::vector<T> &a_in, const std::vector<uint32_t> &a_keep)
+{
+  std::vector<uint32_t> predicate(a_keep.size());
+  for(size_t i = 0; i < a_keep.size(); ++i)
+    predicate[i] = a_keep[i] != 0 ? 1u : 0u;
+  const auto offsets = ScanReference(predicate, nullptr, false);
+
+  std::vector<T> res(a_in.empty() ? 0 : size_t(offsets.back()) + predicate.back());
+  ParallelFor(a_in.size(), [&](size_t, size_t a_begin, size_t a_end) {
+    for(size_t i = a_begin; i < a_end; ++i)
+      if(predicate[i] != 0)
+        res[offsets[i]] = a_in[i];
+  });
+  return res;
+}
+
+// ranges are sorted on separate threads, then merged pairwise
+template<typename T>
+inline std::vector<T> SortReference(std::vector<T> a_keys)
+{
+  std::vector<size_t> bounds(std::thread::hardware_concurrency() + 2, a_keys.size());
+  const size_t rangesNum = ParallelFor(a_keys.size(), [&](size_t r, size_t a_begin, size_t a_end) {
+    bounds[r] = a_begin;
+    std::sort(a_keys.begin() + a_begin, a_keys.begin() + a_end);
+  });
+  bounds[rangesNum] = a_keys.size();
+
+  for(size_t width = 1; width < rangesNum; width *= 2)
+  {
+    std::vector<std::thread> threads;
+    for(size_t r = 0; r + width < rangesNum; r += 2 * width)
+    {
+      const auto first  = a_keys.begin() + bounds[r];
+      const auto middle = a_keys.begin() + bounds[r + width];
+      const auto last   = a_keys.begin() + bounds[std::min(r + 2 * width, rangesNum)];
+      threads.emplace_back([first, middle, last]() { std::inplace_merge(first, middle, last); });
+    }
+    for(auto &thread : threads)
+      thread.join();
+  }
+  return a_keys;
+}
+
+// inputs of checks are small integers, so float sums are exact until 2^24
+template<typename T>
+inline bool NearlyEqual(T a, T b) { return a == b; }
+template<>
+inline bool NearlyEqual<float>(float a, float b)
+{
+  return std::abs(a - b) <= 1e-4f * std::max(std::abs(a), std::abs(b)) + 1e-4f;
+}
+
+// index of the first different element of the first a_count ones, UINT32_MAX if they are equal
+template<typename T>
+inline uint32_t FirstMismatch(const std::vector<T> &a, const std::vector<T> &b, size_t a_count)
+{
+  for(size_t i = 0; i < a_count; ++i)
+    if(!NearlyEqual(a[i], b[i]))
+      return uint32_t(i);
+  return UINT32_MAX;
+}
+
+#endif//CHIMERA_CPU_REFERENCE_H
@@ -0,0 +1,177 @@
+#include "frame_profiler.h"
+#include "imgui/imgui.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+FrameProfiler::FrameProfiler(VkDevice a_device, VkPhysicalDevice a_physicalDevice, uint32_t a_queueFamily,
+                             uint32_t a_framesInFlight, uint32_t a_maxScopes, uint32_t a_historyLength) :
+  m_historyLength(std::max(a_historyLength, 1u)), m_start(std::chrono::steady_clock::now())
+{
+  m_slots.resize(a_framesInFlight);
+  for(auto &slot : m_slots)
+    slot.timer = std::make_unique<GpuTimer>(a_device, a_physicalDevice, a_queueFamily, a_maxScopes);
+  m_supported = !m_slots.empty() && m_slots[0].timer->Supported();
+}
+
+double FrameProfiler::NowMs() const
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void FrameProfiler::BeginFrame(uint32_t a_frameId)
+{
+  auto &slot = m_slots[a_frameId];
+  if(!slot.submitted)
+    return;
+
+  // fence of the frame is signaled, so results are already there
+  const auto &scopes = slot.timer->Resolve();
+  slot.frame.gpu.clear();
+  for(const auto &scope : scopes)
+    slot.frame.gpu.push_back({scope.name, scope.startMs, scope.ms});
+  slot.frame.gpuMs = slot.timer->TotalMs();
+  slot.submitted   = false;
+
+  m_history.push_back(std::move(slot.frame));
+  slot.frame = Frame{};
+  while(m_history.size() > m_historyLength)
+    m_history.pop_front();
+}
+
+void FrameProfiler::Submitted(uint32_t a_frameId)
+{
+  auto &slot = m_slots[a_frameId];
+  slot.frame.index    = m_framesSubmitted++;
+  slot.frame.submitMs = NowMs();
+  slot.frame.cpu      = std::move(m_pendingCpu);
+  slot.submitted      = true;
+  m_pendingCpu.clear();
+}
+
+void FrameProfiler::ResetCmd(VkCommandBuffer a_cmdBuff, uint32_t a_frameId)
+{
+  // scopes of the previous submit are replaced by the new recording, so they are collected first
+  BeginFrame(a_frameId);
+  m_slots[a_frameId].timer->Reset(a_cmdBuff);
+}
+
+uint32_t FrameProfiler::BeginGpu(VkCommandBuffer a_cmdBuff, uint32_t a_frameId, const char* a_name)
+{
+  return m_slots[a_frameId].timer->Begin(a_cmdBuff, a_name);
+}
+
+void FrameProfiler::EndGpu(VkCommandBuffer a_cmdBuff, uint32_t a_frameId, uint32_t a_scope)
+{
+  m_slots[a_frameId].timer->End(a_cmdBuff, a_scope);
+}
+
+FrameProfiler::CpuScope::CpuScope(FrameProfiler* a_profiler, const char* a_name) : m_profiler(a_profiler), m_name(a_name),
+  m_startMs(a_profiler != nullptr ? a_profiler->NowMs() : 0.0)
+{
+}
+
+FrameProfiler::CpuScope::~CpuScope()
+{
+  if(m_profiler != nullptr)
+    m_profiler->m_pendingCpu.push_back({m_name, m_startMs, m_profiler->NowMs() - m_startMs});
+}
+
+void FrameProfiler::DrawImGuiPanel(const char* a_tracePath)
+{
+  constexpr size_t averageFrames = 60;
+
+  // scopes of the same name are summed in a frame and averaged over the last frames, in order of the latest frame
+  auto average = [this](bool a_gpu, std::vector<std::pair<std::string, double>> &a_result) {
+    a_result.clear();
+    const size_t first = m_history.size() > averageFrames ? m_history.size() - averageFrames : 0;
+    for(size_t i = m_history.size(); i > first; --i)
+    {
+      for(const auto &scope : (a_gpu ? m_history[i - 1].gpu : m_history[i - 1].cpu))
+      {
+        auto it = std::find_if(a_result.begin(), a_result.end(), [&scope](const auto &a_s) { return a_s.first == scope.name; });
+        if(it == a_result.end())
+        {
+          if(i < m_history.size())
+            continue;
+          a_result.emplace_back(scope.name, 0.0);
+          it = a_result.end() - 1;
+        }
+        it->second += scope.ms;
+      }
+    }
+    for(auto &scope : a_result)
+      scope.second /= double(std::max<size_t>(m_history.size() - first, 1));
+  };
+
+  std::vector<std::pair<std::string, double>> scopes;
+
+  ImGui::Begin("Profiler");
+  if(!m_supported)
+    ImGui::Text("Queue has no timestamps");
+
+  std::vector<float> gpuFrames;
+  for(const auto &frame : m_history)
+    gpuFrames.push_back(float(frame.gpuMs));
+  if(!gpuFrames.empty())
+  {
+    ImGui::Text("GPU frame %.3f ms", gpuFrames.back());
+    ImGui::PlotLines("##gpu frames", gpuFrames.data(), int(gpuFrames.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+  }
+
+  ImGui::Separator();
+  average(true, scopes);
+  for(const auto &scope : scopes)
+    ImGui::Text("GPU %-20s %8.3f ms", scope.first.c_str(), scope.second);
+
+  ImGui::Separator();
+  average(false, scopes);
+  for(const auto &scope : scopes)
+    ImGui::Text("CPU %-20s %8.3f ms", scope.first.c_str(), scope.second);
+
+  ImGui::Separator();
+  if(ImGui::Button("Save trace"))
+  {
+    if(WriteChromeTrace(a_tracePath))
+      std::cout << "Trace of " << m_history.size() << " frames is saved to " << a_tracePath << std::endl;
+    else
+      std::cout << "Can't save trace to " << a_tracePath << std::endl;
+  }
+  ImGui::SameLine();
+  ImGui::Text("%s", a_tracePath);
+  ImGui::End();
+}
+
+bool FrameProfiler::WriteChromeTrace(const std::string &a_path) const
+{
+  std::ofstream fout(a_path);
+  if(!fout.is_open())
+    return false;
+
+  // complete events in microseconds, cpu and gpu are two threads of one process
+  fout << std::fixed << std::setprecision(3);
+  fout << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  fout << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"CPU\"}},\n";
+  fout << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 1, \"args\": {\"name\": \"GPU\"}}";
+
+  auto writeEvent = [&fout](const std::string &a_name, uint32_t a_tid, double a_startMs, double a_ms, uint64_t a_frame) {
+    fout << ",\n{\"name\": \"" << a_name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << a_tid
+         << ", \"ts\": " << a_startMs * 1000.0 << ", \"dur\": " << a_ms * 1000.0
+         << ", \"args\": {\"frame\": " << a_frame << "}}";
+  };
+
+  for(const auto &frame : m_history)
+  {
+    for(const auto &scope : frame.cpu)
+      writeEvent(scope.name, 0, scope.startMs, scope.ms, frame.index);
+    if(!frame.gpu.empty())
+      writeEvent("frame", 1, frame.submitMs, frame.gpuMs, frame.index);
+    for(const auto &scope : frame.gpu)
+      writeEvent(scope.name, 1, frame.submitMs + scope.startMs, scope.ms, frame.index);
+  }
+  fout << "\n]}\n";
+  return fout.good();
+}
@@ -0,0 +1,93 @@
+#ifndef CHIMERA_FRAME_PROFILER_H
+#define CHIMERA_FRAME_PROFILER_H
+
+#include "gpu_timer.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// gpu and cpu scopes of rendered frames. Every frame id (frame in flight or swapchain image, whatever command
+// buffers are kept for) has its own GpuTimer, its results are read when the same id starts again after waiting
+// for its fence, so profiling never stalls on gpu. Command buffer with scopes may be submitted again without
+// rerecording, the same scopes are read every time. The last frames are kept for ImGui panel and Chrome trace
+class FrameProfiler
+{
+public:
+  struct Scope
+  {
+    std::string name;
+    double      startMs = 0.0; // cpu scopes from creation of profiler, gpu ones from submit of their frame
+    double      ms      = 0.0;
+  };
+
+  struct Frame
+  {
+    uint64_t           index    = 0;
+    double             submitMs = 0.0;
+    double             gpuMs    = 0.0; // from the beginning of the first gpu scope to the end of the last one
+    std::vector<Scope> cpu;
+    std::vector<Scope> gpu;
+  };
+
+  // a_queueFamily - family of queue where frames are submitted
+  FrameProfiler(VkDevice a_device, VkPhysicalDevice a_physicalDevice, uint32_t a_queueFamily, uint32_t a_framesInFlight,
+                uint32_t a_maxScopes = 16, uint32_t a_historyLength = 300);
+
+  // a_frameId is not used by gpu anymore, its previous results are collected
+  void BeginFrame(uint32_t a_frameId);
+  // cpu scopes since the previous submit belong to this frame, gpu ones are read in BeginFrame with the same id
+  void Submitted(uint32_t a_frameId);
+
+  // gpu scopes of frame in flight, reset is recorded before the first one outside of render pass.
+  // Scopes may be in several command buffers of one submit in order of their recording.
+  // If a_frameId is rerecorded before BeginFrame, it waits for results of its previous submit
+  void ResetCmd(VkCommandBuffer a_cmdBuff, uint32_t a_frameId);
+  uint32_t BeginGpu(VkCommandBuffer a_cmdBuff, uint32_t a_frameId, const char* a_name);
+  void EndGpu(VkCommandBuffer a_cmdBuff, uint32_t a_frameId, uint32_t a_scope);
+
+  // cpu scope lasts until the end of the object's life
+  class CpuScope
+  {
+  public:
+    CpuScope(FrameProfiler* a_profiler, const char* a_name);
+    ~CpuScope();
+  private:
+    FrameProfiler* m_profiler;
+    const char*    m_name;
+    double         m_startMs;
+  };
+
+  // gpu time of the latest collected frame, negative if there is no such frame or no timestamps on queue
+  double LastGpuFrameMs() const { return m_history.empty() || !m_supported ? -1.0 : m_history.back().gpuMs; }
+  const std::deque<Frame>& History() const { return m_history; }
+
+  // window with scopes averaged over the last frames, should be called between ImGui::NewFrame and ImGui::Render
+  void DrawImGuiPanel(const char* a_tracePath);
+  // kept frames in Chrome trace event format, it is opened in chrome://tracing or Perfetto.
+  // gpu scopes are placed from submit of their frame, as gpu clock is not related to cpu one
+  bool WriteChromeTrace(const std::string &a_path) const;
+
+private:
+  struct FrameSlot
+  {
+    std::unique_ptr<GpuTimer> timer;
+    bool                      submitted = false;
+    Frame                     frame;
+  };
+
+  double NowMs() const;
+
+  std::vector<FrameSlot> m_slots;
+  std::vector<Scope>     m_pendingCpu;
+  std::deque<Frame>      m_history;
+  uint32_t               m_historyLength = 300;
+  uint64_t               m_framesSubmitted = 0;
+  bool                   m_supported = false;
+
+  std::chrono::steady_clock::time_point m_start;
+};
+
+#endif//CHIMERA_FRAME_PROFILER_H
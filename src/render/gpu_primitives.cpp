@@ -0,0 +1,510 @@
+#include "gpu_primitives.h"
+#include "pipeline_cache.h"
+#include "gpu_timer.h"
+#include "vk_utils.h"
+#include "vk_buffers.h"
+
+#include "../../resources/shaders/scan_common.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+static_assert(GpuPrimitives::GROUP_SIZE == SCAN_GROUP_SIZE, "radix sort group size differs from shaders");
+// result of even number of passes is in the source buffer
+static_assert((32 / SORT_RADIX_BITS) % 2 == 0, "radix sort needs even number of passes");
+static_assert(GpuPrimitives::SORT_PASSES == 32 / SORT_RADIX_BITS, "radix sort passes differ from shaders");
+
+// all value types are 32 bit, so scratch buffers and block sums don't depend on type
+static constexpr uint32_t VALUE_SIZE = sizeof(uint32_t);
+
+static uint32_t DivUp(uint32_t a, uint32_t b) { return (a + b - 1) / b; }
+
+static bool IsPowerOfTwo(uint32_t a) { return a != 0 && (a & (a - 1)) == 0; }
+
+static uint32_t ConflictFree(uint32_t n) { return n + (n >> LOG_NUM_BANKS); }
+
+GpuPrimitives::GpuPrimitives(VkDevice a_device, VkPhysicalDevice a_physicalDevice, VkPipelineCache a_cache,
+                             const ScanTiles &a_tiles, uint32_t a_typesMask) :
+  m_device(a_device), m_physicalDevice(a_physicalDevice), m_tiles(a_tiles)
+{
+  VkPhysicalDeviceProperties deviceProps = {};
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProps);
+  if(!TilesFit(m_tiles, deviceProps.limits))
+  {
+    std::cout << "GpuPrimitives: scan tiles " << m_tiles.scanGroupSize << ", " << m_tiles.lookbackGroupSize << "x"
+              << m_tiles.lookbackItems << " don't fit device, defaults are used" << std::endl;
+    m_tiles = ScanTiles();
+  }
+
+  VkPhysicalDeviceSubgroupProperties subgroupProps = {};
+  subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+  VkPhysicalDeviceProperties2 props = {};
+  props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  props.pNext = &subgroupProps;
+  vkGetPhysicalDeviceProperties2(m_physicalDevice, &props);
+
+  const VkFlags subgroupOps = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+  m_subgroupScan = (subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+                   (subgroupProps.supportedOperations & subgroupOps) == subgroupOps;
+
+  CreateKernels(a_cache, a_typesMask);
+}
+
+bool GpuPrimitives::TilesFit(const ScanTiles &a_tiles, const VkPhysicalDeviceLimits &a_limits)
+{
+  const uint32_t maxGroupSize = std::min(a_limits.maxComputeWorkGroupSize[0], a_limits.maxComputeWorkGroupInvocations);
+  if(!IsPowerOfTwo(a_tiles.scanGroupSize) || !IsPowerOfTwo(a_tiles.lookbackGroupSize) || a_tiles.lookbackItems == 0 ||
+     a_tiles.scanGroupSize > maxGroupSize || a_tiles.lookbackGroupSize > maxGroupSize)
+    return false;
+
+  // shared arrays of scan_block.comp and scan_lookback.comp (with subgroup sums, whichever variant is used)
+  const uint32_t scanShared     = 2 * ConflictFree(2 * a_tiles.scanGroupSize) * VALUE_SIZE + VALUE_SIZE;
+  const uint32_t lookbackShared = (ConflictFree(a_tiles.lookbackGroupSize * a_tiles.lookbackItems) +
+                                   2 * a_tiles.lookbackGroupSize + 2) * VALUE_SIZE;
+  return scanShared <= a_limits.maxComputeSharedMemorySize && lookbackShared <= a_limits.maxComputeSharedMemorySize;
+}
+
+GpuPrimitives::~GpuPrimitives()
+{
+  for(auto &kernel : m_kernels)
+  {
+    for(auto pipeline : kernel.pipelines)
+      vkDestroyPipeline(m_device, pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, kernel.layout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, kernel.dsLayout, nullptr);
+  }
+}
+
+GpuPrimitives::Plan::~Plan()
+{
+  if(m_dsPool != VK_NULL_HANDLE)
+    vkDestroyDescriptorPool(m_device, m_dsPool, nullptr);
+  for(auto buf : m_scratch)
+    vkDestroyBuffer(m_device, buf, nullptr);
+  if(m_scratchMem != VK_NULL_HANDLE)
+    vkFreeMemory(m_device, m_scratchMem, nullptr);
+}
+
+void GpuPrimitives::CreateKernels(VkPipelineCache a_cache, uint32_t a_typesMask)
+{
+  const char* kernelNames[KERNELS_NUM] = {"scan_block", "scan_add", "compact_scatter",
+                                          m_subgroupScan ? "scan_lookback_subgroup" : "scan_lookback",
+                                          "radix_histogram", "radix_scatter", "simple"};
+  const uint32_t bindingsNum[KERNELS_NUM] = {6, 3, 5, 5, 2, 5, 3};
+  // radix sort works with uint keys only and add with floats, they have one shader
+  const bool typed[KERNELS_NUM] = {true, true, true, true, false, false, false};
+  const char* typeNames[uint32_t(ScanValueType::COUNT)] = {"uint", "int", "float"};
+
+  for(uint32_t k = 0; k < KERNELS_NUM; ++k)
+  {
+    auto &kernel = m_kernels[k];
+    kernel.bindingsNum = bindingsNum[k];
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(kernel.bindingsNum);
+    for(uint32_t i = 0; i < kernel.bindingsNum; ++i)
+    {
+      bindings[i] = {};
+      bindings[i].binding         = i;
+      bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo dsLayoutInfo = {};
+    dsLayoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    dsLayoutInfo.bindingCount = kernel.bindingsNum;
+    dsLayoutInfo.pBindings    = bindings.data();
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &dsLayoutInfo, nullptr, &kernel.dsLayout));
+
+    // every kernel takes {len, mode or argument}
+    VkPushConstantRange pcRange = {};
+    pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pcRange.offset     = 0;
+    pcRange.size       = 2 * sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount         = 1;
+    layoutInfo.pSetLayouts            = &kernel.dsLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges    = &pcRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &kernel.layout));
+  }
+
+  // {GROUP_SIZE, ITEMS} of scan_common.h, radix sort kernels have no specialization, add takes GROUP_SIZE of scan
+  const uint32_t scanSpec[2]     = {m_tiles.scanGroupSize, 2};
+  const uint32_t lookbackSpec[2] = {m_tiles.lookbackGroupSize, m_tiles.lookbackItems};
+  const VkSpecializationMapEntry specEntries[2] = {{SCAN_SPEC_GROUP_SIZE, 0, sizeof(uint32_t)},
+                                                   {SCAN_SPEC_ITEMS, sizeof(uint32_t), sizeof(uint32_t)}};
+  const VkSpecializationInfo scanSpecInfo     = {2, specEntries, sizeof(scanSpec), scanSpec};
+  const VkSpecializationInfo lookbackSpecInfo = {2, specEntries, sizeof(lookbackSpec), lookbackSpec};
+  const VkSpecializationInfo* specInfos[KERNELS_NUM] = {&scanSpecInfo, &scanSpecInfo, &scanSpecInfo, &lookbackSpecInfo,
+                                                        nullptr, nullptr, &scanSpecInfo};
+
+  auto create = [this, a_cache](const std::string &a_path, VkPipelineLayout a_layout,
+                                const VkSpecializationInfo* a_specInfo, VkPipeline &a_pipeline) {
+    std::vector<uint32_t> code = vk_utils::readSPVFile(a_path.c_str());
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.pCode    = code.data();
+    moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateShaderModule(m_device, &moduleInfo, nullptr, &shaderModule));
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName  = "main";
+    pipelineInfo.stage.pSpecializationInfo = a_specInfo;
+    pipelineInfo.layout       = a_layout;
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_device, a_cache, 1, &pipelineInfo, nullptr, &a_pipeline));
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+  };
+
+  // shader variants per type: scan_block_float.comp.spv etc.
+  std::vector<std::function<void()>> jobs;
+  for(uint32_t k = 0; k < KERNELS_NUM; ++k)
+  {
+    if(!typed[k])
+    {
+      const std::string path = std::string("../resources/shaders/") + kernelNames[k] + ".comp.spv";
+      jobs.push_back([this, create, path, k, specInfos]() {
+        create(path, m_kernels[k].layout, specInfos[k], m_kernels[k].pipelines[uint32_t(ScanValueType::UINT)]); });
+      continue;
+    }
+    for(uint32_t t = 0; t < uint32_t(ScanValueType::COUNT); ++t)
+    {
+      if((a_typesMask & (1u << t)) == 0)
+        continue;
+      const std::string path = std::string("../resources/shaders/") + kernelNames[k] + "_" + typeNames[t] + ".comp.spv";
+      jobs.push_back([this, create, path, k, t, specInfos]() {
+        create(path, m_kernels[k].layout, specInfos[k], m_kernels[k].pipelines[t]); });
+    }
+  }
+  BuildPipelinesParallel(jobs);
+}
+
+uint32_t GpuPrimitives::LevelsNum(uint32_t a_length) const
+{
+  const uint32_t blockSize = 2 * m_tiles.scanGroupSize;
+  uint32_t levels = 1;
+  for(uint32_t blocks = DivUp(a_length, blockSize); blocks > 1; blocks = DivUp(blocks, blockSize))
+    levels++;
+  return levels;
+}
+
+VkBuffer GpuPrimitives::CreateScratch(Plan &a_plan, uint32_t a_elements) const
+{
+  VkBuffer buf = vk_utils::createBuffer(m_device, VkDeviceSize(std::max(a_elements, 1u)) * VALUE_SIZE,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  a_plan.m_scratch.push_back(buf);
+  return buf;
+}
+
+void GpuPrimitives::AddDispatch(Plan &a_plan, Kernel a_kernel, ScanValueType a_type, const std::vector<VkBuffer> &a_buffers,
+                                uint32_t a_groups, uint32_t a_len, uint32_t a_arg) const
+{
+  Plan::Step step;
+  step.kernel    = a_kernel;
+  step.buffers   = a_buffers;
+  step.pipeline  = m_kernels[a_kernel].pipelines[uint32_t(a_type)];
+  if(step.pipeline == VK_NULL_HANDLE)
+    RUN_TIME_ERROR("GpuPrimitives: value type is not in types mask");
+  step.layout    = m_kernels[a_kernel].layout;
+  step.groups    = a_groups;
+  step.params[0] = a_len;
+  step.params[1] = a_arg;
+  a_plan.m_steps.push_back(step);
+}
+
+void GpuPrimitives::AddScanLevels(Plan &a_plan, ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+                                  uint32_t a_mode, VkBuffer a_segmentFlags) const
+{
+  struct Level
+  {
+    VkBuffer out, sums, firstFlags;
+    uint32_t len, blocks;
+  };
+  std::vector<Level> levels;
+
+  // level k scans block sums of level k - 1 in place, until everything fits in one block
+  VkBuffer in = a_in, out = a_out, flags = a_segmentFlags;
+  uint32_t len = a_length, mode = a_mode;
+  while(true)
+  {
+    Level level;
+    level.len        = len;
+    level.blocks     = DivUp(len, 2 * m_tiles.scanGroupSize);
+    level.out        = out;
+    level.sums       = CreateScratch(a_plan, level.blocks);
+    level.firstFlags = CreateScratch(a_plan, level.blocks);
+    VkBuffer blockFlags = CreateScratch(a_plan, level.blocks);
+
+    // without segments flags are not read, any buffer fits
+    AddDispatch(a_plan, KERNEL_SCAN_BLOCK, a_type,
+                {in, flags != VK_NULL_HANDLE ? flags : blockFlags, out, level.sums, blockFlags, level.firstFlags},
+                level.blocks, level.len, mode);
+    levels.push_back(level);
+
+    if(level.blocks == 1)
+      break;
+
+    in    = level.sums;
+    out   = level.sums;
+    flags = (a_mode & SCAN_MODE_SEGMENTED) != 0 ? blockFlags : VK_NULL_HANDLE;
+    len   = level.blocks;
+    mode  = (a_mode & (SCAN_MODE_SEGMENTED | SCAN_MODE_WRITE_RESULT)) | SCAN_MODE_RAW;
+  }
+
+  if((a_mode & SCAN_MODE_WRITE_RESULT) == 0)
+    return;
+
+  // sums of level k are now exclusive prefixes of its blocks
+  for(int k = int(levels.size()) - 2; k >= 0; --k)
+  {
+    const Level &level = levels[k];
+    AddDispatch(a_plan, KERNEL_SCAN_ADD, a_type, {level.out, level.sums, level.firstFlags}, level.blocks, level.len,
+                k > 0 ? 1u : 0u);
+  }
+}
+
+void GpuPrimitives::AddLookbackScan(Plan &a_plan, ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+                                    uint32_t a_mode) const
+{
+  const uint32_t tiles = DivUp(a_length, m_tiles.lookbackGroupSize * m_tiles.lookbackItems);
+  // tile counter followed by tile flags
+  VkBuffer tileFlags      = CreateScratch(a_plan, tiles + 1);
+  VkBuffer tileAggregates = CreateScratch(a_plan, tiles);
+  VkBuffer tilePrefixes   = CreateScratch(a_plan, tiles);
+
+  Plan::Step clear;
+  clear.copyDst  = tileFlags;
+  clear.copySize = VkDeviceSize(tiles + 1) * VALUE_SIZE;
+  a_plan.m_steps.push_back(clear);
+
+  AddDispatch(a_plan, KERNEL_SCAN_LOOKBACK, a_type, {a_in, a_out, tileFlags, tileAggregates, tilePrefixes}, tiles,
+              a_length, a_mode & (SCAN_MODE_INCLUSIVE | SCAN_MODE_PREDICATE));
+}
+
+void GpuPrimitives::AddScan(Plan &a_plan, ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+                            uint32_t a_mode, VkBuffer a_segmentFlags) const
+{
+  if(m_scanAlgorithm == ScanAlgorithm::DECOUPLED_LOOKBACK && (a_mode & SCAN_MODE_SEGMENTED) == 0)
+    AddLookbackScan(a_plan, a_type, a_in, a_out, a_length, a_mode);
+  else
+    AddScanLevels(a_plan, a_type, a_in, a_out, a_length, a_mode, a_segmentFlags);
+}
+
+void GpuPrimitives::Finalize(Plan &a_plan) const
+{
+  if(!a_plan.m_scratch.empty())
+    a_plan.m_scratchMem = vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice, a_plan.m_scratch, 0);
+
+  uint32_t setsNum = 0, descriptorsNum = 0;
+  for(const auto &step : a_plan.m_steps)
+  {
+    if(step.kernel == KERNELS_NUM)
+      continue;
+    setsNum++;
+    descriptorsNum += m_kernels[step.kernel].bindingsNum;
+  }
+  if(setsNum == 0)
+    return;
+
+  VkDescriptorPoolSize poolSize = {};
+  poolSize.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = descriptorsNum;
+
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets       = setsNum;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes    = &poolSize;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &a_plan.m_dsPool));
+
+  for(auto &step : a_plan.m_steps)
+  {
+    if(step.kernel == KERNELS_NUM)
+      continue;
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool     = a_plan.m_dsPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts        = &m_kernels[step.kernel].dsLayout;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &step.dSet));
+
+    std::vector<VkDescriptorBufferInfo> bufInfos(step.buffers.size());
+    std::vector<VkWriteDescriptorSet>   writes(step.buffers.size());
+    for(size_t i = 0; i < step.buffers.size(); ++i)
+    {
+      bufInfos[i] = {step.buffers[i], 0, VK_WHOLE_SIZE};
+
+      writes[i] = {};
+      writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet          = step.dSet;
+      writes[i].dstBinding      = uint32_t(i);
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pBufferInfo     = &bufInfos[i];
+    }
+    vkUpdateDescriptorSets(m_device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+  }
+}
+
+std::unique_ptr<GpuPrimitives::Plan> GpuPrimitives::MakeScan(ScanValueType a_type, VkBuffer a_in, VkBuffer a_out,
+                                                             uint32_t a_length, uint32_t a_flags, VkBuffer a_segmentFlags)
+{
+  std::unique_ptr<Plan> plan(new Plan(m_device));
+  plan->m_length = a_length;
+  if(a_length > 0)
+  {
+    uint32_t mode = SCAN_MODE_WRITE_RESULT;
+    if(a_flags & SCAN_INCLUSIVE)
+      mode |= SCAN_MODE_INCLUSIVE;
+    if(a_flags & SCAN_SEGMENTED)
+      mode |= SCAN_MODE_SEGMENTED;
+    AddScan(*plan, a_type, a_in, a_out, a_length, mode, (a_flags & SCAN_SEGMENTED) ? a_segmentFlags : VK_NULL_HANDLE);
+  }
+  Finalize(*plan);
+  return plan;
+}
+
+std::unique_ptr<GpuPrimitives::Plan> GpuPrimitives::MakeReduce(ScanValueType a_type, VkBuffer a_in, VkBuffer a_result,
+                                                               uint32_t a_length)
+{
+  std::unique_ptr<Plan> plan(new Plan(m_device));
+  plan->m_length = a_length;
+
+  Plan::Step copy;
+  copy.copyDst  = a_result;
+  copy.copySize = VALUE_SIZE;
+  if(a_length > 0)
+  {
+    // block sums only, the last level has one block and its sum is the total
+    AddScanLevels(*plan, a_type, a_in, a_in, a_length, 0, VK_NULL_HANDLE);
+    copy.copySrc = plan->m_steps.back().buffers[3];
+  }
+  plan->m_steps.push_back(copy);
+
+  Finalize(*plan);
+  return plan;
+}
+
+std::unique_ptr<GpuPrimitives::Plan> GpuPrimitives::MakeCompact(ScanValueType a_type, VkBuffer a_in, VkBuffer a_keep,
+                                                                VkBuffer a_out, VkBuffer a_count, uint32_t a_length)
+{
+  std::unique_ptr<Plan> plan(new Plan(m_device));
+  plan->m_length = a_length;
+  if(a_length > 0)
+  {
+    VkBuffer offsets = CreateScratch(*plan, a_length);
+    AddScan(*plan, ScanValueType::UINT, a_keep, offsets, a_length, SCAN_MODE_PREDICATE | SCAN_MODE_WRITE_RESULT,
+            VK_NULL_HANDLE);
+    AddDispatch(*plan, KERNEL_COMPACT_SCATTER, a_type, {a_in, a_keep, offsets, a_out, a_count},
+                DivUp(a_length, m_tiles.scanGroupSize), a_length, 0);
+  }
+  else
+  {
+    Plan::Step clear;
+    clear.copyDst  = a_count;
+    clear.copySize = VALUE_SIZE;
+    plan->m_steps.push_back(clear);
+  }
+  Finalize(*plan);
+  return plan;
+}
+
+std::unique_ptr<GpuPrimitives::Plan> GpuPrimitives::MakeSort(VkBuffer a_keys, VkBuffer a_values, uint32_t a_length)
+{
+  std::unique_ptr<Plan> plan(new Plan(m_device));
+  plan->m_length = a_length;
+  if(a_length > 1)
+  {
+    const uint32_t blocksNum = DivUp(a_length, SORT_BLOCK_SIZE);
+    const uint32_t histLen   = SORT_RADIX * blocksNum;
+    const bool     withValues = a_values != VK_NULL_HANDLE;
+
+    VkBuffer tmpKeys   = CreateScratch(*plan, a_length);
+    VkBuffer tmpValues = withValues ? CreateScratch(*plan, a_length) : tmpKeys;
+    VkBuffer hist      = CreateScratch(*plan, histLen);
+
+    // passes go back and forth between source and temporary buffers, values are not read without SORT_WITH_VALUES
+    VkBuffer keys[2]   = {a_keys, tmpKeys};
+    VkBuffer values[2] = {withValues ? a_values : a_keys, tmpValues};
+    for(uint32_t pass = 0; pass < 32 / SORT_RADIX_BITS; ++pass)
+    {
+      const uint32_t src   = pass % 2;
+      const uint32_t dst   = 1 - src;
+      const uint32_t shift = pass * SORT_RADIX_BITS | (withValues ? SORT_WITH_VALUES : 0u);
+
+      AddDispatch(*plan, KERNEL_RADIX_HISTOGRAM, ScanValueType::UINT, {keys[src], hist}, blocksNum, a_length, shift);
+      AddScan(*plan, ScanValueType::UINT, hist, hist, histLen, SCAN_MODE_WRITE_RESULT, VK_NULL_HANDLE);
+      AddDispatch(*plan, KERNEL_RADIX_SCATTER, ScanValueType::UINT,
+                  {keys[src], values[src], hist, keys[dst], values[dst]}, blocksNum, a_length, shift);
+    }
+  }
+  Finalize(*plan);
+  return plan;
+}
+
+std::unique_ptr<GpuPrimitives::Plan> GpuPrimitives::MakeAdd(VkBuffer a_a, VkBuffer a_b, VkBuffer a_sum, uint32_t a_length)
+{
+  std::unique_ptr<Plan> plan(new Plan(m_device));
+  plan->m_length = a_length;
+  if(a_length > 0)
+    AddDispatch(*plan, KERNEL_ADD, ScanValueType::UINT, {a_a, a_b, a_sum}, DivUp(a_length, m_tiles.scanGroupSize),
+                a_length, 0);
+  Finalize(*plan);
+  return plan;
+}
+
+void GpuPrimitives::RecordCmd(VkCommandBuffer a_cmdBuff, const Plan &a_plan, GpuTimer* a_timer) const
+{
+  const char* stepNames[KERNELS_NUM] = {"scan_block", "scan_add", "compact_scatter", "scan_lookback",
+                                        "radix_histogram", "radix_scatter", "add"};
+
+  // every step reads results of the previous one
+  VkMemoryBarrier barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+  for(size_t i = 0; i < a_plan.m_steps.size(); ++i)
+  {
+    const auto &step = a_plan.m_steps[i];
+    if(i > 0)
+      vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                           1, &barrier, 0, nullptr, 0, nullptr);
+
+    uint32_t scope = UINT32_MAX;
+    if(a_timer != nullptr)
+      scope = a_timer->Begin(a_cmdBuff, step.kernel != KERNELS_NUM ? stepNames[step.kernel] :
+                                        step.copySrc != VK_NULL_HANDLE ? "copy" : "fill");
+
+    if(step.kernel != KERNELS_NUM)
+    {
+      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, step.pipeline);
+      vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, step.layout, 0, 1, &step.dSet, 0, nullptr);
+      vkCmdPushConstants(a_cmdBuff, step.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(step.params), step.params);
+      // groups beyond step.groups return at once
+      const uint32_t groupsX = std::min(step.groups, uint32_t(SCAN_MAX_GROUPS_X));
+      vkCmdDispatch(a_cmdBuff, groupsX, DivUp(step.groups, groupsX), 1);
+    }
+    else if(step.copySrc != VK_NULL_HANDLE)
+    {
+      VkBufferCopy region = {0, 0, step.copySize};
+      vkCmdCopyBuffer(a_cmdBuff, step.copySrc, step.copyDst, 1, &region);
+    }
+    else
+      vkCmdFillBuffer(a_cmdBuff, step.copyDst, 0, step.copySize, 0);
+
+    if(a_timer != nullptr)
+      a_timer->End(a_cmdBuff, scope);
+  }
+}
@@ -0,0 +1,186 @@
+#ifndef CHIMERA_GPU_PRIMITIVES_H
+#define CHIMERA_GPU_PRIMITIVES_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "volk.h"
+
+class GpuTimer;
+
+// element type of scan primitives, each one has its own shader variants
+enum class ScanValueType : uint32_t
+{
+  UINT  = 0,
+  INT   = 1,
+  FLOAT = 2,
+  COUNT = 3
+};
+
+// workgroup shapes of scan kernels, passed to shaders as specialization constants.
+// sizes are powers of two, ScanTuner finds the fastest ones for a device
+struct ScanTiles
+{
+  uint32_t scanGroupSize     = 256; // scan_block, scan_add and compact_scatter, scan_block takes 2 elements per thread
+  uint32_t lookbackGroupSize = 256;
+  uint32_t lookbackItems     = 8;   // elements per thread of look-back scan
+
+  bool operator==(const ScanTiles &a_other) const
+  {
+    return scanGroupSize == a_other.scanGroupSize && lookbackGroupSize == a_other.lookbackGroupSize &&
+           lookbackItems == a_other.lookbackItems;
+  }
+};
+
+enum class ScanAlgorithm : uint32_t
+{
+  MULTI_LEVEL        = 0, // block scan, recursive scan of block sums, add pass: reads and writes array twice
+  DECOUPLED_LOOKBACK = 1  // single pass, tiles get prefix of predecessors through tile status buffer
+};
+
+// scan, reduction, stream compaction and radix sort of arrays of any length.
+// arrays longer than one block (2 * ScanTiles::scanGroupSize elements) are processed recursively:
+// sums of blocks are scanned by the next level and added back, so length is limited only by memory
+class GpuPrimitives
+{
+public:
+  static constexpr uint32_t GROUP_SIZE = 256;             // radix sort kernels, scan kernels take it from ScanTiles
+  static constexpr uint32_t ALL_TYPES  = (1u << uint32_t(ScanValueType::COUNT)) - 1;
+  static constexpr uint32_t SORT_PASSES = 8;              // 4 bit digits of 32 bit keys
+
+  enum ScanFlags : uint32_t
+  {
+    SCAN_EXCLUSIVE = 0,
+    SCAN_INCLUSIVE = 1,
+    SCAN_SEGMENTED = 2  // nonzero uint in segment flags buffer starts a new segment
+  };
+
+  // dispatches, descriptor sets and scratch buffers for one set of buffers.
+  // plans are made once and recorded any number of times, but not concurrently
+  class Plan;
+
+  // tiles which don't fit device limits are replaced with defaults.
+  // a_typesMask - bits of ScanValueType with pipelines, plans of other types can't be made
+  GpuPrimitives(VkDevice a_device, VkPhysicalDevice a_physicalDevice, VkPipelineCache a_cache = VK_NULL_HANDLE,
+                const ScanTiles &a_tiles = ScanTiles(), uint32_t a_typesMask = ALL_TYPES);
+  ~GpuPrimitives();
+
+  GpuPrimitives(const GpuPrimitives &) = delete;
+  GpuPrimitives& operator=(const GpuPrimitives &) = delete;
+
+  // a_in and a_out may be the same buffer
+  std::unique_ptr<Plan> MakeScan(ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+                                 uint32_t a_flags = SCAN_EXCLUSIVE, VkBuffer a_segmentFlags = VK_NULL_HANDLE);
+  // sum of a_in is written to the first element of a_result, a_result needs TRANSFER_DST usage
+  std::unique_ptr<Plan> MakeReduce(ScanValueType a_type, VkBuffer a_in, VkBuffer a_result, uint32_t a_length);
+  // elements of a_in with nonzero uint in a_keep are packed to the beginning of a_out in the same order,
+  // their number is written to the first uint of a_count
+  std::unique_ptr<Plan> MakeCompact(ScanValueType a_type, VkBuffer a_in, VkBuffer a_keep, VkBuffer a_out,
+                                    VkBuffer a_count, uint32_t a_length);
+  // stable LSD radix sort of 32 bit uint keys in place, a_values (any 32 bit payload) are moved with keys if not null.
+  // offsets of digits are found by scan of per-block histograms, so it uses the selected scan algorithm
+  std::unique_ptr<Plan> MakeSort(VkBuffer a_keys, VkBuffer a_values, uint32_t a_length);
+  // a_sum[i] = a_a[i] + a_b[i] for float arrays (simple.comp)
+  std::unique_ptr<Plan> MakeAdd(VkBuffer a_a, VkBuffer a_b, VkBuffer a_sum, uint32_t a_length);
+
+  // algorithm of scans and compaction in plans made after this call, segmented scans are always multi-level
+  void SetScanAlgorithm(ScanAlgorithm a_algorithm) { m_scanAlgorithm = a_algorithm; }
+  ScanAlgorithm GetScanAlgorithm() const { return m_scanAlgorithm; }
+  // look-back scan uses subgroup arithmetic for scan inside of tile if device supports it in compute shaders
+  bool SubgroupScan() const { return m_subgroupScan; }
+
+  // inputs must be made visible to compute shaders before, results are visible after a barrier
+  // with src = compute shader write (and transfer write for reduction).
+  // if a_timer is not null, every dispatch, copy and fill is a scope of it named after the kernel
+  void RecordCmd(VkCommandBuffer a_cmdBuff, const Plan &a_plan, GpuTimer* a_timer = nullptr) const;
+
+  const ScanTiles& Tiles() const { return m_tiles; }
+  // workgroup sizes and shared memory of a_tiles are within a_limits
+  static bool TilesFit(const ScanTiles &a_tiles, const VkPhysicalDeviceLimits &a_limits);
+
+  // number of recursion levels of multi-level scan for a_length elements
+  uint32_t LevelsNum(uint32_t a_length) const;
+
+private:
+  enum Kernel : uint32_t
+  {
+    KERNEL_SCAN_BLOCK = 0,
+    KERNEL_SCAN_ADD,
+    KERNEL_COMPACT_SCATTER,
+    KERNEL_SCAN_LOOKBACK,
+    KERNEL_RADIX_HISTOGRAM,
+    KERNEL_RADIX_SCATTER,
+    KERNEL_ADD,
+    KERNELS_NUM
+  };
+
+  struct KernelInfo
+  {
+    VkDescriptorSetLayout dsLayout = VK_NULL_HANDLE;
+    VkPipelineLayout      layout   = VK_NULL_HANDLE;
+    VkPipeline            pipelines[uint32_t(ScanValueType::COUNT)] = {}; // only UINT for untyped kernels
+    uint32_t              bindingsNum = 0;
+  };
+
+  void CreateKernels(VkPipelineCache a_cache, uint32_t a_typesMask);
+  VkBuffer CreateScratch(Plan &a_plan, uint32_t a_elements) const;
+  void AddScanLevels(Plan &a_plan, ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+                     uint32_t a_mode, VkBuffer a_segmentFlags) const;
+  void AddLookbackScan(Plan &a_plan, ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+                       uint32_t a_mode) const;
+  // a_mode is SCAN_MODE_* bits
+  void AddScan(Plan &a_plan, ScanValueType a_type, VkBuffer a_in, VkBuffer a_out, uint32_t a_length,
+               uint32_t a_mode, VkBuffer a_segmentFlags) const;
+  void AddDispatch(Plan &a_plan, Kernel a_kernel, ScanValueType a_type, const std::vector<VkBuffer> &a_buffers,
+                   uint32_t a_groups, uint32_t a_len, uint32_t a_arg) const;
+  // allocates scratch memory and descriptor sets when all steps are known
+  void Finalize(Plan &a_plan) const;
+
+  VkDevice         m_device         = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+  KernelInfo       m_kernels[KERNELS_NUM];
+  ScanTiles        m_tiles;
+  ScanAlgorithm    m_scanAlgorithm = ScanAlgorithm::MULTI_LEVEL;
+  bool             m_subgroupScan  = false;
+};
+
+class GpuPrimitives::Plan
+{
+public:
+  ~Plan();
+
+  Plan(const Plan &) = delete;
+  Plan& operator=(const Plan &) = delete;
+
+  uint32_t Length() const { return m_length; }
+  // dispatches, copies and fills recorded by RecordCmd
+  uint32_t StepsNum() const { return uint32_t(m_steps.size()); }
+
+private:
+  friend class GpuPrimitives;
+  explicit Plan(VkDevice a_device) : m_device(a_device) {}
+
+  struct Step
+  {
+    Kernel           kernel   = KERNELS_NUM; // KERNELS_NUM for copy or fill
+    std::vector<VkBuffer> buffers;          // in order of bindings
+    VkPipeline       pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout layout   = VK_NULL_HANDLE;
+    VkDescriptorSet  dSet     = VK_NULL_HANDLE;
+    uint32_t         groups   = 0;
+    uint32_t         params[2] = {0, 0};
+    VkBuffer         copySrc  = VK_NULL_HANDLE; // null means zero fill of copyDst
+    VkBuffer         copyDst  = VK_NULL_HANDLE;
+    VkDeviceSize     copySize = 0;
+  };
+
+  VkDevice              m_device = VK_NULL_HANDLE;
+  VkDescriptorPool      m_dsPool = VK_NULL_HANDLE;
+  std::vector<VkBuffer> m_scratch;
+  VkDeviceMemory        m_scratchMem = VK_NULL_HANDLE;
+  std::vector<Step>     m_steps;
+  uint32_t              m_length = 0;
+};
+
+#endif//CHIMERA_GPU_PRIMITIVES_H
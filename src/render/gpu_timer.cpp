@@ -0,0 +1,105 @@
+#include "gpu_timer.h"
+#include "vk_utils.h"
+
+GpuTimer::GpuTimer(VkDevice a_device, VkPhysicalDevice a_physicalDevice, uint32_t a_queueFamily, uint32_t a_maxScopes,
+                   bool a_pipelineStatistics) : m_device(a_device), m_maxScopes(a_maxScopes)
+{
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(a_physicalDevice, &props);
+  m_period = double(props.limits.timestampPeriod);
+
+  uint32_t familiesNum = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physicalDevice, &familiesNum, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familiesNum);
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physicalDevice, &familiesNum, families.data());
+  const uint32_t bits = a_queueFamily < familiesNum ? families[a_queueFamily].timestampValidBits : 0;
+  m_validBits = bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+
+  if(!Supported() || m_maxScopes == 0)
+    return;
+
+  VkQueryPoolCreateInfo poolInfo = {};
+  poolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = 2 * m_maxScopes;
+  VK_CHECK_RESULT(vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_timestamps));
+
+  if(a_pipelineStatistics)
+  {
+    poolInfo.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    poolInfo.queryCount         = m_maxScopes;
+    poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+    VK_CHECK_RESULT(vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_statistics));
+  }
+}
+
+GpuTimer::~GpuTimer()
+{
+  if(m_timestamps != VK_NULL_HANDLE)
+    vkDestroyQueryPool(m_device, m_timestamps, nullptr);
+  if(m_statistics != VK_NULL_HANDLE)
+    vkDestroyQueryPool(m_device, m_statistics, nullptr);
+}
+
+void GpuTimer::Reset(VkCommandBuffer a_cmdBuff)
+{
+  m_scopes.clear();
+  if(m_timestamps != VK_NULL_HANDLE)
+    vkCmdResetQueryPool(a_cmdBuff, m_timestamps, 0, 2 * m_maxScopes);
+  if(m_statistics != VK_NULL_HANDLE)
+    vkCmdResetQueryPool(a_cmdBuff, m_statistics, 0, m_maxScopes);
+}
+
+uint32_t GpuTimer::Begin(VkCommandBuffer a_cmdBuff, const char* a_name)
+{
+  if(m_timestamps == VK_NULL_HANDLE || m_scopes.size() >= m_maxScopes)
+    return UINT32_MAX;
+
+  const uint32_t scope = uint32_t(m_scopes.size());
+  m_scopes.push_back({a_name, 0.0, 0.0, 0});
+  // bottom of pipe in both ends: scope starts when previous commands are finished
+  vkCmdWriteTimestamp(a_cmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamps, 2 * scope);
+  if(m_statistics != VK_NULL_HANDLE)
+    vkCmdBeginQuery(a_cmdBuff, m_statistics, scope, 0);
+  return scope;
+}
+
+void GpuTimer::End(VkCommandBuffer a_cmdBuff, uint32_t a_scope)
+{
+  if(a_scope == UINT32_MAX)
+    return;
+  if(m_statistics != VK_NULL_HANDLE)
+    vkCmdEndQuery(a_cmdBuff, m_statistics, a_scope);
+  vkCmdWriteTimestamp(a_cmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamps, 2 * a_scope + 1);
+}
+
+const std::vector<GpuTimer::Scope>& GpuTimer::Resolve()
+{
+  m_totalMs = 0.0;
+  const uint32_t scopesNum = uint32_t(m_scopes.size());
+  if(scopesNum == 0)
+    return m_scopes;
+
+  std::vector<uint64_t> ticks(2 * scopesNum);
+  VK_CHECK_RESULT(vkGetQueryPoolResults(m_device, m_timestamps, 0, 2 * scopesNum, ticks.size() * sizeof(uint64_t),
+                                        ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  // counters may wrap around within valid bits
+  auto toMs = [this](uint64_t a_begin, uint64_t a_end) { return double((a_end - a_begin) & m_validBits) * m_period * 1e-6; };
+  for(uint32_t i = 0; i < scopesNum; ++i)
+  {
+    m_scopes[i].ms      = toMs(ticks[2 * i], ticks[2 * i + 1]);
+    m_scopes[i].startMs = toMs(ticks.front(), ticks[2 * i]);
+  }
+  m_totalMs = toMs(ticks.front(), ticks.back());
+
+  if(m_statistics != VK_NULL_HANDLE)
+  {
+    std::vector<uint64_t> invocations(scopesNum);
+    VK_CHECK_RESULT(vkGetQueryPoolResults(m_device, m_statistics, 0, scopesNum, invocations.size() * sizeof(uint64_t),
+                                          invocations.data(), sizeof(uint64_t),
+                                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    for(uint32_t i = 0; i < scopesNum; ++i)
+      m_scopes[i].invocations = invocations[i];
+  }
+  return m_scopes;
+}
@@ -0,0 +1,59 @@
+#ifndef CHIMERA_GPU_TIMER_H
+#define CHIMERA_GPU_TIMER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "volk.h"
+
+// named GPU time intervals of one command buffer, measured with vkCmdWriteTimestamp.
+// if device supports pipeline statistics queries, invocations of compute shaders inside of every scope
+// are counted too. scopes must not overlap, one timer is recorded in one command buffer at a time
+class GpuTimer
+{
+public:
+  struct Scope
+  {
+    std::string name;
+    double      ms          = 0.0;
+    double      startMs     = 0.0; // from the beginning of the first scope
+    uint64_t    invocations = 0; // 0 if pipeline statistics are not supported or not enabled
+  };
+
+  // a_queueFamily - family of queue where command buffers are submitted, its timestamp bits are checked.
+  // a_pipelineStatistics requires pipelineStatisticsQuery feature enabled on device
+  GpuTimer(VkDevice a_device, VkPhysicalDevice a_physicalDevice, uint32_t a_queueFamily, uint32_t a_maxScopes,
+           bool a_pipelineStatistics = false);
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer& operator=(const GpuTimer &) = delete;
+
+  // queue family has no timestamps, all scopes are empty then
+  bool Supported() const { return m_validBits != 0; }
+
+  // must be recorded before the first scope, outside of render pass
+  void Reset(VkCommandBuffer a_cmdBuff);
+  // scopes beyond a_maxScopes are ignored, returns index of scope or UINT32_MAX
+  uint32_t Begin(VkCommandBuffer a_cmdBuff, const char* a_name);
+  void End(VkCommandBuffer a_cmdBuff, uint32_t a_scope);
+
+  // waits for results of the last submitted recording
+  const std::vector<Scope>& Resolve();
+  // time from the beginning of the first scope to the end of the last one, valid after Resolve
+  double TotalMs() const { return m_totalMs; }
+
+private:
+  VkDevice    m_device     = VK_NULL_HANDLE;
+  VkQueryPool m_timestamps = VK_NULL_HANDLE;
+  VkQueryPool m_statistics = VK_NULL_HANDLE;
+  uint32_t    m_maxScopes  = 0;
+  uint64_t    m_validBits  = 0;
+  double      m_period     = 1.0; // ns per tick
+
+  std::vector<Scope> m_scopes;
+  double             m_totalMs = 0.0;
+};
+
+#endif//CHIMERA_GPU_TIMER_H
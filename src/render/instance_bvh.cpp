@@ -0,0 +1,359 @@
+#include "instance_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+static float SafeInverse(float a_x)
+{
+  const float eps = 1e-20f;
+  return 1.0f / (std::abs(a_x) < eps ? std::copysign(eps, a_x) : a_x);
+}
+
+void InstanceBVH::Clear()
+{
+  m_nodes.clear();
+  m_instIds.clear();
+  m_boxes.clear();
+  m_parents.clear();
+  m_leafNodes.clear();
+  m_instPos.clear();
+  m_bounds = LiteMath::Box4f();
+}
+
+void InstanceBVH::Build(const std::vector<LiteMath::Box4f> &a_boxes)
+{
+  Clear();
+  if(a_boxes.empty())
+    return;
+
+  std::vector<LiteMath::float4> centers(a_boxes.size());
+  m_instIds.resize(a_boxes.size());
+  for(uint32_t i = 0; i < a_boxes.size(); ++i)
+  {
+    centers[i]   = 0.5f * (a_boxes[i].boxMin + a_boxes[i].boxMax);
+    m_instIds[i] = i;
+  }
+
+  m_nodes.reserve(2 * a_boxes.size() / LEAF_SIZE + 1);
+  BuildNode(centers, 0, static_cast<uint32_t>(a_boxes.size()));
+  LinkNodes();
+
+  Refit(a_boxes);
+}
+
+void InstanceBVH::LinkNodes()
+{
+  m_parents.assign(m_nodes.size(), INVALID_NODE);
+  m_leafNodes.resize(m_instIds.size());
+  m_instPos.resize(m_instIds.size());
+  for(uint32_t nodeId = 0; nodeId < m_nodes.size(); ++nodeId)
+  {
+    const Node &node = m_nodes[nodeId];
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+      if(node.child[i] != INVALID_NODE)
+      {
+        m_parents[node.child[i]] = nodeId;
+        continue;
+      }
+      for(uint32_t j = node.first[i]; j < node.first[i] + node.count[i]; ++j)
+      {
+        m_leafNodes[m_instIds[j]] = nodeId;
+        m_instPos[m_instIds[j]]   = j;
+      }
+    }
+  }
+}
+
+uint32_t InstanceBVH::BuildNode(const std::vector<LiteMath::float4> &a_centers, uint32_t a_first, uint32_t a_count)
+{
+  // median split along the longest axis of centers
+  auto split = [this, &a_centers](uint32_t a_begin, uint32_t a_num) {
+    LiteMath::Box4f centerBox;
+    for(uint32_t i = a_begin; i < a_begin + a_num; ++i)
+      centerBox.include(a_centers[m_instIds[i]]);
+
+    const LiteMath::float4 size = centerBox.boxMax - centerBox.boxMin;
+    int axis = 0;
+    if(size.y > size[axis]) axis = 1;
+    if(size.z > size[axis]) axis = 2;
+
+    const uint32_t mid = a_begin + a_num / 2;
+    std::nth_element(m_instIds.begin() + a_begin, m_instIds.begin() + mid, m_instIds.begin() + a_begin + a_num,
+                     [&a_centers, axis](uint32_t a, uint32_t b) { return a_centers[a][axis] < a_centers[b][axis]; });
+    return mid;
+  };
+
+  // up to 4 children from two levels of binary splits
+  std::pair<uint32_t, uint32_t> parts[4];
+  uint32_t partsNum = 0;
+  if(a_count <= LEAF_SIZE)
+    parts[partsNum++] = {a_first, a_count};
+  else
+  {
+    const uint32_t mid = split(a_first, a_count);
+    for(auto half : {std::make_pair(a_first, mid - a_first), std::make_pair(mid, a_first + a_count - mid)})
+    {
+      if(half.second <= LEAF_SIZE)
+      {
+        parts[partsNum++] = half;
+        continue;
+      }
+      const uint32_t quarter = split(half.first, half.second);
+      parts[partsNum++] = {half.first, quarter - half.first};
+      parts[partsNum++] = {quarter, half.first + half.second - quarter};
+    }
+  }
+
+  const uint32_t nodeId = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.emplace_back();
+  for(uint32_t i = 0; i < 4; ++i)
+  {
+    m_nodes[nodeId].child[i] = INVALID_NODE;
+    m_nodes[nodeId].first[i] = 0;
+    m_nodes[nodeId].count[i] = 0;
+    SetChildBounds(m_nodes[nodeId], i, LiteMath::Box4f());
+  }
+
+  for(uint32_t i = 0; i < partsNum; ++i)
+  {
+    // children are always placed after their parent, Refit relies on it
+    const uint32_t child = (parts[i].second <= LEAF_SIZE) ? INVALID_NODE : BuildNode(a_centers, parts[i].first, parts[i].second);
+    m_nodes[nodeId].child[i] = child;
+    m_nodes[nodeId].first[i] = parts[i].first;
+    m_nodes[nodeId].count[i] = parts[i].second;
+  }
+
+  return nodeId;
+}
+
+void InstanceBVH::Refit(const std::vector<LiteMath::Box4f> &a_boxes)
+{
+  m_boxes.resize(m_instIds.size());
+  for(uint32_t i = 0; i < m_instIds.size(); ++i)
+    m_boxes[i] = a_boxes[m_instIds[i]];
+
+  for(uint32_t nodeId = static_cast<uint32_t>(m_nodes.size()); nodeId-- > 0;)
+    RefitNode(nodeId);
+
+  m_bounds = m_nodes.empty() ? LiteMath::Box4f() : NodeBounds(0);
+}
+
+void InstanceBVH::Refit(const std::vector<uint32_t> &a_instIds, const std::vector<LiteMath::Box4f> &a_boxes)
+{
+  if(m_nodes.empty())
+    return;
+
+  std::vector<uint32_t> nodes;
+  for(size_t i = 0; i < a_instIds.size(); ++i)
+  {
+    m_boxes[m_instPos[a_instIds[i]]] = a_boxes[i];
+    for(uint32_t nodeId = m_leafNodes[a_instIds[i]]; nodeId != INVALID_NODE; nodeId = m_parents[nodeId])
+      nodes.push_back(nodeId);
+  }
+
+  // children are placed after their parent, so going from larger ids refits children first
+  std::sort(nodes.begin(), nodes.end(), std::greater<uint32_t>());
+  nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  for(uint32_t nodeId : nodes)
+    RefitNode(nodeId);
+
+  m_bounds = NodeBounds(0);
+}
+
+void InstanceBVH::RefitNode(uint32_t a_nodeId)
+{
+  Node &node = m_nodes[a_nodeId];
+  for(uint32_t i = 0; i < 4; ++i)
+  {
+    LiteMath::Box4f box;
+    if(node.child[i] != INVALID_NODE)
+      box = NodeBounds(node.child[i]);
+    else
+    {
+      for(uint32_t j = node.first[i]; j < node.first[i] + node.count[i]; ++j)
+        box.include(m_boxes[j]);
+    }
+    SetChildBounds(node, i, box);
+  }
+}
+
+LiteMath::Box4f InstanceBVH::NodeBounds(uint32_t a_nodeId) const
+{
+  const Node &node = m_nodes[a_nodeId];
+  LiteMath::Box4f box;
+  for(uint32_t i = 0; i < 4; ++i)
+  {
+    if(node.count[i] == 0)
+      continue;
+    box.include(LiteMath::Box4f(LiteMath::float4(node.boxMin[0][i], node.boxMin[1][i], node.boxMin[2][i], 0.0f),
+                                LiteMath::float4(node.boxMax[0][i], node.boxMax[1][i], node.boxMax[2][i], 0.0f)));
+  }
+  return box;
+}
+
+void InstanceBVH::SetChildBounds(Node &a_node, uint32_t a_slot, const LiteMath::Box4f &a_box)
+{
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    a_node.boxMin[axis][a_slot] = a_box.boxMin[axis];
+    a_node.boxMax[axis][a_slot] = a_box.boxMax[axis];
+  }
+}
+
+void InstanceBVH::ExtractPlanes(const LiteMath::float4x4 &a_viewProj, Plane a_planes[6]) const
+{
+  const LiteMath::float4 r0 = a_viewProj.get_row(0);
+  const LiteMath::float4 r1 = a_viewProj.get_row(1);
+  const LiteMath::float4 r2 = a_viewProj.get_row(2);
+  const LiteMath::float4 r3 = a_viewProj.get_row(3);
+
+  const LiteMath::float4 planes[6] = {r3 + r0, r3 - r0, r3 + r1, r3 - r1, r2, r3 - r2};
+  for(int i = 0; i < 6; ++i)
+    a_planes[i] = Plane{planes[i].x, planes[i].y, planes[i].z, planes[i].w};
+}
+
+template<typename Visit>
+void InstanceBVH::TraverseFrustum(const LiteMath::float4x4 &a_viewProj, Visit a_visit) const
+{
+  if(m_nodes.empty())
+    return;
+
+  Plane planes[6];
+  ExtractPlanes(a_viewProj, planes);
+
+  auto boxOutside = [&planes](const LiteMath::Box4f &a_box) {
+    for(const auto &p : planes)
+    {
+      const float x = p.a > 0.0f ? a_box.boxMax.x : a_box.boxMin.x;
+      const float y = p.b > 0.0f ? a_box.boxMax.y : a_box.boxMin.y;
+      const float z = p.c > 0.0f ? a_box.boxMax.z : a_box.boxMin.z;
+      if(p.a * x + p.b * y + p.c * z + p.d < 0.0f)
+        return true;
+    }
+    return false;
+  };
+
+  std::vector<uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+  while(!stack.empty())
+  {
+    const Node &node = m_nodes[stack.back()];
+    stack.pop_back();
+
+    // distances of the farthest (p) and the nearest (n) box corners to planes, 4 children at once
+    bool outside[4] = {false, false, false, false};
+    bool inside[4]  = {true, true, true, true};
+    for(const auto &p : planes)
+    {
+      for(uint32_t i = 0; i < 4; ++i)
+      {
+        const float px = p.a > 0.0f ? node.boxMax[0][i] : node.boxMin[0][i];
+        const float py = p.b > 0.0f ? node.boxMax[1][i] : node.boxMin[1][i];
+        const float pz = p.c > 0.0f ? node.boxMax[2][i] : node.boxMin[2][i];
+        const float nx = p.a > 0.0f ? node.boxMin[0][i] : node.boxMax[0][i];
+        const float ny = p.b > 0.0f ? node.boxMin[1][i] : node.boxMax[1][i];
+        const float nz = p.c > 0.0f ? node.boxMin[2][i] : node.boxMax[2][i];
+        outside[i] = outside[i] || (p.a * px + p.b * py + p.c * pz + p.d <  0.0f);
+        inside[i]  = inside[i]  && (p.a * nx + p.b * ny + p.c * nz + p.d >= 0.0f);
+      }
+    }
+
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+      if(node.count[i] == 0 || outside[i])
+        continue;
+
+      if(inside[i])
+      {
+        for(uint32_t j = node.first[i]; j < node.first[i] + node.count[i]; ++j)
+          a_visit(j);
+      }
+      else if(node.child[i] != INVALID_NODE)
+        stack.push_back(node.child[i]);
+      else
+      {
+        for(uint32_t j = node.first[i]; j < node.first[i] + node.count[i]; ++j)
+          if(!boxOutside(m_boxes[j]))
+            a_visit(j);
+      }
+    }
+  }
+}
+
+void InstanceBVH::QueryFrustum(const LiteMath::float4x4 &a_viewProj, std::vector<uint32_t> &a_instIds) const
+{
+  a_instIds.clear();
+  TraverseFrustum(a_viewProj, [this, &a_instIds](uint32_t a_id) { a_instIds.push_back(m_instIds[a_id]); });
+}
+
+LiteMath::Box4f InstanceBVH::FrustumBounds(const LiteMath::float4x4 &a_viewProj) const
+{
+  LiteMath::Box4f bounds;
+  TraverseFrustum(a_viewProj, [this, &bounds](uint32_t a_id) { bounds.include(m_boxes[a_id]); });
+  return bounds;
+}
+
+void InstanceBVH::QueryRay(const LiteMath::float3 &a_origin, const LiteMath::float3 &a_dir, float a_tMax,
+                           std::vector<uint32_t> &a_instIds) const
+{
+  a_instIds.clear();
+  if(m_nodes.empty())
+    return;
+
+  const float invDir[3] = {SafeInverse(a_dir.x), SafeInverse(a_dir.y), SafeInverse(a_dir.z)};
+  const float origin[3] = {a_origin.x, a_origin.y, a_origin.z};
+
+  auto slabs = [&](float a_min, float a_max, int a_axis, float &a_tNear, float &a_tFar) {
+    const float t0 = (a_min - origin[a_axis]) * invDir[a_axis];
+    const float t1 = (a_max - origin[a_axis]) * invDir[a_axis];
+    a_tNear = std::max(a_tNear, std::min(t0, t1));
+    a_tFar  = std::min(a_tFar,  std::max(t0, t1));
+  };
+
+  std::vector<std::pair<float, uint32_t>> hits;
+  std::vector<uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+  while(!stack.empty())
+  {
+    const Node &node = m_nodes[stack.back()];
+    stack.pop_back();
+
+    float tNear[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float tFar[4]  = {a_tMax, a_tMax, a_tMax, a_tMax};
+    for(int axis = 0; axis < 3; ++axis)
+      for(uint32_t i = 0; i < 4; ++i)
+        slabs(node.boxMin[axis][i], node.boxMax[axis][i], axis, tNear[i], tFar[i]);
+
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+      if(node.count[i] == 0 || tNear[i] > tFar[i])
+        continue;
+
+      if(node.child[i] != INVALID_NODE)
+      {
+        stack.push_back(node.child[i]);
+        continue;
+      }
+
+      for(uint32_t j = node.first[i]; j < node.first[i] + node.count[i]; ++j)
+      {
+        float tBoxNear = 0.0f;
+        float tBoxFar  = a_tMax;
+        for(int axis = 0; axis < 3; ++axis)
+          slabs(m_boxes[j].boxMin[axis], m_boxes[j].boxMax[axis], axis, tBoxNear, tBoxFar);
+        if(tBoxNear <= tBoxFar)
+          hits.emplace_back(tBoxNear, m_instIds[j]);
+      }
+    }
+  }
+
+  std::sort(hits.begin(), hits.end());
+  a_instIds.reserve(hits.size());
+  for(const auto &hit : hits)
+    a_instIds.push_back(hit.second);
+}
@@ -0,0 +1,72 @@
+#ifndef CHIMERA_INSTANCE_BVH_H
+#define CHIMERA_INSTANCE_BVH_H
+
+#include <vector>
+#include <cstdint>
+
+#include "LiteMath.h"
+
+// 4-wide bounding volume hierarchy over world space boxes of instances.
+// bounds of node children are stored as structure of arrays, so each node is tested against a plane or a ray
+// with straight loops over 4 lanes which compilers turn into SIMD code
+class InstanceBVH
+{
+public:
+  static constexpr uint32_t LEAF_SIZE    = 4u;
+  static constexpr uint32_t INVALID_NODE = 0xFFFFFFFFu;
+
+  // a_boxes[i] is box of instance i, queries return these indices
+  void Build(const std::vector<LiteMath::Box4f> &a_boxes);
+  // updates bounds after instances were moved, tree topology is kept
+  void Refit(const std::vector<LiteMath::Box4f> &a_boxes);
+  // same for a few moved instances, instance a_instIds[i] gets a_boxes[i], only nodes above them are refitted
+  void Refit(const std::vector<uint32_t> &a_instIds, const std::vector<LiteMath::Box4f> &a_boxes);
+  void Clear();
+
+  // instances whose boxes are not completely outside of frustum of a_viewProj,
+  // clip space is the same as in shaders: -w <= x,y <= w, 0 <= z <= w
+  void QueryFrustum(const LiteMath::float4x4 &a_viewProj, std::vector<uint32_t> &a_instIds) const;
+  // union of boxes of instances that QueryFrustum returns, i.e. what a shadow frustum should cover
+  LiteMath::Box4f FrustumBounds(const LiteMath::float4x4 &a_viewProj) const;
+  // instances whose boxes are hit by ray in [0, a_tMax], sorted by distance to box
+  void QueryRay(const LiteMath::float3 &a_origin, const LiteMath::float3 &a_dir, float a_tMax,
+                std::vector<uint32_t> &a_instIds) const;
+
+  LiteMath::Box4f Bounds() const { return m_bounds; }
+  uint32_t NodesNum() const { return static_cast<uint32_t>(m_nodes.size()); }
+  bool Empty() const { return m_nodes.empty(); }
+
+private:
+  struct Node
+  {
+    float    boxMin[3][4];  // [axis][child]
+    float    boxMax[3][4];
+    uint32_t child[4];      // node index or INVALID_NODE for leaves and unused slots
+    uint32_t first[4];      // instances of child subtree are m_instIds[first, first + count)
+    uint32_t count[4];
+  };
+
+  struct Plane
+  {
+    float a, b, c, d;
+  };
+
+  uint32_t BuildNode(const std::vector<LiteMath::float4> &a_centers, uint32_t a_first, uint32_t a_count);
+  LiteMath::Box4f NodeBounds(uint32_t a_nodeId) const;
+  void RefitNode(uint32_t a_nodeId);
+  void LinkNodes();
+  void SetChildBounds(Node &a_node, uint32_t a_slot, const LiteMath::Box4f &a_box);
+  void ExtractPlanes(const LiteMath::float4x4 &a_viewProj, Plane a_planes[6]) const;
+  template<typename Visit>
+  void TraverseFrustum(const LiteMath::float4x4 &a_viewProj, Visit a_visit) const;
+
+  std::vector<Node>     m_nodes;
+  std::vector<uint32_t> m_instIds;
+  std::vector<LiteMath::Box4f> m_boxes; // boxes of m_instIds, leaf instances are tested one by one
+  std::vector<uint32_t> m_parents;   // parent of every node, INVALID_NODE for root
+  std::vector<uint32_t> m_leafNodes; // node and position in m_instIds of every instance, for partial refit
+  std::vector<uint32_t> m_instPos;
+  LiteMath::Box4f       m_bounds;
+};
+
+#endif//CHIMERA_INSTANCE_BVH_H
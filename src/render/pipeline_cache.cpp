@@ -0,0 +1,151 @@
+#include "pipeline_cache.h"
+#include "vk_utils.h"
+#include "vk_pipeline.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+
+// VkPipelineCacheHeaderVersionOne
+struct CacheHeader
+{
+  uint32_t headerSize;
+  uint32_t headerVersion;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+PipelineCache::PipelineCache(VkDevice a_device, VkPhysicalDevice a_physicalDevice, const std::string &a_path) :
+  m_device(a_device), m_path(a_path)
+{
+  vkGetPhysicalDeviceProperties(a_physicalDevice, &m_props);
+
+  std::vector<char> data;
+  std::ifstream fin(m_path, std::ios::binary | std::ios::ate);
+  if(fin.is_open())
+  {
+    data.resize(static_cast<size_t>(fin.tellg()));
+    fin.seekg(0);
+    fin.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if(!fin || !HeaderMatches(data))
+    {
+      std::cout << "PipelineCache: '" << m_path << "' is stale or was made for another device, rebuilding" << std::endl;
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo createInfo = {};
+  createInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData    = data.empty() ? nullptr : data.data();
+  if(vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache) != VK_SUCCESS)
+  {
+    // driver rejected data, start from empty cache
+    createInfo.initialDataSize = 0;
+    createInfo.pInitialData    = nullptr;
+    data.clear();
+    VK_CHECK_RESULT(vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache));
+  }
+  m_loadedBytes = data.size();
+}
+
+PipelineCache::~PipelineCache()
+{
+  if(m_cache != VK_NULL_HANDLE)
+  {
+    Save();
+    vkDestroyPipelineCache(m_device, m_cache, nullptr);
+  }
+}
+
+bool PipelineCache::HeaderMatches(const std::vector<char> &a_data) const
+{
+  CacheHeader header = {};
+  if(a_data.size() < sizeof(header))
+    return false;
+  memcpy(&header, a_data.data(), sizeof(header));
+
+  return header.headerSize    >= sizeof(header) &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID      == m_props.vendorID &&
+         header.deviceID      == m_props.deviceID &&
+         memcmp(header.pipelineCacheUUID, m_props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::Save() const
+{
+  size_t size = 0;
+  if(vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+    return;
+
+  std::vector<char> data(size);
+  if(vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  // other samples may read the same file, so it is replaced only when completely written
+  const std::string tmpPath = m_path + ".tmp";
+  {
+    std::ofstream fout(tmpPath, std::ios::binary | std::ios::trunc);
+    fout.write(data.data(), static_cast<std::streamsize>(size));
+    if(!fout)
+    {
+      std::cout << "PipelineCache: can't write '" << tmpPath << "'" << std::endl;
+      return;
+    }
+  }
+  std::remove(m_path.c_str());
+  std::rename(tmpPath.c_str(), m_path.c_str());
+}
+
+VkPipeline MakeGraphicsPipeline(vk_utils::GraphicsPipelineMaker &a_maker, VkDevice a_device, VkPipelineCache a_cache,
+                                VkPipelineLayout a_layout, VkPipelineVertexInputStateCreateInfo a_vertexLayout,
+                                VkRenderPass a_renderPass, const std::vector<VkDynamicState> &a_dynamicStates)
+{
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(a_dynamicStates.size());
+  dynamicState.pDynamicStates    = a_dynamicStates.data();
+
+  // fixed function state is filled by SetDefaultState and whatever the caller changed after it
+  VkGraphicsPipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount          = static_cast<uint32_t>(a_maker.stagesNum);
+  pipelineInfo.pStages             = a_maker.shaderStageInfos;
+  pipelineInfo.pVertexInputState   = &a_vertexLayout;
+  pipelineInfo.pInputAssemblyState = &a_maker.inputAssembly;
+  pipelineInfo.pViewportState      = &a_maker.viewportState;
+  pipelineInfo.pRasterizationState = &a_maker.rasterizer;
+  pipelineInfo.pMultisampleState   = &a_maker.multisampling;
+  pipelineInfo.pDepthStencilState  = &a_maker.depthStencilTest;
+  pipelineInfo.pColorBlendState    = &a_maker.colorBlending;
+  pipelineInfo.pDynamicState       = a_dynamicStates.empty() ? nullptr : &dynamicState;
+  pipelineInfo.layout              = a_layout;
+  pipelineInfo.renderPass          = a_renderPass;
+  pipelineInfo.subpass             = 0;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateGraphicsPipelines(a_device, a_cache, 1, &pipelineInfo, nullptr, &pipeline));
+
+  for(int i = 0; i < a_maker.stagesNum; ++i)
+    vkDestroyShaderModule(a_device, a_maker.shaderStageInfos[i].module, nullptr);
+  a_maker.stagesNum = 0;
+
+  return pipeline;
+}
+
+void BuildPipelinesParallel(const std::vector<std::function<void()>> &a_jobs)
+{
+  std::vector<std::future<void>> results;
+  results.reserve(a_jobs.size());
+  for(const auto &job : a_jobs)
+    results.push_back(std::async(std::launch::async, job));
+
+  // get() rethrows, but every job has to finish before that
+  for(auto &result : results)
+    result.wait();
+  for(auto &result : results)
+    result.get();
+}
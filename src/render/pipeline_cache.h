@@ -0,0 +1,55 @@
+#ifndef CHIMERA_PIPELINE_CACHE_H
+#define CHIMERA_PIPELINE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "volk.h"
+
+namespace vk_utils
+{
+  struct GraphicsPipelineMaker;
+}
+
+// VkPipelineCache which is loaded from file on creation and written back on destruction.
+// file data is used only if its header matches the device (vendor, device id and pipeline cache UUID),
+// so a cache left by another GPU or driver version is silently rebuilt
+class PipelineCache
+{
+public:
+  // file in working directory of samples, so all of them share it
+  static constexpr const char* DEFAULT_PATH = "pipelines.cache";
+
+  PipelineCache(VkDevice a_device, VkPhysicalDevice a_physicalDevice, const std::string &a_path);
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache& operator=(const PipelineCache &) = delete;
+
+  VkPipelineCache Get() const { return m_cache; }
+  // size of valid data read from file, 0 means cold start
+  size_t LoadedBytes() const { return m_loadedBytes; }
+  void Save() const;
+
+private:
+  bool HeaderMatches(const std::vector<char> &a_data) const;
+
+  VkDevice        m_device = VK_NULL_HANDLE;
+  VkPipelineCache m_cache  = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties m_props {};
+  std::string     m_path;
+  size_t          m_loadedBytes = 0;
+};
+
+// pipeline of a_maker as GraphicsPipelineMaker::MakePipeline makes it, but created with a_cache, which MakePipeline
+// has no parameter for. Shader modules of a_maker are destroyed as well
+VkPipeline MakeGraphicsPipeline(vk_utils::GraphicsPipelineMaker &a_maker, VkDevice a_device, VkPipelineCache a_cache,
+                                VkPipelineLayout a_layout, VkPipelineVertexInputStateCreateInfo a_vertexLayout,
+                                VkRenderPass a_renderPass, const std::vector<VkDynamicState> &a_dynamicStates);
+
+// runs pipeline builds on separate threads and waits for all of them, rethrows the first error.
+// jobs must not share descriptor pools or other externally synchronized objects
+void BuildPipelinesParallel(const std::vector<std::function<void()>> &a_jobs);
+
+#endif//CHIMERA_PIPELINE_CACHE_H
@@ -6,6 +6,7 @@
 #include "utils/Camera.h"
 #include <cstring>
 #include <memory>
+#include <vector>
 
 struct AppInput
 {
@@ -43,10 +44,19 @@ public:
 
   virtual void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) = 0;
   virtual void InitPresentation(VkSurfaceKHR& a_surface) = 0;
+  // called instead of InitPresentation when there is no window, frames are rendered to an offscreen target
+  virtual void InitOffscreen() { RUN_TIME_ERROR("offscreen rendering is not supported by this render"); }
+  // offscreen frames are copied to host memory when readback is enabled,
+  // ReadbackFrame gives the latest frame finished by gpu as RGBA8 pixels, or waits for the last submitted one.
+  // It returns false if there is no such frame
+  virtual void SetReadback(bool a_enable) { }
+  virtual bool ReadbackFrame(std::vector<uint32_t> &a_pixels, bool a_waitLast = false) { return false; }
   virtual void ProcessInput(const AppInput& input) = 0;
   virtual void UpdateCamera(const Camera* cams, uint32_t a_camsCount) = 0;
   virtual void LoadScene(const char* path, bool transpose_inst_matrices) = 0;
   virtual void DrawFrame(float a_time, DrawMode a_mode) = 0;
+  // gpu time of the latest finished frame in ms, negative if render doesn't measure it
+  virtual double GetGpuFrameTime() const { return -1.0; }
 
   virtual ~IRender() = default;
 
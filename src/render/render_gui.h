@@ -23,7 +23,7 @@ class ImGuiRender : public IRenderGUI
 {
 public:
   ImGuiRender(VkInstance a_instance, VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFID, VkQueue a_queue,
-    const VulkanSwapChain &a_swapchain);
+    const VulkanSwapChain &a_swapchain, VkPipelineCache a_pipelineCache = VK_NULL_HANDLE);
   VkCommandBuffer BuildGUIRenderCommand(uint32_t a_swapchainFrameIdx, void* a_userData) override;
   ~ImGuiRender() override;
 private:
@@ -33,6 +33,7 @@ private:
   uint32_t m_queue_FID = UINT32_MAX;
   VkQueue m_queue = VK_NULL_HANDLE;
   const VulkanSwapChain m_swapchain;
+  VkPipelineCache m_pipelineCache = VK_NULL_HANDLE; // not owned
 
   // Owned objects
   VkRenderPass m_renderpass = VK_NULL_HANDLE;
@@ -4,8 +4,9 @@
 
 
 ImGuiRender::ImGuiRender(VkInstance a_instance, VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFID, VkQueue a_queue,
-  const VulkanSwapChain &a_swapchain) : m_instance(a_instance), m_device(a_device), m_physDevice(a_physDevice),
-                                        m_queue_FID(a_queueFID), m_queue(a_queue), m_swapchain(a_swapchain)
+  const VulkanSwapChain &a_swapchain, VkPipelineCache a_pipelineCache) : m_instance(a_instance), m_device(a_device),
+  m_physDevice(a_physDevice), m_queue_FID(a_queueFID), m_queue(a_queue), m_swapchain(a_swapchain),
+  m_pipelineCache(a_pipelineCache)
 {
   InitImGui();
 }
@@ -36,7 +37,7 @@ void ImGuiRender::InitImGui()
   init_info.Device = m_device;
   init_info.QueueFamily = m_queue_FID;
   init_info.Queue = m_queue;
-  init_info.PipelineCache = VK_NULL_HANDLE;
+  init_info.PipelineCache = m_pipelineCache;
   init_info.DescriptorPool = m_descriptorPool;
   init_info.Allocator = VK_NULL_HANDLE;
   init_info.MinImageCount = m_swapchain.GetMinImageCount();
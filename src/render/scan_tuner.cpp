@@ -0,0 +1,223 @@
+#include "scan_tuner.h"
+#include "gpu_timer.h"
+#include "vk_utils.h"
+#include "vk_buffers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+static const char* SCAN_KERNEL     = "scan";
+static const char* LOOKBACK_KERNEL = "lookback";
+
+ScanTuner::ScanTuner(VkDevice a_device, VkPhysicalDevice a_physicalDevice, VkPipelineCache a_cache,
+                     const std::string &a_path) :
+  m_device(a_device), m_physicalDevice(a_physicalDevice), m_cache(a_cache), m_path(a_path)
+{
+}
+
+std::string ScanTuner::DeviceKey() const
+{
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+  return std::to_string(props.vendorID) + " " + std::to_string(props.deviceID) + " " + std::to_string(props.driverVersion);
+}
+
+bool ScanTuner::Load(ScanTiles &a_tiles) const
+{
+  std::ifstream in(m_path);
+  if(!in)
+    return false;
+
+  const std::string key = DeviceKey();
+  bool foundScan = false, foundLookback = false;
+  ScanTiles tiles;
+  for(std::string line; std::getline(in, line);)
+  {
+    if(line.compare(0, key.size() + 1, key + " ") != 0)
+      continue;
+
+    std::istringstream fields(line.substr(key.size() + 1));
+    std::string kernel;
+    uint32_t groupSize = 0, items = 0;
+    if(!(fields >> kernel >> groupSize >> items))
+      continue;
+    if(kernel == SCAN_KERNEL)
+    {
+      tiles.scanGroupSize = groupSize;
+      foundScan = true;
+    }
+    else if(kernel == LOOKBACK_KERNEL)
+    {
+      tiles.lookbackGroupSize = groupSize;
+      tiles.lookbackItems     = items;
+      foundLookback = true;
+    }
+  }
+
+  if(foundScan && foundLookback)
+    a_tiles = tiles;
+  return foundScan && foundLookback;
+}
+
+void ScanTuner::Save(const ScanTiles &a_tiles, double a_scanMs, double a_lookbackMs) const
+{
+  // lines of other devices are kept
+  const std::string key = DeviceKey();
+  std::vector<std::string> lines;
+  {
+    std::ifstream in(m_path);
+    for(std::string line; std::getline(in, line);)
+      if(!line.empty() && line.compare(0, key.size() + 1, key + " ") != 0)
+        lines.push_back(line);
+  }
+
+  std::ofstream out(m_path);
+  if(!out)
+  {
+    std::cout << "ScanTuner: can't write " << m_path << std::endl;
+    return;
+  }
+  for(const auto &line : lines)
+    out << line << "\n";
+  out << std::fixed << std::setprecision(3);
+  out << key << " " << SCAN_KERNEL << " " << a_tiles.scanGroupSize << " 2 " << a_scanMs << "\n";
+  out << key << " " << LOOKBACK_KERNEL << " " << a_tiles.lookbackGroupSize << " " << a_tiles.lookbackItems << " "
+      << a_lookbackMs << "\n";
+}
+
+ScanTiles ScanTuner::Tune(VkQueue a_queue, uint32_t a_queueFamily, uint32_t a_length)
+{
+  constexpr uint32_t WARMUP = 2;
+  constexpr uint32_t RUNS   = 5;
+
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+
+  VkBuffer data = vk_utils::createBuffer(m_device, VkDeviceSize(a_length) * sizeof(uint32_t),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  VkDeviceMemory dataMem = vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice, {data}, 0);
+
+  VkCommandPool   pool = vk_utils::createCommandPool(m_device, a_queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  VkCommandBuffer cmd  = vk_utils::createCommandBuffers(m_device, pool, 1)[0];
+
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &fence));
+
+  GpuTimer timer(m_device, m_physicalDevice, a_queueFamily, 1);
+
+  // median time of in place scan of zeros, wall time of submit if queue has no timestamps
+  auto timeScan = [&](const ScanTiles &a_tiles, ScanAlgorithm a_algorithm) {
+    // all value types are 32 bit and run the same code, uint is enough
+    GpuPrimitives primitives(m_device, m_physicalDevice, m_cache, a_tiles, 1u << uint32_t(ScanValueType::UINT));
+    primitives.SetScanAlgorithm(a_algorithm);
+    auto plan = primitives.MakeScan(ScanValueType::UINT, data, data, a_length);
+
+    std::vector<double> ms;
+    for(uint32_t i = 0; i < WARMUP + RUNS; ++i)
+    {
+      vkResetCommandBuffer(cmd, 0);
+      VkCommandBufferBeginInfo beginInfo = {};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &beginInfo));
+
+      VkMemoryBarrier barrier = {};
+      barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      if(i == 0)
+      {
+        vkCmdFillBuffer(cmd, data, 0, VK_WHOLE_SIZE, 0);
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             1, &barrier, 0, nullptr, 0, nullptr);
+      }
+
+      timer.Reset(cmd);
+      const uint32_t scope = timer.Begin(cmd, "scan");
+      primitives.RecordCmd(cmd, *plan);
+      timer.End(cmd, scope);
+      VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+
+      VkSubmitInfo submitInfo = {};
+      submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers    = &cmd;
+
+      const auto start = std::chrono::high_resolution_clock::now();
+      VK_CHECK_RESULT(vkResetFences(m_device, 1, &fence));
+      VK_CHECK_RESULT(vkQueueSubmit(a_queue, 1, &submitInfo, fence));
+      VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &fence, VK_TRUE, 100000000000));
+      const auto end = std::chrono::high_resolution_clock::now();
+
+      if(i < WARMUP)
+        continue;
+      ms.push_back(timer.Supported() ? timer.Resolve()[0].ms : std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::nth_element(ms.begin(), ms.begin() + ms.size() / 2, ms.end());
+    return ms[ms.size() / 2];
+  };
+
+  const uint32_t groupSizes[] = {64, 128, 256, 512, 1024};
+  const uint32_t itemsNums[]  = {2, 4, 8, 16};
+
+  std::cout << "ScanTuner: " << props.deviceName << ", " << a_length << " elements" << std::fixed << std::setprecision(3)
+            << std::endl;
+
+  // kernels of the two algorithms don't share tiles, so they are tuned separately from defaults
+  ScanTiles best;
+  double bestScanMs = std::numeric_limits<double>::max();
+  for(uint32_t groupSize : groupSizes)
+  {
+    ScanTiles tiles;
+    tiles.scanGroupSize = groupSize;
+    if(!GpuPrimitives::TilesFit(tiles, props.limits))
+      continue;
+    const double ms = timeScan(tiles, ScanAlgorithm::MULTI_LEVEL);
+    std::cout << "  multi-level " << std::setw(4) << groupSize << "    " << std::setw(9) << ms << " ms" << std::endl;
+    if(ms < bestScanMs)
+    {
+      bestScanMs         = ms;
+      best.scanGroupSize = groupSize;
+    }
+  }
+
+  double bestLookbackMs = std::numeric_limits<double>::max();
+  for(uint32_t groupSize : groupSizes)
+  {
+    for(uint32_t items : itemsNums)
+    {
+      ScanTiles tiles;
+      tiles.lookbackGroupSize = groupSize;
+      tiles.lookbackItems     = items;
+      if(!GpuPrimitives::TilesFit(tiles, props.limits))
+        continue;
+      const double ms = timeScan(tiles, ScanAlgorithm::DECOUPLED_LOOKBACK);
+      std::cout << "  look-back   " << std::setw(4) << groupSize << "x" << std::setw(2) << items << " " << std::setw(9)
+                << ms << " ms" << std::endl;
+      if(ms < bestLookbackMs)
+      {
+        bestLookbackMs         = ms;
+        best.lookbackGroupSize = groupSize;
+        best.lookbackItems     = items;
+      }
+    }
+  }
+
+  vkDestroyFence(m_device, fence, nullptr);
+  vkDestroyCommandPool(m_device, pool, nullptr);
+  vkDestroyBuffer(m_device, data, nullptr);
+  vkFreeMemory(m_device, dataMem, nullptr);
+
+  std::cout << "ScanTuner: multi-level " << best.scanGroupSize << ", look-back " << best.lookbackGroupSize << "x"
+            << best.lookbackItems << " are saved to " << m_path << std::endl;
+  Save(best, bestScanMs, bestLookbackMs);
+  return best;
+}
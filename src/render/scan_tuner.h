@@ -0,0 +1,37 @@
+#ifndef CHIMERA_SCAN_TUNER_H
+#define CHIMERA_SCAN_TUNER_H
+
+#include <string>
+#include <vector>
+
+#include "volk.h"
+#include "gpu_primitives.h"
+
+// finds the fastest ScanTiles of a device by timing uint scans of every tile shape that fits its limits.
+// results are kept in a text file shared by all samples, one line per device and kernel:
+// <vendor id> <device id> <driver version> <kernel> <group size> <items per thread> <ms>
+class ScanTuner
+{
+public:
+  // file in working directory of samples, next to pipeline cache
+  static constexpr const char* DEFAULT_PATH = "scan_tiles.txt";
+
+  ScanTuner(VkDevice a_device, VkPhysicalDevice a_physicalDevice, VkPipelineCache a_cache, const std::string &a_path);
+
+  // tiles saved for this device and driver, false if there are none
+  bool Load(ScanTiles &a_tiles) const;
+  // times multi-level and look-back scans of a_length elements with all shapes, saves and returns the fastest ones.
+  // builds pipelines for every shape, so it takes a while on software devices
+  ScanTiles Tune(VkQueue a_queue, uint32_t a_queueFamily, uint32_t a_length = 4 * 1024 * 1024);
+
+private:
+  std::string DeviceKey() const;
+  void Save(const ScanTiles &a_tiles, double a_scanMs, double a_lookbackMs) const;
+
+  VkDevice         m_device         = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+  VkPipelineCache  m_cache          = VK_NULL_HANDLE;
+  std::string      m_path;
+};
+
+#endif//CHIMERA_SCAN_TUNER_H
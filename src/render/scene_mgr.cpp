@@ -1,9 +1,17 @@
 #include <map>
 #include <array>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
 #include "scene_mgr.h"
+#include "unified_memory.h"
 #include "vk_utils.h"
 #include "vk_buffers.h"
 #include "../loader_utils/hydraxml.h"
+#include "../loader_utils/mapped_file.h"
+#include "../loader_utils/scene_cache.h"
 
 
 VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
@@ -20,20 +28,100 @@ VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
   return transformMatrix;
 }
 
+static LiteMath::Box4f ComputeMeshBox(const float* a_pos4f, uint32_t a_vertNum)
+{
+  LiteMath::Box4f box;
+  for(uint32_t i = 0; i < a_vertNum; ++i)
+    box.include(LiteMath::float4(a_pos4f[i * 4 + 0], a_pos4f[i * 4 + 1], a_pos4f[i * 4 + 2], 1.0f));
+  return box;
+}
+
+static LiteMath::Box4f TransformBox(const LiteMath::float4x4 &a_matrix, const LiteMath::Box4f &a_box)
+{
+  LiteMath::Box4f box;
+  for(uint32_t i = 0; i < 8; ++i)
+  {
+    const LiteMath::float4 corner((i & 1) ? a_box.boxMax.x : a_box.boxMin.x,
+                                  (i & 2) ? a_box.boxMax.y : a_box.boxMin.y,
+                                  (i & 4) ? a_box.boxMax.z : a_box.boxMin.z, 1.0f);
+    box.include(a_matrix * corner);
+  }
+  return box;
+}
+
+static void UpdateBufferCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_buffer, VkDeviceSize a_offset, const void* a_src,
+                            VkDeviceSize a_size)
+{
+  // vkCmdUpdateBuffer takes at most 65536 bytes
+  const VkDeviceSize maxUpdate = 65536;
+  for(VkDeviceSize done = 0; done < a_size; done += maxUpdate)
+  {
+    vkCmdUpdateBuffer(a_cmdBuff, a_buffer, a_offset + done, std::min(maxUpdate, a_size - done),
+                      static_cast<const uint8_t*>(a_src) + done);
+  }
+}
+
 SceneManager::SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice,
   uint32_t a_transferQId, uint32_t a_graphicsQId, bool debug) : m_device(a_device), m_physDevice(a_physDevice),
                  m_transferQId(a_transferQId), m_graphicsQId(a_graphicsQId), m_debug(debug)
 {
   vkGetDeviceQueue(m_device, m_transferQId, 0, &m_transferQ);
   vkGetDeviceQueue(m_device, m_graphicsQId, 0, &m_graphicsQ);
-  VkDeviceSize scratchMemSize = 64 * 1024 * 1024;
-  m_pCopyHelper = std::make_shared<vk_utils::PingPongCopyHelper>(m_physDevice, m_device, m_transferQ, m_transferQId, scratchMemSize);
-  m_pMeshData   = std::make_shared<Mesh8F>();
+  m_pMeshData      = std::make_shared<Mesh8F>();
+  m_unifiedMemType = FindUnifiedMemoryType(m_physDevice);
+}
 
+std::shared_ptr<vk_utils::ICopyEngine> SceneManager::GetCopyHelper()
+{
+  if(m_pCopyHelper == nullptr)
+  {
+    VkDeviceSize scratchMemSize = 64 * 1024 * 1024;
+    m_pCopyHelper = std::make_shared<vk_utils::PingPongCopyHelper>(m_physDevice, m_device, m_transferQ, m_transferQId, scratchMemSize);
+  }
+  return m_pCopyHelper;
+}
+
+void* SceneManager::MappedAddress(VkBuffer a_buffer) const
+{
+  const VkBuffer geoBuffers[]       = {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf};
+  const VkBuffer instancesBuffers[] = {m_instanceMatricesBuffer, m_instanceBoxesBuffer, m_meshDrawsBuffer};
+  for(size_t i = 0; i < m_geoMapped.size(); ++i)
+  {
+    if(geoBuffers[i] == a_buffer)
+      return m_geoMapped[i];
+  }
+  for(size_t i = 0; i < m_instancesMapped.size(); ++i)
+  {
+    if(instancesBuffers[i] == a_buffer)
+      return m_instancesMapped[i];
+  }
+  return nullptr;
+}
+
+void SceneManager::WriteBuffer(VkBuffer a_dst, VkDeviceSize a_dstOffset, const void* a_src, VkDeviceSize a_size)
+{
+  if(void* mapped = MappedAddress(a_dst))
+  {
+    memcpy(static_cast<uint8_t*>(mapped) + a_dstOffset, a_src, a_size);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_transferQMutex);
+  GetCopyHelper()->UpdateBuffer(a_dst, a_dstOffset, a_src, a_size);
 }
 
 bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
 {
+  // transfer queue is the graphics one when device has no separate transfer family, it can't be used by another thread
+  const bool loadAsync = m_asyncUpload && m_transferQId != m_graphicsQId;
+  if(m_asyncUpload && !loadAsync)
+    std::cout << "no separate transfer queue, scene is uploaded before the first frame" << std::endl;
+  if(loadAsync && !m_sceneCachePath.empty())
+    std::cout << "scene cache is not used with async upload, meshes are read from scene files" << std::endl;
+
+  if(!loadAsync && !m_sceneCachePath.empty() && LoadSceneCache(scenePath, transpose))
+    return true;
+
   auto hscene_main = std::make_shared<hydra_xml::HydraScene>();
   auto res         = hscene_main->LoadState(scenePath);
 
@@ -43,22 +131,53 @@ bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
     return false;
   }
 
+  std::vector<std::string> meshLocs;
   for(auto loc : hscene_main->MeshFiles())
+    meshLocs.push_back(loc);
+
+  std::vector<uint32_t> meshIds(meshLocs.size());
+  const bool loadMapped = !loadAsync && m_mappedLoading;
+  const bool loadSerial = !loadAsync && !loadMapped && m_loaderThreadsNum <= 1;
+  if(loadAsync)
+    StartAsyncUpload(meshLocs, meshIds);
+  else if(loadMapped)
+    LoadMeshesMapped(meshLocs, meshIds);
+  else if(m_loaderThreadsNum > 1)
+    LoadMeshesStreaming(meshLocs, meshIds);
+  else
+  {
+    for(size_t i = 0; i < meshLocs.size(); ++i)
+      meshIds[i] = AddMeshFromFile(meshLocs[i]);
+  }
+
+  for(size_t i = 0; i < meshLocs.size(); ++i)
   {
-    auto meshId    = AddMeshFromFile(loc);
-    auto instances = hscene_main->GetAllInstancesOfMeshLoc(loc); 
+    auto instances = hscene_main->GetAllInstancesOfMeshLoc(meshLocs[i]);
     for(size_t j = 0; j < instances.size(); ++j)
     {
       if(transpose)
-        InstanceMesh(meshId, LiteMath::transpose(instances[j]));
+        InstanceMesh(meshIds[i], LiteMath::transpose(instances[j]));
       else
-        InstanceMesh(meshId, instances[j]);
+        InstanceMesh(meshIds[i], instances[j]);
     }
   }
 
-  LoadGeoDataOnGPU();
+  if(loadSerial)
+    LoadGeoDataOnGPU();
+  else
+    UploadMeshInfos();
+  UploadInstances();
   hscene_main = nullptr;
 
+  if(loadAsync)
+  {
+    // instances and mesh infos are uploaded by now, so from here on transfer queue belongs to upload thread
+    std::vector<MeshInfo> meshInfos = m_meshInfos;
+    m_uploadThread = std::thread([this, meshLocs, meshInfos]() { UploadMeshesAsync(meshLocs, meshInfos); });
+  }
+  else if(!m_sceneCachePath.empty())
+    WriteSceneCache(scenePath, meshLocs, transpose);
+
   return true;
 }
 
@@ -94,8 +213,8 @@ void SceneManager::LoadSingleTriangle()
 
   VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_geoVertBuf, m_geoMemAlloc, 0));
   VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_geoIdxBuf,  m_geoMemAlloc, pad));
-  m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0, vertices.data(),  vertexBufSize);
-  m_pCopyHelper->UpdateBuffer(m_geoIdxBuf,  0, indices.data(), indexBufSize);
+  GetCopyHelper()->UpdateBuffer(m_geoVertBuf, 0, vertices.data(),  vertexBufSize);
+  GetCopyHelper()->UpdateBuffer(m_geoIdxBuf,  0, indices.data(), indexBufSize);
 }
 
 
@@ -118,9 +237,15 @@ uint32_t SceneManager::AddMeshFromData(cmesh::SimpleMesh &meshData)
 
   m_pMeshData->Append(meshData);
 
+  return AddMeshInfo(meshData.VerticesNum(), meshData.IndicesNum(),
+                     ComputeMeshBox(meshData.vPos4f.data(), meshData.VerticesNum()));
+}
+
+uint32_t SceneManager::AddMeshInfo(uint32_t a_vertNum, uint32_t a_indNum, const LiteMath::Box4f &a_box)
+{
   MeshInfo info;
-  info.m_vertNum = meshData.VerticesNum();
-  info.m_indNum  = meshData.IndicesNum();
+  info.m_vertNum = a_vertNum;
+  info.m_indNum  = a_indNum;
 
   info.m_vertexOffset = m_totalVertices;
   info.m_indexOffset  = m_totalIndices;
@@ -128,10 +253,11 @@ uint32_t SceneManager::AddMeshFromData(cmesh::SimpleMesh &meshData)
   info.m_vertexBufOffset = info.m_vertexOffset * m_pMeshData->SingleVertexSize();
   info.m_indexBufOffset  = info.m_indexOffset  * m_pMeshData->SingleIndexSize();
 
-  m_totalVertices += meshData.VerticesNum();
-  m_totalIndices  += meshData.IndicesNum();
+  m_totalVertices += a_vertNum;
+  m_totalIndices  += a_indNum;
 
   m_meshInfos.push_back(info);
+  m_meshBoxes.push_back(a_box);
 
   return m_meshInfos.size() - 1;
 }
@@ -157,48 +283,1037 @@ uint32_t SceneManager::InstanceMesh(const uint32_t meshId, const LiteMath::float
 void SceneManager::MarkInstance(const uint32_t instId)
 {
   assert(instId < m_instanceInfos.size());
-  m_instanceInfos[instId].renderMark = true;
+  auto &inst = m_instanceInfos[instId];
+  if(!inst.renderMark)
+  {
+    (inst.dynamic ? m_dynamicInstancesDirty : m_staticInstancesDirty) = true;
+    MarkSlotDirty(inst, SLOT_BOX_DIRTY);
+  }
+  inst.renderMark = true;
 }
 
 void SceneManager::UnmarkInstance(const uint32_t instId)
 {
   assert(instId < m_instanceInfos.size());
-  m_instanceInfos[instId].renderMark = false;
+  auto &inst = m_instanceInfos[instId];
+  if(inst.renderMark)
+  {
+    (inst.dynamic ? m_dynamicInstancesDirty : m_staticInstancesDirty) = true;
+    MarkSlotDirty(inst, SLOT_BOX_DIRTY);
+  }
+  inst.renderMark = false;
 }
 
-void SceneManager::LoadGeoDataOnGPU()
+void SceneManager::SetInstanceMatrix(const uint32_t instId, const LiteMath::float4x4 &matrix)
 {
-  VkDeviceSize vertexBufSize = m_pMeshData->VertexDataSize();
-  VkDeviceSize indexBufSize  = m_pMeshData->IndexDataSize();
-  VkDeviceSize infoBufSize   = m_meshInfos.size() * sizeof(uint32_t) * 2;
+  assert(instId < m_instanceInfos.size());
+  m_instanceMatrices[instId] = matrix;
+  (m_instanceInfos[instId].dynamic ? m_dynamicInstancesDirty : m_staticInstancesDirty) = true;
+  MarkSlotDirty(m_instanceInfos[instId], SLOT_BOX_DIRTY | SLOT_MATRIX_DIRTY);
+}
+
+void SceneManager::SetInstanceDynamic(const uint32_t instId, bool a_dynamic)
+{
+  assert(instId < m_instanceInfos.size());
+  auto &inst = m_instanceInfos[instId];
+  if(inst.dynamic == a_dynamic)
+    return;
+
+  // instance leaves one set of casters and joins the other, its box mark is changed
+  inst.dynamic            = a_dynamic;
+  m_staticInstancesDirty  = true;
+  m_dynamicInstancesDirty = true;
+  MarkSlotDirty(inst, SLOT_BOX_DIRTY);
+}
+
+void SceneManager::MarkSlotDirty(const InstanceInfo &a_inst, uint8_t a_flags)
+{
+  // instances which are not uploaded yet are written whole by UploadInstances
+  const size_t slot = a_inst.instBufOffset / sizeof(LiteMath::float4x4);
+  if(slot >= m_slotDirty.size())
+    return;
+  if(m_slotDirty[slot] == 0)
+    m_dirtySlots.push_back(static_cast<uint32_t>(slot));
+  m_slotDirty[slot] |= a_flags;
+}
+
+void SceneManager::RecordInstanceUpdatesCmd(VkCommandBuffer a_cmdBuff)
+{
+  if(m_dirtySlots.empty() || m_instanceBoxesBuffer == VK_NULL_HANDLE)
+    return;
+
+  std::sort(m_dirtySlots.begin(), m_dirtySlots.end());
+
+  std::vector<uint32_t> movedIds;
+  std::vector<LiteMath::Box4f> movedBoxes;
+  for(uint32_t slot : m_dirtySlots)
+  {
+    const auto &inst = m_instanceInfos[m_slotInstances[slot]];
+    auto &box = m_instanceBoxes[slot];
+    box = InstanceBox(inst, box.getStart());
+    if(m_slotDirty[slot] & SLOT_MATRIX_DIRTY)
+    {
+      movedIds.push_back(inst.inst_id);
+      movedBoxes.push_back(box);
+    }
+  }
+
+  // culling and drawing of frames still in flight read these buffers, they are written in submission order after them
+  VkMemoryBarrier memBarrier = {};
+  memBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBarrier.srcAccessMask = 0;
+  memBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+
+  // each run of consecutive slots with a_flag is written by one update, untouched slots between runs are skipped
+  auto forEachRun = [this](uint8_t a_flag, auto a_write) {
+    for(size_t i = 0; i < m_dirtySlots.size();)
+    {
+      if((m_slotDirty[m_dirtySlots[i]] & a_flag) == 0)
+      {
+        ++i;
+        continue;
+      }
+      size_t j = i + 1;
+      while(j < m_dirtySlots.size() && m_dirtySlots[j] == m_dirtySlots[j - 1] + 1 && (m_slotDirty[m_dirtySlots[j]] & a_flag) != 0)
+        ++j;
+      a_write(m_dirtySlots[i], static_cast<uint32_t>(j - i));
+      i = j;
+    }
+  };
+
+  forEachRun(SLOT_BOX_DIRTY, [this, a_cmdBuff](uint32_t a_first, uint32_t a_count) {
+    UpdateBufferCmd(a_cmdBuff, m_instanceBoxesBuffer, a_first * sizeof(LiteMath::Box4f), m_instanceBoxes.data() + a_first,
+                    a_count * sizeof(LiteMath::Box4f));
+  });
+
+  // matrices are kept by instance id, slots of a run are gathered first
+  std::vector<LiteMath::float4x4> matrices;
+  forEachRun(SLOT_MATRIX_DIRTY, [this, a_cmdBuff, &matrices](uint32_t a_first, uint32_t a_count) {
+    matrices.resize(a_count);
+    for(uint32_t i = 0; i < a_count; ++i)
+      matrices[i] = m_instanceMatrices[m_slotInstances[a_first + i]];
+    UpdateBufferCmd(a_cmdBuff, m_instanceMatricesBuffer, a_first * sizeof(LiteMath::float4x4), matrices.data(),
+                    a_count * sizeof(LiteMath::float4x4));
+  });
+
+  memBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                       1, &memBarrier, 0, nullptr, 0, nullptr);
+
+  // only nodes above moved instances are refitted
+  if(!movedIds.empty())
+    m_instanceBVH.Refit(movedIds, movedBoxes);
+
+  m_staticInstancesVersion  += m_staticInstancesDirty  ? 1 : 0;
+  m_dynamicInstancesVersion += m_dynamicInstancesDirty ? 1 : 0;
+  m_staticInstancesDirty  = false;
+  m_dynamicInstancesDirty = false;
+  for(uint32_t slot : m_dirtySlots)
+    m_slotDirty[slot] = 0;
+  m_dirtySlots.clear();
+}
 
-  m_geoVertBuf  = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_geoIdxBuf   = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_meshInfoBuf = vk_utils::createBuffer(m_device, infoBufSize,   VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+void SceneManager::BuildInstanceBVH(bool a_refit)
+{
+  std::vector<LiteMath::Box4f> boxes(m_instanceInfos.size());
+  for(const auto &inst : m_instanceInfos)
+    boxes[inst.inst_id] = m_instanceBoxes[inst.instBufOffset / sizeof(LiteMath::float4x4)];
 
-  VkMemoryAllocateFlags allocFlags {};
+  if(a_refit)
+    m_instanceBVH.Refit(boxes);
+  else
+    m_instanceBVH.Build(boxes);
+}
 
-  m_geoMemAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf}, allocFlags);
+LiteMath::Box4f SceneManager::InstanceBox(const InstanceInfo &a_inst, uint32_t a_drawId) const
+{
+  const auto &matrix  = m_instanceMatrices[a_inst.inst_id];
+  const bool resident = MeshResident(a_inst.mesh_id);
 
+  LiteMath::Box4f box;
+  if(resident)
+    box = TransformBox(matrix, m_meshBoxes[a_inst.mesh_id]);
+  else
+  {
+    // bounds of a mesh are unknown until it is read, meanwhile its instances are points in bvh and are never drawn
+    box.boxMin = matrix * LiteMath::float4(0.0f, 0.0f, 0.0f, 1.0f);
+    box.boxMax = box.boxMin;
+  }
+  box.setStart(a_drawId);
+  box.setCount(a_inst.renderMark && resident ? INSTANCE_RENDERED | (a_inst.dynamic ? INSTANCE_DYNAMIC : 0) : 0);
+  return box;
+}
+
+void SceneManager::AllocateGeoBuffers(VkDeviceSize a_vertexBufSize, VkDeviceSize a_indexBufSize, VkDeviceSize a_infoBufSize)
+{
+  m_geoVertBuf  = vk_utils::createBuffer(m_device, a_vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_geoIdxBuf   = vk_utils::createBuffer(m_device, a_indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_meshInfoBuf = vk_utils::createBuffer(m_device, a_infoBufSize,   VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+  const std::vector<VkBuffer> buffers = {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf};
+  if(m_directUpload)
+    m_geoMemAlloc = AllocateAndBindMapped(m_device, buffers, m_unifiedMemType, m_geoMapped);
+  if(m_geoMemAlloc == VK_NULL_HANDLE)
+  {
+    VkMemoryAllocateFlags allocFlags {};
+    m_geoMemAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, buffers, allocFlags);
+  }
+}
+
+void SceneManager::UploadMeshInfos()
+{
   std::vector<LiteMath::uint2> mesh_info_tmp;
   for(const auto& m : m_meshInfos)
   {
     mesh_info_tmp.emplace_back(m.m_indexOffset, m.m_vertexOffset);
   }
 
-  m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0, m_pMeshData->VertexData(), vertexBufSize);
-  m_pCopyHelper->UpdateBuffer(m_geoIdxBuf,  0, m_pMeshData->IndexData(), indexBufSize);
   if(!mesh_info_tmp.empty())
-    m_pCopyHelper->UpdateBuffer(m_meshInfoBuf,  0, mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
+    WriteBuffer(m_meshInfoBuf, 0, mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
+}
+
+void SceneManager::UploadInstances()
+{
+  if(m_instanceInfos.empty())
+    return;
+
+  // instances are grouped by mesh, so all instances of a mesh are drawn with a single instanced draw
+  std::vector<uint32_t> order(m_instanceInfos.size());
+  for(uint32_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return m_instanceInfos[a].mesh_id < m_instanceInfos[b].mesh_id;
+  });
+
+  std::vector<LiteMath::float4x4> matrices(order.size());
+  m_instanceBoxes.resize(order.size());
+  m_slotInstances = order;
+  m_slotDirty.assign(order.size(), 0);
+  m_dirtySlots.clear();
+  m_meshDraws.clear();
+  uint32_t lastMeshId = UINT32_MAX;
+  for(uint32_t i = 0; i < order.size(); ++i)
+  {
+    auto &inst = m_instanceInfos[order[i]];
+    inst.instBufOffset = i * sizeof(LiteMath::float4x4);
+    matrices[i]        = m_instanceMatrices[inst.inst_id];
+
+    if(inst.mesh_id != lastMeshId)
+    {
+      const auto &mesh = m_meshInfos[inst.mesh_id];
+      VkDrawIndexedIndirectCommand draw = {};
+      draw.indexCount    = mesh.m_indNum;
+      draw.instanceCount = 0;
+      draw.firstIndex    = mesh.m_indexOffset;
+      draw.vertexOffset  = static_cast<int32_t>(mesh.m_vertexOffset);
+      draw.firstInstance = i;
+      m_meshDraws.push_back(draw);
+      lastMeshId = inst.mesh_id;
+    }
+    m_meshDraws.back().instanceCount++;
+
+    m_instanceBoxes[i] = InstanceBox(inst, static_cast<uint32_t>(m_meshDraws.size() - 1));
+  }
+  m_staticInstancesDirty  = false;
+  m_dynamicInstancesDirty = false;
+  ++m_staticInstancesVersion;
+  ++m_dynamicInstancesVersion;
+  BuildInstanceBVH(false);
+
+  // culling fills instance counts itself
+  std::vector<VkDrawIndexedIndirectCommand> emptyDraws = m_meshDraws;
+  for(auto &draw : emptyDraws)
+    draw.instanceCount = 0;
+
+  const VkDeviceSize matricesSize = matrices.size() * sizeof(matrices[0]);
+  const VkDeviceSize boxesSize    = m_instanceBoxes.size() * sizeof(m_instanceBoxes[0]);
+  const VkDeviceSize drawsSize    = emptyDraws.size() * sizeof(emptyDraws[0]);
+  m_instanceMatricesBuffer = vk_utils::createBuffer(m_device, matricesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_instanceBoxesBuffer    = vk_utils::createBuffer(m_device, boxesSize,    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_meshDrawsBuffer        = vk_utils::createBuffer(m_device, drawsSize,    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+  const std::vector<VkBuffer> buffers = {m_instanceMatricesBuffer, m_instanceBoxesBuffer, m_meshDrawsBuffer};
+  if(m_directUpload)
+    m_instancesAlloc = AllocateAndBindMapped(m_device, buffers, m_unifiedMemType, m_instancesMapped);
+  if(m_instancesAlloc == VK_NULL_HANDLE)
+  {
+    VkMemoryAllocateFlags allocFlags {};
+    m_instancesAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, buffers, allocFlags);
+  }
+
+  WriteBuffer(m_instanceMatricesBuffer, 0, matrices.data(), matricesSize);
+  WriteBuffer(m_instanceBoxesBuffer,    0, m_instanceBoxes.data(), boxesSize);
+  WriteBuffer(m_meshDrawsBuffer,        0, emptyDraws.data(), drawsSize);
+}
+
+void SceneManager::LoadGeoDataOnGPU()
+{
+  VkDeviceSize vertexBufSize = m_pMeshData->VertexDataSize();
+  VkDeviceSize indexBufSize  = m_pMeshData->IndexDataSize();
+  VkDeviceSize infoBufSize   = m_meshInfos.size() * sizeof(uint32_t) * 2;
+
+  AllocateGeoBuffers(vertexBufSize, indexBufSize, infoBufSize);
+
+  WriteBuffer(m_geoVertBuf, 0, m_pMeshData->VertexData(), vertexBufSize);
+  WriteBuffer(m_geoIdxBuf,  0, m_pMeshData->IndexData(), indexBufSize);
+  UploadMeshInfos();
+}
+
+bool SceneManager::AllocateGeoBuffersForMeshes(const std::vector<std::string> &a_meshLocs, std::vector<vsgf::Header> &a_headers)
+{
+  assert(m_meshInfos.empty());
+  if(a_meshLocs.empty())
+    return false;
+
+  // vsgf headers are enough to size geometry buffers before any mesh is decoded
+  a_headers.resize(a_meshLocs.size());
+  VkDeviceSize totalVertices = 0;
+  VkDeviceSize totalIndices  = 0;
+  for(size_t i = 0; i < a_meshLocs.size(); ++i)
+  {
+    if(!vsgf::ReadHeader(a_meshLocs[i], a_headers[i]))
+      RUN_TIME_ERROR(("can't load mesh at " + a_meshLocs[i]).c_str());
+
+    totalVertices += a_headers[i].verticesNum;
+    totalIndices  += a_headers[i].indicesNum;
+  }
+
+  AllocateGeoBuffers(totalVertices * m_pMeshData->SingleVertexSize(), totalIndices * m_pMeshData->SingleIndexSize(),
+                     a_meshLocs.size() * sizeof(uint32_t) * 2);
+
+  return true;
+}
+
+// same vertex layout and normal encoding as Mesh8F::Append
+static inline uint32_t EncodeNormal(const float* n)
+{
+  const int x = (int)(n[0] * 32767.0f);
+  const int y = (int)(n[1] * 32767.0f);
+
+  const uint32_t sign = (n[2] >= 0) ? 0 : 1;
+  const uint32_t sx   = ((uint32_t)(x & 0xfffe) | sign);
+  const uint32_t sy   = ((uint32_t)(y & 0xffff) << 16);
+
+  return (sx | sy);
+}
+
+static void PackVertices8F(const vsgf::MeshView &a_mesh, VkDeviceSize a_first, VkDeviceSize a_count, float* a_out)
+{
+  const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for(VkDeviceSize i = a_first; i < a_first + a_count; ++i, a_out += 8)
+  {
+    const float* pos  = a_mesh.pos4f + i * 4;
+    const float* tex  = a_mesh.texcoord2f + i * 2;
+    const float* norm = (a_mesh.norm4f != nullptr) ? a_mesh.norm4f + i * 4 : zero;
+    const float* tang = (a_mesh.tang4f != nullptr) ? a_mesh.tang4f + i * 4 : zero;
+
+    const uint32_t encodedNormal  = EncodeNormal(norm);
+    const uint32_t encodedTangent = EncodeNormal(tang);
+
+    a_out[0] = pos[0];
+    a_out[1] = pos[1];
+    a_out[2] = pos[2];
+    memcpy(a_out + 3, &encodedNormal, sizeof(float));
+    a_out[4] = tex[0];
+    a_out[5] = tex[1];
+    memcpy(a_out + 6, &encodedTangent, sizeof(float));
+    a_out[7] = 0.0f;
+  }
+}
+
+// view of a decoded mesh, so it is packed the same way as memory mapped ones
+static vsgf::MeshView GetMeshView(const cmesh::SimpleMesh &a_mesh)
+{
+  vsgf::MeshView view;
+  view.header.verticesNum = static_cast<uint32_t>(a_mesh.VerticesNum());
+  view.header.indicesNum  = static_cast<uint32_t>(a_mesh.IndicesNum());
+  view.pos4f      = a_mesh.vPos4f.data();
+  view.norm4f     = a_mesh.vNorm4f.empty() ? nullptr : a_mesh.vNorm4f.data();
+  view.tang4f     = a_mesh.vTang4f.empty() ? nullptr : a_mesh.vTang4f.data();
+  view.texcoord2f = a_mesh.vTexCoord2f.data();
+  view.indices    = a_mesh.indices.data();
+  return view;
 }
 
-void SceneManager::DrawMarkedInstances()
+void SceneManager::LoadMeshesStreaming(const std::vector<std::string> &a_meshLocs, std::vector<uint32_t> &a_meshIds)
 {
+  std::vector<vsgf::Header> headers;
+  if(!AllocateGeoBuffersForMeshes(a_meshLocs, headers))
+    return;
+
+  const uint32_t meshesNum = static_cast<uint32_t>(a_meshLocs.size());
+  const VkDeviceSize vertexSize = m_pMeshData->SingleVertexSize();
+  const VkDeviceSize indexSize  = m_pMeshData->SingleIndexSize();
+  assert(vertexSize == 8 * sizeof(float) && indexSize == sizeof(uint32_t));
+
+  // workers decode meshes in any order, calling thread packs and uploads them strictly in scene order,
+  // so the result is the same as for the serial path. decoded meshes are released right after upload
+  const uint32_t threadsNum  = std::min(m_loaderThreadsNum, meshesNum);
+  const uint32_t maxInFlight = 2 * threadsNum; // limits memory taken by decoded meshes which are not uploaded yet
+
+  std::vector<cmesh::SimpleMesh> decoded(meshesNum);
+  std::vector<uint8_t> ready(meshesNum, 0);
+  uint32_t nextJob  = 0;
+  uint32_t consumed = 0;
+  std::mutex mtx;
+  std::condition_variable cvReady;
+  std::condition_variable cvSlot;
+
+  auto worker = [&]() {
+    while(true)
+    {
+      uint32_t job = 0;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        cvSlot.wait(lock, [&]() { return nextJob >= meshesNum || nextJob < consumed + maxInFlight; });
+        if(nextJob >= meshesNum)
+          return;
+        job = nextJob++;
+      }
+
+      // a mesh which can't be decoded stays empty and is reported as failed by calling thread
+      cmesh::SimpleMesh mesh;
+      try
+      {
+        mesh = cmesh::LoadMeshFromVSGF(a_meshLocs[job].c_str());
+      }
+      catch(...)
+      {
+      }
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        decoded[job] = std::move(mesh);
+        ready[job]   = 1;
+      }
+      cvReady.notify_all();
+    }
+  };
+
+  // workers are stopped and joined on every way out, including exceptions of uploads,
+  // destroying joinable threads would call std::terminate
+  std::vector<std::thread> workers;
+  auto stopWorkers = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      nextJob = meshesNum;
+    }
+    cvSlot.notify_all();
+    for(auto &t : workers)
+    {
+      if(t.joinable())
+        t.join();
+    }
+  };
+  struct WorkersGuard
+  {
+    decltype(stopWorkers) &stop;
+    ~WorkersGuard() { stop(); }
+  } workersGuard {stopWorkers};
+
+  workers.reserve(threadsNum);
+  for(uint32_t i = 0; i < threadsNum; ++i)
+    workers.emplace_back(worker);
+
+  if(m_geoMapped.empty())
+    CreateStaging(16 * 1024 * 1024);
+
+  for(uint32_t i = 0; i < meshesNum; ++i)
+  {
+    cmesh::SimpleMesh decodedMesh;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cvReady.wait(lock, [&]() { return ready[i] != 0; });
+      decodedMesh = std::move(decoded[i]);
+      consumed    = i + 1;
+    }
+    cvSlot.notify_all();
 
+    if(decodedMesh.VerticesNum() != headers[i].verticesNum || decodedMesh.IndicesNum() != headers[i].indicesNum)
+    {
+      stopWorkers();
+      DestroyStaging();
+      RUN_TIME_ERROR(("can't load mesh at " + a_meshLocs[i]).c_str());
+    }
+
+    const vsgf::MeshView mesh = GetMeshView(decodedMesh);
+    a_meshIds[i] = AddMeshInfo(mesh.header.verticesNum, mesh.header.indicesNum,
+                               ComputeMeshBox(mesh.pos4f, mesh.header.verticesNum));
+    const auto &info = m_meshInfos[a_meshIds[i]];
+
+    UploadThroughStaging(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+      [&mesh](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) {
+        PackVertices8F(mesh, a_first, a_count, static_cast<float*>(a_dst));
+      });
+    UploadThroughStaging(m_geoIdxBuf, info.m_indexBufOffset, info.m_indNum, indexSize,
+      [&mesh](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) {
+        memcpy(a_dst, mesh.indices + a_first, a_count * sizeof(uint32_t));
+      });
+    // staging memory is filled synchronously, decoded mesh is released here
+  }
+
+  WaitStaging();
+  DestroyStaging();
+}
+
+bool SceneManager::LoadSceneCache(const std::string &a_scenePath, bool a_transpose)
+{
+  assert(m_meshInfos.empty());
+
+  MappedFile file;
+  scene_cache::SceneView scene;
+  if(!file.Open(m_sceneCachePath) || !scene_cache::GetSceneView(file.Data(), file.Size(), scene))
+    return false;
+
+  uint64_t key = 0;
+  if(!scene_cache::ComputeKey(a_scenePath, scene.chunkPaths, a_transpose ? 1 : 0, key) || key != scene.header.key ||
+     scene.header.vertexSize != m_pMeshData->SingleVertexSize())
+    return false;
+
+  for(uint32_t i = 0; i < scene.header.meshesNum; ++i)
+  {
+    const float* box = scene.meshBoxes + i * 8;
+    AddMeshInfo(scene.meshSizes[i * 2 + 0], scene.meshSizes[i * 2 + 1],
+                LiteMath::Box4f(LiteMath::float4(box[0], box[1], box[2], box[3]), LiteMath::float4(box[4], box[5], box[6], box[7])));
+  }
+
+  AllocateGeoBuffers(scene.header.vertexDataSize, scene.header.indexDataSize, m_meshInfos.size() * sizeof(uint32_t) * 2);
+
+  auto copyFrom = [](const uint8_t* a_src) {
+    return [a_src](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) { memcpy(a_dst, a_src + a_first, a_count); };
+  };
+  if(m_geoMapped.empty())
+    CreateStaging(16 * 1024 * 1024);
+  UploadThroughStaging(m_geoVertBuf, 0, scene.header.vertexDataSize, 1, copyFrom(scene.vertexData));
+  UploadThroughStaging(m_geoIdxBuf,  0, scene.header.indexDataSize,  1, copyFrom(scene.indexData));
+  DestroyStaging();
+
+  for(uint32_t i = 0; i < scene.header.instancesNum; ++i)
+  {
+    LiteMath::float4x4 matrix;
+    memcpy(static_cast<void*>(&matrix), scene.instMatrices + i * 16, sizeof(matrix));
+    InstanceMesh(scene.instMeshIds[i], matrix);
+  }
+
+  UploadMeshInfos();
+  UploadInstances();
+
+  return true;
+}
+
+void SceneManager::WriteSceneCache(const std::string &a_scenePath, const std::vector<std::string> &a_meshLocs, bool a_transpose)
+{
+  static_assert(sizeof(LiteMath::float4x4) == sizeof(float) * 16, "instance matrices are written as 16 floats");
+  if(m_meshInfos.empty() || m_meshInfos.size() != a_meshLocs.size() || m_totalVertices == 0)
+    return;
+
+  const VkDeviceSize vertexSize = m_pMeshData->SingleVertexSize();
+  const VkDeviceSize indexSize  = m_pMeshData->SingleIndexSize();
+  assert(vertexSize == 8 * sizeof(float) && indexSize == sizeof(uint32_t));
+
+  // geometry is packed again from memory mapped mesh files, so it doesn't have to stay in host memory after upload.
+  // mesh ids are the same as indices of a_meshLocs for every loading path that writes cache
+  MappedFile file;
+  auto openMesh = [&](size_t a_meshId, vsgf::MeshView &a_mesh) {
+    const auto &info = m_meshInfos[a_meshId];
+    return file.Open(a_meshLocs[a_meshId]) && vsgf::GetMeshView(file.Data(), file.Size(), a_mesh) &&
+           a_mesh.header.verticesNum == info.m_vertNum && a_mesh.header.indicesNum == info.m_indNum;
+  };
+
+  scene_cache::SceneData scene;
+  scene.chunkPaths     = a_meshLocs;
+  scene.vertexSize     = static_cast<uint32_t>(vertexSize);
+  scene.instMatrices   = reinterpret_cast<const float*>(m_instanceMatrices.data());
+  scene.vertexDataSize = m_totalVertices * vertexSize;
+  scene.indexDataSize  = m_totalIndices * indexSize;
+  scene.writeVertices  = [&](const scene_cache::WriteFunc &a_write) {
+    constexpr VkDeviceSize CHUNK_VERTICES = 64 * 1024;
+    std::vector<float> packed(CHUNK_VERTICES * 8);
+    for(size_t i = 0; i < m_meshInfos.size(); ++i)
+    {
+      vsgf::MeshView mesh;
+      if(!openMesh(i, mesh))
+        return false;
+      for(VkDeviceSize first = 0; first < mesh.header.verticesNum; first += CHUNK_VERTICES)
+      {
+        const VkDeviceSize count = std::min<VkDeviceSize>(CHUNK_VERTICES, mesh.header.verticesNum - first);
+        PackVertices8F(mesh, first, count, packed.data());
+        a_write(packed.data(), count * vertexSize);
+      }
+      file.Close();
+    }
+    return true;
+  };
+  scene.writeIndices   = [&](const scene_cache::WriteFunc &a_write) {
+    for(size_t i = 0; i < m_meshInfos.size(); ++i)
+    {
+      vsgf::MeshView mesh;
+      if(!openMesh(i, mesh))
+        return false;
+      a_write(mesh.indices, mesh.header.indicesNum * indexSize);
+      file.Close();
+    }
+    return true;
+  };
+  for(const auto &info : m_meshInfos)
+  {
+    scene.meshSizes.push_back(info.m_vertNum);
+    scene.meshSizes.push_back(info.m_indNum);
+  }
+  for(const auto &box : m_meshBoxes)
+  {
+    for(int i = 0; i < 4; ++i)
+      scene.meshBoxes.push_back(box.boxMin[i]);
+    for(int i = 0; i < 4; ++i)
+      scene.meshBoxes.push_back(box.boxMax[i]);
+  }
+  for(const auto &info : m_instanceInfos)
+    scene.instMeshIds.push_back(info.mesh_id);
+
+  uint64_t key = 0;
+  if(!scene_cache::ComputeKey(a_scenePath, a_meshLocs, a_transpose ? 1 : 0, key) ||
+     !scene_cache::Write(m_sceneCachePath, key, scene))
+    std::cout << "can't write scene cache to " << m_sceneCachePath << std::endl;
+}
+
+void SceneManager::LoadMeshesMapped(const std::vector<std::string> &a_meshLocs, std::vector<uint32_t> &a_meshIds)
+{
+  std::vector<vsgf::Header> headers;
+  if(!AllocateGeoBuffersForMeshes(a_meshLocs, headers))
+    return;
+
+  const VkDeviceSize vertexSize = m_pMeshData->SingleVertexSize();
+  const VkDeviceSize indexSize  = m_pMeshData->SingleIndexSize();
+  assert(vertexSize == 8 * sizeof(float) && indexSize == sizeof(uint32_t));
+
+  if(m_geoMapped.empty())
+    CreateStaging(16 * 1024 * 1024);
+
+  MappedFile file;
+  for(size_t i = 0; i < a_meshLocs.size(); ++i)
+  {
+    vsgf::MeshView mesh;
+    if(!file.Open(a_meshLocs[i]) || !vsgf::GetMeshView(file.Data(), file.Size(), mesh) ||
+       mesh.header.verticesNum != headers[i].verticesNum || mesh.header.indicesNum != headers[i].indicesNum)
+    {
+      DestroyStaging();
+      RUN_TIME_ERROR(("can't load mesh at " + a_meshLocs[i]).c_str());
+    }
+
+    a_meshIds[i] = AddMeshInfo(mesh.header.verticesNum, mesh.header.indicesNum,
+                               ComputeMeshBox(mesh.pos4f, mesh.header.verticesNum));
+    const auto &info = m_meshInfos[a_meshIds[i]];
+
+    UploadThroughStaging(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+      [&mesh](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) {
+        PackVertices8F(mesh, a_first, a_count, static_cast<float*>(a_dst));
+      });
+    UploadThroughStaging(m_geoIdxBuf, info.m_indexBufOffset, info.m_indNum, indexSize,
+      [&mesh](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) {
+        memcpy(a_dst, mesh.indices + a_first, a_count * sizeof(uint32_t));
+      });
+
+    // staging memory is filled synchronously, so file can be unmapped before copies are finished
+    file.Close();
+  }
+
+  WaitStaging();
+  DestroyStaging();
+}
+
+static VkBufferMemoryBarrier OwnershipBarrier(VkBuffer a_buffer, VkDeviceSize a_offset, VkDeviceSize a_size,
+                                              uint32_t a_srcQId, uint32_t a_dstQId,
+                                              VkAccessFlags a_srcAccess, VkAccessFlags a_dstAccess)
+{
+  // release and acquire barriers of a range must have the same buffer, offset, size and queue families
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask       = a_srcAccess;
+  barrier.dstAccessMask       = a_dstAccess;
+  barrier.srcQueueFamilyIndex = a_srcQId;
+  barrier.dstQueueFamilyIndex = a_dstQId;
+  barrier.buffer              = a_buffer;
+  barrier.offset              = a_offset;
+  barrier.size                = a_size;
+  return barrier;
+}
+
+void SceneManager::StartAsyncUpload(const std::vector<std::string> &a_meshLocs, std::vector<uint32_t> &a_meshIds)
+{
+  std::vector<vsgf::Header> headers;
+  if(!AllocateGeoBuffersForMeshes(a_meshLocs, headers))
+    return;
+
+  // sizes from headers are enough for mesh infos and draws, boxes are filled in as meshes arrive
+  for(size_t i = 0; i < a_meshLocs.size(); ++i)
+    a_meshIds[i] = AddMeshInfo(headers[i].verticesNum, headers[i].indicesNum, LiteMath::Box4f());
+
+  m_residentMeshes  = 0;
+  m_uploadMeshesNum = static_cast<uint32_t>(m_meshInfos.size());
+  m_uploadBoxes.assign(m_uploadMeshesNum, LiteMath::Box4f());
+  m_uploadFailed.assign(m_uploadMeshesNum, 0);
+  m_failedMeshes.assign(m_uploadMeshesNum, 0);
+  m_stopUpload      = false;
+
+  VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+  typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+  typeInfo.initialValue  = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_uploadSemaphore));
+
+  if(m_geoMapped.empty())
+    CreateStaging(16 * 1024 * 1024);
+}
+
+void SceneManager::UploadMeshesAsync(const std::vector<std::string> &a_meshLocs, const std::vector<MeshInfo> &a_meshInfos)
+{
+  const VkDeviceSize vertexSize = m_pMeshData->SingleVertexSize();
+  const VkDeviceSize indexSize  = m_pMeshData->SingleIndexSize();
+  assert(vertexSize == 8 * sizeof(float) && indexSize == sizeof(uint32_t));
+
+  auto signalUploaded = [this](uint64_t a_value) {
+    VkSemaphoreSignalInfoKHR signalInfo = {};
+    signalInfo.sType     = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR;
+    signalInfo.semaphore = m_uploadSemaphore;
+    signalInfo.value     = a_value;
+    VK_CHECK_RESULT(vkSignalSemaphoreKHR(m_device, &signalInfo));
+  };
+
+  // the same packing as LoadMeshesMapped, but the last copy of each mesh releases its ranges to graphics queue
+  // and signals the number of uploaded meshes
+  MappedFile file;
+  for(uint32_t i = 0; i < a_meshLocs.size() && !m_stopUpload; ++i)
+  {
+    const auto &info = a_meshInfos[i];
+    vsgf::MeshView mesh;
+    if(!file.Open(a_meshLocs[i]) || !vsgf::GetMeshView(file.Data(), file.Size(), mesh) ||
+       mesh.header.verticesNum != info.m_vertNum || mesh.header.indicesNum != info.m_indNum)
+    {
+      // mesh is counted as uploaded but marked failed, its instances are never drawn and nothing is acquired for it.
+      // host signal must not overtake signals of copies still in flight on transfer queue
+      std::cout << "can't load mesh at " << a_meshLocs[i] << ", its instances are not drawn" << std::endl;
+      file.Close();
+      {
+        std::lock_guard<std::mutex> lock(m_uploadMutex);
+        m_uploadFailed[i] = 1;
+      }
+      WaitStaging();
+      signalUploaded(i + 1);
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_uploadMutex);
+      m_uploadBoxes[i] = ComputeMeshBox(mesh.pos4f, mesh.header.verticesNum);
+    }
+
+    if(!m_geoMapped.empty())
+    {
+      // mapped device memory, mesh is packed in place and there is nothing to copy or release on transfer queue
+      PackVertices8F(mesh, 0, info.m_vertNum, reinterpret_cast<float*>(static_cast<uint8_t*>(m_geoMapped[0]) + info.m_vertexBufOffset));
+      memcpy(static_cast<uint8_t*>(m_geoMapped[1]) + info.m_indexBufOffset, mesh.indices, info.m_indNum * indexSize);
+      file.Close();
+      signalUploaded(i + 1);
+      continue;
+    }
+
+    StagingRelease release;
+    release.signalValue = i + 1;
+    release.barriers.push_back(OwnershipBarrier(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum * vertexSize,
+                                                m_transferQId, m_graphicsQId, VK_ACCESS_TRANSFER_WRITE_BIT, 0));
+    release.barriers.push_back(OwnershipBarrier(m_geoIdxBuf, info.m_indexBufOffset, info.m_indNum * indexSize,
+                                                m_transferQId, m_graphicsQId, VK_ACCESS_TRANSFER_WRITE_BIT, 0));
+
+    UploadThroughStaging(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+      [&mesh](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) {
+        PackVertices8F(mesh, a_first, a_count, static_cast<float*>(a_dst));
+      });
+    UploadThroughStaging(m_geoIdxBuf, info.m_indexBufOffset, info.m_indNum, indexSize,
+      [&mesh](void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count) {
+        memcpy(a_dst, mesh.indices + a_first, a_count * sizeof(uint32_t));
+      }, &release);
+
+    file.Close();
+  }
+
+  DestroyStaging();
+}
+
+void SceneManager::StopAsyncUpload()
+{
+  m_stopUpload = true;
+  if(m_uploadThread.joinable())
+    m_uploadThread.join();
+
+  m_residentMeshes  = 0;
+  m_uploadMeshesNum = 0;
+  m_uploadBoxes.clear();
+  m_uploadFailed.clear();
+  m_failedMeshes.clear();
+
+  // submits of upload thread are finished once staging is destroyed, graphics queue may still wait on the semaphore
+  if(m_uploadSemaphore != VK_NULL_HANDLE)
+  {
+    VK_CHECK_RESULT(vkDeviceWaitIdle(m_device));
+    vkDestroySemaphore(m_device, m_uploadSemaphore, nullptr);
+    m_uploadSemaphore = VK_NULL_HANDLE;
+  }
+}
+
+uint64_t SceneManager::RecordUploadsCmd(VkCommandBuffer a_cmdBuff)
+{
+  if(UploadFinished())
+    return 0;
+
+  uint64_t uploaded = 0;
+  VK_CHECK_RESULT(vkGetSemaphoreCounterValueKHR(m_device, m_uploadSemaphore, &uploaded));
+  const uint32_t firstMesh = m_residentMeshes;
+  const uint32_t lastMesh  = static_cast<uint32_t>(std::min<uint64_t>(uploaded, m_uploadMeshesNum));
+  if(lastMesh <= firstMesh)
+    return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(m_uploadMutex);
+    for(uint32_t i = firstMesh; i < lastMesh; ++i)
+    {
+      m_meshBoxes[i]    = m_uploadBoxes[i];
+      m_failedMeshes[i] = m_uploadFailed[i];
+    }
+  }
+  m_residentMeshes = lastMesh;
+
+  // acquire barriers mirror release barriers recorded on transfer queue, mapped geometry is written on host
+  const VkDeviceSize vertexSize = m_pMeshData->SingleVertexSize();
+  const VkDeviceSize indexSize  = m_pMeshData->SingleIndexSize();
+  std::vector<VkBufferMemoryBarrier> acquire;
+  acquire.reserve(2 * (lastMesh - firstMesh));
+  for(uint32_t i = firstMesh; i < lastMesh && m_geoMapped.empty(); ++i)
+  {
+    if(m_failedMeshes[i])
+      continue; // nothing was released for it
+    const auto &info = m_meshInfos[i];
+    acquire.push_back(OwnershipBarrier(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum * vertexSize,
+                                       m_transferQId, m_graphicsQId, 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT));
+    acquire.push_back(OwnershipBarrier(m_geoIdxBuf, info.m_indexBufOffset, info.m_indNum * indexSize,
+                                       m_transferQId, m_graphicsQId, 0, VK_ACCESS_INDEX_READ_BIT));
+  }
+  if(!acquire.empty())
+    vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                         0, nullptr, static_cast<uint32_t>(acquire.size()), acquire.data(), 0, nullptr);
+
+  // instances are sorted by mesh, so instances of new meshes take a single range of slots
+  size_t firstSlot = m_instanceBoxes.size();
+  size_t lastSlot  = 0;
+  bool newStatic   = false;
+  bool newDynamic  = false;
+  for(const auto &inst : m_instanceInfos)
+  {
+    if(inst.mesh_id < firstMesh || inst.mesh_id >= lastMesh)
+      continue;
+    const size_t slot = inst.instBufOffset / sizeof(LiteMath::float4x4);
+    m_instanceBoxes[slot] = InstanceBox(inst, m_instanceBoxes[slot].getStart());
+    firstSlot = std::min(firstSlot, slot);
+    lastSlot  = std::max(lastSlot, slot + 1);
+    newStatic  = newStatic  || !inst.dynamic;
+    newDynamic = newDynamic ||  inst.dynamic;
+  }
+  // instances of new meshes are drawn from now on
+  m_staticInstancesVersion  += newStatic  ? 1 : 0;
+  m_dynamicInstancesVersion += newDynamic ? 1 : 0;
+
+  if(firstSlot < lastSlot)
+  {
+    // culling of previous frames reads boxes
+    VkMemoryBarrier memBarrier = {};
+    memBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memBarrier.srcAccessMask = 0;
+    memBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &memBarrier, 0, nullptr, 0, nullptr);
+
+    UpdateBufferCmd(a_cmdBuff, m_instanceBoxesBuffer, firstSlot * sizeof(LiteMath::Box4f), m_instanceBoxes.data() + firstSlot,
+                    (lastSlot - firstSlot) * sizeof(LiteMath::Box4f));
+
+    memBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &memBarrier, 0, nullptr, 0, nullptr);
+  }
+
+  // refit keeps tree built over placeholder points, it is rebuilt when the whole scene is resident
+  BuildInstanceBVH(!UploadFinished());
+
+  return lastMesh;
+}
+
+void SceneManager::CreateStaging(VkDeviceSize a_size)
+{
+  m_stagingPartSize = a_size / 2;
+
+  VkMemoryRequirements memReq;
+  m_stagingBuf = vk_utils::createBuffer(m_device, a_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.pNext           = nullptr;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                          m_physDevice);
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_stagingMem));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_stagingBuf, m_stagingMem, 0));
+  VK_CHECK_RESULT(vkMapMemory(m_device, m_stagingMem, 0, a_size, 0, &m_stagingMapped));
+
+  m_stagingCmdPool = vk_utils::createCommandPool(m_device, m_transferQId, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  auto cmdBufs     = vk_utils::createCommandBuffers(m_device, m_stagingCmdPool, 2);
+
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for(uint32_t i = 0; i < 2; ++i)
+  {
+    m_stagingParts[i].cmdBuf = cmdBufs[i];
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_stagingParts[i].fence));
+  }
+  m_currStagingPart = 0;
+}
+
+void SceneManager::UploadThroughStaging(VkBuffer a_dst, VkDeviceSize a_dstOffset, VkDeviceSize a_elemsNum,
+                                        VkDeviceSize a_elemSize, const StagingFillFunc &a_fill,
+                                        const StagingRelease *a_release)
+{
+  if(void* mapped = MappedAddress(a_dst))
+  {
+    // destination is mapped device memory, it is filled in place
+    assert(a_release == nullptr);
+    a_fill(static_cast<uint8_t*>(mapped) + a_dstOffset, 0, a_elemsNum);
+    return;
+  }
+
+  const VkDeviceSize elemsPerPart = m_stagingPartSize / a_elemSize;
+  assert(elemsPerPart > 0);
+  assert(a_release == nullptr || a_elemsNum > 0);
+
+  for(VkDeviceSize first = 0; first < a_elemsNum; first += elemsPerPart)
+  {
+    const VkDeviceSize count = std::min(elemsPerPart, a_elemsNum - first);
+    auto &part = m_stagingParts[m_currStagingPart];
+
+    VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &part.fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK_RESULT(vkResetFences(m_device, 1, &part.fence));
+
+    const VkDeviceSize stagingOffset = m_currStagingPart * m_stagingPartSize;
+    a_fill(static_cast<uint8_t*>(m_stagingMapped) + stagingOffset, first, count);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(part.cmdBuf, 0);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(part.cmdBuf, &beginInfo));
+    VkBufferCopy region = {};
+    region.srcOffset = stagingOffset;
+    region.dstOffset = a_dstOffset + first * a_elemSize;
+    region.size      = count * a_elemSize;
+    vkCmdCopyBuffer(part.cmdBuf, m_stagingBuf, a_dst, 1, &region);
+
+    const bool lastCopy = first + count >= a_elemsNum;
+    if(lastCopy && a_release != nullptr && !a_release->barriers.empty())
+      vkCmdPipelineBarrier(part.cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                           static_cast<uint32_t>(a_release->barriers.size()), a_release->barriers.data(), 0, nullptr);
+    VK_CHECK_RESULT(vkEndCommandBuffer(part.cmdBuf));
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers    = &part.cmdBuf;
+
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+    if(lastCopy && a_release != nullptr && a_release->signalValue > 0)
+    {
+      timelineInfo.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+      timelineInfo.signalSemaphoreValueCount = 1;
+      timelineInfo.pSignalSemaphoreValues    = &a_release->signalValue;
+      submitInfo.pNext                       = &timelineInfo;
+      submitInfo.signalSemaphoreCount        = 1;
+      submitInfo.pSignalSemaphores           = &m_uploadSemaphore;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_transferQMutex);
+      VK_CHECK_RESULT(vkQueueSubmit(m_transferQ, 1, &submitInfo, part.fence));
+    }
+
+    m_currStagingPart = 1 - m_currStagingPart;
+  }
+}
+
+void SceneManager::WaitStaging()
+{
+  for(auto &part : m_stagingParts)
+  {
+    if(part.fence != VK_NULL_HANDLE)
+      VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &part.fence, VK_TRUE, UINT64_MAX));
+  }
+}
+
+void SceneManager::DestroyStaging()
+{
+  WaitStaging();
+
+  for(auto &part : m_stagingParts)
+  {
+    if(part.fence != VK_NULL_HANDLE)
+    {
+      vkDestroyFence(m_device, part.fence, nullptr);
+      part.fence = VK_NULL_HANDLE;
+    }
+    part.cmdBuf = VK_NULL_HANDLE;
+  }
+
+  if(m_stagingCmdPool != VK_NULL_HANDLE)
+  {
+    vkDestroyCommandPool(m_device, m_stagingCmdPool, nullptr);
+    m_stagingCmdPool = VK_NULL_HANDLE;
+  }
+
+  if(m_stagingBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_stagingBuf, nullptr);
+    m_stagingBuf = VK_NULL_HANDLE;
+  }
+
+  if(m_stagingMem != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_device, m_stagingMem, nullptr);
+    m_stagingMem    = VK_NULL_HANDLE;
+    m_stagingMapped = nullptr;
+  }
+}
+
+void SceneManager::DrawMarkedInstances(VkCommandBuffer a_cmdBuff, VkBuffer a_drawsBuffer, uint32_t a_firstDraw,
+                                       uint32_t a_drawsNum)
+{
+  // one indirect draw per mesh, so multiDrawIndirect feature is not required
+  const uint32_t stride  = sizeof(VkDrawIndexedIndirectCommand);
+  const uint32_t drawEnd = static_cast<uint32_t>(std::min<size_t>(m_meshDraws.size(), size_t(a_firstDraw) + a_drawsNum));
+  for(uint32_t i = a_firstDraw; i < drawEnd; ++i)
+    vkCmdDrawIndexedIndirect(a_cmdBuff, a_drawsBuffer, i * stride, 1, stride);
 }
 
 void SceneManager::DestroyScene()
 {
+  StopAsyncUpload();
+  DestroyStaging();
+
   if(m_geoVertBuf != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_geoVertBuf, nullptr);
@@ -223,16 +1338,47 @@ void SceneManager::DestroyScene()
     m_instanceMatricesBuffer = VK_NULL_HANDLE;
   }
 
+  if(m_instanceBoxesBuffer != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_instanceBoxesBuffer, nullptr);
+    m_instanceBoxesBuffer = VK_NULL_HANDLE;
+  }
+
+  if(m_meshDrawsBuffer != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_meshDrawsBuffer, nullptr);
+    m_meshDrawsBuffer = VK_NULL_HANDLE;
+  }
+
   if(m_geoMemAlloc != VK_NULL_HANDLE)
   {
     vkFreeMemory(m_device, m_geoMemAlloc, nullptr);
     m_geoMemAlloc = VK_NULL_HANDLE;
   }
 
+  if(m_instancesAlloc != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_device, m_instancesAlloc, nullptr);
+    m_instancesAlloc = VK_NULL_HANDLE;
+  }
+  m_geoMapped.clear();
+  m_instancesMapped.clear();
+
   m_pCopyHelper = nullptr;
 
   m_meshInfos.clear();
+  m_meshBoxes.clear();
   m_pMeshData = nullptr;
   m_instanceInfos.clear();
   m_instanceMatrices.clear();
+  m_meshDraws.clear();
+  m_instanceBoxes.clear();
+  m_slotInstances.clear();
+  m_slotDirty.clear();
+  m_dirtySlots.clear();
+  m_instanceBVH.Clear();
+
+  // versions are never repeated, so nothing drawn from the old scene is taken for the new one
+  ++m_staticInstancesVersion;
+  ++m_dynamicInstancesVersion;
 }
\ No newline at end of file
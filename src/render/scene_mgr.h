@@ -2,12 +2,19 @@
 #define CHIMERA_SCENE_MGR_H
 
 #include <vector>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include <geom/vk_mesh.h>
 #include "LiteMath.h"
 #include <vk_copy.h>
 
 #include "../resources/shaders/common.h"
+#include "../loader_utils/vsgf_utils.h"
+#include "instance_bvh.h"
 
 struct InstanceInfo
 {
@@ -15,6 +22,7 @@ struct InstanceInfo
   uint32_t mesh_id = 0u;
   VkDeviceSize instBufOffset = 0u;
   bool renderMark = false;
+  bool dynamic    = false;
 };
 
 struct SceneManager
@@ -26,6 +34,26 @@ struct SceneManager
   bool LoadSceneXML(const std::string &scenePath, bool transpose = true);
   void LoadSingleTriangle();
 
+  // 0 or 1 - meshes are decoded and uploaded serially, otherwise meshes are decoded on a pool of worker threads
+  // and each mesh is uploaded as soon as it is ready
+  void SetLoaderThreadsNum(uint32_t a_threadsNum) { m_loaderThreadsNum = a_threadsNum; }
+  // meshes are read from memory mapped files and packed straight into staging memory,
+  // so host memory used by loading doesn't grow with scene size
+  void SetMappedLoading(bool a_enable) { m_mappedLoading = a_enable; }
+  // binary cache with packed geometry and instances, it is written after a scene is loaded from xml
+  // and memory mapped instead of parsing xml and meshes while scene files stay unchanged
+  void SetSceneCachePath(const std::string &a_path) { m_sceneCachePath = a_path; }
+  // LoadSceneXML returns as soon as buffers are allocated, meshes are uploaded on transfer queue by a background thread
+  // and their instances are not rendered until RecordUploadsCmd acquires them on graphics queue.
+  // scene cache is not used, device must have VK_KHR_timeline_semaphore enabled and a separate transfer queue
+  void SetAsyncUpload(bool a_enable) { m_asyncUpload = a_enable; }
+  // if device local memory is host visible (integrated gpus, software implementations), scene buffers are allocated
+  // in it and written through mapped pointers without staging and copy commands. on by default, can be turned off
+  // before loading to compare load time and memory with staged uploads
+  void SetDirectUpload(bool a_enable) { m_directUpload = a_enable; }
+  // scene geometry was written to mapped device memory
+  bool GeometryMapped() const { return !m_geoMapped.empty(); }
+
   uint32_t AddMeshFromFile(const std::string& meshPath);
   uint32_t AddMeshFromData(cmesh::SimpleMesh &meshData);
 
@@ -33,8 +61,34 @@ struct SceneManager
 
   void MarkInstance(uint32_t instId);
   void UnmarkInstance(uint32_t instId);
-
-  void DrawMarkedInstances();
+  // moves loaded instance, it is applied to gpu buffers and instance bvh by RecordInstanceUpdatesCmd
+  void SetInstanceMatrix(uint32_t instId, const LiteMath::float4x4 &matrix);
+  // dynamic instances are expected to move often, so renders keep them out of cached data such as static shadow map.
+  // applied by RecordInstanceUpdatesCmd as well
+  void SetInstanceDynamic(uint32_t instId, bool a_dynamic);
+  // grow every time marks, matrices or residency of static or dynamic instances reach gpu buffers,
+  // anything drawn from these instances stays valid while the version is the same
+  uint64_t StaticInstancesVersion()  const { return m_staticInstancesVersion; }
+  uint64_t DynamicInstancesVersion() const { return m_dynamicInstancesVersion; }
+  // render marks, matrices or dynamic flags are changed since the last RecordInstanceUpdatesCmd
+  bool InstancesChanged() const { return !m_dirtySlots.empty(); }
+  // records writes of changed boxes and matrices to instance buffers and refits instance bvh above them,
+  // runs of consecutive changed slots are written by one vkCmdUpdateBuffer each. frames in flight may still
+  // read the buffers, the update is ordered after them by barriers. must be submitted to graphics queue before culling
+  void RecordInstanceUpdatesCmd(VkCommandBuffer a_cmdBuff);
+  // acquires meshes uploaded since the previous call and updates boxes of their instances, must be submitted
+  // to graphics queue before culling. returns value of GetUploadSemaphore that the submit has to wait for
+  // at VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0 if nothing was recorded
+  uint64_t RecordUploadsCmd(VkCommandBuffer a_cmdBuff);
+  // timeline semaphore of async upload, its value is the number of meshes copied on transfer queue
+  VkSemaphore GetUploadSemaphore() const { return m_uploadSemaphore; }
+  bool UploadFinished() const { return m_residentMeshes == m_uploadMeshesNum; }
+
+  // draws meshes with per mesh commands from a_drawsBuffer, which has the same layout as GetMeshDrawsBuffer,
+  // usually after instance counts were filled by culling of marked instances,
+  // a_firstDraw and a_drawsNum select a range of mesh draws, e.g. for recording a pass on several threads
+  void DrawMarkedInstances(VkCommandBuffer a_cmdBuff, VkBuffer a_drawsBuffer, uint32_t a_firstDraw = 0,
+                           uint32_t a_drawsNum = UINT32_MAX);
 
   void DestroyScene();
 
@@ -43,32 +97,136 @@ struct SceneManager
   VkBuffer GetVertexBuffer() const { return m_geoVertBuf; }
   VkBuffer GetIndexBuffer()  const { return m_geoIdxBuf; }
   VkBuffer GetMeshInfoBuffer()  const { return m_meshInfoBuf; }
-  std::shared_ptr<vk_utils::ICopyEngine> GetCopyHelper() { return  m_pCopyHelper; }
+  VkBuffer GetInstanceMatricesBuffer() const { return m_instanceMatricesBuffer; }
+  // world space bounding boxes of instances in the same order as matrices, as_uint(boxMin.w) is index of mesh draw
+  // and as_uint(boxMax.w) has INSTANCE_RENDERED and INSTANCE_DYNAMIC bits of common.h
+  VkBuffer GetInstanceBoxesBuffer() const { return m_instanceBoxesBuffer; }
+  // mesh draws with zero instance counts, to be copied to draw buffers before culling
+  VkBuffer GetMeshDrawsBuffer() const { return m_meshDrawsBuffer; }
+  // one instanced draw per mesh, firstInstance points to matrices of mesh instances in instance matrices buffer
+  const std::vector<VkDrawIndexedIndirectCommand>& GetMeshDraws() const { return m_meshDraws; }
+  // created on first use, scenes written to mapped device memory don't need its staging memory
+  std::shared_ptr<vk_utils::ICopyEngine> GetCopyHelper();
 
   uint32_t MeshesNum() const {return m_meshInfos.size();}
   uint32_t InstancesNum() const {return m_instanceInfos.size();}
 
   MeshInfo GetMeshInfo(uint32_t meshId) const {assert(meshId < m_meshInfos.size()); return m_meshInfos[meshId];}
+  LiteMath::Box4f GetMeshBox(uint32_t meshId) const {assert(meshId < m_meshBoxes.size()); return m_meshBoxes[meshId];}
+  // bvh over world space boxes of all instances, queries return instance ids
+  const InstanceBVH& GetInstanceBVH() const { return m_instanceBVH; }
   InstanceInfo GetInstanceInfo(uint32_t instId) const {assert(instId < m_instanceInfos.size()); return m_instanceInfos[instId];}
   LiteMath::float4x4 GetInstanceMatrix(uint32_t instId) const {assert(instId < m_instanceMatrices.size()); return m_instanceMatrices[instId];}
 
 private:
   void LoadGeoDataOnGPU();
+  void LoadMeshesStreaming(const std::vector<std::string> &a_meshLocs, std::vector<uint32_t> &a_meshIds);
+  void LoadMeshesMapped(const std::vector<std::string> &a_meshLocs, std::vector<uint32_t> &a_meshIds);
+  void StartAsyncUpload(const std::vector<std::string> &a_meshLocs, std::vector<uint32_t> &a_meshIds);
+  void UploadMeshesAsync(const std::vector<std::string> &a_meshLocs, const std::vector<MeshInfo> &a_meshInfos);
+  void StopAsyncUpload();
+  bool MeshResident(uint32_t a_meshId) const
+  {
+    return (a_meshId < m_residentMeshes || a_meshId >= m_uploadMeshesNum) &&
+           (a_meshId >= m_failedMeshes.size() || m_failedMeshes[a_meshId] == 0);
+  }
+  LiteMath::Box4f InstanceBox(const InstanceInfo &a_inst, uint32_t a_drawId) const;
+  void MarkSlotDirty(const InstanceInfo &a_inst, uint8_t a_flags);
+  void AllocateGeoBuffers(VkDeviceSize a_vertexBufSize, VkDeviceSize a_indexBufSize, VkDeviceSize a_infoBufSize);
+  bool AllocateGeoBuffersForMeshes(const std::vector<std::string> &a_meshLocs, std::vector<vsgf::Header> &a_headers);
+  void UploadMeshInfos();
+  void UploadInstances();
+  void BuildInstanceBVH(bool a_refit);
+  uint32_t AddMeshInfo(uint32_t a_vertNum, uint32_t a_indNum, const LiteMath::Box4f &a_box);
+  bool LoadSceneCache(const std::string &a_scenePath, bool a_transpose);
+  void WriteSceneCache(const std::string &a_scenePath, const std::vector<std::string> &a_meshLocs, bool a_transpose);
+
+  // a_fill writes elements [first, first + count) to staging memory
+  using StagingFillFunc = std::function<void(void* a_dst, VkDeviceSize a_first, VkDeviceSize a_count)>;
+  // recorded after the last copy of an upload: barriers release buffer ranges to graphics queue family
+  // and signalValue is signaled on upload timeline semaphore
+  struct StagingRelease
+  {
+    std::vector<VkBufferMemoryBarrier> barriers;
+    uint64_t signalValue = 0u;
+  };
+  void CreateStaging(VkDeviceSize a_size);
+  void DestroyStaging();
+  void UploadThroughStaging(VkBuffer a_dst, VkDeviceSize a_dstOffset, VkDeviceSize a_elemsNum, VkDeviceSize a_elemSize,
+                            const StagingFillFunc &a_fill, const StagingRelease *a_release = nullptr);
+  void WaitStaging();
+  // memcpy to mapped device memory if a_dst is allocated in it, copy helper otherwise
+  void WriteBuffer(VkBuffer a_dst, VkDeviceSize a_dstOffset, const void* a_src, VkDeviceSize a_size);
+  void* MappedAddress(VkBuffer a_buffer) const;
 
   std::vector<MeshInfo> m_meshInfos = {};
+  std::vector<LiteMath::Box4f> m_meshBoxes = {};
   std::shared_ptr<IMeshData> m_pMeshData = nullptr;
 
   std::vector<InstanceInfo> m_instanceInfos = {};
   std::vector<LiteMath::float4x4> m_instanceMatrices = {};
+  std::vector<VkDrawIndexedIndirectCommand> m_meshDraws = {};
+  std::vector<LiteMath::Box4f> m_instanceBoxes = {}; // in the same order as in instance boxes buffer
+  bool m_staticInstancesDirty  = false; // some of dirty marks or matrices belong to static or dynamic instances
+  bool m_dynamicInstancesDirty = false;
+  // slots of instance buffers changed since the last update, their SLOT_*_DIRTY flags and instance in every slot
+  static constexpr uint8_t SLOT_BOX_DIRTY    = 1u;
+  static constexpr uint8_t SLOT_MATRIX_DIRTY = 2u;
+  std::vector<uint32_t> m_dirtySlots;
+  std::vector<uint8_t>  m_slotDirty;
+  std::vector<uint32_t> m_slotInstances;
+  uint64_t m_staticInstancesVersion  = 0u;
+  uint64_t m_dynamicInstancesVersion = 0u;
+  InstanceBVH m_instanceBVH;
 
   uint32_t m_totalVertices = 0u;
   uint32_t m_totalIndices  = 0u;
 
+  uint32_t m_loaderThreadsNum = 0u;
+  bool     m_mappedLoading    = false;
+  std::string m_sceneCachePath;
+
+  // async upload, meshes [m_residentMeshes, m_uploadMeshesNum) are not acquired by graphics queue yet
+  bool        m_asyncUpload     = false;
+  uint32_t    m_residentMeshes  = 0u;
+  uint32_t    m_uploadMeshesNum = 0u;
+  VkSemaphore m_uploadSemaphore = VK_NULL_HANDLE;
+  std::thread m_uploadThread;
+  std::atomic<bool> m_stopUpload {false};
+  std::mutex  m_uploadMutex;                   // guards m_uploadBoxes and m_uploadFailed
+  std::vector<LiteMath::Box4f> m_uploadBoxes;  // computed by upload thread as meshes are read
+  std::vector<uint8_t> m_uploadFailed;         // set by upload thread for meshes it couldn't read
+  std::vector<uint8_t> m_failedMeshes;         // copy of m_uploadFailed for acquired meshes, used on render thread
+  std::mutex  m_transferQMutex;                // transfer queue is shared by upload thread and copy helper
+
+  // ping-pong staging buffer, one half is filled on host while the other one is copied on transfer queue
+  struct StagingPart
+  {
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    VkFence         fence  = VK_NULL_HANDLE;
+  };
+  VkBuffer       m_stagingBuf      = VK_NULL_HANDLE;
+  VkDeviceMemory m_stagingMem      = VK_NULL_HANDLE;
+  void*          m_stagingMapped   = nullptr;
+  VkDeviceSize   m_stagingPartSize = 0u;
+  VkCommandPool  m_stagingCmdPool  = VK_NULL_HANDLE;
+  StagingPart    m_stagingParts[2];
+  uint32_t       m_currStagingPart = 0u;
+
   VkBuffer m_geoVertBuf = VK_NULL_HANDLE;
   VkBuffer m_geoIdxBuf  = VK_NULL_HANDLE;
   VkBuffer m_meshInfoBuf  = VK_NULL_HANDLE;
   VkBuffer m_instanceMatricesBuffer = VK_NULL_HANDLE;
+  VkBuffer m_instanceBoxesBuffer = VK_NULL_HANDLE;
+  VkBuffer m_meshDrawsBuffer = VK_NULL_HANDLE;
   VkDeviceMemory m_geoMemAlloc = VK_NULL_HANDLE;
+  VkDeviceMemory m_instancesAlloc = VK_NULL_HANDLE;
+
+  // direct upload, addresses of buffers in the same order as they were bound, empty if memory isn't mapped
+  uint32_t m_unifiedMemType = UINT32_MAX;
+  bool     m_directUpload   = true;
+  std::vector<void*> m_geoMapped;       // vertices, indices, mesh infos
+  std::vector<void*> m_instancesMapped; // matrices, boxes, mesh draws
 
   VkDevice m_device = VK_NULL_HANDLE;
   VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
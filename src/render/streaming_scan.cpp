@@ -0,0 +1,250 @@
+#include "streaming_scan.h"
+#include "vk_utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+// all scan value types are 32 bit
+static constexpr VkDeviceSize VALUE_SIZE = sizeof(uint32_t);
+
+// copies chunk results adding running prefix of previous chunks and updates it
+template<typename T>
+static void AddCarry(const void* a_res, const void* a_in, void* a_out, uint32_t a_count, bool a_inclusive,
+                     uint32_t &a_carryBits)
+{
+  const T* res = static_cast<const T*>(a_res);
+  T*       out = static_cast<T*>(a_out);
+  T carry;
+  memcpy(&carry, &a_carryBits, sizeof(T));
+
+  // in and out may be the same array, so the last input is read first
+  T lastIn;
+  memcpy(&lastIn, static_cast<const T*>(a_in) + a_count - 1, sizeof(T));
+  const T lastRes = res[a_count - 1];
+
+  for(uint32_t i = 0; i < a_count; ++i)
+    out[i] = res[i] + carry;
+
+  carry = a_inclusive ? carry + lastRes : carry + lastRes + lastIn;
+  memcpy(&a_carryBits, &carry, sizeof(T));
+}
+
+StreamingScan::StreamingScan(VkDevice a_device, VkPhysicalDevice a_physicalDevice, GpuPrimitives &a_primitives,
+                             QueueInfo a_compute, QueueInfo a_transfer, ScanValueType a_type, uint32_t a_chunkLength,
+                             uint32_t a_slotsNum, uint32_t a_scanFlags) :
+  m_device(a_device), m_physicalDevice(a_physicalDevice), m_primitives(a_primitives), m_compute(a_compute),
+  m_transfer(a_transfer), m_type(a_type), m_chunkLength(std::max(a_chunkLength, 1u)),
+  m_scanFlags(a_scanFlags & GpuPrimitives::SCAN_INCLUSIVE)
+{
+  m_computePool  = vk_utils::createCommandPool(m_device, m_compute.familyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  m_transferPool = vk_utils::createCommandPool(m_device, m_transfer.familyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+  const VkDeviceSize chunkBytes = VkDeviceSize(m_chunkLength) * VALUE_SIZE;
+  m_slots.resize(std::max(a_slotsNum, 2u));
+  for(auto &slot : m_slots)
+  {
+    slot.upload   = CreateBuffer(chunkBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false);
+    slot.readback = CreateBuffer(chunkBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, false);
+    // chunk is copied on transfer queue and scanned on compute queue
+    slot.chunk    = CreateBuffer(chunkBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                             VK_BUFFER_USAGE_TRANSFER_DST_BIT, true);
+
+    const VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    slot.uploadMem   = AllocateAndBind(slot.upload, hostFlags, 0);
+    slot.readbackMem = AllocateAndBind(slot.readback, hostFlags, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    slot.chunkMem    = AllocateAndBind(slot.chunk, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    vkMapMemory(m_device, slot.uploadMem, 0, chunkBytes, 0, &slot.uploadPtr);
+    vkMapMemory(m_device, slot.readbackMem, 0, chunkBytes, 0, &slot.readbackPtr);
+    m_deviceBytes += chunkBytes;
+
+    slot.plan = m_primitives.MakeScan(m_type, slot.chunk, slot.chunk, m_chunkLength, m_scanFlags);
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &slot.uploaded));
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &slot.scanned));
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &slot.done));
+
+    RecordSlot(slot);
+  }
+}
+
+StreamingScan::~StreamingScan()
+{
+  for(auto &slot : m_slots)
+  {
+    vkWaitForFences(m_device, 1, &slot.done, VK_TRUE, UINT64_MAX);
+    slot.plan = nullptr;
+
+    vkDestroyFence(m_device, slot.done, nullptr);
+    vkDestroySemaphore(m_device, slot.uploaded, nullptr);
+    vkDestroySemaphore(m_device, slot.scanned, nullptr);
+
+    vkDestroyBuffer(m_device, slot.upload, nullptr);
+    vkDestroyBuffer(m_device, slot.chunk, nullptr);
+    vkDestroyBuffer(m_device, slot.readback, nullptr);
+    vkFreeMemory(m_device, slot.uploadMem, nullptr);
+    vkFreeMemory(m_device, slot.chunkMem, nullptr);
+    vkFreeMemory(m_device, slot.readbackMem, nullptr);
+  }
+  vkDestroyCommandPool(m_device, m_computePool, nullptr);
+  vkDestroyCommandPool(m_device, m_transferPool, nullptr);
+}
+
+VkBuffer StreamingScan::CreateBuffer(VkDeviceSize a_size, VkBufferUsageFlags a_usage, bool a_shared) const
+{
+  const uint32_t families[2] = {m_compute.familyIndex, m_transfer.familyIndex};
+  const bool concurrent = a_shared && families[0] != families[1];
+
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size        = a_size;
+  bufferInfo.usage       = a_usage;
+  bufferInfo.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+  bufferInfo.queueFamilyIndexCount = concurrent ? 2 : 0;
+  bufferInfo.pQueueFamilyIndices   = concurrent ? families : nullptr;
+
+  VkBuffer buf = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateBuffer(m_device, &bufferInfo, nullptr, &buf));
+  return buf;
+}
+
+VkDeviceMemory StreamingScan::AllocateAndBind(VkBuffer a_buffer, VkMemoryPropertyFlags a_props,
+                                              VkMemoryPropertyFlags a_preferred) const
+{
+  VkMemoryRequirements memReq = {};
+  vkGetBufferMemoryRequirements(m_device, a_buffer, &memReq);
+
+  // readback is read by CPU element by element, uncached memory makes that several times slower
+  VkPhysicalDeviceMemoryProperties memProps = {};
+  vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProps);
+  uint32_t typeIndex = UINT32_MAX;
+  for(uint32_t i = 0; i < memProps.memoryTypeCount && typeIndex == UINT32_MAX; ++i)
+  {
+    const VkMemoryPropertyFlags wanted = a_props | a_preferred;
+    if((memReq.memoryTypeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & wanted) == wanted)
+      typeIndex = i;
+  }
+  if(typeIndex == UINT32_MAX)
+    typeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits, a_props, m_physicalDevice);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = typeIndex;
+
+  VkDeviceMemory mem = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &mem));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_device, a_buffer, mem, 0));
+  return mem;
+}
+
+void StreamingScan::RecordSlot(Slot &a_slot)
+{
+  // commands are the same for every chunk: the last one copies and scans stale tail, which doesn't affect its prefix
+  a_slot.uploadCmd   = vk_utils::createCommandBuffers(m_device, m_transferPool, 1)[0];
+  a_slot.readbackCmd = vk_utils::createCommandBuffers(m_device, m_transferPool, 1)[0];
+  a_slot.scanCmd     = vk_utils::createCommandBuffers(m_device, m_computePool, 1)[0];
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+  const VkBufferCopy region = {0, 0, VkDeviceSize(m_chunkLength) * VALUE_SIZE};
+
+  VK_CHECK_RESULT(vkBeginCommandBuffer(a_slot.uploadCmd, &beginInfo));
+  vkCmdCopyBuffer(a_slot.uploadCmd, a_slot.upload, a_slot.chunk, 1, &region);
+  VK_CHECK_RESULT(vkEndCommandBuffer(a_slot.uploadCmd));
+
+  VK_CHECK_RESULT(vkBeginCommandBuffer(a_slot.scanCmd, &beginInfo));
+  m_primitives.RecordCmd(a_slot.scanCmd, *a_slot.plan);
+  VK_CHECK_RESULT(vkEndCommandBuffer(a_slot.scanCmd));
+
+  VK_CHECK_RESULT(vkBeginCommandBuffer(a_slot.readbackCmd, &beginInfo));
+  vkCmdCopyBuffer(a_slot.readbackCmd, a_slot.chunk, a_slot.readback, 1, &region);
+  VkMemoryBarrier toHost = {};
+  toHost.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(a_slot.readbackCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                       1, &toHost, 0, nullptr, 0, nullptr);
+  VK_CHECK_RESULT(vkEndCommandBuffer(a_slot.readbackCmd));
+}
+
+void StreamingScan::Submit(Slot &a_slot)
+{
+  VK_CHECK_RESULT(vkResetFences(m_device, 1, &a_slot.done));
+
+  VkSubmitInfo upload = {};
+  upload.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  upload.commandBufferCount   = 1;
+  upload.pCommandBuffers      = &a_slot.uploadCmd;
+  upload.signalSemaphoreCount = 1;
+  upload.pSignalSemaphores    = &a_slot.uploaded;
+  VK_CHECK_RESULT(vkQueueSubmit(m_transfer.queue, 1, &upload, VK_NULL_HANDLE));
+
+  const VkPipelineStageFlags scanWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+  VkSubmitInfo scan = {};
+  scan.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  scan.waitSemaphoreCount   = 1;
+  scan.pWaitSemaphores      = &a_slot.uploaded;
+  scan.pWaitDstStageMask    = &scanWaitStage;
+  scan.commandBufferCount   = 1;
+  scan.pCommandBuffers      = &a_slot.scanCmd;
+  scan.signalSemaphoreCount = 1;
+  scan.pSignalSemaphores    = &a_slot.scanned;
+  VK_CHECK_RESULT(vkQueueSubmit(m_compute.queue, 1, &scan, VK_NULL_HANDLE));
+
+  const VkPipelineStageFlags readbackWaitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  VkSubmitInfo readback = {};
+  readback.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  readback.waitSemaphoreCount = 1;
+  readback.pWaitSemaphores    = &a_slot.scanned;
+  readback.pWaitDstStageMask  = &readbackWaitStage;
+  readback.commandBufferCount = 1;
+  readback.pCommandBuffers    = &a_slot.readbackCmd;
+  VK_CHECK_RESULT(vkQueueSubmit(m_transfer.queue, 1, &readback, a_slot.done));
+}
+
+void StreamingScan::Finish(Slot &a_slot, const void* a_in, void* a_out)
+{
+  VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &a_slot.done, VK_TRUE, UINT64_MAX));
+
+  const void* in  = static_cast<const uint8_t*>(a_in) + a_slot.first * VALUE_SIZE;
+  void*       out = static_cast<uint8_t*>(a_out) + a_slot.first * VALUE_SIZE;
+  const bool inclusive = (m_scanFlags & GpuPrimitives::SCAN_INCLUSIVE) != 0;
+  switch(m_type)
+  {
+  case ScanValueType::UINT:  AddCarry<uint32_t>(a_slot.readbackPtr, in, out, a_slot.count, inclusive, m_carry); break;
+  case ScanValueType::INT:   AddCarry<int32_t> (a_slot.readbackPtr, in, out, a_slot.count, inclusive, m_carry); break;
+  case ScanValueType::FLOAT: AddCarry<float>   (a_slot.readbackPtr, in, out, a_slot.count, inclusive, m_carry); break;
+  default: break;
+  }
+  a_slot.count = 0;
+}
+
+void StreamingScan::Run(const void* a_in, void* a_out, uint64_t a_length)
+{
+  m_carry = 0; // zero bits are zero of every type
+
+  const uint64_t chunksNum = (a_length + m_chunkLength - 1) / m_chunkLength;
+  const uint64_t slotsNum  = m_slots.size();
+  for(uint64_t c = 0; c < chunksNum; ++c)
+  {
+    // chunks are finished in order, because each one needs prefix of all previous
+    Slot &slot = m_slots[c % slotsNum];
+    if(slot.count > 0)
+      Finish(slot, a_in, a_out);
+
+    slot.first = c * m_chunkLength;
+    slot.count = uint32_t(std::min<uint64_t>(m_chunkLength, a_length - slot.first));
+    memcpy(slot.uploadPtr, static_cast<const uint8_t*>(a_in) + slot.first * VALUE_SIZE, slot.count * VALUE_SIZE);
+    Submit(slot);
+  }
+
+  for(uint64_t c = chunksNum - std::min(chunksNum, slotsNum); c < chunksNum; ++c)
+    Finish(m_slots[c % slotsNum], a_in, a_out);
+}
@@ -0,0 +1,90 @@
+#ifndef CHIMERA_STREAMING_SCAN_H
+#define CHIMERA_STREAMING_SCAN_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "volk.h"
+#include "gpu_primitives.h"
+
+// scan of host arrays that don't have to fit in device memory.
+// array goes through a ring of chunk slots: upload on transfer queue -> scan on compute queue -> readback on
+// transfer queue, connected by semaphores, so copies of one chunk overlap with scan of another.
+// chunks are scanned independently and running prefix is added on CPU while results are copied out,
+// so GPU never waits for previous chunks
+class StreamingScan
+{
+public:
+  struct QueueInfo
+  {
+    VkQueue  queue       = VK_NULL_HANDLE;
+    uint32_t familyIndex = 0;
+  };
+
+  // a_slotsNum - 2 for double buffering, 3 lets upload, scan and readback of different chunks run at once
+  StreamingScan(VkDevice a_device, VkPhysicalDevice a_physicalDevice, GpuPrimitives &a_primitives,
+                QueueInfo a_compute, QueueInfo a_transfer, ScanValueType a_type, uint32_t a_chunkLength,
+                uint32_t a_slotsNum = 3, uint32_t a_scanFlags = GpuPrimitives::SCAN_EXCLUSIVE);
+  ~StreamingScan();
+
+  StreamingScan(const StreamingScan &) = delete;
+  StreamingScan& operator=(const StreamingScan &) = delete;
+
+  // a_in and a_out hold a_length 32 bit values of scan type and may be the same array
+  void Run(const void* a_in, void* a_out, uint64_t a_length);
+
+  uint32_t ChunkLength() const { return m_chunkLength; }
+  // device memory of all slots, doesn't depend on array length
+  VkDeviceSize DeviceBytes() const { return m_deviceBytes; }
+
+private:
+  struct Slot
+  {
+    VkBuffer       upload   = VK_NULL_HANDLE; // host visible, written by CPU
+    VkBuffer       chunk    = VK_NULL_HANDLE; // device local, scanned in place
+    VkBuffer       readback = VK_NULL_HANDLE; // host visible, cached if possible
+    VkDeviceMemory uploadMem   = VK_NULL_HANDLE;
+    VkDeviceMemory chunkMem    = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMem = VK_NULL_HANDLE;
+    void*          uploadPtr   = nullptr;
+    void*          readbackPtr = nullptr;
+
+    std::unique_ptr<GpuPrimitives::Plan> plan;
+    VkCommandBuffer uploadCmd   = VK_NULL_HANDLE;
+    VkCommandBuffer scanCmd     = VK_NULL_HANDLE;
+    VkCommandBuffer readbackCmd = VK_NULL_HANDLE;
+    VkSemaphore     uploaded    = VK_NULL_HANDLE;
+    VkSemaphore     scanned     = VK_NULL_HANDLE;
+    VkFence         done        = VK_NULL_HANDLE; // readback finished, slot is free
+
+    uint64_t first = 0;  // chunk in flight, valid when count > 0
+    uint32_t count = 0;
+  };
+
+  VkBuffer CreateBuffer(VkDeviceSize a_size, VkBufferUsageFlags a_usage, bool a_shared) const;
+  VkDeviceMemory AllocateAndBind(VkBuffer a_buffer, VkMemoryPropertyFlags a_props, VkMemoryPropertyFlags a_preferred) const;
+  void RecordSlot(Slot &a_slot);
+  void Submit(Slot &a_slot);
+  // waits for slot and copies its results to a_out adding running prefix
+  void Finish(Slot &a_slot, const void* a_in, void* a_out);
+
+  VkDevice         m_device         = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+  GpuPrimitives   &m_primitives;
+  QueueInfo        m_compute;
+  QueueInfo        m_transfer;
+  ScanValueType    m_type;
+  uint32_t         m_chunkLength = 0;
+  uint32_t         m_scanFlags   = 0;
+  VkDeviceSize     m_deviceBytes = 0;
+
+  VkCommandPool    m_computePool  = VK_NULL_HANDLE;
+  VkCommandPool    m_transferPool = VK_NULL_HANDLE;
+  std::vector<Slot> m_slots;
+
+  // running prefix as raw bits of scan type
+  uint32_t         m_carry = 0;
+};
+
+#endif//CHIMERA_STREAMING_SCAN_H
@@ -0,0 +1,118 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t a_threadsNum)
+{
+  const uint32_t threadsNum = a_threadsNum != 0 ? a_threadsNum : std::max(std::thread::hardware_concurrency(), 1u);
+  for(uint32_t i = 0; i < threadsNum; ++i)
+    m_queues.push_back(std::make_unique<Queue>());
+  for(uint32_t i = 1; i < threadsNum; ++i)
+    m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for(auto &worker : m_workers)
+    worker.join();
+}
+
+bool ThreadPool::Take(uint32_t a_thread, Range &a_range)
+{
+  {
+    Queue &own = *m_queues[a_thread];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if(!own.ranges.empty())
+    {
+      a_range = own.ranges.back();
+      own.ranges.pop_back();
+      return true;
+    }
+  }
+
+  // victims are visited starting from the next thread, so thieves spread over different queues
+  const uint32_t threadsNum = ThreadsNum();
+  for(uint32_t i = 1; i < threadsNum; ++i)
+  {
+    Queue &victim = *m_queues[(a_thread + i) % threadsNum];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if(!victim.ranges.empty())
+    {
+      a_range = victim.ranges.front();
+      victim.ranges.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::Run(const Range &a_range)
+{
+  (*m_func)(a_range.begin, a_range.end);
+  m_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::WorkerLoop(uint32_t a_thread)
+{
+  uint64_t seenGeneration = 0;
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_wakeMutex);
+      m_wake.wait(lock, [&]() { return m_stop || m_generation != seenGeneration; });
+      if(m_stop)
+        return;
+      seenGeneration = m_generation;
+    }
+
+    Range range;
+    while(Take(a_thread, range))
+      Run(range);
+  }
+}
+
+void ThreadPool::ParallelFor(size_t a_count, size_t a_grain, const std::function<void(size_t, size_t)> &a_func)
+{
+  const size_t grain     = std::max<size_t>(a_grain, 1);
+  const size_t rangesNum = (a_count + grain - 1) / grain;
+  if(rangesNum <= 1 || m_workers.empty())
+  {
+    for(size_t begin = 0; begin < a_count; begin += grain)
+      a_func(begin, std::min(a_count, begin + grain));
+    return;
+  }
+
+  // contiguous runs of ranges per queue, so without stealing every thread walks its own part of memory
+  m_func = &a_func;
+  m_pending.store(rangesNum, std::memory_order_release);
+  const uint32_t threadsNum = ThreadsNum();
+  for(uint32_t t = 0; t < threadsNum; ++t)
+  {
+    Queue &queue = *m_queues[t];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    const size_t first = rangesNum * t / threadsNum;
+    const size_t last  = rangesNum * (t + 1) / threadsNum;
+    // the owner pops from the back, so ranges are pushed in reverse order to be taken in memory order
+    for(size_t r = last; r > first; --r)
+      queue.ranges.push_back({(r - 1) * grain, std::min(a_count, r * grain)});
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_generation++;
+  }
+  m_wake.notify_all();
+
+  Range range;
+  while(Take(0, range))
+    Run(range);
+  // the last ranges may still run on workers
+  while(m_pending.load(std::memory_order_acquire) != 0)
+    std::this_thread::yield();
+  m_func = nullptr;
+}
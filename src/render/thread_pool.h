@@ -0,0 +1,63 @@
+#ifndef CHIMERA_THREAD_POOL_H
+#define CHIMERA_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads for data parallel loops. ranges of a loop are spread over per-thread queues,
+// each thread takes ranges from the back of its own queue and idle threads steal from the front of others,
+// so uneven ranges (i.e. a slow core or a busy one) don't keep the whole loop waiting
+class ThreadPool
+{
+public:
+  // a_threadsNum - threads including the calling one, 0 means one per hardware thread
+  explicit ThreadPool(uint32_t a_threadsNum = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool& operator=(const ThreadPool &) = delete;
+
+  uint32_t ThreadsNum() const { return uint32_t(m_queues.size()); }
+
+  // calls a_func(begin, end) for ranges of a_grain elements that cover [0, a_count), the calling thread works too.
+  // returns when all ranges are done. a_func must not call ParallelFor of the same pool
+  void ParallelFor(size_t a_count, size_t a_grain, const std::function<void(size_t, size_t)> &a_func);
+
+private:
+  struct Range
+  {
+    size_t begin = 0;
+    size_t end   = 0;
+  };
+
+  struct Queue
+  {
+    std::mutex        mutex;
+    std::deque<Range> ranges;
+  };
+
+  // own queue first, then steals, returns false if all queues are empty
+  bool Take(uint32_t a_thread, Range &a_range);
+  void Run(const Range &a_range);
+  void WorkerLoop(uint32_t a_thread);
+
+  std::vector<std::unique_ptr<Queue>> m_queues; // index 0 is the calling thread
+  std::vector<std::thread>            m_workers;
+
+  std::mutex              m_wakeMutex;
+  std::condition_variable m_wake;
+  uint64_t                m_generation = 0; // incremented by every loop
+  bool                    m_stop       = false;
+
+  const std::function<void(size_t, size_t)>* m_func = nullptr;
+  std::atomic<size_t>                        m_pending {0};
+};
+
+#endif//CHIMERA_THREAD_POOL_H
@@ -0,0 +1,161 @@
+#include "unified_memory.h"
+#include "vk_utils.h"
+
+#include <cstring>
+
+uint32_t FindUnifiedMemoryType(VkPhysicalDevice a_physDevice, uint32_t a_typeBits)
+{
+  VkPhysicalDeviceMemoryProperties memProps;
+  vkGetPhysicalDeviceMemoryProperties(a_physDevice, &memProps);
+
+  uint32_t mainHeap = UINT32_MAX;
+  for(uint32_t i = 0; i < memProps.memoryHeapCount; ++i)
+  {
+    if((memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0)
+      continue;
+    if(mainHeap == UINT32_MAX || memProps.memoryHeaps[i].size > memProps.memoryHeaps[mainHeap].size)
+      mainHeap = i;
+  }
+
+  const VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  for(uint32_t i = 0; i < memProps.memoryTypeCount; ++i)
+  {
+    const auto &type = memProps.memoryTypes[i];
+    if((a_typeBits & (1u << i)) != 0 && type.heapIndex == mainHeap && (type.propertyFlags & required) == required)
+      return i;
+  }
+  return UINT32_MAX;
+}
+
+VkDeviceMemory AllocateAndBindMapped(VkDevice a_device, const std::vector<VkBuffer> &a_buffers, uint32_t a_memType,
+                                     std::vector<void*> &a_mapped)
+{
+  a_mapped.clear();
+  if(a_memType == UINT32_MAX || a_buffers.empty())
+    return VK_NULL_HANDLE;
+
+  std::vector<VkDeviceSize> offsets(a_buffers.size());
+  VkDeviceSize size = 0;
+  for(size_t i = 0; i < a_buffers.size(); ++i)
+  {
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(a_device, a_buffers[i], &memReq);
+    if((memReq.memoryTypeBits & (1u << a_memType)) == 0)
+      return VK_NULL_HANDLE;
+
+    offsets[i] = vk_utils::getPaddedSize(size, memReq.alignment);
+    size       = offsets[i] + memReq.size;
+  }
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.pNext           = nullptr;
+  allocateInfo.allocationSize  = size;
+  allocateInfo.memoryTypeIndex = a_memType;
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkAllocateMemory(a_device, &allocateInfo, nullptr, &memory));
+
+  void* mapped = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(a_device, memory, 0, size, 0, &mapped));
+  for(size_t i = 0; i < a_buffers.size(); ++i)
+  {
+    VK_CHECK_RESULT(vkBindBufferMemory(a_device, a_buffers[i], memory, offsets[i]));
+    a_mapped.push_back(static_cast<uint8_t*>(mapped) + offsets[i]);
+  }
+
+  return memory;
+}
+
+vk_utils::VulkanImageMem AllocateColorTextureLDR(VkDevice a_device, VkPhysicalDevice a_physDevice,
+                                                 const unsigned char* a_pixels, uint32_t a_width, uint32_t a_height,
+                                                 uint32_t a_mipLevels, VkFormat a_format,
+                                                 std::shared_ptr<vk_utils::ICopyEngine> a_pCopy,
+                                                 VkImageUsageFlags a_usage, VkImageLayout &a_layout)
+{
+  auto allocateWithCopy = [&]() {
+    a_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    return vk_utils::allocateColorTextureFromDataLDR(a_device, a_physDevice, a_pixels, a_width, a_height, a_mipLevels,
+                                                     a_format, a_pCopy, a_usage);
+  };
+
+  // mip levels are generated with blits from optimal images, linear images are only sampled
+  // or written by copies with the usage caller asked for
+  const VkImageUsageFlags usage = a_usage | VK_IMAGE_USAGE_SAMPLED_BIT;
+  if(a_mipLevels != 1 || (usage & ~(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)) != 0 ||
+     FindUnifiedMemoryType(a_physDevice) == UINT32_MAX)
+    return allocateWithCopy();
+
+  // linear tiling support is much narrower than the format features tell, it depends on usage and extent as well
+  VkFormatProperties formatProps;
+  vkGetPhysicalDeviceFormatProperties(a_physDevice, a_format, &formatProps);
+  VkImageFormatProperties imageProps = {};
+  if((formatProps.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0 ||
+     vkGetPhysicalDeviceImageFormatProperties(a_physDevice, a_format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR, usage, 0,
+                                              &imageProps) != VK_SUCCESS ||
+     imageProps.maxExtent.width < a_width || imageProps.maxExtent.height < a_height ||
+     imageProps.maxMipLevels < 1 || imageProps.maxArrayLayers < 1 ||
+     (imageProps.sampleCounts & VK_SAMPLE_COUNT_1_BIT) == 0)
+    return allocateWithCopy();
+
+  vk_utils::VulkanImageMem result = {};
+  result.format     = a_format;
+  result.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = a_format;
+  imageInfo.extent        = VkExtent3D{a_width, a_height, 1};
+  imageInfo.mipLevels     = 1;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling        = VK_IMAGE_TILING_LINEAR;
+  imageInfo.usage         = usage;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+  VK_CHECK_RESULT(vkCreateImage(a_device, &imageInfo, nullptr, &result.image));
+
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(a_device, result.image, &memReq);
+  const uint32_t memType = FindUnifiedMemoryType(a_physDevice, memReq.memoryTypeBits);
+  if(memType == UINT32_MAX)
+  {
+    vkDestroyImage(a_device, result.image, nullptr);
+    return allocateWithCopy();
+  }
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = memType;
+  VK_CHECK_RESULT(vkAllocateMemory(a_device, &allocateInfo, nullptr, &result.mem));
+  VK_CHECK_RESULT(vkBindImageMemory(a_device, result.image, result.mem, 0));
+
+  // LDR texels are 4 bytes, rows of linear image may be padded
+  VkImageSubresource subresource = {};
+  subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  VkSubresourceLayout layout;
+  vkGetImageSubresourceLayout(a_device, result.image, &subresource, &layout);
+
+  void* mapped = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(a_device, result.mem, 0, memReq.size, 0, &mapped));
+  const size_t rowSize = size_t(a_width) * 4;
+  for(uint32_t y = 0; y < a_height; ++y)
+    memcpy(static_cast<uint8_t*>(mapped) + layout.offset + y * layout.rowPitch, a_pixels + y * rowSize, rowSize);
+  vkUnmapMemory(a_device, result.mem);
+
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType                       = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image                       = result.image;
+  viewInfo.viewType                    = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format                      = a_format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.layerCount = 1;
+  VK_CHECK_RESULT(vkCreateImageView(a_device, &viewInfo, nullptr, &result.view));
+
+  a_layout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+  return result;
+}
@@ -0,0 +1,33 @@
+#ifndef CHIMERA_UNIFIED_MEMORY_H
+#define CHIMERA_UNIFIED_MEMORY_H
+
+#include <vector>
+#include <memory>
+
+#include "volk.h"
+#include <vk_images.h>
+#include <vk_copy.h>
+
+// integrated gpus and software implementations have device local memory which is also host visible,
+// there data is written straight to mapped device memory instead of going through staging buffers and copy commands
+
+// memory type which is DEVICE_LOCAL, HOST_VISIBLE and HOST_COHERENT and belongs to the largest device local heap,
+// UINT32_MAX if there is none. small host visible windows to video memory of discrete gpus don't count
+uint32_t FindUnifiedMemoryType(VkPhysicalDevice a_physDevice, uint32_t a_typeBits = UINT32_MAX);
+
+// binds a_buffers one after another with required alignments to one allocation of a_memType and maps it,
+// a_mapped gets address of every buffer. returns VK_NULL_HANDLE if a_memType doesn't suit some buffer.
+// memory stays mapped until it is freed
+VkDeviceMemory AllocateAndBindMapped(VkDevice a_device, const std::vector<VkBuffer> &a_buffers, uint32_t a_memType,
+                                     std::vector<void*> &a_mapped);
+
+// vk_utils::allocateColorTextureFromDataLDR which writes pixels of single mip textures to a linear image in unified
+// memory if the device supports linear images of the format with a_usage and extent, a_layout is set to
+// VK_IMAGE_LAYOUT_PREINITIALIZED then. otherwise it goes through a_pCopy and a_layout is VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+vk_utils::VulkanImageMem AllocateColorTextureLDR(VkDevice a_device, VkPhysicalDevice a_physDevice,
+                                                 const unsigned char* a_pixels, uint32_t a_width, uint32_t a_height,
+                                                 uint32_t a_mipLevels, VkFormat a_format,
+                                                 std::shared_ptr<vk_utils::ICopyEngine> a_pCopy,
+                                                 VkImageUsageFlags a_usage, VkImageLayout &a_layout);
+
+#endif//CHIMERA_UNIFIED_MEMORY_H
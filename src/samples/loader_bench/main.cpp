@@ -0,0 +1,360 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "loader_utils/hydraxml.h"
+#include "render/instance_bvh.h"
+#include "utils/Camera.h"
+
+namespace
+{
+  // the way hydraxml parsed values before, kept as a reference for results and timings
+  LiteMath::float4x4 float4x4FromStringStream(const std::wstring &matrix_str)
+  {
+    LiteMath::float4x4 result;
+    std::wstringstream inputStream(matrix_str);
+
+    float data[16] = {};
+    for(int i = 0; i < 16; i++)
+      inputStream >> data[i];
+
+    result.set_row(0, LiteMath::float4(data[0],data[1], data[2], data[3]));
+    result.set_row(1, LiteMath::float4(data[4],data[5], data[6], data[7]));
+    result.set_row(2, LiteMath::float4(data[8],data[9], data[10], data[11]));
+    result.set_row(3, LiteMath::float4(data[12],data[13], data[14], data[15]));
+
+    return result;
+  }
+
+  LiteMath::float3 read3fStream(pugi::xml_attribute a_attr)
+  {
+    LiteMath::float3 res(0, 0, 0);
+    const wchar_t* str = a_attr.as_string();
+    if (str != nullptr)
+    {
+      std::wstringstream inputStream(str);
+      inputStream >> res.x >> res.y >> res.z;
+    }
+    return res;
+  }
+
+  // scene xml with a_instancesNum instances of a few meshes, matrices are written as hydra exporters do
+  std::wstring MakeSyntheticScene(uint32_t a_instancesNum)
+  {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> rot(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> pos(-1000.0f, 1000.0f);
+
+    std::wstringstream xml;
+    xml << L"<root><scenes><scene id=\"0\" name=\"bench\">\n";
+    for(uint32_t i = 0; i < a_instancesNum; ++i)
+    {
+      xml << L"<instance id=\"" << i << L"\" mesh_id=\"" << (i % 64) << L"\" matrix=\"";
+      for(int j = 0; j < 16; ++j)
+      {
+        const float v = (j == 15) ? 1.0f : ((j % 4) == 3 ? pos(rng) : rot(rng));
+        xml << v << L" ";
+      }
+      xml << L"\" pos=\"" << pos(rng) << L" " << pos(rng) << L" " << pos(rng) << L"\" />\n";
+    }
+    xml << L"</scene></scenes></root>\n";
+
+    return xml.str();
+  }
+
+  // the way HydraScene::parseInstancedMeshes matched instances to meshes before: a scan of geometry library
+  // and a file system probe per instance
+  std::unordered_map<std::string, std::vector<LiteMath::float4x4>> ParseInstancedMeshesLinear(pugi::xml_node a_scenelib,
+    pugi::xml_node a_geomlib, const std::string &a_rootDir)
+  {
+    std::unordered_map<std::string, std::vector<LiteMath::float4x4>> instancesPerMeshLoc;
+    auto scene = a_scenelib.first_child();
+    for (pugi::xml_node inst = scene.first_child(); inst != nullptr; inst = inst.next_sibling())
+    {
+      if (std::wstring(inst.name()) == L"instance_light")
+        break;
+
+      auto meshNode = a_geomlib.find_child_by_attribute(L"id", inst.attribute(L"mesh_id").as_string());
+      if(meshNode == nullptr)
+        continue;
+
+      auto meshLoc = a_rootDir + "/" + hydra_xml::ws2s(std::wstring(meshNode.attribute(L"loc").as_string()));
+      std::ifstream checkMesh(meshLoc);
+      if(!checkMesh.good())
+        continue;
+
+      instancesPerMeshLoc[meshLoc].push_back(hydra_xml::float4x4FromString(inst.attribute(L"matrix").as_string()));
+    }
+    return instancesPerMeshLoc;
+  }
+
+  // full scene with a_meshesNum empty mesh files in a_dir, instances refer to meshes in random order
+  std::string MakeSyntheticSceneFiles(const std::filesystem::path &a_dir, uint32_t a_meshesNum, uint32_t a_instancesNum)
+  {
+    std::filesystem::create_directories(a_dir / "data");
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint32_t> meshDist(0, a_meshesNum - 1);
+    std::uniform_real_distribution<float>   pos(-1000.0f, 1000.0f);
+
+    std::wofstream xml(a_dir / "statex_00001.xml");
+    xml << L"<?xml version=\"1.0\"?>\n<textures_lib />\n<materials_lib />\n<geometry_lib>\n";
+    for(uint32_t i = 0; i < a_meshesNum; ++i)
+    {
+      const std::string loc = "data/chunk_" + std::to_string(i) + ".vsgf";
+      std::ofstream((a_dir / loc).string());
+      xml << L"  <mesh id=\"" << i << L"\" name=\"mesh" << i << L"\" loc=\"" << hydra_xml::s2ws(loc) << L"\" />\n";
+    }
+    xml << L"</geometry_lib>\n<lights_lib />\n<cam_lib />\n<render_lib />\n<scenes>\n<scene id=\"0\" name=\"bench\">\n";
+    for(uint32_t i = 0; i < a_instancesNum; ++i)
+    {
+      xml << L"  <instance id=\"" << i << L"\" mesh_id=\"" << meshDist(rng) << L"\" matrix=\"1 0 0 " << pos(rng)
+          << L" 0 1 0 " << pos(rng) << L" 0 0 1 " << pos(rng) << L" 0 0 0 1 \" />\n";
+    }
+    xml << L"</scene>\n</scenes>\n";
+
+    return (a_dir / "statex_00001.xml").string();
+  }
+
+  template<typename F>
+  double MeasureMs(F a_func)
+  {
+    auto before = std::chrono::high_resolution_clock::now();
+    a_func();
+    auto after  = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(after - before).count() / 1000.0;
+  }
+
+  bool BenchMatrixParsing(uint32_t a_instancesNum)
+  {
+    std::wstring sceneStr = MakeSyntheticScene(a_instancesNum);
+
+    pugi::xml_document doc;
+    if(!doc.load_string(sceneStr.c_str()))
+    {
+      std::cout << "can't parse synthetic scene" << std::endl;
+      return false;
+    }
+
+    std::vector<pugi::xml_node> instances;
+    for(auto inst : doc.child(L"root").child(L"scenes").child(L"scene").children(L"instance"))
+      instances.push_back(inst);
+
+    std::vector<LiteMath::float4x4> refMatrices(instances.size());
+    std::vector<LiteMath::float4x4> newMatrices(instances.size());
+    std::vector<LiteMath::float3>   refPositions(instances.size());
+    std::vector<LiteMath::float3>   newPositions(instances.size());
+
+    double refMs = MeasureMs([&]() {
+      for(size_t i = 0; i < instances.size(); ++i)
+      {
+        refMatrices[i]  = float4x4FromStringStream(instances[i].attribute(L"matrix").as_string());
+        refPositions[i] = read3fStream(instances[i].attribute(L"pos"));
+      }
+    });
+
+    double newMs = MeasureMs([&]() {
+      for(size_t i = 0; i < instances.size(); ++i)
+      {
+        newMatrices[i]  = hydra_xml::float4x4FromString(instances[i].attribute(L"matrix").as_string());
+        newPositions[i] = hydra_xml::read3f(instances[i].attribute(L"pos"));
+      }
+    });
+
+    bool identical = true;
+    for(size_t i = 0; i < instances.size() && identical; ++i)
+    {
+      for(int row = 0; row < 4; ++row)
+      {
+        const LiteMath::float4 a = refMatrices[i].get_row(row);
+        const LiteMath::float4 b = newMatrices[i].get_row(row);
+        identical = identical && memcmp(&a, &b, sizeof(a)) == 0;
+      }
+      identical = identical && memcmp(&refPositions[i], &newPositions[i], sizeof(float) * 3) == 0;
+    }
+
+    std::cout << "float4x4FromString + read3f, " << instances.size() << " instances:" << std::endl;
+    std::cout << "  wstringstream : " << refMs << " ms" << std::endl;
+    std::cout << "  hydra_xml     : " << newMs << " ms" << std::endl;
+    std::cout << "  results are " << (identical ? "bit-identical" : "DIFFERENT") << std::endl;
+
+    return identical;
+  }
+
+  bool BenchInstancedMeshes(uint32_t a_meshesNum, uint32_t a_instancesNum)
+  {
+    const auto dir = std::filesystem::temp_directory_path() / "loader_bench_scene";
+    const std::string scenePath = MakeSyntheticSceneFiles(dir, a_meshesNum, a_instancesNum);
+    const std::string rootDir   = scenePath.substr(0, scenePath.find_last_of('/'));
+
+    std::unordered_map<std::string, std::vector<LiteMath::float4x4>> refInstances;
+    double refMs = MeasureMs([&]() {
+      pugi::xml_document doc;
+      doc.load_file(scenePath.c_str());
+      refInstances = ParseInstancedMeshesLinear(doc.child(L"scenes"), doc.child(L"geometry_lib"), rootDir);
+    });
+
+    hydra_xml::HydraScene scene;
+    int res = 0;
+    double newMs = MeasureMs([&]() { res = scene.LoadState(scenePath); });
+
+    bool identical = (res == 0);
+    size_t instancesFound = 0;
+    for(auto loc : scene.MeshFiles())
+    {
+      auto instances = scene.GetAllInstancesOfMeshLoc(loc);
+      auto pRef      = refInstances.find(loc);
+      instancesFound += instances.size();
+      if(pRef == refInstances.end())
+      {
+        identical = identical && instances.empty();
+        continue;
+      }
+      identical = identical && pRef->second.size() == instances.size() &&
+                  memcmp(pRef->second.data(), instances.data(), instances.size() * sizeof(instances[0])) == 0;
+    }
+    identical = identical && instancesFound == a_instancesNum;
+
+    std::cout << "HydraScene::LoadState, " << a_meshesNum << " meshes, " << a_instancesNum << " instances:" << std::endl;
+    std::cout << "  linear lookup  : " << refMs << " ms" << std::endl;
+    std::cout << "  indexed lookup : " << newMs << " ms" << std::endl;
+    std::cout << "  results are " << (identical ? "identical" : "DIFFERENT") << std::endl;
+
+    std::error_code err;
+    std::filesystem::remove_all(dir, err);
+
+    return identical;
+  }
+
+  bool BoxOutsideFrustum(const LiteMath::float4x4 &a_viewProj, const LiteMath::Box4f &a_box)
+  {
+    const LiteMath::float4 r0 = a_viewProj.get_row(0);
+    const LiteMath::float4 r1 = a_viewProj.get_row(1);
+    const LiteMath::float4 r2 = a_viewProj.get_row(2);
+    const LiteMath::float4 r3 = a_viewProj.get_row(3);
+    for(const auto &p : {r3 + r0, r3 - r0, r3 + r1, r3 - r1, r2, r3 - r2})
+    {
+      const float x = p.x > 0.0f ? a_box.boxMax.x : a_box.boxMin.x;
+      const float y = p.y > 0.0f ? a_box.boxMax.y : a_box.boxMin.y;
+      const float z = p.z > 0.0f ? a_box.boxMax.z : a_box.boxMin.z;
+      if(p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+        return true;
+    }
+    return false;
+  }
+
+  bool BenchInstanceBVH(uint32_t a_instancesNum)
+  {
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> pos(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> size(0.5f, 10.0f);
+    std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
+
+    std::vector<LiteMath::Box4f> boxes(a_instancesNum);
+    for(auto &box : boxes)
+    {
+      const LiteMath::float4 center(pos(rng), pos(rng), pos(rng), 1.0f);
+      const LiteMath::float4 half(size(rng), size(rng), size(rng), 0.0f);
+      box = LiteMath::Box4f(center - half, center + half);
+    }
+
+    const uint32_t queriesNum = 100;
+    std::vector<LiteMath::float4x4> viewProjs(queriesNum);
+    std::vector<std::pair<LiteMath::float3, LiteMath::float3>> rays(queriesNum * 10);
+    for(auto &viewProj : viewProjs)
+    {
+      const LiteMath::float3 eye(pos(rng), pos(rng), pos(rng));
+      const LiteMath::float3 target(pos(rng), pos(rng), pos(rng));
+      viewProj = OpenglToVulkanProjectionMatrixFix() * projectionMatrix(45.0f, 1.0f, 0.1f, 1000.0f) *
+                 LiteMath::lookAt(eye, target, LiteMath::float3(0, 1, 0));
+    }
+    for(auto &ray : rays)
+      ray = {LiteMath::float3(pos(rng), pos(rng), pos(rng)), LiteMath::normalize(LiteMath::float3(dir(rng), dir(rng), dir(rng)))};
+
+    InstanceBVH bvh;
+    const double buildMs = MeasureMs([&]() { bvh.Build(boxes); });
+    const double refitMs = MeasureMs([&]() { bvh.Refit(boxes); });
+
+    std::vector<std::vector<uint32_t>> refVisible(queriesNum), bvhVisible(queriesNum);
+    const double refFrustumMs = MeasureMs([&]() {
+      for(uint32_t q = 0; q < queriesNum; ++q)
+        for(uint32_t i = 0; i < boxes.size(); ++i)
+          if(!BoxOutsideFrustum(viewProjs[q], boxes[i]))
+            refVisible[q].push_back(i);
+    });
+    const double bvhFrustumMs = MeasureMs([&]() {
+      for(uint32_t q = 0; q < queriesNum; ++q)
+        bvh.QueryFrustum(viewProjs[q], bvhVisible[q]);
+    });
+
+    const float tMax = 1e5f;
+    std::vector<std::vector<uint32_t>> refHits(rays.size()), bvhHits(rays.size());
+    const double refRayMs = MeasureMs([&]() {
+      for(uint32_t r = 0; r < rays.size(); ++r)
+      {
+        const LiteMath::float4 origin(rays[r].first.x, rays[r].first.y, rays[r].first.z, 1.0f);
+        const LiteMath::float4 invDir(1.0f / rays[r].second.x, 1.0f / rays[r].second.y, 1.0f / rays[r].second.z, 1.0f);
+        for(uint32_t i = 0; i < boxes.size(); ++i)
+        {
+          const LiteMath::float2 t = LiteMath::Ray4fBox4fIntersection(origin, invDir, boxes[i].boxMin, boxes[i].boxMax);
+          if(std::max(t.x, 0.0f) <= std::min(t.y, tMax))
+            refHits[r].push_back(i);
+        }
+      }
+    });
+    const double bvhRayMs = MeasureMs([&]() {
+      for(uint32_t r = 0; r < rays.size(); ++r)
+        bvh.QueryRay(rays[r].first, rays[r].second, tMax, bvhHits[r]);
+    });
+
+    bool identical = true;
+    size_t visibleNum = 0;
+    for(uint32_t q = 0; q < queriesNum; ++q)
+    {
+      std::sort(bvhVisible[q].begin(), bvhVisible[q].end());
+      identical  = identical && bvhVisible[q] == refVisible[q];
+      visibleNum += refVisible[q].size();
+    }
+    for(uint32_t r = 0; r < rays.size(); ++r)
+    {
+      std::sort(bvhHits[r].begin(), bvhHits[r].end());
+      identical = identical && bvhHits[r] == refHits[r];
+    }
+
+    std::cout << "InstanceBVH, " << a_instancesNum << " instances, " << bvh.NodesNum() << " nodes:" << std::endl;
+    std::cout << "  build : " << buildMs << " ms" << std::endl;
+    std::cout << "  refit : " << refitMs << " ms" << std::endl;
+    std::cout << "  " << queriesNum << " frustum queries, " << visibleNum / queriesNum << " visible on average:" << std::endl;
+    std::cout << "    brute force : " << refFrustumMs << " ms" << std::endl;
+    std::cout << "    bvh         : " << bvhFrustumMs << " ms" << std::endl;
+    std::cout << "  " << rays.size() << " ray queries:" << std::endl;
+    std::cout << "    brute force : " << refRayMs << " ms" << std::endl;
+    std::cout << "    bvh         : " << bvhRayMs << " ms" << std::endl;
+    std::cout << "  results are " << (identical ? "identical" : "DIFFERENT") << std::endl;
+
+    return identical;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  uint32_t instancesNum = 100000;
+  uint32_t meshesNum    = 10000;
+  if(argc > 1)
+    instancesNum = static_cast<uint32_t>(std::stoul(argv[1]));
+  if(argc > 2)
+    meshesNum = static_cast<uint32_t>(std::stoul(argv[2]));
+
+  bool ok = BenchMatrixParsing(instancesNum);
+  ok = BenchInstancedMeshes(meshesNum, instancesNum) && ok;
+  ok = BenchInstanceBVH(instancesNum) && ok;
+
+  return ok ? 0 : 1;
+}
@@ -1,6 +1,9 @@
 #include "quad2d_render.h"
 #include "utils/glfw_window.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int deviceID)
 {
   uint32_t glfwExtensionCount = 0;
@@ -23,13 +26,18 @@ void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int devic
   }
 }
 
-int main()
+int main(int argc, const char** argv)
 {
   constexpr int WIDTH = 1024;
   constexpr int HEIGHT = 1024;
   constexpr int VULKAN_DEVICE_ID = 0;
 
-  std::shared_ptr<IRender> app = std::make_unique<Quad2D_Render>(WIDTH, HEIGHT);
+  // number of frames in flight may be passed as the first argument, 1 makes cpu wait for every frame
+  uint32_t framesInFlight = 2;
+  if(argc > 1)
+    framesInFlight = static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1));
+
+  std::shared_ptr<IRender> app = std::make_unique<Quad2D_Render>(WIDTH, HEIGHT, framesInFlight);
   if(app == nullptr)
   {
     std::cout << "Can't create render of specified type" << std::endl;
@@ -1,12 +1,16 @@
 #include "quad2d_render.h"
 #include "utils/input_definitions.h"
+#include "../../render/unified_memory.h"
 
 #include <geom/vk_mesh.h>
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 #include <vk_utils.h>
 
-Quad2D_Render::Quad2D_Render(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
+#include <algorithm>
+
+Quad2D_Render::Quad2D_Render(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight) :
+  m_width(a_width), m_height(a_height), m_framesInFlight(std::max(a_framesInFlight, 1u))
 {
 #ifdef NDEBUG
   m_enableValidation = false;
@@ -69,11 +73,17 @@ void Quad2D_Render::InitPresentation(VkSurfaceKHR &a_surface)
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
                                                               m_width, m_height, m_framesInFlight, m_vsync);
   m_presentationResources.currentFrame = 0;
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  m_presentationResources.imageAvailable.resize(m_framesInFlight);
+  m_presentationResources.renderingFinished.resize(m_framesInFlight);
+  for (uint32_t i = 0; i < m_framesInFlight; ++i)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable[i]));
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished[i]));
+  }
 
   vk_utils::RenderTargetInfo2D rtargetInfo = {};
   rtargetInfo.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
@@ -222,6 +232,7 @@ void Quad2D_Render::RecreateSwapChain()
   rtargetInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   m_screenRenderPass = vk_utils::createRenderPass(m_device, rtargetInfo);
   m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass);
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
 
   m_frameFences.resize(m_framesInFlight);
   VkFenceCreateInfo fenceInfo = {};
@@ -233,7 +244,7 @@ void Quad2D_Render::RecreateSwapChain()
   }
 
   m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (size_t i = 0; i < m_swapchain.GetImageCount(); ++i)
+  for (size_t i = 0; i < m_framesInFlight; ++i)
   {
     BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i], m_swapchain.GetAttachment(i).view);
   }
@@ -245,11 +256,11 @@ void Quad2D_Render::Cleanup()
   CleanupPipelineAndSwapchain();
 
 
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
-  
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
+  for (auto semaphore : m_presentationResources.imageAvailable)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+
+  for (auto semaphore : m_presentationResources.renderingFinished)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -271,6 +282,8 @@ void Quad2D_Render::ProcessInput(const AppInput &input)
     std::system("cd ../resources/shaders && python3 compile_quad_render_shaders.py");
 #endif
 
+    // pipeline is destroyed and recreated, frames in flight may still use it
+    vkDeviceWaitIdle(m_device);
     SetupQuadRenderer();
     SetupSimplePipeline();
 
@@ -336,12 +349,14 @@ void Quad2D_Render::LoadScene(const char* path, bool transpose_inst_matrices)
   uint32_t texW, texH;
   auto texData = LoadBMP("../resources/textures/texture1.bmp", &texW, &texH);
   
-  m_imageData    = vk_utils::allocateColorTextureFromDataLDR(m_device, m_physicalDevice, (const unsigned char*)texData.data(), texW, texH, 1, VK_FORMAT_R8G8B8A8_UNORM,
-                                                             m_pCopyHelper, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  // on unified memory devices texture is written in place, without copy helper
+  VkImageLayout texLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  m_imageData    = AllocateColorTextureLDR(m_device, m_physicalDevice, (const unsigned char*)texData.data(), texW, texH, 1, VK_FORMAT_R8G8B8A8_UNORM,
+                                           m_pCopyHelper, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, texLayout);
 
   m_imageSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT);
   
-  // transfer our texture layout from VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL 
+  // transfer our texture layout from VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL (or PREINITIALIZED) to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL 
   //
   VkCommandBuffer commandBuffer = vk_utils::createCommandBuffer(m_device, m_commandPool);
     
@@ -359,7 +374,7 @@ void Quad2D_Render::LoadScene(const char* path, bool transpose_inst_matrices)
   
       imgBar.srcAccessMask = 0;
       imgBar.dstAccessMask = 0;
-      imgBar.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      imgBar.oldLayout     = texLayout;
       imgBar.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
       imgBar.image         = m_imageData.image;
   
@@ -390,15 +405,21 @@ void Quad2D_Render::LoadScene(const char* path, bool transpose_inst_matrices)
 
 void Quad2D_Render::DrawFrameSimple()
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  const uint32_t frameId = m_presentationResources.currentFrame;
+  vkWaitForFences(m_device, 1, &m_frameFences[frameId], VK_TRUE, UINT64_MAX);
 
   uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable[frameId], &imageIdx);
 
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
+  // swapchain may return images out of order, so the image can still be used by another frame in flight
+  if (m_imageFences[imageIdx] != VK_NULL_HANDLE)
+    vkWaitForFences(m_device, 1, &m_imageFences[imageIdx], VK_TRUE, UINT64_MAX);
+  m_imageFences[imageIdx] = m_frameFences[frameId];
+  vkResetFences(m_device, 1, &m_frameFences[frameId]);
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
+  auto currentCmdBuf = m_cmdBuffersDrawMain[frameId];
+
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable[frameId]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
   BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view);
@@ -411,14 +432,14 @@ void Quad2D_Render::DrawFrameSimple()
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &currentCmdBuf;
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
+  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished[frameId]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[frameId]));
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+                                                 m_presentationResources.renderingFinished[frameId]);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -430,8 +451,6 @@ void Quad2D_Render::DrawFrameSimple()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
-
-  vkQueueWaitIdle(m_presentationResources.queue);
 }
 
 void Quad2D_Render::DrawFrame(float a_time, DrawMode a_mode)
@@ -17,7 +17,8 @@
 class Quad2D_Render : public IRender
 {
 public:
-  Quad2D_Render(uint32_t a_width, uint32_t a_height);
+  // a_framesInFlight - how many frames cpu may record ahead of gpu
+  Quad2D_Render(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight = 2);
   ~Quad2D_Render()  { Cleanup(); };
 
   inline uint32_t     GetWidth()      const override { return m_width; }
@@ -67,11 +68,12 @@ private:
   {
     uint32_t    currentFrame      = 0u;
     VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> imageAvailable;    // per frame in flight
+    std::vector<VkSemaphore> renderingFinished;
   } m_presentationResources;
 
   std::vector<VkFence> m_frameFences;
+  std::vector<VkFence> m_imageFences; // fence of the frame which uses swapchain image now, if any
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
   VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
 
@@ -1,5 +1,10 @@
 #include "shadowmap_render.h"
 #include "utils/glfw_window.h"
+#include "utils/offscreen_loop.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int deviceID)
 {
@@ -18,31 +23,78 @@ void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int devic
   {
     VkSurfaceKHR surface;
     VK_CHECK_RESULT(glfwCreateWindowSurface(app->GetVkInstance(), window, nullptr, &surface));
-//    setupImGuiContext(window);
+    setupImGuiContext(window);
     app->InitPresentation(surface);
   }
 }
 
-int main()
+int main(int argc, const char** argv)
 {
   constexpr int WIDTH = 1024;
   constexpr int HEIGHT = 1024;
   constexpr int VULKAN_DEVICE_ID = 0;
 
-  std::shared_ptr<IRender> app = std::make_unique<SimpleShadowmapRender>(WIDTH, HEIGHT);
+  // number of frames in flight may be passed as the first argument, 1 makes cpu wait for every frame.
+  // "-headless N" renders N frames without window, "-readback" reads every frame back,
+  // "-out" saves the last frame and "-ref" compares it with the given image.
+  // "-record path" saves cameras of every frame, "-replay path" draws them with fixed time step,
+  // "-times path" writes cpu and gpu time of every frame, "-animate" moves the first instance of the scene
+  uint32_t framesInFlight = 2;
+  bool headless = false;
+  bool animate  = false;
+  OffscreenRun offscreenRun;
+  CameraReplay replay;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "-headless") == 0 && i + 1 < argc)
+    {
+      headless = true;
+      offscreenRun.framesNum = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 1));
+    }
+    else if(strcmp(argv[i], "-readback") == 0)
+      offscreenRun.readback = true;
+    else if(strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+      offscreenRun.imagePath = argv[++i];
+    else if(strcmp(argv[i], "-ref") == 0 && i + 1 < argc)
+      offscreenRun.refPath = argv[++i];
+    else if(strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+      replay.recordPath = argv[++i];
+    else if(strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+      replay.replayPath = argv[++i];
+    else if(strcmp(argv[i], "-times") == 0 && i + 1 < argc)
+      replay.timesPath = argv[++i];
+    else if(strcmp(argv[i], "-animate") == 0)
+      animate = true;
+    else if(i == 1)
+      framesInFlight = static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1));
+  }
+
+  auto render = std::make_shared<SimpleShadowmapRender>(WIDTH, HEIGHT, framesInFlight);
+  render->SetAnimateInstance(animate);
+  std::shared_ptr<IRender> app = render;
   if(app == nullptr)
   {
     std::cout << "Can't create render of specified type" << std::endl;
     return 1;
   }
 
+  if(headless)
+  {
+    app->InitVulkan(nullptr, 0, VULKAN_DEVICE_ID);
+    app->InitOffscreen();
+    app->LoadScene("../resources/scenes/043_cornell_normals/statex_00001.xml", false);
+    offscreenRun.replay = replay;
+    return offscreenLoop(app, offscreenRun);
+  }
+
   auto* window = initWindow(WIDTH, HEIGHT);
 
   initVulkanGLFW(app, window, VULKAN_DEVICE_ID);
 
   app->LoadScene("../resources/scenes/043_cornell_normals/statex_00001.xml", false);
 
-  mainLoop(app, window);
+  bool showGUI = true;
+  mainLoop(app, window, showGUI, replay);
 
   return 0;
 }
@@ -5,7 +5,13 @@
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 
-SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight) :
+  m_width(a_width), m_height(a_height), m_framesInFlight(std::max(a_framesInFlight, 1u))
 {
 #ifdef NDEBUG
   m_enableValidation = false;
@@ -17,11 +23,36 @@ SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height
 void SimpleShadowmapRender::SetupDeviceFeatures()
 {
   // m_enabledDeviceFeatures.fillModeNonSolid = VK_TRUE;
+
+  // optional, VK_KHR_timeline_semaphore is core only since Vulkan 1.2
+  uint32_t extensionsNum = 0;
+  vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionsNum, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionsNum);
+  vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionsNum, extensions.data());
+  const bool hasTimeline = std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties &a_ext) {
+    return strcmp(a_ext.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0;
+  });
+
+  m_timelineFeatures = {};
+  m_timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  if(hasTimeline)
+  {
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &m_timelineFeatures;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+  }
+
+  m_asyncUpload = hasTimeline && m_timelineFeatures.timelineSemaphore == VK_TRUE;
+  if(m_asyncUpload)
+    m_deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
 }
 
 void SimpleShadowmapRender::SetupDeviceExtensions()
 {
-  m_deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  // there are no window system extensions in headless mode, so swapchain is not needed as well
+  if(!m_instanceExtensions.empty())
+    m_deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 }
 
 void SimpleShadowmapRender::SetupValidationLayers()
@@ -47,19 +78,45 @@ void SimpleShadowmapRender::InitVulkan(const char** a_instanceExtensions, uint32
 
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
+  m_cmdBuffersUpload = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+  CreateFrameSyncObjects();
 
   m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer, m_queueFamilyIDXs.graphics, false);
+  m_pScnMgr->SetLoaderThreadsNum(std::thread::hardware_concurrency());
+  m_pScnMgr->SetAsyncUpload(m_asyncUpload);
+
+  m_pPipelineCache = std::make_unique<PipelineCache>(m_device, m_physicalDevice, PipelineCache::DEFAULT_PATH);
+}
+
+void SimpleShadowmapRender::CreateImageResources(uint32_t a_imagesNum)
+{
+  // everything a recorded command buffer refers to belongs to one image, so it may be submitted again
+  // as soon as the previous submit of the same image is finished
+  m_imagesNum          = a_imagesNum;
+  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_imagesNum);
+  m_cmdBuffersProfile  = vk_utils::createCommandBuffers(m_device, m_commandPool, m_imagesNum);
+  m_guiScopes.assign(m_imagesNum, UINT32_MAX);
+  m_recordedKeys.assign(m_imagesNum, RECORD_DIRTY);
+
+  m_pProfiler    = std::make_unique<FrameProfiler>(m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_imagesNum);
+  m_pCmdRecorder = std::make_unique<SecondaryCmdRecorder>(m_device, m_queueFamilyIDXs.graphics,
+                                                          std::thread::hardware_concurrency(),
+                                                          m_imagesNum * SCENE_PASSES_NUM);
+}
+
+void SimpleShadowmapRender::DestroyImageResources()
+{
+  m_pCmdRecorder = nullptr;
+  m_pProfiler    = nullptr;
+  if(!m_cmdBuffersProfile.empty())
+  {
+    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersProfile.size()),
+                         m_cmdBuffersProfile.data());
+    m_cmdBuffersProfile.clear();
+  }
+  m_guiScopes.clear();
+  m_recordedKeys.clear();
 }
 
 void SimpleShadowmapRender::InitPresentation(VkSurfaceKHR &a_surface)
@@ -69,11 +126,18 @@ void SimpleShadowmapRender::InitPresentation(VkSurfaceKHR &a_surface)
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
                                                               m_width, m_height, m_framesInFlight, m_vsync);
   m_presentationResources.currentFrame = 0;
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
+  CreateImageResources(m_swapchain.GetImageCount());
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  m_presentationResources.imageAvailable.resize(m_framesInFlight);
+  m_presentationResources.renderingFinished.resize(m_framesInFlight);
+  for (uint32_t i = 0; i < m_framesInFlight; ++i)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable[i]));
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished[i]));
+  }
   m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat());
 
   std::vector<VkFormat> depthFormats = {
@@ -94,31 +158,181 @@ void SimpleShadowmapRender::InitPresentation(VkSurfaceKHR &a_surface)
                     vk_utils::RenderTargetInfo2D{ VkExtent2D{ m_width, m_height }, m_swapchain.GetFormat(),                                        // this is debug full scree quad
                                                   VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }); // seems we need LOAD_OP_LOAD if we want to draw quad to part of screen
 
-  // create shadow map
+  CreateShadowMap();
+
+  // GUI is optional, there is no ImGui context if window is not set up for it
+  if(ImGui::GetCurrentContext() != nullptr)
+  {
+    m_pGUIRender = std::make_shared<ImGuiRender>(m_instance, m_device, m_physicalDevice, m_queueFamilyIDXs.graphics,
+                                                 m_graphicsQueue, m_swapchain, m_pPipelineCache->Get());
+  }
+}
+
+void SimpleShadowmapRender::InitOffscreen()
+{
+  m_presentationResources.currentFrame = 0;
+  // there are no swapchain images, every frame in flight has its own command buffer and readback buffer
+  CreateImageResources(m_framesInFlight);
+
+  // color and depth of the main pass, pipelines are made for its render pass instead of the screen one
   //
-  m_pShadowMap2 = std::make_shared<vk_utils::RenderTarget>(m_device, VkExtent2D{2048, 2048});
+  m_pOffscreen = std::make_shared<vk_utils::RenderTarget>(m_device, VkExtent2D{m_width, m_height});
+
+  vk_utils::AttachmentInfo infoColor;
+  infoColor.format           = VK_FORMAT_R8G8B8A8_UNORM;
+  infoColor.usage            = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  infoColor.imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
+  m_offscreenColorId         = m_pOffscreen->CreateAttachment(infoColor);
+
+  std::vector<VkFormat> depthFormats = {
+      VK_FORMAT_D32_SFLOAT,
+      VK_FORMAT_D32_SFLOAT_S8_UINT,
+      VK_FORMAT_D24_UNORM_S8_UINT,
+      VK_FORMAT_D16_UNORM_S8_UINT,
+      VK_FORMAT_D16_UNORM
+  };
+  vk_utils::AttachmentInfo infoDepth;
+  vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &infoDepth.format);
+  infoDepth.usage            = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  infoDepth.imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
+  m_pOffscreen->CreateAttachment(infoDepth);
+
+  // both attachments share one allocation
+  auto memReqs = m_pOffscreen->GetMemoryRequirements();
+  std::vector<VkDeviceSize> offsets(memReqs.size());
+  VkDeviceSize allocSize = 0;
+  uint32_t memTypeBits   = UINT32_MAX;
+  for(size_t i = 0; i < memReqs.size(); ++i)
+  {
+    offsets[i]   = vk_utils::getPaddedSize(allocSize, memReqs[i].alignment);
+    allocSize    = offsets[i] + memReqs[i].size;
+    memTypeBits &= memReqs[i].memoryTypeBits;
+  }
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = allocSize;
+  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physicalDevice);
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_memOffscreen));
+
+  m_pOffscreen->CreateViewAndBindMemory(m_memOffscreen, offsets);
+  m_pOffscreen->CreateDefaultRenderPass();
+  m_screenRenderPass = m_pOffscreen->m_renderPass;
+
+  CreateShadowMap();
+  CreateReadbackBuffers();
+}
+
+void SimpleShadowmapRender::CreateShadowMap()
+{
+  m_pShadowMap2       = std::make_shared<vk_utils::RenderTarget>(m_device, VkExtent2D{2048, 2048});
+  m_pDynamicShadowMap = std::make_shared<vk_utils::RenderTarget>(m_device, VkExtent2D{2048, 2048});
 
   vk_utils::AttachmentInfo infoDepth;
   infoDepth.format           = VK_FORMAT_D16_UNORM;
   infoDepth.usage            = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
   infoDepth.imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
   m_shadowMapId              = m_pShadowMap2->CreateAttachment(infoDepth);
-  auto memReq                = m_pShadowMap2->GetMemoryRequirements()[0]; // we know that we have only one texture
+  m_pDynamicShadowMap->CreateAttachment(infoDepth);
+  auto memReq                = m_pShadowMap2->GetMemoryRequirements()[0]; // we know that we have only one texture, the same in both maps
   
-  // memory for all shadowmaps (well, if you have them more than 1 ...)
+  // memory for all shadowmaps, dynamic one follows static one
+  const VkDeviceSize dynamicOffset = vk_utils::getPaddedSize(memReq.size, memReq.alignment);
   {
     VkMemoryAllocateInfo allocateInfo = {};
     allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocateInfo.pNext           = nullptr;
-    allocateInfo.allocationSize  = memReq.size;
+    allocateInfo.allocationSize  = dynamicOffset + memReq.size;
     allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physicalDevice);
 
     VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, NULL, &m_memShadowMap));
   }
 
   m_pShadowMap2->CreateViewAndBindMemory(m_memShadowMap, {0});
-  m_pShadowMap2->CreateDefaultSampler();
-  m_pShadowMap2->CreateDefaultRenderPass();
+  m_pDynamicShadowMap->CreateViewAndBindMemory(m_memShadowMap, {dynamicOffset});
+  for(const auto &shadowMap : {m_pShadowMap2, m_pDynamicShadowMap})
+  {
+    shadowMap->CreateDefaultSampler();
+    shadowMap->CreateDefaultRenderPass();
+  }
+  InvalidateShadowCache();
+}
+
+void SimpleShadowmapRender::CreateReadbackBuffers()
+{
+  const VkDeviceSize frameSize = VkDeviceSize(m_width) * m_height * sizeof(uint32_t);
+
+  m_readbacks.resize(m_framesInFlight);
+  for(auto &readback : m_readbacks)
+  {
+    VkMemoryRequirements memReq;
+    readback.buffer = vk_utils::createBuffer(m_device, frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, &memReq);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize  = memReq.size;
+    allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+                                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                            m_physicalDevice);
+    VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &readback.mem));
+    VK_CHECK_RESULT(vkBindBufferMemory(m_device, readback.buffer, readback.mem, 0));
+
+    vkMapMemory(m_device, readback.mem, 0, frameSize, 0, &readback.mappedMem);
+  }
+}
+
+void SimpleShadowmapRender::ReadbackCmd(VkCommandBuffer a_cmdBuff, uint32_t a_imageIdx)
+{
+  // default render pass of RenderTarget leaves color attachment in shader read layout,
+  // the next frame doesn't care about its contents
+  const auto &color = m_pOffscreen->m_attachments[m_offscreenColorId];
+  VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vk_utils::setImageLayout(a_cmdBuff, color.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, range,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent                 = VkExtent3D{m_width, m_height, 1};
+  vkCmdCopyImageToBuffer(a_cmdBuff, color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbacks[a_imageIdx].buffer,
+                         1, &region);
+
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask       = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer              = m_readbacks[a_imageIdx].buffer;
+  barrier.offset              = 0;
+  barrier.size                = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+bool SimpleShadowmapRender::ReadbackFrame(std::vector<uint32_t> &a_pixels, bool a_waitLast)
+{
+  if(!m_readback || m_readbacks.empty())
+    return false;
+
+  // frames in flight are finished in order of submission, so the search goes from the last submitted one
+  for(uint32_t i = 0; i < m_framesInFlight; ++i)
+  {
+    const uint32_t frameId = (m_presentationResources.currentFrame + m_framesInFlight - 1 - i) % m_framesInFlight;
+    if(!m_readbacks[frameId].recorded)
+      continue;
+
+    if(a_waitLast)
+      vkWaitForFences(m_device, 1, &m_frameFences[frameId], VK_TRUE, UINT64_MAX);
+    else if(vkGetFenceStatus(m_device, m_frameFences[frameId]) != VK_SUCCESS)
+      continue;
+
+    a_pixels.resize(size_t(m_width) * m_height);
+    memcpy(a_pixels.data(), m_readbacks[frameId].mappedMem, a_pixels.size() * sizeof(uint32_t));
+    return true;
+  }
+  return false;
 }
 
 void SimpleShadowmapRender::CreateInstance()
@@ -146,7 +360,8 @@ void SimpleShadowmapRender::CreateDevice(uint32_t a_deviceId)
   SetupDeviceFeatures();
   m_device = vk_utils::createLogicalDevice(m_physicalDevice, m_validationLayers, m_deviceExtensions,
                                            m_enabledDeviceFeatures, m_queueFamilyIDXs,
-                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT);
+                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT,
+                                           m_asyncUpload ? &m_timelineFeatures : nullptr);
 
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.graphics, 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.transfer, 0, &m_transferQueue);
@@ -156,18 +371,25 @@ void SimpleShadowmapRender::CreateDevice(uint32_t a_deviceId)
 void SimpleShadowmapRender::SetupSimplePipeline()
 {
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1},
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,     1}
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             m_imagesNum},
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,     2 * m_imagesNum + 1},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,             5 * CULL_VIEWS_NUM}
   };
 
-  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 2);
+  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, m_imagesNum + 1 + 2 * CULL_VIEWS_NUM);
   
-  auto shadowMap = m_pShadowMap2->m_attachments[m_shadowMapId];
+  auto shadowMap        = m_pShadowMap2->m_attachments[m_shadowMapId];
+  auto dynamicShadowMap = m_pDynamicShadowMap->m_attachments[m_shadowMapId];
 
-  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  m_pBindings->BindImage (1, shadowMap.view, m_pShadowMap2->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-  m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+  // matrices of light and camera are taken by vertex and culling shaders as well
+  for(auto &frame : m_frameUniforms)
+  {
+    m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+    m_pBindings->BindBuffer(0, frame.ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    m_pBindings->BindImage (1, shadowMap.view, m_pShadowMap2->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    m_pBindings->BindImage (2, dynamicShadowMap.view, m_pDynamicShadowMap->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    m_pBindings->BindEnd(&frame.dSet, &m_dSetLayout);
+  }
 
   //m_pBindings->BindImage(0, m_GBufTarget->m_attachments[m_GBuf_idx[GBUF_ATTACHMENT::POS_Z]].view, m_GBufTarget->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
@@ -175,6 +397,20 @@ void SimpleShadowmapRender::SetupSimplePipeline()
   m_pBindings->BindImage(0, shadowMap.view, m_pShadowMap2->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
   m_pBindings->BindEnd(&m_quadDS, &m_quadDSLayout);
 
+  for(auto &view : m_culledViews)
+  {
+    m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT);
+    m_pBindings->BindBuffer(0, view.visibleMatrices);
+    m_pBindings->BindEnd(&view.instDS, &m_instDSLayout);
+
+    m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    m_pBindings->BindBuffer(0, m_pScnMgr->GetInstanceBoxesBuffer());
+    m_pBindings->BindBuffer(1, m_pScnMgr->GetInstanceMatricesBuffer());
+    m_pBindings->BindBuffer(2, view.draws);
+    m_pBindings->BindBuffer(3, view.visibleMatrices);
+    m_pBindings->BindEnd(&view.cullDS, &m_cullDSLayout);
+  }
+
   // if we are recreating pipeline (for example, to reload shaders)
   // we need to cleanup old pipeline
   if(m_basicForwardPipeline.layout != VK_NULL_HANDLE)
@@ -188,78 +424,274 @@ void SimpleShadowmapRender::SetupSimplePipeline()
     m_basicForwardPipeline.pipeline = VK_NULL_HANDLE;
   }
 
+  if(m_shadowPipeline.layout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_shadowPipeline.layout, nullptr);
+    m_shadowPipeline.layout = VK_NULL_HANDLE;
+  }
   if(m_shadowPipeline.pipeline != VK_NULL_HANDLE)
   {
     vkDestroyPipeline(m_device, m_shadowPipeline.pipeline, nullptr);
     m_shadowPipeline.pipeline = VK_NULL_HANDLE;
   }
 
-  vk_utils::GraphicsPipelineMaker maker;
-  
+  // pipelines don't depend on each other, so each one is compiled on its own thread with its own maker.
+  // layouts of forward and shadow pipelines are identical, so they are compatible for binding and push constants
+  const auto buildStart = std::chrono::high_resolution_clock::now();
+
   // pipeline for drawing objects
   //
-  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
-  {
+  auto buildForward = [this]() {
+    vk_utils::GraphicsPipelineMaker maker;
+
+    std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
     shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/simple_shadow.frag.spv";
     shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = "../resources/shaders/simple.vert.spv";
-  }
-  maker.LoadShaders(m_device, shader_paths);
+    maker.LoadShaders(m_device, shader_paths);
 
-  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
-  maker.SetDefaultState(m_width, m_height);
+    m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout, m_instDSLayout}, sizeof(pushConst));
+    maker.SetDefaultState(m_width, m_height);
+
+    m_basicForwardPipeline.pipeline = MakeGraphicsPipeline(maker, m_device, m_pPipelineCache->Get(), m_basicForwardPipeline.layout,
+                                                           m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), m_screenRenderPass,
+                                                           {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  };
 
-  m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
-                                                       m_screenRenderPass);
-                                                       //, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR}
-  
   // pipeline for rendering objects to shadowmap
   //
-  // maker.SetDefaultState(m_width, m_height);
-  shader_paths.clear();
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/simple.vert.spv";
-  maker.LoadShaders(m_device, shader_paths);
+  auto buildShadow = [this]() {
+    vk_utils::GraphicsPipelineMaker maker;
 
-  maker.viewport.width  = float(m_pShadowMap2->m_resolution.width);
-  maker.viewport.height = float(m_pShadowMap2->m_resolution.height);
-  maker.scissor.extent  = VkExtent2D{ uint32_t(m_pShadowMap2->m_resolution.width), uint32_t(m_pShadowMap2->m_resolution.height) };
+    std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+    shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/simple.vert.spv";
+    maker.LoadShaders(m_device, shader_paths);
 
-  m_shadowPipeline.layout   = m_basicForwardPipeline.layout;
-  m_shadowPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), 
-                                                 m_pShadowMap2->m_renderPass);                                                       
+    m_shadowPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout, m_instDSLayout}, sizeof(pushConst));
+    maker.SetDefaultState(m_width, m_height);
+
+    maker.viewport.width  = float(m_pShadowMap2->m_resolution.width);
+    maker.viewport.height = float(m_pShadowMap2->m_resolution.height);
+    maker.scissor.extent  = VkExtent2D{ uint32_t(m_pShadowMap2->m_resolution.width), uint32_t(m_pShadowMap2->m_resolution.height) };
+
+    m_shadowPipeline.pipeline = MakeGraphicsPipeline(maker, m_device, m_pPipelineCache->Get(), m_shadowPipeline.layout,
+                                                     m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), m_pShadowMap2->m_renderPass,
+                                                     {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  };
+
+  BuildPipelinesParallel({buildForward, buildShadow, [this]() { SetupCullingPipeline(); }});
+
+  const auto buildEnd = std::chrono::high_resolution_clock::now();
+  std::cout << "Pipelines are built in " << std::chrono::duration<float, std::milli>(buildEnd - buildStart).count()
+            << " ms, pipeline cache is " << (m_pPipelineCache->LoadedBytes() > 0 ? "warm" : "cold") << std::endl;
+}
+
+void SimpleShadowmapRender::SetupCullingPipeline()
+{
+  if(m_cullPipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_cullPipeline, nullptr);
+    m_cullPipeline = VK_NULL_HANDLE;
+  }
+  if(m_cullPipelineLayout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, nullptr);
+    m_cullPipelineLayout = VK_NULL_HANDLE;
+  }
+
+  std::vector<uint32_t> code = vk_utils::readSPVFile("../resources/shaders/cull_instances.comp.spv");
+  VkShaderModuleCreateInfo createInfo = {};
+  createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.pCode    = code.data();
+  createInfo.codeSize = code.size() * sizeof(uint32_t);
+
+  VkShaderModule shaderModule;
+  VK_CHECK_RESULT(vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule));
+
+  VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
+  shaderStageCreateInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStageCreateInfo.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+  shaderStageCreateInfo.module = shaderModule;
+  shaderStageCreateInfo.pName  = "main";
+
+  VkPushConstantRange pcRange = {};
+  pcRange.offset     = 0;
+  pcRange.size       = sizeof(cullPushConst);
+  pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+  pipelineLayoutCreateInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  VkDescriptorSetLayout setLayouts[] = {m_cullDSLayout, m_dSetLayout};
+  pipelineLayoutCreateInfo.setLayoutCount         = 2;
+  pipelineLayoutCreateInfo.pSetLayouts            = setLayouts;
+  pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pipelineLayoutCreateInfo.pPushConstantRanges    = &pcRange;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_cullPipelineLayout));
+
+  VkComputePipelineCreateInfo pipelineCreateInfo = {};
+  pipelineCreateInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineCreateInfo.stage  = shaderStageCreateInfo;
+  pipelineCreateInfo.layout = m_cullPipelineLayout;
+  VK_CHECK_RESULT(vkCreateComputePipelines(m_device, m_pPipelineCache->Get(), 1, &pipelineCreateInfo, nullptr, &m_cullPipeline));
+
+  vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
+
+void SimpleShadowmapRender::CreateCullingBuffers()
+{
+  const VkDeviceSize drawsSize    = m_pScnMgr->GetMeshDraws().size() * sizeof(VkDrawIndexedIndirectCommand);
+  const VkDeviceSize matricesSize = m_pScnMgr->InstancesNum() * sizeof(float4x4);
+
+  std::vector<VkBuffer> buffers;
+  for(auto &view : m_culledViews)
+  {
+    view.draws = vk_utils::createBuffer(m_device, drawsSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                              VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    view.visibleMatrices = vk_utils::createBuffer(m_device, matricesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    buffers.push_back(view.draws);
+    buffers.push_back(view.visibleMatrices);
+  }
+
+  VkMemoryAllocateFlags allocFlags {};
+  m_cullingAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice, buffers, allocFlags);
+}
+
+void SimpleShadowmapRender::DestroyCullingBuffers()
+{
+  for(auto &view : m_culledViews)
+  {
+    if(view.draws != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, view.draws, nullptr);
+    if(view.visibleMatrices != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, view.visibleMatrices, nullptr);
+    view = CulledView{};
+  }
+
+  if(m_cullingAlloc != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_device, m_cullingAlloc, nullptr);
+    m_cullingAlloc = VK_NULL_HANDLE;
+  }
 }
 
 void SimpleShadowmapRender::CreateUniformBuffer()
 {
-  VkMemoryRequirements memReq;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+  m_frameUniforms.resize(m_imagesNum);
+  for(auto &frame : m_frameUniforms)
+  {
+    VkMemoryRequirements memReq;
+    frame.ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext = nullptr;
-  allocateInfo.allocationSize = memReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
-                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                          m_physicalDevice);
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, 0));
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext = nullptr;
+    allocateInfo.allocationSize = memReq.size;
+    allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+                                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                            m_physicalDevice);
+    VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &frame.uboAlloc));
+    VK_CHECK_RESULT(vkBindBufferMemory(m_device, frame.ubo, frame.uboAlloc, 0));
+
+    vkMapMemory(m_device, frame.uboAlloc, 0, sizeof(m_uniforms), 0, &frame.mappedMem);
+  }
 
-  vkMapMemory(m_device, m_uboAlloc, 0, sizeof(m_uniforms), 0, &m_uboMappedMem);
+  for(uint32_t i = 0; i < m_imagesNum; ++i)
+    UpdateUniformBuffer(0.0f, i);
+}
 
-  UpdateUniformBuffer(0.0f);
+void SimpleShadowmapRender::DestroyUniformBuffer()
+{
+  for (auto &frame : m_frameUniforms)
+  {
+    if (frame.mappedMem != nullptr)
+      vkUnmapMemory(m_device, frame.uboAlloc);
+    vkDestroyBuffer(m_device, frame.ubo, nullptr);
+    vkFreeMemory(m_device, frame.uboAlloc, nullptr);
+  }
+  m_frameUniforms.clear();
 }
 
-void SimpleShadowmapRender::UpdateUniformBuffer(float a_time)
+void SimpleShadowmapRender::UpdateUniformBuffer(float a_time, uint32_t a_imageIdx)
 {
-  m_uniforms.lightMatrix = m_lightMatrix;
+  FrameProfiler::CpuScope profile(m_pProfiler.get(), "UpdateUniformBuffer");
+
+  m_uniforms.lightMatrix  = m_lightMatrix;
+  m_uniforms.cameraMatrix = m_worldViewProj;
   m_uniforms.lightPos    = m_light.cam.pos; //LiteMath::float3(sinf(a_time), 1.0f, cosf(a_time));
   m_uniforms.time        = a_time;
 
   m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
-  memcpy(m_uboMappedMem, &m_uniforms, sizeof(m_uniforms));
+  memcpy(m_frameUniforms[a_imageIdx].mappedMem, &m_uniforms, sizeof(m_uniforms));
+}
+
+void SimpleShadowmapRender::CullInstancesCmd(VkCommandBuffer a_cmdBuff, CullView a_view, uint32_t a_imageIdx,
+                                             uint32_t a_casters)
+{
+  const auto &view = m_culledViews[a_view];
+
+  // previous use of draws and visible matrices must be finished before they are overwritten
+  VkMemoryBarrier memBarrier = {};
+  memBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBarrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  memBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBarrier, 0, nullptr, 0, nullptr);
+
+  // reset instance counts
+  VkBufferCopy region = {};
+  region.size = m_pScnMgr->GetMeshDraws().size() * sizeof(VkDrawIndexedIndirectCommand);
+  vkCmdCopyBuffer(a_cmdBuff, m_pScnMgr->GetMeshDrawsBuffer(), view.draws, 1, &region);
+
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer              = view.draws;
+  barrier.offset              = 0;
+  barrier.size                = region.size;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+  cullPushConst.viewId       = a_view;
+  cullPushConst.instancesNum = m_pScnMgr->InstancesNum();
+  cullPushConst.casters      = a_casters;
+
+  // view matrix is read from uniforms of the image
+  VkDescriptorSet cullSets[] = {view.cullDS, m_frameUniforms[a_imageIdx].dSet};
+  vkCmdBindPipeline      (a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 2, cullSets, 0, nullptr);
+  vkCmdPushConstants     (a_cmdBuff, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConst), &cullPushConst);
+
+  const uint32_t groupSize = 256; // same as GROUP_SIZE in cull_instances.comp
+  vkCmdDispatch(a_cmdBuff, (cullPushConst.instancesNum + groupSize - 1) / groupSize, 1, 1);
+
+  VkBufferMemoryBarrier culled[2] = {barrier, barrier};
+  culled[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  culled[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  culled[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  culled[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  culled[1].buffer        = view.visibleMatrices;
+  culled[1].size          = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 2, culled, 0, nullptr);
 }
 
-void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp)
+void SimpleShadowmapRender::CreateFrameSyncObjects()
+{
+  m_frameFences.resize(m_framesInFlight);
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for (size_t i = 0; i < m_framesInFlight; i++)
+  {
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+  }
+}
+
+void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, CullView a_view, uint32_t a_imageIdx,
+                                         uint32_t a_firstDraw, uint32_t a_drawsNum)
 {
   VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
@@ -269,22 +701,77 @@ void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4
   
   vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
   vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
+  VkDescriptorSet sets[] = {m_frameUniforms[a_imageIdx].dSet, m_culledViews[a_view].instDS};
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 2,
+                          sets, 0, VK_NULL_HANDLE);
+
+  // local copy, scene passes may be recorded on several threads at once
+  auto pushConstCopy = pushConst;
+  pushConstCopy.viewId = a_view;
+  vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConstCopy), &pushConstCopy);
+
+  // vertex shader takes model matrices of visible instances by gl_InstanceIndex
+  m_pScnMgr->DrawMarkedInstances(a_cmdBuff, m_culledViews[a_view].draws, a_firstDraw, a_drawsNum);
+}
 
-  pushConst2M.projView = a_wvp;
-  for (size_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+void SimpleShadowmapRender::RecordScenePassCmd(VkCommandBuffer a_cmdBuff, ScenePass a_pass, VkPipeline a_pipeline,
+                                               uint32_t a_imageIdx, uint32_t a_firstDraw, uint32_t a_drawsNum)
+{
+  // set in every command buffer of a pass, secondary command buffers don't inherit dynamic state
+  if(a_pass == SCENE_PASS_SHADOW || a_pass == SCENE_PASS_DYNAMIC_SHADOW)
   {
-    auto inst         = m_pScnMgr->GetInstanceInfo(i);
-    pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
-    vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConst2M), &pushConst2M);
+    const uint32_t width  = uint32_t(m_pShadowMap2->m_resolution.width);
+    const uint32_t height = uint32_t(m_pShadowMap2->m_resolution.height);
+    vk_utils::setDefaultViewport(a_cmdBuff, static_cast<float>(width), static_cast<float>(height));
+    vk_utils::setDefaultScissor(a_cmdBuff, width, height);
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline.pipeline);
+    DrawSceneCmd(a_cmdBuff, CULL_VIEW_LIGHT, a_imageIdx, a_firstDraw, a_drawsNum);
+  }
+  else
+  {
+    vk_utils::setDefaultViewport(a_cmdBuff, static_cast<float>(m_width), static_cast<float>(m_height));
+    vk_utils::setDefaultScissor(a_cmdBuff, m_width, m_height);
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+    DrawSceneCmd(a_cmdBuff, CULL_VIEW_CAMERA, a_imageIdx, a_firstDraw, a_drawsNum);
+  }
+}
 
-    auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
-    vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+void SimpleShadowmapRender::ExecuteScenePassCmd(VkCommandBuffer a_cmdBuff, const VkRenderPassBeginInfo &a_passInfo,
+                                                ScenePass a_pass, VkPipeline a_pipeline, uint32_t a_imageIdx)
+{
+  if(!m_input.parallelRecording || m_pCmdRecorder == nullptr)
+  {
+    vkCmdBeginRenderPass(a_cmdBuff, &a_passInfo, VK_SUBPASS_CONTENTS_INLINE);
+    RecordScenePassCmd(a_cmdBuff, a_pass, a_pipeline, a_imageIdx, 0, UINT32_MAX);
+    vkCmdEndRenderPass(a_cmdBuff);
+    return;
   }
+
+  // mesh draws are split between recording threads, each one records its own secondary command buffer
+  VkCommandBufferInheritanceInfo inheritance = {};
+  inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.renderPass  = a_passInfo.renderPass;
+  inheritance.subpass     = 0;
+  inheritance.framebuffer = a_passInfo.framebuffer;
+
+  const uint32_t drawsNum = static_cast<uint32_t>(m_pScnMgr->GetMeshDraws().size());
+  auto secondary = m_pCmdRecorder->Record(a_imageIdx * SCENE_PASSES_NUM + a_pass, inheritance, drawsNum,
+    [this, a_pass, a_pipeline, a_imageIdx](VkCommandBuffer a_secondary, uint32_t a_first, uint32_t a_count) {
+      RecordScenePassCmd(a_secondary, a_pass, a_pipeline, a_imageIdx, a_first, a_count);
+    });
+
+  vkCmdBeginRenderPass(a_cmdBuff, &a_passInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  vkCmdExecuteCommands(a_cmdBuff, static_cast<uint32_t>(secondary.size()), secondary.data());
+  vkCmdEndRenderPass(a_cmdBuff);
 }
 
 void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                                     VkImageView a_targetImageView, VkPipeline a_pipeline)
+                                                     VkImageView a_targetImageView, VkPipeline a_pipeline,
+                                                     uint32_t a_imageIdx, uint32_t a_shadowPasses, bool a_guiFollows)
 {
+  FrameProfiler::CpuScope profile(m_pProfiler.get(), "BuildCommandBufferSimple");
+  ++m_recordsNum;
+
   vkResetCommandBuffer(a_cmdBuff, 0);
 
   VkCommandBufferBeginInfo beginInfo = {};
@@ -293,41 +780,68 @@ void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff,
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
 
-  VkViewport viewport{};
-  VkRect2D scissor{};
-  VkExtent2D ext;
-  ext.height = m_height;
-  ext.width  = m_width;
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width  = static_cast<float>(ext.width);
-  viewport.height = static_cast<float>(ext.height);
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  scissor.offset = {0, 0};
-  scissor.extent = ext;
-
-  std::vector<VkViewport> viewports = {viewport};
-  std::vector<VkRect2D> scissors = {scissor};
-  vkCmdSetViewport(a_cmdBuff, 0, 1, viewports.data());
-  vkCmdSetScissor(a_cmdBuff, 0, 1, scissors.data());
-
-  //// draw scene to shadowmap
+  // every pass is a gpu scope, they are outside of render passes as secondary command buffers may be inside
+  m_pProfiler->ResetCmd(a_cmdBuff, a_imageIdx);
+  uint32_t scope = 0;
+
+  //// draw casters to shadow maps which are out of date, the rest are kept from previous frames.
+  //   Both maps are culled to draws of light view one after another
   //
   VkClearValue clearDepth = {};
   clearDepth.depthStencil.depth   = 1.0f;
   clearDepth.depthStencil.stencil = 0;
   std::vector<VkClearValue> clear =  {clearDepth};
-  VkRenderPassBeginInfo renderToShadowMap = m_pShadowMap2->GetRenderPassBeginInfo(0, clear);
-  vkCmdBeginRenderPass(a_cmdBuff, &renderToShadowMap, VK_SUBPASS_CONTENTS_INLINE);
+  if(a_shadowPasses & SHADOW_PASS_STATIC)
   {
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline.pipeline);
-    DrawSceneCmd(a_cmdBuff, m_lightMatrix);
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "cull light static");
+    CullInstancesCmd(a_cmdBuff, CULL_VIEW_LIGHT, a_imageIdx, CULL_STATIC);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
+
+    VkRenderPassBeginInfo renderToShadowMap = m_pShadowMap2->GetRenderPassBeginInfo(0, clear);
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "shadow pass static");
+    ExecuteScenePassCmd(a_cmdBuff, renderToShadowMap, SCENE_PASS_SHADOW, a_pipeline, a_imageIdx);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
   }
-  vkCmdEndRenderPass(a_cmdBuff);
 
-  //// draw final scene to screen
+  if(a_shadowPasses & SHADOW_PASS_DYNAMIC)
+  {
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "cull light dynamic");
+    CullInstancesCmd(a_cmdBuff, CULL_VIEW_LIGHT, a_imageIdx, CULL_DYNAMIC);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
+
+    VkRenderPassBeginInfo renderToShadowMap = m_pDynamicShadowMap->GetRenderPassBeginInfo(0, clear);
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "shadow pass dynamic");
+    ExecuteScenePassCmd(a_cmdBuff, renderToShadowMap, SCENE_PASS_DYNAMIC_SHADOW, a_pipeline, a_imageIdx);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
+  }
+
+  //// cull instances for camera
+  //
+  scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "cull camera");
+  CullInstancesCmd(a_cmdBuff, CULL_VIEW_CAMERA, a_imageIdx);
+  m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
+
+  //// draw final scene to screen or offscreen target
   //
+  if(m_pOffscreen != nullptr)
+  {
+    VkClearValue clearColor = {};
+    clearColor.color = {0.0f, 0.0f, 0.0f, 1.0f};
+    std::vector<VkClearValue> clearValues = {clearColor, clearDepth};
+    VkRenderPassBeginInfo renderPassInfo = m_pOffscreen->GetRenderPassBeginInfo(0, clearValues);
+
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "main pass");
+    ExecuteScenePassCmd(a_cmdBuff, renderPassInfo, SCENE_PASS_MAIN, a_pipeline, a_imageIdx);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
+
+    if(m_readback)
+    {
+      scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "readback");
+      ReadbackCmd(a_cmdBuff, a_imageIdx);
+      m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
+    }
+  }
+  else
   {
     VkRenderPassBeginInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -342,27 +856,62 @@ void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff,
     renderPassInfo.clearValueCount = 2;
     renderPassInfo.pClearValues    = &clearValues[0];
 
-    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1, &m_dSet, 0, VK_NULL_HANDLE);
-
-    DrawSceneCmd(a_cmdBuff, m_worldViewProj);
-
-    vkCmdEndRenderPass(a_cmdBuff);
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "main pass");
+    ExecuteScenePassCmd(a_cmdBuff, renderPassInfo, SCENE_PASS_MAIN, a_pipeline, a_imageIdx);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
   }
 
-  if(m_input.drawFSQuad)
+  if(m_input.drawFSQuad && m_pFSQuad != nullptr)
   {
+    scope = m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "fs quad");
     float scaleAndOffset[4] = {0.5f, 0.5f, -0.5f, +0.5f};
     m_pFSQuad->SetRenderTarget(a_targetImageView);
     m_pFSQuad->DrawCmd(a_cmdBuff, m_quadDS, scaleAndOffset);
+    m_pProfiler->EndGpu(a_cmdBuff, a_imageIdx, scope);
   }
 
+  // ended by m_cmdBuffersProfile after GUI command buffer
+  m_guiScopes[a_imageIdx] = a_guiFollows ? m_pProfiler->BeginGpu(a_cmdBuff, a_imageIdx, "gui") : UINT32_MAX;
+
   VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
 }
 
 
+uint32_t SimpleShadowmapRender::RecordKey(bool a_gui, uint32_t a_shadowPasses) const
+{
+  // camera and light only change uniforms, these switches and redrawn shadow maps change commands
+  return (m_input.drawFSQuad        ? 1u : 0u) |
+         (m_input.parallelRecording ? 2u : 0u) |
+         (m_readback                ? 4u : 0u) |
+         (a_gui                     ? 8u : 0u) |
+         (a_shadowPasses << 4u);
+}
+
+uint32_t SimpleShadowmapRender::ShadowPassesToDraw()
+{
+  // maps are shared by all images and drawn in submit order, so the next frames see what this one draws
+  const bool lightChanged = memcmp(&m_shadowCache.lightMatrix, &m_lightMatrix, sizeof(m_lightMatrix)) != 0;
+  const uint64_t staticVersion  = m_pScnMgr->StaticInstancesVersion();
+  const uint64_t dynamicVersion = m_pScnMgr->DynamicInstancesVersion();
+
+  uint32_t passes = 0;
+  if(!m_input.cacheShadows || lightChanged || m_shadowCache.staticVersion != staticVersion)
+    passes |= SHADOW_PASS_STATIC;
+  if(!m_input.cacheShadows || lightChanged || m_shadowCache.dynamicVersion != dynamicVersion)
+    passes |= SHADOW_PASS_DYNAMIC;
+
+  m_shadowCache.lightMatrix    = m_lightMatrix;
+  m_shadowCache.staticVersion  = staticVersion;
+  m_shadowCache.dynamicVersion = dynamicVersion;
+  return passes;
+}
+
+void SimpleShadowmapRender::MarkCommandBuffersDirty()
+{
+  // pipelines, descriptor sets, framebuffers or scene are replaced, every image is rerecorded when it is drawn next time
+  m_recordedKeys.assign(m_imagesNum, RECORD_DIRTY);
+}
+
 void SimpleShadowmapRender::CleanupPipelineAndSwapchain()
 {
   if (!m_cmdBuffersDrawMain.empty())
@@ -376,6 +925,8 @@ void SimpleShadowmapRender::CleanupPipelineAndSwapchain()
   {
     vkDestroyFence(m_device, m_frameFences[i], nullptr);
   }
+  m_frameFences.clear();
+  m_imageFences.clear();
 
   vkDestroyImageView(m_device, m_depthBuffer.view, nullptr);
   vkDestroyImage(m_device, m_depthBuffer.image, nullptr);
@@ -411,28 +962,55 @@ void SimpleShadowmapRender::RecreateSwapChain()
   m_depthBuffer      = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
   m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+  CreateFrameSyncObjects();
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
 
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (size_t i = 0; i < m_swapchain.GetImageCount(); ++i)
+  // new swapchain may have another number of images (after resize or vsync switch),
+  // then uniforms, command buffers, profiler queries and recorder slots are made again for it
+  if(m_swapchain.GetImageCount() != m_imagesNum)
   {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    DestroyImageResources();
+    DestroyUniformBuffer();
+    CreateImageResources(m_swapchain.GetImageCount());
+    CreateUniformBuffer();
+    SetupSimplePipeline(); // descriptor sets are per image
   }
-
+  else
+    m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_imagesNum);
+  MarkCommandBuffersDirty();
 }
 
 void SimpleShadowmapRender::Cleanup()
 {
-  m_pShadowMap2 = nullptr;
-  m_pFSQuad     = nullptr; // smartptr delete it's resources
+  DestroyImageResources();
+  if(m_pGUIRender != nullptr)
+  {
+    m_pGUIRender = nullptr;
+    ImGui::DestroyContext();
+  }
+
+  m_pShadowMap2       = nullptr;
+  m_pDynamicShadowMap = nullptr;
+  m_pFSQuad           = nullptr; // smartptr delete it's resources
+
+  // render pass of offscreen target is destroyed with it
+  if(m_pOffscreen != nullptr)
+  {
+    m_pOffscreen       = nullptr;
+    m_screenRenderPass = VK_NULL_HANDLE;
+  }
+  if(m_memOffscreen != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_device, m_memOffscreen, VK_NULL_HANDLE);
+    m_memOffscreen = VK_NULL_HANDLE;
+  }
+  for(auto &readback : m_readbacks)
+  {
+    vkUnmapMemory(m_device, readback.mem);
+    vkDestroyBuffer(m_device, readback.buffer, nullptr);
+    vkFreeMemory(m_device, readback.mem, nullptr);
+  }
+  m_readbacks.clear();
   
   if(m_memShadowMap != VK_NULL_HANDLE)
   {
@@ -442,6 +1020,16 @@ void SimpleShadowmapRender::Cleanup()
 
   CleanupPipelineAndSwapchain();
 
+  DestroyCullingBuffers();
+  if (m_cullPipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_cullPipeline, nullptr);
+  }
+  if (m_cullPipelineLayout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, nullptr);
+  }
+
   if (m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
   {
     vkDestroyPipeline(m_device, m_basicForwardPipeline.pipeline, nullptr);
@@ -450,15 +1038,30 @@ void SimpleShadowmapRender::Cleanup()
   {
     vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
   }
+  if (m_shadowPipeline.pipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_shadowPipeline.pipeline, nullptr);
+  }
+  if (m_shadowPipeline.layout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_shadowPipeline.layout, nullptr);
+  }
+
+  // written to disk here, all pipelines are created by now
+  m_pPipelineCache = nullptr;
 
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
+  for (auto semaphore : m_presentationResources.imageAvailable)
   {
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
+    vkDestroySemaphore(m_device, semaphore, nullptr);
   }
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
+  for (auto semaphore : m_presentationResources.renderingFinished)
   {
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
+    vkDestroySemaphore(m_device, semaphore, nullptr);
   }
+  m_presentationResources.imageAvailable.clear();
+  m_presentationResources.renderingFinished.clear();
+
+  DestroyUniformBuffer();
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -477,6 +1080,23 @@ void SimpleShadowmapRender::ProcessInput(const AppInput &input)
   if(input.keyReleased[GLFW_KEY_P])
     m_light.usePerspectiveM = !m_light.usePerspectiveM;
 
+  if(input.keyReleased[GLFW_KEY_M])
+    m_input.parallelRecording = !m_input.parallelRecording;
+
+  if(input.keyReleased[GLFW_KEY_C])
+    m_input.cacheShadows = !m_input.cacheShadows;
+
+  if(input.keyReleased[GLFW_KEY_I])
+    m_input.animateInstance = !m_input.animateInstance;
+
+  if(input.keyReleased[GLFW_KEY_T])
+  {
+    if(m_pProfiler->WriteChromeTrace(m_tracePath))
+      std::cout << "Trace of " << m_pProfiler->History().size() << " frames is saved to " << m_tracePath << std::endl;
+    else
+      std::cout << "Can't save trace to " << m_tracePath << std::endl;
+  }
+
   // recreate pipeline to reload shaders
   if(input.keyPressed[GLFW_KEY_B])
   {
@@ -486,13 +1106,11 @@ void SimpleShadowmapRender::ProcessInput(const AppInput &input)
     std::system("cd ../resources/shaders && python3 compile_shadowmap_shaders.py");
 #endif
 
+    // pipeline is destroyed and recreated, frames in flight may still use it
+    vkDeviceWaitIdle(m_device);
     SetupSimplePipeline();
-
-    for (size_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                               m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
+    MarkCommandBuffersDirty();
+    InvalidateShadowCache();
   }
 }
 
@@ -506,6 +1124,8 @@ void SimpleShadowmapRender::UpdateCamera(const Camera* cams, uint32_t a_camsNumb
 
 void SimpleShadowmapRender::UpdateView()
 {
+  FrameProfiler::CpuScope profile(m_pProfiler.get(), "UpdateView");
+
   ///// calc camera matrix
   //
   const float aspect = float(m_width) / float(m_height);
@@ -534,52 +1154,170 @@ void SimpleShadowmapRender::UpdateView()
 
 void SimpleShadowmapRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
+  m_pScnMgr->SetSceneCachePath(std::string(path) + ".scncache");
+  const auto loadStart = std::chrono::high_resolution_clock::now();
   m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
+  const auto loadEnd = std::chrono::high_resolution_clock::now();
+  std::cout << "Scene is loaded in " << std::chrono::duration<float, std::milli>(loadEnd - loadStart).count()
+            << " ms, geometry is " << (m_pScnMgr->GeometryMapped() ? "written to mapped device memory" : "copied from staging")
+            << std::endl;
 
   CreateUniformBuffer();
+  CreateCullingBuffers();
   SetupSimplePipeline();
 
-  UpdateView();
-
-  for (size_t i = 0; i < m_framesInFlight; ++i)
+  m_animatedInstance = UINT32_MAX;
+  if(m_pScnMgr->InstancesNum() > 0)
   {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    m_animatedInstance = 0;
+    m_animatedMatrix   = m_pScnMgr->GetInstanceMatrix(m_animatedInstance);
   }
+
+  UpdateView();
+  MarkCommandBuffersDirty();
+  InvalidateShadowCache();
+}
+
+void SimpleShadowmapRender::AnimateInstance(float a_time)
+{
+  if(m_animatedInstance == UINT32_MAX)
+    return;
+
+  // instance is dynamic only while it moves, once stopped it is cached with static casters again
+  m_pScnMgr->SetInstanceDynamic(m_animatedInstance, m_input.animateInstance);
+  if(!m_input.animateInstance)
+    return;
+
+  // spins around its own vertical axis and floats up and down
+  const float4x4 lift = LiteMath::translate4x4(float3(0.0f, 0.25f * (1.0f + std::sin(a_time)), 0.0f));
+  m_pScnMgr->SetInstanceMatrix(m_animatedInstance, lift * m_animatedMatrix * LiteMath::rotate4x4Y(a_time));
 }
 
-void SimpleShadowmapRender::DrawFrameSimple()
+void SimpleShadowmapRender::DrawFrameSimple(float a_time, bool a_gui)
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  const uint32_t frameId = m_presentationResources.currentFrame;
+  vkWaitForFences(m_device, 1, &m_frameFences[frameId], VK_TRUE, UINT64_MAX);
+
+  // headless mode has no swapchain, every frame in flight uses its own command buffer and uniforms instead
+  const bool offscreen = m_pOffscreen != nullptr;
+  uint32_t imageIdx = frameId;
+  if (!offscreen)
+  {
+    m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable[frameId], &imageIdx);
+
+    // swapchain may return images out of order, so the image can still be used by another frame in flight
+    if (m_imageFences[imageIdx] != VK_NULL_HANDLE)
+      vkWaitForFences(m_device, 1, &m_imageFences[imageIdx], VK_TRUE, UINT64_MAX);
+    m_imageFences[imageIdx] = m_frameFences[frameId];
+  }
+  vkResetFences(m_device, 1, &m_frameFences[frameId]);
+
+  // gpu is done with resources of this image, so its uniforms and command buffers may be overwritten
+  // and its timestamps are ready
+  m_pProfiler->BeginFrame(imageIdx);
+  UpdateUniformBuffer(a_time, imageIdx);
+
+  auto currentCmdBuf = m_cmdBuffersDrawMain[imageIdx];
 
-  uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  AnimateInstance(a_time);
 
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
+  // meshes which finished uploading on transfer queue are acquired before anything else of the frame,
+  // value for binary imageAvailable semaphore is ignored. moved instances are written to instance buffers
+  // by the same command buffer, after culling of previous frames
+  uint64_t uploadValue = 0;
+  bool instancesUpdated = false;
+  const bool uploading  = m_asyncUpload && !m_pScnMgr->UploadFinished();
+  if(uploading || m_pScnMgr->InstancesChanged())
+  {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(m_cmdBuffersUpload[frameId], 0);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_cmdBuffersUpload[frameId], &beginInfo));
+    if(uploading)
+      uploadValue = m_pScnMgr->RecordUploadsCmd(m_cmdBuffersUpload[frameId]);
+    instancesUpdated = m_pScnMgr->InstancesChanged();
+    m_pScnMgr->RecordInstanceUpdatesCmd(m_cmdBuffersUpload[frameId]);
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_cmdBuffersUpload[frameId]));
+  }
+
+  // there is no swapchain image to wait for in headless mode
+  const uint32_t firstWait = offscreen ? 1 : 0;
+  const uint32_t waitsNum  = (uploadValue > 0 ? 2 : 1) - firstWait;
+  VkSemaphore waitSemaphores[] = {offscreen ? VK_NULL_HANDLE : m_presentationResources.imageAvailable[frameId],
+                                  m_pScnMgr->GetUploadSemaphore()};
+  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+  uint64_t waitValues[] = {0, uploadValue};
+
+  // shadow maps are checked after uploads, which may make new casters visible
+  m_shadowPasses = ShadowPassesToDraw();
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  // command buffer of the image is submitted again as it is, unless something it was recorded with is changed
+  const uint32_t recordKey = RecordKey(a_gui, m_shadowPasses);
+  if (m_recordedKeys[imageIdx] != recordKey)
+  {
+    if (offscreen)
+      BuildCommandBufferSimple(currentCmdBuf, VK_NULL_HANDLE, VK_NULL_HANDLE, m_basicForwardPipeline.pipeline, imageIdx,
+                               m_shadowPasses);
+    else
+      BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
+                               m_basicForwardPipeline.pipeline, imageIdx, m_shadowPasses, a_gui);
+    m_recordedKeys[imageIdx] = recordKey;
+  }
+  if (offscreen)
+    m_readbacks[imageIdx].recorded = m_readback;
+
+  VkCommandBuffer cmdBufs[4] = {};
+  uint32_t cmdBufsNum = 0;
+  if (uploadValue > 0 || instancesUpdated)
+    cmdBufs[cmdBufsNum++] = m_cmdBuffersUpload[frameId];
+  cmdBufs[cmdBufsNum++] = currentCmdBuf;
+  if (a_gui)
+  {
+    // GUI command buffers are per swapchain image, the image fence above keeps them from being rerecorded in use
+    cmdBufs[cmdBufsNum++] = m_pGUIRender->BuildGUIRenderCommand(imageIdx, ImGui::GetDrawData());
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(m_cmdBuffersProfile[imageIdx], 0);
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_cmdBuffersProfile[imageIdx], &beginInfo));
+    m_pProfiler->EndGpu(m_cmdBuffersProfile[imageIdx], imageIdx, m_guiScopes[imageIdx]);
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_cmdBuffersProfile[imageIdx]));
+    cmdBufs[cmdBufsNum++] = m_cmdBuffersProfile[imageIdx];
+  }
 
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-                           m_basicForwardPipeline.pipeline);
+  VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+  timelineInfo.sType                   = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+  timelineInfo.waitSemaphoreValueCount = waitsNum;
+  timelineInfo.pWaitSemaphoreValues    = waitValues + firstWait;
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &currentCmdBuf;
-
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pNext = uploadValue > 0 ? &timelineInfo : nullptr;
+  submitInfo.waitSemaphoreCount = waitsNum;
+  submitInfo.pWaitSemaphores = waitSemaphores + firstWait;
+  submitInfo.pWaitDstStageMask = waitStages + firstWait;
+  submitInfo.commandBufferCount = cmdBufsNum;
+  submitInfo.pCommandBuffers = cmdBufs;
+
+  VkSemaphore signalSemaphores[] = {offscreen ? VK_NULL_HANDLE : m_presentationResources.renderingFinished[frameId]};
+  submitInfo.signalSemaphoreCount = offscreen ? 0 : 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[frameId]));
+  m_pProfiler->Submitted(imageIdx);
+
+  if (offscreen)
+  {
+    m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+    return;
+  }
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+                                                 m_presentationResources.renderingFinished[frameId]);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -591,25 +1329,50 @@ void SimpleShadowmapRender::DrawFrameSimple()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
-
-  vkQueueWaitIdle(m_presentationResources.queue);
 }
 
 void SimpleShadowmapRender::DrawFrame(float a_time, DrawMode a_mode)
 {
-  UpdateUniformBuffer(a_time);
   switch (a_mode)
   {
     case DrawMode::WITH_GUI:
-//      DrawFrameWithGUI();
-//      break;
+      if (m_pGUIRender != nullptr)
+      {
+        SetupGUIElements();
+        DrawFrameSimple(a_time, true);
+        break;
+      }
+      [[fallthrough]];
     case DrawMode::NO_GUI:
-      DrawFrameSimple();
+      DrawFrameSimple(a_time, false);
       break;
     default:
-      DrawFrameSimple();
+      DrawFrameSimple(a_time, false);
   }
 
 }
 
+void SimpleShadowmapRender::SetupGUIElements()
+{
+  ImGui_ImplVulkan_NewFrame();
+  ImGui_ImplGlfw_NewFrame();
+  ImGui::NewFrame();
+  {
+    ImGui::Begin("Shadowmap render settings");
+    ImGui::Checkbox("Draw shadow map ('Q')", &m_input.drawFSQuad);
+    ImGui::Checkbox("Perspective light ('P')", &m_light.usePerspectiveM);
+    ImGui::Checkbox("Record scene on several threads ('M')", &m_input.parallelRecording);
+    ImGui::Checkbox("Cache shadow maps ('C')", &m_input.cacheShadows);
+    ImGui::Checkbox("Animate dynamic instance ('I')", &m_input.animateInstance);
+    ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("Command buffers recorded: %llu", static_cast<unsigned long long>(m_recordsNum));
+    ImGui::Text("Shadow maps redrawn: static %s, dynamic %s", (m_shadowPasses & SHADOW_PASS_STATIC) ? "yes" : "no",
+                (m_shadowPasses & SHADOW_PASS_DYNAMIC) ? "yes" : "no");
+    ImGui::Text("Press 'T' to save trace of the last frames");
+    ImGui::End();
+
+    m_pProfiler->DrawImGuiPanel(m_tracePath);
+  }
 
+  ImGui::Render();
+}
@@ -4,6 +4,10 @@
 #define VK_NO_PROTOTYPES
 #include "../../render/scene_mgr.h"
 #include "../../render/render_common.h"
+#include "../../render/cmd_recorder.h"
+#include "../../render/pipeline_cache.h"
+#include "../../render/frame_profiler.h"
+#include "../../render/render_gui.h"
 #include "../../../resources/shaders/common.h"
 #include <geom/vk_mesh.h>
 #include <vk_descriptor_sets.h>
@@ -18,7 +22,8 @@
 class SimpleShadowmapRender : public IRender
 {
 public:
-  SimpleShadowmapRender(uint32_t a_width, uint32_t a_height);
+  // a_framesInFlight - how many frames cpu may record ahead of gpu, each one has its own sync objects and uniforms
+  SimpleShadowmapRender(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight = 2);
   ~SimpleShadowmapRender()  { Cleanup(); };
 
   inline uint32_t     GetWidth()      const override { return m_width; }
@@ -27,6 +32,11 @@ public:
   void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) override;
 
   void InitPresentation(VkSurfaceKHR& a_surface) override;
+  void InitOffscreen() override;
+  void SetReadback(bool a_enable) override { m_readback = a_enable; }
+  bool ReadbackFrame(std::vector<uint32_t> &a_pixels, bool a_waitLast) override;
+  // moves the first instance of the scene every frame, off by default so a static scene keeps its cached shadows
+  void SetAnimateInstance(bool a_enable) { m_input.animateInstance = a_enable; }
 
   void ProcessInput(const AppInput& input) override;
   void UpdateCamera(const Camera* cams, uint32_t a_camsNumber) override;
@@ -34,6 +44,7 @@ public:
 
   void LoadScene(const char *path, bool transpose_inst_matrices) override;
   void DrawFrame(float a_time, DrawMode a_mode) override;
+  double GetGpuFrameTime() const override { return m_pProfiler != nullptr ? m_pProfiler->LastGpuFrameMs() : -1.0; }
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -69,32 +80,59 @@ private:
   {
     uint32_t    currentFrame      = 0u;
     VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> imageAvailable;    // per frame in flight
+    std::vector<VkSemaphore> renderingFinished;
   } m_presentationResources;
 
   std::vector<VkFence> m_frameFences;
+  std::vector<VkFence> m_imageFences; // fence of the frame which uses swapchain image now, if any
+
+  // per swapchain image (per frame in flight in headless mode), recorded once and submitted again every time
+  // the image comes back. Everything which changes per frame is in uniforms of the same image, so a command buffer
+  // is rerecorded only if its record key differs from the current one or all of them are marked dirty
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
+  std::vector<uint32_t>        m_recordedKeys;
+  uint32_t                     m_imagesNum  = 0;
+  uint64_t                     m_recordsNum = 0;
+  static constexpr uint32_t    RECORD_DIRTY = UINT32_MAX;
+
+  // per frame in flight, acquire meshes which were uploaded in background since the previous frame
+  std::vector<VkCommandBuffer> m_cmdBuffersUpload;
+
+  // per image, ends gpu scope of GUI which is drawn by its own command buffer
+  std::vector<VkCommandBuffer> m_cmdBuffersProfile;
+  std::vector<uint32_t>        m_guiScopes;
+
+  // gpu time of every pass and cpu time of frame preparation, see ProcessInput and SetupGUIElements
+  std::unique_ptr<FrameProfiler> m_pProfiler;
+  const char* m_tracePath = "shadowmap_trace.json";
 
+  // selects matrix of uniforms in vertex shader, it is the same for all frames of a pass
   struct
   {
-    float4x4 projView;
-    float4x4 model;
-  } pushConst2M;
+    uint32_t viewId;
+  } pushConst;
 
   float4x4 m_worldViewProj;
   float4x4 m_lightMatrix;    
 
   UniformParams m_uniforms {};
-  VkBuffer m_ubo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
-  void* m_uboMappedMem = nullptr;
+
+  // every image has its own copy of uniforms, so they are updated without waiting for gpu
+  struct FrameUniforms
+  {
+    VkBuffer        ubo       = VK_NULL_HANDLE;
+    VkDeviceMemory  uboAlloc  = VK_NULL_HANDLE;
+    void*           mappedMem = nullptr;
+    VkDescriptorSet dSet      = VK_NULL_HANDLE;
+  };
+  std::vector<FrameUniforms> m_frameUniforms;
 
   pipeline_data_t m_basicForwardPipeline {};
   pipeline_data_t m_shadowPipeline {};
 
-  VkDescriptorSet m_dSet = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSetLayout m_instDSLayout = VK_NULL_HANDLE; // instance matrices, used by vertex shader in all passes
   VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
 
   std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings = nullptr;
@@ -111,6 +149,9 @@ private:
   bool m_vsync = false;
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
+  // scene is uploaded in background while frames are rendered if timeline semaphores are supported
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR m_timelineFeatures = {};
+  bool m_asyncUpload = false;
   std::vector<const char*> m_deviceExtensions      = {};
   std::vector<const char*> m_instanceExtensions    = {};
 
@@ -118,21 +159,109 @@ private:
   std::vector<const char*> m_validationLayers;
 
   std::shared_ptr<SceneManager>     m_pScnMgr;
+  std::shared_ptr<IRenderGUI>       m_pGUIRender;
   
   // objects and data for shadow map
   //
   std::shared_ptr<vk_utils::IQuad>               m_pFSQuad;
   //std::shared_ptr<vk_utils::RenderableTexture2D> m_pShadowMap;
   std::shared_ptr<vk_utils::RenderTarget>        m_pShadowMap2;
-  uint32_t                                       m_shadowMapId = 0;
+  std::shared_ptr<vk_utils::RenderTarget>        m_pDynamicShadowMap; // casters which move, main pass takes the nearest of both maps
+  uint32_t                                       m_shadowMapId = 0;    // the same in both maps
   
   VkDeviceMemory        m_memShadowMap = VK_NULL_HANDLE;
   VkDescriptorSet       m_quadDS; 
   VkDescriptorSetLayout m_quadDSLayout = nullptr;
 
+  // every shadow map keeps the light matrix and versions of its casters it was drawn with,
+  // it is redrawn only when they change. Static casters are drawn once, dynamic ones when they move
+  enum ShadowPass
+  {
+    SHADOW_PASS_STATIC  = 1,
+    SHADOW_PASS_DYNAMIC = 2
+  };
+
+  struct ShadowCache
+  {
+    float4x4 lightMatrix;
+    uint64_t staticVersion  = UINT64_MAX;
+    uint64_t dynamicVersion = UINT64_MAX;
+  } m_shadowCache;
+  uint32_t m_shadowPasses = 0; // redrawn by the last frame
+
+  // first instance of the scene is dynamic and moved every frame while animation is on,
+  // only dynamic shadow map is redrawn for it
+  uint32_t m_animatedInstance = UINT32_MAX;
+  float4x4 m_animatedMatrix;
+  void AnimateInstance(float a_time);
+
+  // headless mode renders to m_pOffscreen instead of swapchain images. Every frame in flight copies it
+  // to its own host visible buffer, which is read after the frame fence is signaled
+  //
+  std::shared_ptr<vk_utils::RenderTarget> m_pOffscreen;
+  uint32_t       m_offscreenColorId = 0;
+  VkDeviceMemory m_memOffscreen     = VK_NULL_HANDLE;
+
+  struct FrameReadback
+  {
+    VkBuffer       buffer    = VK_NULL_HANDLE;
+    VkDeviceMemory mem       = VK_NULL_HANDLE;
+    void*          mappedMem = nullptr;
+    bool           recorded  = false; // the last submit of this frame in flight copies image to buffer
+  };
+  std::vector<FrameReadback> m_readbacks;
+  bool m_readback = false;
+
+  // gpu frustum culling, light and camera views have their own draws and compacted matrices of visible instances
+  //
+  enum CullView
+  {
+    CULL_VIEW_LIGHT  = VIEW_LIGHT,
+    CULL_VIEW_CAMERA = VIEW_CAMERA,
+    CULL_VIEWS_NUM   = 2
+  };
+
+  struct CulledView
+  {
+    VkBuffer        draws           = VK_NULL_HANDLE; // indirect draw per mesh, instance counts are written by culling
+    VkBuffer        visibleMatrices = VK_NULL_HANDLE;
+    VkDescriptorSet cullDS          = VK_NULL_HANDLE;
+    VkDescriptorSet instDS          = VK_NULL_HANDLE;
+  } m_culledViews[CULL_VIEWS_NUM];
+
+  struct
+  {
+    uint32_t viewId;
+    uint32_t instancesNum;
+    uint32_t casters;
+  } cullPushConst;
+
+  VkDeviceMemory        m_cullingAlloc       = VK_NULL_HANDLE;
+  VkDescriptorSetLayout m_cullDSLayout       = VK_NULL_HANDLE;
+  VkPipelineLayout      m_cullPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline            m_cullPipeline       = VK_NULL_HANDLE;
+
+  // scene passes can be recorded to secondary command buffers on several threads
+  //
+  enum ScenePass
+  {
+    SCENE_PASS_SHADOW         = 0,
+    SCENE_PASS_DYNAMIC_SHADOW = 1,
+    SCENE_PASS_MAIN           = 2,
+    SCENE_PASSES_NUM          = 3
+  };
+
+  std::unique_ptr<SecondaryCmdRecorder> m_pCmdRecorder;
+
+  // shared by all pipelines of the render, kept on disk between runs
+  std::unique_ptr<PipelineCache> m_pPipelineCache;
+
   struct InputControlMouseEtc
   {
-    bool drawFSQuad = false;
+    bool drawFSQuad        = false;
+    bool parallelRecording = true;
+    bool cacheShadows      = true;
+    bool animateInstance   = false;
   } m_input;
 
   /**
@@ -158,22 +287,48 @@ private:
   
   } m_light;
  
-  void DrawFrameSimple();
+  void DrawFrameSimple(float a_time, bool a_gui);
+  void SetupGUIElements();
 
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
+  // a_shadowPasses - ShadowPass bits of maps which are redrawn, with a_guiFollows the last command starts gpu scope of GUI
   void BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                VkImageView a_targetImageView, VkPipeline a_pipeline);
-
-  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp);
+                                VkImageView a_targetImageView, VkPipeline a_pipeline, uint32_t a_imageIdx,
+                                uint32_t a_shadowPasses, bool a_guiFollows = false);
+  // state which command buffer of a frame is recorded with
+  uint32_t RecordKey(bool a_gui, uint32_t a_shadowPasses) const;
+  void MarkCommandBuffersDirty();
+  // shadow maps which are out of date for the current light and instances, they are taken as redrawn
+  uint32_t ShadowPassesToDraw();
+  void InvalidateShadowCache() { m_shadowCache = ShadowCache{}; }
+
+  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, CullView a_view, uint32_t a_imageIdx,
+                    uint32_t a_firstDraw = 0, uint32_t a_drawsNum = UINT32_MAX);
+  void RecordScenePassCmd(VkCommandBuffer a_cmdBuff, ScenePass a_pass, VkPipeline a_pipeline,
+                          uint32_t a_imageIdx, uint32_t a_firstDraw, uint32_t a_drawsNum);
+  void ExecuteScenePassCmd(VkCommandBuffer a_cmdBuff, const VkRenderPassBeginInfo &a_passInfo,
+                           ScenePass a_pass, VkPipeline a_pipeline, uint32_t a_imageIdx);
+  // a_casters - CULL_ALL, CULL_STATIC or CULL_DYNAMIC of common.h
+  void CullInstancesCmd(VkCommandBuffer a_cmdBuff, CullView a_view, uint32_t a_imageIdx, uint32_t a_casters = CULL_ALL);
 
   void SetupSimplePipeline();
+  void SetupCullingPipeline();
+  void CreateCullingBuffers();
+  void CreateShadowMap();
+  void CreateReadbackBuffers();
+  void ReadbackCmd(VkCommandBuffer a_cmdBuff, uint32_t a_imageIdx);
+  void CreateImageResources(uint32_t a_imagesNum);
+  void DestroyImageResources();
+  void DestroyCullingBuffers();
   void CleanupPipelineAndSwapchain();
   void RecreateSwapChain();
 
   void CreateUniformBuffer();
-  void UpdateUniformBuffer(float a_time);
+  void DestroyUniformBuffer();
+  void UpdateUniformBuffer(float a_time, uint32_t a_imageIdx);
+  void CreateFrameSyncObjects();
 
   void Cleanup();
 
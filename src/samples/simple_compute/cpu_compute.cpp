@@ -0,0 +1,280 @@
+#include "cpu_compute.h"
+#include "../../render/cpu_reference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <type_traits>
+
+CpuCompute::CpuCompute(uint32_t a_length, uint32_t a_threadsNum, CpuPrimitives::Isa a_maxIsa) : m_length(a_length),
+  m_threadsNum(a_threadsNum), m_maxIsa(a_maxIsa)
+{
+}
+
+
+void CpuCompute::InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId)
+{
+  m_pPool       = std::make_unique<ThreadPool>(m_threadsNum);
+  m_pPrimitives = std::make_unique<CpuPrimitives>(*m_pPool, m_maxIsa);
+}
+
+
+std::string CpuCompute::DeviceName() const
+{
+  return "CPU (" + std::to_string(m_pPool->ThreadsNum()) + " threads, " +
+         CpuPrimitives::IsaName(m_pPrimitives->GetIsa()) + ")";
+}
+
+
+float CpuCompute::TimeRuns(const std::function<void()> &a_func, uint32_t a_repeats)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t i = 0; i < a_repeats; ++i)
+    a_func();
+  const auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<float, std::milli>(end - start).count() / float(std::max(a_repeats, 1u));
+}
+
+
+void CpuCompute::TimeRuns(const std::function<void()> &a_func, const BenchConfig &a_config, BenchResult &a_result)
+{
+  std::vector<double> totalMs;
+  for (uint32_t i = 0; i < a_config.warmup + a_config.iterations; ++i)
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    a_func();
+    const auto end = std::chrono::high_resolution_clock::now();
+    if (i >= a_config.warmup)
+      totalMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  // one range of work per run, there are no dispatches to split it into
+  a_result.SetTimes(totalMs, {});
+}
+
+
+template<typename T>
+uint32_t CpuCompute::TestPrimitives(ScanValueType a_type, const char* a_typeName)
+{
+  // the same data as SimpleCompute::TestPrimitives
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> valueDist(std::is_signed<T>::value ? -3 : 0, 3);
+  std::uniform_int_distribution<int> segmentDist(0, 999);
+
+  std::vector<T> values(m_length);
+  std::vector<uint32_t> segmentFlags(m_length), keep(m_length);
+  for (uint32_t i = 0; i < m_length; ++i)
+  {
+    values[i]       = T(valueDist(gen));
+    segmentFlags[i] = segmentDist(gen) == 0 ? 1u : 0u;
+    keep[i]         = uint32_t(valueDist(gen) > 0) * 7u;
+  }
+
+  uint32_t failed = 0;
+  auto report = [&](const char* a_name, bool a_passed, uint32_t a_mismatch, float a_ms) {
+    failed += a_passed ? 0 : 1;
+    PrintCheck(a_typeName, a_name, a_passed, a_mismatch, a_ms, m_length);
+  };
+
+  struct ScanCase
+  {
+    const char* name;
+    uint32_t    flags;
+  };
+  const ScanCase scanCases[] = {
+    {"exclusive scan",           GpuPrimitives::SCAN_EXCLUSIVE},
+    {"inclusive scan",           GpuPrimitives::SCAN_INCLUSIVE},
+    {"segmented exclusive scan", GpuPrimitives::SCAN_SEGMENTED},
+    {"segmented inclusive scan", GpuPrimitives::SCAN_SEGMENTED | GpuPrimitives::SCAN_INCLUSIVE}};
+
+  std::vector<T> result(m_length);
+  for (const auto &scanCase : scanCases)
+  {
+    const bool segmented = (scanCase.flags & GpuPrimitives::SCAN_SEGMENTED) != 0;
+    auto run = [&]() {
+      m_pPrimitives->Scan(a_type, values.data(), result.data(), m_length, scanCase.flags, segmentFlags.data()); };
+
+    run();
+    const auto reference = ScanReference(values, segmented ? &segmentFlags : nullptr,
+                                         (scanCase.flags & GpuPrimitives::SCAN_INCLUSIVE) != 0);
+    const uint32_t mismatch = FirstMismatch(result, reference, m_length);
+
+    report(scanCase.name, mismatch == UINT32_MAX, mismatch, TimeRuns(run, m_benchRepeats));
+  }
+
+  {
+    T sum = T(0);
+    auto run = [&]() { m_pPrimitives->Reduce(a_type, values.data(), &sum, m_length); };
+    run();
+    report("reduce", NearlyEqual(sum, ReduceReference(values)), UINT32_MAX, TimeRuns(run, m_benchRepeats));
+  }
+
+  {
+    uint32_t count = 0;
+    auto run = [&]() { count = m_pPrimitives->Compact(a_type, values.data(), keep.data(), result.data(), m_length); };
+    run();
+
+    const auto reference = CompactReference(values, keep);
+    uint32_t mismatch = UINT32_MAX;
+    if (count == reference.size())
+      mismatch = FirstMismatch(result, reference, count);
+
+    report("compact", count == reference.size() && mismatch == UINT32_MAX, mismatch, TimeRuns(run, m_benchRepeats));
+  }
+
+  return failed;
+}
+
+
+uint32_t CpuCompute::TestAdd()
+{
+  std::vector<float> a(m_length), b(m_length), result(m_length), reference(m_length);
+  FillPattern(a, BenchPattern::RANDOM, 1000, 5);
+  FillPattern(b, BenchPattern::RANDOM, 1000, 6);
+  for (uint32_t i = 0; i < m_length; ++i)
+    reference[i] = a[i] + b[i];
+
+  auto run = [&]() { m_pPrimitives->Add(a.data(), b.data(), result.data(), m_length); };
+  run();
+  const uint32_t mismatch = FirstMismatch(result, reference, m_length);
+
+  PrintCheck("float", "add", mismatch == UINT32_MAX, mismatch, TimeRuns(run, m_benchRepeats), m_length);
+  return mismatch == UINT32_MAX ? 0 : 1;
+}
+
+
+template<typename T>
+void CpuCompute::BenchPrimitives(ScanValueType a_type, const char* a_typeName, uint32_t a_size, BenchPattern a_pattern,
+                                 const BenchConfig &a_config, std::vector<BenchResult> &a_results)
+{
+  // the same data and byte counts as SimpleCompute::BenchPrimitives
+  std::vector<T> values(a_size);
+  FillPattern(values, a_pattern, 3, 42);
+  std::vector<uint32_t> keep(a_size), segmentFlags(a_size);
+  std::mt19937 gen(17);
+  for (uint32_t i = 0; i < a_size; ++i)
+  {
+    keep[i]         = values[i] != T(0) ? 1u : 0u;
+    segmentFlags[i] = gen() % 1000 == 0 ? 1u : 0u;
+  }
+
+  auto addResult = [&](const char* a_kernel, uint64_t a_bytes) -> BenchResult& {
+    a_results.emplace_back();
+    BenchResult &res = a_results.back();
+    res.kernel  = a_kernel;
+    res.type    = a_typeName;
+    res.size    = a_size;
+    res.pattern = a_pattern;
+    res.bytes   = a_bytes;
+    return res;
+  };
+
+  struct ScanCase
+  {
+    const char* name;
+    uint32_t    flags;
+  };
+  const ScanCase scanCases[] = {
+    {"exclusive scan",           GpuPrimitives::SCAN_EXCLUSIVE},
+    {"inclusive scan",           GpuPrimitives::SCAN_INCLUSIVE},
+    {"segmented exclusive scan", GpuPrimitives::SCAN_SEGMENTED}};
+
+  std::vector<T> result(a_size);
+  for (const auto &scanCase : scanCases)
+  {
+    const bool segmented = (scanCase.flags & GpuPrimitives::SCAN_SEGMENTED) != 0;
+    BenchResult &res = addResult(scanCase.name, uint64_t(a_size) * (segmented ? 12 : 8));
+    auto run = [&]() {
+      m_pPrimitives->Scan(a_type, values.data(), result.data(), a_size, scanCase.flags, segmentFlags.data()); };
+
+    run();
+    const auto reference = ScanReference(values, segmented ? &segmentFlags : nullptr,
+                                         (scanCase.flags & GpuPrimitives::SCAN_INCLUSIVE) != 0);
+    res.passed = FirstMismatch(result, reference, a_size) == UINT32_MAX;
+
+    TimeRuns(run, a_config, res);
+  }
+
+  {
+    BenchResult &res = addResult("reduce", uint64_t(a_size) * 4);
+    T sum = T(0);
+    auto run = [&]() { m_pPrimitives->Reduce(a_type, values.data(), &sum, a_size); };
+    run();
+    res.passed = NearlyEqual(sum, ReduceReference(values));
+
+    TimeRuns(run, a_config, res);
+  }
+
+  {
+    const auto reference = CompactReference(values, keep);
+    BenchResult &res = addResult("compact", uint64_t(a_size) * 8 + reference.size() * sizeof(T));
+    uint32_t count = 0;
+    auto run = [&]() { count = m_pPrimitives->Compact(a_type, values.data(), keep.data(), result.data(), a_size); };
+    run();
+    res.passed = count == reference.size() && FirstMismatch(result, reference, count) == UINT32_MAX;
+
+    TimeRuns(run, a_config, res);
+  }
+}
+
+
+void CpuCompute::BenchAdd(uint32_t a_size, BenchPattern a_pattern, const BenchConfig &a_config,
+                          std::vector<BenchResult> &a_results)
+{
+  std::vector<float> a(a_size), b(a_size), result(a_size);
+  FillPattern(a, a_pattern, 1000, 5);
+  FillPattern(b, a_pattern, 1000, 6);
+
+  a_results.emplace_back();
+  BenchResult &res = a_results.back();
+  res.kernel  = "add";
+  res.type    = "float";
+  res.size    = a_size;
+  res.pattern = a_pattern;
+  res.bytes   = uint64_t(a_size) * sizeof(float) * 3;
+
+  auto run = [&]() { m_pPrimitives->Add(a.data(), b.data(), result.data(), a_size); };
+  run();
+  res.passed = true;
+  for (uint32_t i = 0; i < a_size && res.passed; ++i)
+    res.passed = result[i] == a[i] + b[i];
+
+  TimeRuns(run, a_config, res);
+}
+
+
+BenchReport CpuCompute::Benchmark(const BenchConfig &a_config)
+{
+  BenchReport report;
+  report.device = DeviceName();
+
+  // radix sort has no CPU version, the rest are the kernels of SimpleCompute::Benchmark
+  for (uint32_t size : a_config.sizes)
+  {
+    for (BenchPattern pattern : a_config.patterns)
+    {
+      BenchPrimitives<uint32_t>(ScanValueType::UINT,  "uint",  size, pattern, a_config, report.results);
+      BenchPrimitives<int32_t> (ScanValueType::INT,   "int",   size, pattern, a_config, report.results);
+      BenchPrimitives<float>   (ScanValueType::FLOAT, "float", size, pattern, a_config, report.results);
+      BenchAdd(size, pattern, a_config, report.results);
+    }
+  }
+  return report;
+}
+
+
+void CpuCompute::Execute()
+{
+  std::cout << "Device: " << DeviceName() << ", " << m_length << " elements" << std::endl;
+
+  uint32_t failed = 0;
+  failed += TestPrimitives<uint32_t>(ScanValueType::UINT,  "uint");
+  failed += TestPrimitives<int32_t> (ScanValueType::INT,   "int");
+  failed += TestPrimitives<float>   (ScanValueType::FLOAT, "float");
+  failed += TestAdd();
+
+  if (failed == 0)
+    std::cout << "All checks passed" << std::endl;
+  else
+    std::cout << failed << " checks failed" << std::endl;
+}
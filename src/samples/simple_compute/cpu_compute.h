@@ -0,0 +1,52 @@
+#ifndef CPU_COMPUTE_H
+#define CPU_COMPUTE_H
+
+#include "../../render/compute_common.h"
+#include "../../render/cpu_primitives.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// workloads of SimpleCompute on CPU threads with SIMD kernels, for machines where the only Vulkan device
+// is a software one. checks and benchmark kernels have the same names, so reports of both can be compared
+class CpuCompute : public ICompute
+{
+public:
+  // a_threadsNum = 0 means one thread per hardware thread
+  CpuCompute(uint32_t a_length, uint32_t a_threadsNum = 0, CpuPrimitives::Isa a_maxIsa = CpuPrimitives::Isa::AVX2);
+
+  // there is no Vulkan instance, InitVulkan only starts threads
+  inline VkInstance   GetVkInstance() const override { return VK_NULL_HANDLE; }
+  void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) override;
+
+  void Execute() override;
+  BenchReport Benchmark(const BenchConfig &a_config) override;
+
+private:
+  const uint32_t m_length;
+  const uint32_t m_threadsNum;
+  const CpuPrimitives::Isa m_maxIsa;
+  // timed runs of every primitive after the correctness check
+  const uint32_t m_benchRepeats = 10;
+
+  std::unique_ptr<ThreadPool>    m_pPool;
+  std::unique_ptr<CpuPrimitives> m_pPrimitives;
+
+  // "CPU (8 threads, AVX2)"
+  std::string DeviceName() const;
+  // average wall time of a_repeats calls of a_func in ms
+  static float TimeRuns(const std::function<void()> &a_func, uint32_t a_repeats);
+  // warm-up and timed calls of a_func, wall time of each one
+  static void TimeRuns(const std::function<void()> &a_func, const BenchConfig &a_config, BenchResult &a_result);
+
+  template<typename T>
+  uint32_t TestPrimitives(ScanValueType a_type, const char* a_typeName);
+  uint32_t TestAdd();
+  template<typename T>
+  void BenchPrimitives(ScanValueType a_type, const char* a_typeName, uint32_t a_size, BenchPattern a_pattern,
+                       const BenchConfig &a_config, std::vector<BenchResult> &a_results);
+  void BenchAdd(uint32_t a_size, BenchPattern a_pattern, const BenchConfig &a_config, std::vector<BenchResult> &a_results);
+};
+
+#endif //CPU_COMPUTE_H
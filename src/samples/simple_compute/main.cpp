@@ -1,11 +1,70 @@
 #include "simple_compute.h"
+#include "cpu_compute.h"
 
-int main()
+#include <cstdlib>
+#include <cstring>
+
+// usage: simple_compute [length] [device id] [multilevel|lookback] [streaming scan length]
+//        simple_compute cpu [length] [threads] - the same checks on CPU threads, see CpuCompute
+//        simple_compute bench [benchmark options, see ParseBenchArgs], --backend both compares GPU and CPU
+//        simple_compute tune [device id] - finds scan tiles again, otherwise it is done on the first run on a device
+// to check primitives without a GPU run it on a software device, i.e. with VK_ICD_FILENAMES pointing to lavapipe
+int main(int argc, const char** argv)
 {
-  constexpr int LENGTH = 256*256;
-  constexpr int VULKAN_DEVICE_ID = 0;
+  if(argc > 1 && std::strcmp(argv[1], "bench") == 0)
+  {
+    BenchConfig config;
+    if(!ParseBenchArgs(argc - 2, argv + 2, config))
+      return 1;
+
+    // buffers of the sample are made for the largest size
+    std::vector<std::shared_ptr<ICompute>> apps;
+    if(config.backend != BenchBackend::CPU)
+      apps.push_back(std::make_unique<SimpleCompute>(config.MaxSize()));
+    if(config.backend != BenchBackend::GPU)
+      apps.push_back(std::make_unique<CpuCompute>(config.MaxSize(), config.threads));
+
+    std::vector<ICompute*> benchmarked;
+    for(auto &app : apps)
+    {
+      app->InitVulkan(nullptr, 0, config.deviceId);
+      benchmarked.push_back(app.get());
+    }
+    return RunBenchmark(benchmarked, config) == 0 ? 0 : 1;
+  }
+
+  if(argc > 1 && std::strcmp(argv[1], "cpu") == 0)
+  {
+    const uint32_t length  = argc > 2 ? uint32_t(std::strtoul(argv[2], nullptr, 10)) : 4*1024*1024 + 123;
+    const uint32_t threads = argc > 3 ? uint32_t(std::strtoul(argv[3], nullptr, 10)) : 0;
+    auto app = std::make_unique<CpuCompute>(length, threads);
+    app->InitVulkan(nullptr, 0, 0);
+    app->Execute();
+    return 0;
+  }
+
+  if(argc > 1 && std::strcmp(argv[1], "tune") == 0)
+  {
+    auto app = std::make_unique<SimpleCompute>(1);
+    app->InitVulkan(nullptr, 0, argc > 2 ? uint32_t(std::strtoul(argv[2], nullptr, 10)) : 0);
+    app->Tune();
+    return 0;
+  }
+
+  uint32_t LENGTH = 4*1024*1024 + 123; // not a multiple of block size on purpose
+  uint32_t VULKAN_DEVICE_ID = 0;
+  ScanAlgorithm SCAN_ALGORITHM = ScanAlgorithm::MULTI_LEVEL;
+  if(argc > 1)
+    LENGTH = uint32_t(std::strtoul(argv[1], nullptr, 10));
+  if(argc > 2)
+    VULKAN_DEVICE_ID = uint32_t(std::strtoul(argv[2], nullptr, 10));
+  if(argc > 3 && std::strcmp(argv[3], "lookback") == 0)
+    SCAN_ALGORITHM = ScanAlgorithm::DECOUPLED_LOOKBACK;
+  uint64_t STREAM_LENGTH = 0; // 4 * length by default, may be larger than device memory
+  if(argc > 4)
+    STREAM_LENGTH = std::strtoull(argv[4], nullptr, 10);
 
-  std::shared_ptr<ICompute> app = std::make_unique<SimpleCompute>(LENGTH);
+  std::shared_ptr<ICompute> app = std::make_unique<SimpleCompute>(LENGTH, SCAN_ALGORITHM, STREAM_LENGTH);
   if(app == nullptr)
   {
     std::cout << "Can't create render of specified type" << std::endl;
@@ -1,10 +1,19 @@
 #include "simple_compute.h"
+#include "../../render/cpu_reference.h"
 
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 #include <vk_utils.h>
 
-SimpleCompute::SimpleCompute(uint32_t a_length) : m_length(a_length)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <type_traits>
+
+SimpleCompute::SimpleCompute(uint32_t a_length, ScanAlgorithm a_scanAlgorithm, uint64_t a_streamLength) : m_length(a_length),
+  m_scanAlgorithm(a_scanAlgorithm), m_streamLength(a_streamLength != 0 ? a_streamLength : 4 * uint64_t(a_length))
 {
 #ifdef NDEBUG
   m_enableValidation = false;
@@ -37,8 +46,15 @@ void SimpleCompute::InitVulkan(const char** a_instanceExtensions, uint32_t a_ins
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.compute, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
   m_cmdBufferCompute = vk_utils::createCommandBuffers(m_device, m_commandPool, 1)[0];
+
+  VkFenceCreateInfo fenceCreateInfo = {};
+  fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceCreateInfo.flags = 0;
+  VK_CHECK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, NULL, &m_fence));
   
   m_pCopyHelper = std::make_shared<vk_utils::SimpleCopyHelper>(m_physicalDevice, m_device, m_transferQueue, m_queueFamilyIDXs.compute, 8*1024*1024);
+
+  m_pPipelineCache = std::make_unique<PipelineCache>(m_device, m_physicalDevice, PipelineCache::DEFAULT_PATH);
 }
 
 
@@ -62,6 +78,11 @@ void SimpleCompute::CreateDevice(uint32_t a_deviceId)
 {
   m_physicalDevice = vk_utils::findPhysicalDevice(m_instance, true, a_deviceId, m_deviceExtensions);
 
+  VkPhysicalDeviceFeatures supportedFeatures = {};
+  vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+  m_pipelineStatistics = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+  m_enabledDeviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
   m_device = vk_utils::createLogicalDevice(m_physicalDevice, m_validationLayers, m_deviceExtensions,
                                            m_enabledDeviceFeatures, m_queueFamilyIDXs,
                                            VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
@@ -73,118 +94,549 @@ void SimpleCompute::CreateDevice(uint32_t a_deviceId)
 
 void SimpleCompute::SetupSimplePipeline()
 {
-  std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,6}
+  // Создание и аллокация буферов
+  const VkDeviceSize size = sizeof(uint32_t) * VkDeviceSize(std::max(m_length, 1u));
+  // sorting is in place, so keys and values in m_A and m_res are uploaded and read back
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  m_A     = vk_utils::createBuffer(m_device, size, usage);
+  // flags also keep original keys of sort benchmark
+  m_flags = vk_utils::createBuffer(m_device, size, usage);
+  m_res   = vk_utils::createBuffer(m_device, size, usage);
+  m_count = vk_utils::createBuffer(m_device, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                               VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                                               VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_buffersMem = vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice, {m_A, m_flags, m_res, m_count}, 0);
+}
+
+
+float SimpleCompute::RunPlan(const GpuPrimitives::Plan &a_plan, uint32_t a_repeats)
+{
+  vkResetCommandBuffer(m_cmdBufferCompute, 0);
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(m_cmdBufferCompute, &beginInfo));
+
+  // runs reuse output and scratch buffers of the plan
+  VkMemoryBarrier barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  for (uint32_t i = 0; i < a_repeats; ++i)
+  {
+    if (i > 0)
+      vkCmdPipelineBarrier(m_cmdBufferCompute,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                           1, &barrier, 0, nullptr, 0, nullptr);
+    m_pPrimitives->RecordCmd(m_cmdBufferCompute, a_plan);
+  }
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(m_cmdBufferCompute));
+
+  const auto start = std::chrono::high_resolution_clock::now();
+  SubmitAndWait();
+  const auto end = std::chrono::high_resolution_clock::now();
+
+  return std::chrono::duration<float, std::milli>(end - start).count() / float(std::max(a_repeats, 1u));
+}
+
+
+void SimpleCompute::SubmitAndWait()
+{
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &m_cmdBufferCompute;
+
+  VK_CHECK_RESULT(vkResetFences(m_device, 1, &m_fence));
+  VK_CHECK_RESULT(vkQueueSubmit(m_computeQueue, 1, &submitInfo, m_fence));
+  VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, 100000000000));
+}
+
+
+void SimpleCompute::TimePlan(const GpuPrimitives::Plan &a_plan, const BenchConfig &a_config, BenchResult &a_result,
+                             const std::function<void(VkCommandBuffer)> &a_prologue)
+{
+  GpuTimer timer(m_device, m_physicalDevice, m_queueFamilyIDXs.compute, a_plan.StepsNum(), m_pipelineStatistics);
+
+  std::vector<double> totalMs;
+  std::vector<std::vector<GpuTimer::Scope>> runs;
+  for (uint32_t i = 0; i < a_config.warmup + a_config.iterations; ++i)
+  {
+    vkResetCommandBuffer(m_cmdBufferCompute, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_cmdBufferCompute, &beginInfo));
+    if (a_prologue)
+      a_prologue(m_cmdBufferCompute);
+    timer.Reset(m_cmdBufferCompute);
+    m_pPrimitives->RecordCmd(m_cmdBufferCompute, a_plan, &timer);
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_cmdBufferCompute));
+
+    SubmitAndWait();
+    if (i < a_config.warmup)
+      continue;
+    runs.push_back(timer.Resolve());
+    totalMs.push_back(timer.TotalMs());
+  }
+
+  a_result.SetTimes(totalMs, runs);
+}
+
+
+template<typename T>
+uint32_t SimpleCompute::TestPrimitives(ScanValueType a_type, const char* a_typeName)
+{
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> valueDist(std::is_signed<T>::value ? -3 : 0, 3);
+  std::uniform_int_distribution<int> segmentDist(0, 999);
+
+  std::vector<T> values(m_length);
+  std::vector<uint32_t> segmentFlags(m_length), keep(m_length);
+  for (uint32_t i = 0; i < m_length; ++i)
+  {
+    values[i]       = T(valueDist(gen));
+    segmentFlags[i] = segmentDist(gen) == 0 ? 1u : 0u;
+    keep[i]         = uint32_t(valueDist(gen) > 0) * 7u; // any nonzero value keeps element
+  }
+  m_pCopyHelper->UpdateBuffer(m_A, 0, values.data(), sizeof(T) * values.size());
+
+  uint32_t failed = 0;
+  auto report = [&](const char* a_name, bool a_passed, uint32_t a_mismatch, float a_ms) {
+    failed += a_passed ? 0 : 1;
+    PrintCheck(a_typeName, a_name, a_passed, a_mismatch, a_ms, m_length);
   };
 
-  // Создание и аллокация буферов
-  m_A = vk_utils::createBuffer(m_device, sizeof(float) * m_length, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_G = vk_utils::createBuffer(m_device, sizeof(float) * GROUP_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-  m_res = vk_utils::createBuffer(m_device, sizeof(float) * m_length, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-  vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice, {m_A, m_G, m_res}, 0);
-
-  m_pBindings = std::make_unique<vk_utils::DescriptorMaker>(m_device, dtypes, 3);
-  
-  // Создание descriptor set для передачи буферов в шейдер
-  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
-  m_pBindings->BindBuffer(0, m_A);
-  m_pBindings->BindBuffer(1, m_G);
-  m_pBindings->BindBuffer(2, m_res);
-  m_pBindings->BindEnd(&m_sumDS, &m_sumDSLayout);
-  
-    // Создание descriptor set для передачи буферов в шейдер
-  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
-  m_pBindings->BindBuffer(0, m_G);
-  m_pBindings->BindBuffer(1, m_G);
-  m_pBindings->BindBuffer(2, m_G);
-  m_pBindings->BindEnd(&m_groupDS, &m_sumDSLayout);
-
-  // Создание descriptor set для передачи буферов в шейдер
-  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
-  m_pBindings->BindBuffer(0, m_G);
-  m_pBindings->BindBuffer(1, m_res);
-  m_pBindings->BindEnd(&m_finalDS, &m_finalDSLayout);
-  
-  // Заполнение буферов
-  std::vector<float> values(m_length);
-  for (uint32_t i = 0; i < values.size(); ++i) {
-    values[i] = 1.0f;
+  struct ScanCase
+  {
+    const char* name;
+    uint32_t    flags;
+  };
+  const ScanCase scanCases[] = {
+    {"exclusive scan",           GpuPrimitives::SCAN_EXCLUSIVE},
+    {"inclusive scan",           GpuPrimitives::SCAN_INCLUSIVE},
+    {"segmented exclusive scan", GpuPrimitives::SCAN_SEGMENTED},
+    {"segmented inclusive scan", GpuPrimitives::SCAN_SEGMENTED | GpuPrimitives::SCAN_INCLUSIVE}};
+
+  m_pCopyHelper->UpdateBuffer(m_flags, 0, segmentFlags.data(), sizeof(uint32_t) * segmentFlags.size());
+  std::vector<T> result(m_length);
+  for (const auto &scanCase : scanCases)
+  {
+    const bool segmented = (scanCase.flags & GpuPrimitives::SCAN_SEGMENTED) != 0;
+    auto plan = m_pPrimitives->MakeScan(a_type, m_A, m_res, m_length, scanCase.flags, m_flags);
+
+    RunPlan(*plan, 1);
+    m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(T) * result.size());
+    const auto reference = ScanReference(values, segmented ? &segmentFlags : nullptr,
+                                         (scanCase.flags & GpuPrimitives::SCAN_INCLUSIVE) != 0);
+    const uint32_t mismatch = FirstMismatch(result, reference, m_length);
+
+    report(scanCase.name, mismatch == UINT32_MAX, mismatch, RunPlan(*plan, m_benchRepeats));
+  }
+
+  {
+    auto plan = m_pPrimitives->MakeReduce(a_type, m_A, m_count, m_length);
+    RunPlan(*plan, 1);
+    T sum = T(0);
+    m_pCopyHelper->ReadBuffer(m_count, 0, &sum, sizeof(T));
+    const T reference = ReduceReference(values);
+
+    report("reduce", NearlyEqual(sum, reference), UINT32_MAX, RunPlan(*plan, m_benchRepeats));
+  }
+
+  {
+    m_pCopyHelper->UpdateBuffer(m_flags, 0, keep.data(), sizeof(uint32_t) * keep.size());
+    auto plan = m_pPrimitives->MakeCompact(a_type, m_A, m_flags, m_res, m_count, m_length);
+    RunPlan(*plan, 1);
+
+    const auto reference = CompactReference(values, keep);
+
+    uint32_t count = 0;
+    m_pCopyHelper->ReadBuffer(m_count, 0, &count, sizeof(count));
+    uint32_t mismatch = UINT32_MAX;
+    if (count == reference.size() && count > 0)
+    {
+      m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(T) * count);
+      mismatch = FirstMismatch(result, reference, count);
+    }
+
+    report("compact", count == reference.size() && mismatch == UINT32_MAX, mismatch, RunPlan(*plan, m_benchRepeats));
+  }
+
+  return failed;
+}
+
+
+uint32_t SimpleCompute::TestSort()
+{
+  std::mt19937 gen(13);
+  std::vector<uint32_t> keys(m_length), values(m_length);
+  for (uint32_t i = 0; i < m_length; ++i)
+  {
+    // half of keys are small to get many equal keys and check stability
+    keys[i]   = (i % 2 == 0) ? uint32_t(gen()) : uint32_t(gen() % 64);
+    values[i] = i;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> reference(m_length);
+  for (uint32_t i = 0; i < m_length; ++i)
+    reference[i] = {keys[i], values[i]};
+  std::stable_sort(reference.begin(), reference.end(),
+                   [](const auto &a, const auto &b) { return a.first < b.first; });
+  std::vector<uint32_t> sortedKeys = keys;
+  std::sort(sortedKeys.begin(), sortedKeys.end());
+
+  uint32_t failed = 0;
+  std::vector<uint32_t> resKeys(m_length), resValues(m_length);
+  for (int withValues = 0; withValues < 2; ++withValues)
+  {
+    auto plan = m_pPrimitives->MakeSort(m_A, withValues ? m_res : VK_NULL_HANDLE, m_length);
+
+    // sorting is in place, so input is uploaded before every run and only runs are timed
+    float ms = 0.0f;
+    for (uint32_t run = 0; run <= m_benchRepeats; ++run)
+    {
+      m_pCopyHelper->UpdateBuffer(m_A, 0, keys.data(), sizeof(uint32_t) * keys.size());
+      if (withValues)
+        m_pCopyHelper->UpdateBuffer(m_res, 0, values.data(), sizeof(uint32_t) * values.size());
+      const float runMs = RunPlan(*plan, 1);
+      if (run > 0) // the first run also checks results
+        ms += runMs / float(m_benchRepeats);
+      else
+      {
+        m_pCopyHelper->ReadBuffer(m_A, 0, resKeys.data(), sizeof(uint32_t) * resKeys.size());
+        if (withValues)
+          m_pCopyHelper->ReadBuffer(m_res, 0, resValues.data(), sizeof(uint32_t) * resValues.size());
+      }
+    }
+
+    uint32_t mismatch = FirstMismatch(resKeys, sortedKeys, m_length);
+    for (uint32_t i = 0; withValues && mismatch == UINT32_MAX && i < m_length; ++i)
+      if (resValues[i] != reference[i].second)
+        mismatch = i;
+
+    failed += mismatch == UINT32_MAX ? 0 : 1;
+    PrintCheck("uint", withValues ? "radix sort pairs" : "radix sort keys", mismatch == UINT32_MAX, mismatch, ms, m_length);
   }
-  m_pCopyHelper->UpdateBuffer(m_A, 0, values.data(), sizeof(float) * values.size());
+  return failed;
+}
 
-  for (uint32_t i = 0; i < values.size(); ++i) {
-    values[i] = 0.0;
+
+uint32_t SimpleCompute::TestAdd()
+{
+  std::vector<float> a(m_length), b(m_length);
+  FillPattern(a, BenchPattern::RANDOM, 1000, 5);
+  FillPattern(b, BenchPattern::RANDOM, 1000, 6);
+  m_pCopyHelper->UpdateBuffer(m_A, 0, a.data(), sizeof(float) * m_length);
+  m_pCopyHelper->UpdateBuffer(m_flags, 0, b.data(), sizeof(float) * m_length);
+
+  auto plan = m_pPrimitives->MakeAdd(m_A, m_flags, m_res, m_length);
+  RunPlan(*plan, 1);
+  std::vector<float> result(m_length), reference(m_length);
+  m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(float) * m_length);
+  for (uint32_t i = 0; i < m_length; ++i)
+    reference[i] = a[i] + b[i];
+  const uint32_t mismatch = FirstMismatch(result, reference, m_length);
+
+  PrintCheck("float", "add", mismatch == UINT32_MAX, mismatch, RunPlan(*plan, m_benchRepeats), m_length);
+  return mismatch == UINT32_MAX ? 0 : 1;
+}
+
+
+uint32_t SimpleCompute::CompareScanAlgorithms()
+{
+  // uint sums are exact for any length, so results of both algorithms are compared exactly
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<uint32_t> valueDist(0, 3);
+  std::vector<uint32_t> values(m_length);
+  for (auto &v : values)
+    v = valueDist(gen);
+  m_pCopyHelper->UpdateBuffer(m_A, 0, values.data(), sizeof(uint32_t) * values.size());
+  // prefixes of the whole array are references for every size
+  const auto reference = ScanReference(values, nullptr, false);
+
+  const ScanAlgorithm algorithms[] = {ScanAlgorithm::MULTI_LEVEL, ScanAlgorithm::DECOUPLED_LOOKBACK};
+  std::cout << std::endl << "exclusive uint scan, Melem/s" << std::endl;
+  std::cout << std::setw(12) << "elements" << std::setw(14) << "multi-level" << std::setw(14) << "look-back"
+            << std::setw(10) << "speedup" << std::endl;
+
+  uint32_t failed = 0;
+  std::vector<uint32_t> result;
+  for (uint64_t length = 64 * 1024; length <= m_length; length *= 4)
+  {
+    const uint32_t len = uint32_t(length);
+    result.resize(len);
+
+    float throughput[2] = {};
+    std::string errors;
+    for (int a = 0; a < 2; ++a)
+    {
+      m_pPrimitives->SetScanAlgorithm(algorithms[a]);
+      auto plan = m_pPrimitives->MakeScan(ScanValueType::UINT, m_A, m_res, len);
+
+      RunPlan(*plan, 1);
+      m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(uint32_t) * len);
+      if (FirstMismatch(result, reference, len) != UINT32_MAX)
+      {
+        errors += a == 0 ? " multi-level FAIL" : " look-back FAIL";
+        failed++;
+      }
+
+      const float ms = RunPlan(*plan, m_benchRepeats);
+      throughput[a] = ms > 0.0f ? float(len) / ms * 1e-3f : 0.0f;
+    }
+
+    std::cout << std::setw(12) << len << std::fixed << std::setprecision(1) << std::setw(14) << throughput[0]
+              << std::setw(14) << throughput[1] << std::setprecision(2) << std::setw(9)
+              << (throughput[0] > 0.0f ? throughput[1] / throughput[0] : 0.0f) << "x" << errors << std::endl;
   }
-  m_pCopyHelper->UpdateBuffer(m_G, 0, values.data(), sizeof(float) * GROUP_SIZE);
-  m_pCopyHelper->UpdateBuffer(m_res, 0, values.data(), sizeof(float) * values.size());
 
+  m_pPrimitives->SetScanAlgorithm(m_scanAlgorithm);
+  return failed;
 }
 
-void SimpleCompute::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline)
+
+uint32_t SimpleCompute::TestStreamingScan()
 {
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<uint32_t> valueDist(0, 3);
+  std::vector<uint32_t> values(m_streamLength);
+  for (auto &v : values)
+    v = valueDist(gen);
+
+  StreamingScan::QueueInfo compute  = {m_computeQueue, m_queueFamilyIDXs.compute};
+  StreamingScan::QueueInfo transfer = {m_transferQueue, m_queueFamilyIDXs.transfer};
+
+  std::cout << std::endl << "streaming scan of " << m_streamLength << " elements by " << m_streamChunkLength
+            << " element chunks" << std::endl;
+
+  uint32_t failed = 0;
+  std::vector<uint32_t> result;
+  for (bool inclusive : {false, true})
+  {
+    const uint32_t flags = inclusive ? GpuPrimitives::SCAN_INCLUSIVE : GpuPrimitives::SCAN_EXCLUSIVE;
+    StreamingScan streaming(m_device, m_physicalDevice, *m_pPrimitives, compute, transfer, ScanValueType::UINT,
+                            m_streamChunkLength, 3, flags);
+    const auto reference = ScanReference(values, nullptr, inclusive);
+
+    // exclusive scan is checked out of place, inclusive one in place
+    if (inclusive)
+      result = values;
+    else
+      result.assign(m_streamLength, 0);
+    const uint32_t* in = inclusive ? result.data() : values.data();
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    streaming.Run(in, result.data(), m_streamLength);
+    const auto end = std::chrono::high_resolution_clock::now();
+    const float ms = std::chrono::duration<float, std::milli>(end - start).count();
+
+    const uint32_t mismatch = FirstMismatch(result, reference, m_streamLength);
+    failed += mismatch == UINT32_MAX ? 0 : 1;
+    PrintCheck("uint", inclusive ? "streaming inclusive scan" : "streaming exclusive scan", mismatch == UINT32_MAX,
+               mismatch, ms, uint32_t(std::min<uint64_t>(m_streamLength, UINT32_MAX)));
+
+    // every element crosses the bus twice
+    const float gbPerSec = ms > 0.0f ? float(2 * sizeof(uint32_t) * m_streamLength) / ms * 1e-6f : 0.0f;
+    std::cout << "      " << std::setprecision(2) << gbPerSec << " GB/s of host traffic, "
+              << streaming.DeviceBytes() / (1024 * 1024) << " MB of device memory" << std::endl;
+  }
+  return failed;
+}
+
 
-struct pushConst
+template<typename T>
+void SimpleCompute::BenchPrimitives(ScanValueType a_type, const char* a_typeName, uint32_t a_size, BenchPattern a_pattern,
+                                    const BenchConfig &a_config, std::vector<BenchResult> &a_results)
 {
-  uint totalLength;
-  uint depth;
-};
+  std::vector<T> values(a_size);
+  FillPattern(values, a_pattern, 3, 42);
+  // compaction keeps nonzero values, so zeros and ones patterns are the extreme cases of it
+  std::vector<uint32_t> keep(a_size), segmentFlags(a_size);
+  std::mt19937 gen(17);
+  for (uint32_t i = 0; i < a_size; ++i)
+  {
+    keep[i]         = values[i] != T(0) ? 1u : 0u;
+    segmentFlags[i] = gen() % 1000 == 0 ? 1u : 0u;
+  }
+  m_pCopyHelper->UpdateBuffer(m_A, 0, values.data(), sizeof(T) * a_size);
+  m_pCopyHelper->UpdateBuffer(m_flags, 0, segmentFlags.data(), sizeof(uint32_t) * a_size);
+
+  auto addResult = [&](const char* a_kernel, uint64_t a_bytes) -> BenchResult& {
+    a_results.emplace_back();
+    BenchResult &res = a_results.back();
+    res.kernel  = a_kernel;
+    res.type    = a_typeName;
+    res.size    = a_size;
+    res.pattern = a_pattern;
+    res.bytes   = a_bytes;
+    return res;
+  };
 
+  struct ScanCase
+  {
+    const char* name;
+    uint32_t    flags;
+  };
+  const ScanCase scanCases[] = {
+    {"exclusive scan",           GpuPrimitives::SCAN_EXCLUSIVE},
+    {"inclusive scan",           GpuPrimitives::SCAN_INCLUSIVE},
+    {"segmented exclusive scan", GpuPrimitives::SCAN_SEGMENTED}};
 
-  vkResetCommandBuffer(a_cmdBuff, 0);
+  std::vector<T> result(a_size);
+  for (const auto &scanCase : scanCases)
+  {
+    const bool segmented = (scanCase.flags & GpuPrimitives::SCAN_SEGMENTED) != 0;
+    // values are read and results written, flags are read by segmented one
+    BenchResult &res = addResult(scanCase.name, uint64_t(a_size) * (segmented ? 12 : 8));
+    auto plan = m_pPrimitives->MakeScan(a_type, m_A, m_res, a_size, scanCase.flags, m_flags);
+
+    RunPlan(*plan, 1);
+    m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(T) * a_size);
+    const auto reference = ScanReference(values, segmented ? &segmentFlags : nullptr,
+                                         (scanCase.flags & GpuPrimitives::SCAN_INCLUSIVE) != 0);
+    res.passed = FirstMismatch(result, reference, a_size) == UINT32_MAX;
+
+    TimePlan(*plan, a_config, res);
+  }
 
-  VkCommandBufferBeginInfo beginInfo = {};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  {
+    BenchResult &res = addResult("reduce", uint64_t(a_size) * 4);
+    auto plan = m_pPrimitives->MakeReduce(a_type, m_A, m_count, a_size);
+    RunPlan(*plan, 1);
+    T sum = T(0);
+    m_pCopyHelper->ReadBuffer(m_count, 0, &sum, sizeof(T));
+    res.passed = NearlyEqual(sum, ReduceReference(values));
+
+    TimePlan(*plan, a_config, res);
+  }
 
-  // Заполняем буфер команд
-  VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  {
+    m_pCopyHelper->UpdateBuffer(m_flags, 0, keep.data(), sizeof(uint32_t) * a_size);
+    const auto reference = CompactReference(values, keep);
+    BenchResult &res = addResult("compact", uint64_t(a_size) * 8 + reference.size() * sizeof(T));
+    auto plan = m_pPrimitives->MakeCompact(a_type, m_A, m_flags, m_res, m_count, a_size);
+    RunPlan(*plan, 1);
+
+    uint32_t count = 0;
+    m_pCopyHelper->ReadBuffer(m_count, 0, &count, sizeof(count));
+    res.passed = count == reference.size();
+    if (res.passed && count > 0)
+    {
+      m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(T) * count);
+      res.passed = FirstMismatch(result, reference, count) == UINT32_MAX;
+    }
+
+    TimePlan(*plan, a_config, res);
+  }
+}
 
-  vkCmdBindPipeline      (a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_sumPipeline);
-  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_sumPipelineLayout, 0, 1, &m_sumDS, 0, NULL);
-  pushConst val = pushConst{m_length, 0};
-  vkCmdPushConstants(a_cmdBuff, m_sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(val), &val);
-  
-  vkCmdDispatch(a_cmdBuff, (m_length/GROUP_SIZE) + (m_length % GROUP_SIZE != 0), 1, 1);
 
-  VkBufferMemoryBarrier barrier = {};
-  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  barrier.buffer = m_G;
-  barrier.offset = 0;
-  barrier.size = GROUP_SIZE*sizeof(float);
+void SimpleCompute::BenchSort(uint32_t a_size, BenchPattern a_pattern, const BenchConfig &a_config,
+                              std::vector<BenchResult> &a_results)
+{
+  std::vector<uint32_t> keys(a_size);
+  FillPattern(keys, a_pattern, UINT32_MAX, 23);
+  // sort is in place, original keys in m_flags are copied to m_A before every run
+  m_pCopyHelper->UpdateBuffer(m_flags, 0, keys.data(), sizeof(uint32_t) * a_size);
+  m_pCopyHelper->UpdateBuffer(m_A, 0, keys.data(), sizeof(uint32_t) * a_size);
+
+  a_results.emplace_back();
+  BenchResult &res = a_results.back();
+  res.kernel  = "radix sort keys";
+  res.type    = "uint";
+  res.size    = a_size;
+  res.pattern = a_pattern;
+  // every pass reads keys for histogram and scatter and writes them once
+  res.bytes   = uint64_t(a_size) * sizeof(uint32_t) * 3 * GpuPrimitives::SORT_PASSES;
+
+  auto plan = m_pPrimitives->MakeSort(m_A, VK_NULL_HANDLE, a_size);
+  RunPlan(*plan, 1);
+  std::vector<uint32_t> result(a_size);
+  m_pCopyHelper->ReadBuffer(m_A, 0, result.data(), sizeof(uint32_t) * a_size);
+  res.passed = result == SortReference(keys);
+
+  const VkDeviceSize bytes = sizeof(uint32_t) * VkDeviceSize(a_size);
+  TimePlan(*plan, a_config, res, [this, bytes](VkCommandBuffer a_cmdBuff) {
+    VkBufferCopy region = {0, 0, bytes};
+    vkCmdCopyBuffer(a_cmdBuff, m_flags, m_A, 1, &region);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+  });
+}
 
-  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,{},0, nullptr,1, &barrier,0, nullptr);
 
-  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_sumPipelineLayout, 0, 1, &m_groupDS, 0, NULL);
+void SimpleCompute::BenchAdd(uint32_t a_size, BenchPattern a_pattern, const BenchConfig &a_config,
+                             std::vector<BenchResult> &a_results)
+{
+  std::vector<float> a(a_size), b(a_size);
+  FillPattern(a, a_pattern, 1000, 5);
+  FillPattern(b, a_pattern, 1000, 6);
+  m_pCopyHelper->UpdateBuffer(m_A, 0, a.data(), sizeof(float) * a_size);
+  m_pCopyHelper->UpdateBuffer(m_flags, 0, b.data(), sizeof(float) * a_size);
+
+  a_results.emplace_back();
+  BenchResult &res = a_results.back();
+  res.kernel  = "add";
+  res.type    = "float";
+  res.size    = a_size;
+  res.pattern = a_pattern;
+  res.bytes   = uint64_t(a_size) * sizeof(float) * 3;
+
+  auto plan = m_pPrimitives->MakeAdd(m_A, m_flags, m_res, a_size);
+  RunPlan(*plan, 1);
+  std::vector<float> result(a_size);
+  m_pCopyHelper->ReadBuffer(m_res, 0, result.data(), sizeof(float) * a_size);
+  res.passed = true;
+  for (uint32_t i = 0; i < a_size && res.passed; ++i)
+    res.passed = result[i] == a[i] + b[i];
+
+  TimePlan(*plan, a_config, res);
+}
 
-  pushConst val2 = pushConst{(m_length/GROUP_SIZE) + (m_length % GROUP_SIZE != 0), 1};
-  vkCmdPushConstants(a_cmdBuff, m_sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(val2), &val2);
-  
-  vkCmdDispatch(a_cmdBuff, 1, 1, 1);
 
-  // barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-  // barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-  // barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  // barrier.buffer = m_B;
-  // barrier.offset = 0;
-  // barrier.size = m_length*sizeof(float);
-  // vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,{},0, nullptr,1, &barrier,0, nullptr);
+BenchReport SimpleCompute::Benchmark(const BenchConfig &a_config)
+{
+  SetupSimplePipeline();
 
-  vkCmdBindPipeline      (a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_finalPipeline);
-  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_finalPipelineLayout, 0, 1, &m_finalDS, 0, NULL);
+  CreateComputePipeline();
 
-  vkCmdPushConstants(a_cmdBuff, m_sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(m_length), &m_length);
-  
-  vkCmdPipelineBarrier(a_cmdBuff,
-  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 0, nullptr, 1, &barrier, 0, nullptr);
+  BenchReport report;
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+  report.device = props.deviceName;
 
-  vkCmdDispatch(a_cmdBuff, (m_length / GROUP_SIZE) + (m_length % GROUP_SIZE != 0), 1, 1);
+  if (!GpuTimer(m_device, m_physicalDevice, m_queueFamilyIDXs.compute, 0).Supported())
+    std::cout << "compute queue has no timestamps, all times are zero" << std::endl;
 
-  VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
+  for (uint32_t size : a_config.sizes)
+  {
+    // buffers are made for m_length elements
+    if (size > m_length)
+    {
+      std::cout << "size " << size << " is skipped, buffers have " << m_length << " elements" << std::endl;
+      continue;
+    }
+    for (BenchPattern pattern : a_config.patterns)
+    {
+      BenchPrimitives<uint32_t>(ScanValueType::UINT,  "uint",  size, pattern, a_config, report.results);
+      BenchPrimitives<int32_t> (ScanValueType::INT,   "int",   size, pattern, a_config, report.results);
+      BenchPrimitives<float>   (ScanValueType::FLOAT, "float", size, pattern, a_config, report.results);
+      BenchSort(size, pattern, a_config, report.results);
+      BenchAdd(size, pattern, a_config, report.results);
+    }
+  }
+  return report;
 }
 
 
@@ -195,16 +647,13 @@ void SimpleCompute::CleanupPipeline()
     vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_cmdBufferCompute);
   }
 
+  m_pPrimitives = nullptr;
+
   vkDestroyBuffer(m_device, m_A, nullptr);
-  vkDestroyBuffer(m_device, m_G, nullptr);
+  vkDestroyBuffer(m_device, m_flags, nullptr);
   vkDestroyBuffer(m_device, m_res, nullptr);
-
-  vkDestroyPipelineLayout(m_device, m_sumPipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_sumPipeline, nullptr);
-
-  vkDestroyPipelineLayout(m_device, m_finalPipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_finalPipeline, nullptr);
-
+  vkDestroyBuffer(m_device, m_count, nullptr);
+  vkFreeMemory(m_device, m_buffersMem, nullptr);
 }
 
 
@@ -212,6 +661,13 @@ void SimpleCompute::Cleanup()
 {
   CleanupPipeline();
 
+  m_pPipelineCache = nullptr;
+
+  if (m_fence != VK_NULL_HANDLE)
+  {
+    vkDestroyFence(m_device, m_fence, nullptr);
+  }
+
   if (m_commandPool != VK_NULL_HANDLE)
   {
     vkDestroyCommandPool(m_device, m_commandPool, nullptr);
@@ -221,54 +677,30 @@ void SimpleCompute::Cleanup()
 
 void SimpleCompute::CreateComputePipeline()
 {
-auto create = [this] (const char *shader_path, uint32_t push_const_size, VkDescriptorSetLayout& DSLayout,
-                         VkPipelineLayout& layout, VkPipeline& pipeline) {
-      // Загружаем шейдер
-      std::vector<uint32_t> code = vk_utils::readSPVFile(shader_path);
-      VkShaderModuleCreateInfo createInfo = {};
-      createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-      createInfo.pCode    = code.data();
-      createInfo.codeSize = code.size()*sizeof(uint32_t);
-
-      VkShaderModule shaderModule;
-      // Создаём шейдер в вулкане
-      VK_CHECK_RESULT(vkCreateShaderModule(m_device, &createInfo, NULL, &shaderModule));
-
-      VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
-      shaderStageCreateInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-      shaderStageCreateInfo.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
-      shaderStageCreateInfo.module = shaderModule;
-      shaderStageCreateInfo.pName  = "main";
-
-      VkPushConstantRange pcRange = {};
-      pcRange.offset = 0;
-      pcRange.size = push_const_size;
-      pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-      // Создаём layout для pipeline
-      VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-      pipelineLayoutCreateInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-      pipelineLayoutCreateInfo.setLayoutCount = 1;
-      pipelineLayoutCreateInfo.pSetLayouts    = &DSLayout;
-      pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-      pipelineLayoutCreateInfo.pPushConstantRanges = &pcRange;
-      VK_CHECK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, NULL, &layout));
-
-      VkComputePipelineCreateInfo pipelineCreateInfo = {};
-      pipelineCreateInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-      pipelineCreateInfo.stage  = shaderStageCreateInfo;
-      pipelineCreateInfo.layout = layout;
-
-      // Создаём pipeline - объект, который выставляет шейдер и его параметры
-      VK_CHECK_RESULT(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &pipeline));
-
-      vkDestroyShaderModule(m_device, shaderModule, nullptr);
-  };
+  // tile shapes saved by ScanTuner for this device, the first run on a device finds them
+  ScanTiles tiles;
+  ScanTuner tuner(m_device, m_physicalDevice, m_pPipelineCache->Get(), ScanTuner::DEFAULT_PATH);
+  if (!tuner.Load(tiles))
+    tiles = tuner.Tune(m_computeQueue, m_queueFamilyIDXs.compute);
+
+  const auto buildStart = std::chrono::high_resolution_clock::now();
+
+  // all kernels of all value types, they are compiled on separate threads
+  m_pPrimitives = std::make_unique<GpuPrimitives>(m_device, m_physicalDevice, m_pPipelineCache->Get(), tiles);
+  m_pPrimitives->SetScanAlgorithm(m_scanAlgorithm);
+
+  const auto buildEnd = std::chrono::high_resolution_clock::now();
+  std::cout << "Pipelines are built in " << std::chrono::duration<float, std::milli>(buildEnd - buildStart).count()
+            << " ms, pipeline cache is " << (m_pPipelineCache->LoadedBytes() > 0 ? "warm" : "cold") << std::endl;
+  std::cout << "Scan tiles: multi-level " << m_pPrimitives->Tiles().scanGroupSize << ", look-back "
+            << m_pPrimitives->Tiles().lookbackGroupSize << "x" << m_pPrimitives->Tiles().lookbackItems << std::endl;
+}
 
-  create("../resources/shaders/scan1.comp.spv", 2*sizeof(m_length),
-         m_sumDSLayout, m_sumPipelineLayout, m_sumPipeline);
-  create("../resources/shaders/scan2.comp.spv", sizeof(m_length),
-         m_finalDSLayout, m_finalPipelineLayout, m_finalPipeline);
+
+void SimpleCompute::Tune()
+{
+  ScanTuner tuner(m_device, m_physicalDevice, m_pPipelineCache->Get(), ScanTuner::DEFAULT_PATH);
+  tuner.Tune(m_computeQueue, m_queueFamilyIDXs.compute);
 }
 
 
@@ -278,27 +710,27 @@ void SimpleCompute::Execute()
   
   CreateComputePipeline();
 
-  BuildCommandBufferSimple(m_cmdBufferCompute, nullptr);
-
-  VkSubmitInfo submitInfo = {};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &m_cmdBufferCompute;
-
-  VkFenceCreateInfo fenceCreateInfo = {};
-  fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceCreateInfo.flags = 0;
-  VK_CHECK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, NULL, &m_fence));
-
-  // Отправляем буфер команд на выполнение
-  VK_CHECK_RESULT(vkQueueSubmit(m_computeQueue, 1, &submitInfo, m_fence));
-
-  //Ждём конца выполнения команд
-  VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, 100000000000));
-
-  std::vector<float> values(m_length);
-  m_pCopyHelper->ReadBuffer(m_res, 0, values.data(), sizeof(float) * values.size());
-  for (auto v: values) {
-    std::cout << v << ' ';
-  }
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+  std::cout << "Device: " << props.deviceName << ", " << m_length << " elements, ";
+  if (m_scanAlgorithm == ScanAlgorithm::DECOUPLED_LOOKBACK)
+    std::cout << "look-back scan";
+  else
+    std::cout << "multi-level scan with " << m_pPrimitives->LevelsNum(m_length) << " levels";
+  std::cout << (m_pPrimitives->SubgroupScan() ? ", subgroup arithmetic" : "") << std::endl;
+
+  uint32_t failed = 0;
+  failed += TestPrimitives<uint32_t>(ScanValueType::UINT,  "uint");
+  failed += TestPrimitives<int32_t> (ScanValueType::INT,   "int");
+  failed += TestPrimitives<float>   (ScanValueType::FLOAT, "float");
+  failed += TestSort();
+  failed += TestAdd();
+
+  failed += CompareScanAlgorithms();
+  failed += TestStreamingScan();
+
+  if (failed == 0)
+    std::cout << "All checks passed" << std::endl;
+  else
+    std::cout << failed << " checks failed" << std::endl;
 }
@@ -3,6 +3,11 @@
 
 #define VK_NO_PROTOTYPES
 #include "../../render/compute_common.h"
+#include "../../render/pipeline_cache.h"
+#include "../../render/gpu_primitives.h"
+#include "../../render/streaming_scan.h"
+#include "../../render/gpu_timer.h"
+#include "../../render/scan_tuner.h"
 #include "../resources/shaders/common.h"
 #include <vk_descriptor_sets.h>
 #include <vk_copy.h>
@@ -10,17 +15,22 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <functional>
 
 class SimpleCompute : public ICompute
 {
 public:
-  SimpleCompute(uint32_t a_length);
+  SimpleCompute(uint32_t a_length, ScanAlgorithm a_scanAlgorithm = ScanAlgorithm::MULTI_LEVEL, uint64_t a_streamLength = 0);
   ~SimpleCompute()  { Cleanup(); };
 
   inline VkInstance   GetVkInstance() const override { return m_instance; }
   void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) override;
 
   void Execute() override;
+  BenchReport Benchmark(const BenchConfig &a_config) override;
+  // times all tile shapes of scan kernels and saves the fastest ones for this device,
+  // otherwise it is done once on the first run on a device
+  void Tune();
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -53,47 +63,71 @@ private:
 
   vk_utils::QueueFID_T m_queueFamilyIDXs {UINT32_MAX, UINT32_MAX, UINT32_MAX};
 
-  VkCommandBuffer m_cmdBufferCompute;
-  VkFence m_fence;
-
-  std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings = nullptr;
+  VkCommandBuffer m_cmdBufferCompute = VK_NULL_HANDLE;
+  VkFence         m_fence            = VK_NULL_HANDLE;
 
   const uint32_t m_length  = 256*256;
-  const uint32_t GROUP_SIZE = 256;
-  
+  // algorithm of checked primitives, both of them are compared in CompareScanAlgorithms
+  ScanAlgorithm m_scanAlgorithm = ScanAlgorithm::MULTI_LEVEL;
+  // timed runs of every primitive after the correctness check
+  const uint32_t m_benchRepeats = 10;
+  // host array of streaming scan, it doesn't have to fit in device memory
+  uint64_t m_streamLength = 0;
+  const uint32_t m_streamChunkLength = 1024*1024;
+
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
+  // compute shader invocations are counted in benchmark if device supports it
+  bool m_pipelineStatistics = false;
   std::vector<const char*> m_deviceExtensions      = {};
   std::vector<const char*> m_instanceExtensions    = {};
 
   bool m_enableValidation;
   std::vector<const char*> m_validationLayers;
   std::shared_ptr<vk_utils::ICopyEngine> m_pCopyHelper;
+  std::unique_ptr<PipelineCache> m_pPipelineCache;
   
-  VkDescriptorSet       m_sumDS; 
-  VkDescriptorSetLayout m_sumDSLayout = nullptr;
- 
-  VkDescriptorSet       m_groupDS;
+  std::unique_ptr<GpuPrimitives> m_pPrimitives;
 
-  VkDescriptorSet       m_finalDS;
-  VkDescriptorSetLayout m_finalDSLayout = nullptr;
-  
-  VkPipeline m_sumPipeline;
-  VkPipelineLayout m_sumPipelineLayout;
+  // all scan value types are 32 bit, so the same buffers are used for each of them
+  VkBuffer m_A     = VK_NULL_HANDLE; // input values
+  VkBuffer m_flags = VK_NULL_HANDLE; // segment starts or keep flags
+  VkBuffer m_res   = VK_NULL_HANDLE;
+  VkBuffer m_count = VK_NULL_HANDLE; // reduction result or number of compacted elements
+  VkDeviceMemory m_buffersMem = VK_NULL_HANDLE;
 
-  VkPipeline m_finalPipeline;
-  VkPipelineLayout m_finalPipelineLayout;
-
-  VkBuffer m_A, m_G, m_res;
- 
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
-  void BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline);
-
   void SetupSimplePipeline();
   void CreateComputePipeline();
   void CleanupPipeline();
 
+  // submits m_cmdBufferCompute to compute queue and waits for it
+  void SubmitAndWait();
+  // submits a_repeats runs of a_plan and waits, returns average time of one run in ms
+  float RunPlan(const GpuPrimitives::Plan &a_plan, uint32_t a_repeats);
+  // warm-up and timed runs of a_plan one per submit with every dispatch in its own timestamp scope.
+  // a_prologue is recorded before timestamps of each run, i.e. to restore input of in place kernels
+  void TimePlan(const GpuPrimitives::Plan &a_plan, const BenchConfig &a_config, BenchResult &a_result,
+                const std::function<void(VkCommandBuffer)> &a_prologue = nullptr);
+  template<typename T>
+  void BenchPrimitives(ScanValueType a_type, const char* a_typeName, uint32_t a_size, BenchPattern a_pattern,
+                       const BenchConfig &a_config, std::vector<BenchResult> &a_results);
+  void BenchSort(uint32_t a_size, BenchPattern a_pattern, const BenchConfig &a_config, std::vector<BenchResult> &a_results);
+  void BenchAdd(uint32_t a_size, BenchPattern a_pattern, const BenchConfig &a_config, std::vector<BenchResult> &a_results);
+  // checks every primitive against CPU reference on random data and measures its throughput,
+  // returns number of failed checks
+  template<typename T>
+  uint32_t TestPrimitives(ScanValueType a_type, const char* a_typeName);
+  // radix sort of keys and of key-value pairs against std::sort, Mkeys/s
+  uint32_t TestSort();
+  // element-wise sum of simple.comp
+  uint32_t TestAdd();
+  // throughput of exclusive scan with both algorithms from 64K elements up to m_length
+  uint32_t CompareScanAlgorithms();
+  // chunked scan of m_streamLength elements with overlapped upload, scan and readback, GB/s of host traffic
+  uint32_t TestStreamingScan();
+
   void Cleanup();
 
   void SetupValidationLayers();
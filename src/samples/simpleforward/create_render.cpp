@@ -4,15 +4,15 @@
 #include "simple_render_tex.h"
 
 
-std::unique_ptr<IRender> CreateRender(uint32_t w, uint32_t h, RenderEngineType type)
+std::unique_ptr<IRender> CreateRender(uint32_t w, uint32_t h, RenderEngineType type, uint32_t framesInFlight)
 {
   switch(type)
   {
   case RenderEngineType::SIMPLE_FORWARD:
-    return std::make_unique<SimpleRender>(w, h);
+    return std::make_unique<SimpleRender>(w, h, framesInFlight);
   
   case RenderEngineType::SIMPLE_TEXTURE:
-    return std::make_unique<SimpleRenderTexture>(w, h);
+    return std::make_unique<SimpleRenderTexture>(w, h, framesInFlight);
 
   default:
     return nullptr;
@@ -7,6 +7,6 @@ enum class RenderEngineType
   SIMPLE_TEXTURE
 };
 
-std::unique_ptr<IRender> CreateRender(uint32_t w, uint32_t h, RenderEngineType type);
+std::unique_ptr<IRender> CreateRender(uint32_t w, uint32_t h, RenderEngineType type, uint32_t framesInFlight = 2);
 
 #endif// VK_GRAPHICS_BASIC_CREATE_RENDER_H
@@ -2,6 +2,9 @@
 #include "create_render.h"
 #include "utils/glfw_window.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int deviceID)
 {
   uint32_t glfwExtensionCount = 0;
@@ -24,14 +27,19 @@ void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int devic
   }
 }
 
-int main()
+int main(int argc, const char** argv)
 {
   constexpr int WIDTH = 1024;
   constexpr int HEIGHT = 1024;
   constexpr int VULKAN_DEVICE_ID = 0;
 
-  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, RenderEngineType::SIMPLE_FORWARD);
-//  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, RenderEngineType::SIMPLE_TEXTURE);
+  // number of frames in flight may be passed as the first argument, 1 makes cpu wait for every frame
+  uint32_t framesInFlight = 2;
+  if(argc > 1)
+    framesInFlight = static_cast<uint32_t>(std::max(std::atoi(argv[1]), 1));
+
+  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, RenderEngineType::SIMPLE_FORWARD, framesInFlight);
+//  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, RenderEngineType::SIMPLE_TEXTURE, framesInFlight);
 
   if(app == nullptr)
   {
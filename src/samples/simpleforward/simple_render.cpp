@@ -5,13 +5,22 @@
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 
-SimpleRender::SimpleRender(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
+#include <algorithm>
+#include <thread>
+
+SimpleRender::SimpleRender(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight) :
+  m_width(a_width), m_height(a_height), m_framesInFlight(std::max(a_framesInFlight, 1u))
 {
 #ifdef NDEBUG
   m_enableValidation = false;
 #else
   m_enableValidation = true;
 #endif
+
+  // not reset when uniform buffers are made again, so GUI settings survive swapchain recreation
+  m_uniforms.lightPos = LiteMath::float3(0.0f, 1.0f, 1.0f);
+  m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
+  m_uniforms.animateLightColor = true;
 }
 
 void SimpleRender::SetupDeviceFeatures()
@@ -48,20 +57,13 @@ void SimpleRender::InitVulkan(const char** a_instanceExtensions, uint32_t a_inst
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics,
                                               VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+  CreateFrameSyncObjects();
 
   m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer,
                                              m_queueFamilyIDXs.graphics, false);
+  m_pScnMgr->SetMappedLoading(true);
+
+  m_pPipelineCache = std::make_unique<PipelineCache>(m_device, m_physicalDevice, PipelineCache::DEFAULT_PATH);
 }
 
 void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface)
@@ -71,11 +73,25 @@ void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface)
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
                                                               m_width, m_height, m_framesInFlight, m_vsync);
   m_presentationResources.currentFrame = 0;
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
+
+  // everything a recorded command buffer refers to belongs to one image, so it may be submitted again
+  // as soon as the previous submit of the same image is finished
+  m_imagesNum          = m_swapchain.GetImageCount();
+  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_imagesNum);
+  m_recordedKeys.assign(m_imagesNum, RECORD_DIRTY);
+  m_pCmdRecorder = std::make_unique<SecondaryCmdRecorder>(m_device, m_queueFamilyIDXs.graphics,
+                                                          std::thread::hardware_concurrency(), m_imagesNum);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  m_presentationResources.imageAvailable.resize(m_framesInFlight);
+  m_presentationResources.renderingFinished.resize(m_framesInFlight);
+  for (uint32_t i = 0; i < m_framesInFlight; ++i)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable[i]));
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished[i]));
+  }
   m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat());
 
   std::vector<VkFormat> depthFormats = {
@@ -89,7 +105,8 @@ void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface)
   m_depthBuffer  = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
   m_frameBuffers = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
 
-  m_pGUIRender = std::make_shared<ImGuiRender>(m_instance, m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_graphicsQueue, m_swapchain);
+  m_pGUIRender = std::make_shared<ImGuiRender>(m_instance, m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_graphicsQueue, m_swapchain,
+                                               m_pPipelineCache->Get());
 }
 
 void SimpleRender::CreateInstance()
@@ -127,15 +144,24 @@ void SimpleRender::CreateDevice(uint32_t a_deviceId)
 void SimpleRender::SetupSimplePipeline()
 {
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1}
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             m_imagesNum},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,             1}
   };
 
   if(m_pBindings == nullptr)
-    m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1);
+    m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, m_imagesNum + 1);
 
-  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+  // camera matrix is taken by vertex shader
+  for(auto &frame : m_frameUniforms)
+  {
+    m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    m_pBindings->BindBuffer(0, frame.ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    m_pBindings->BindEnd(&frame.dSet, &m_dSetLayout);
+  }
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT);
+  m_pBindings->BindBuffer(0, m_pScnMgr->GetInstanceMatricesBuffer());
+  m_pBindings->BindEnd(&m_instDS, &m_instDSLayout);
 
   // if we are recreating pipeline (for example, to reload shaders)
   // we need to cleanup old pipeline
@@ -158,48 +184,103 @@ void SimpleRender::SetupSimplePipeline()
 
   maker.LoadShaders(m_device, shader_paths);
 
-  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
+  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout, m_instDSLayout}, sizeof(pushConst));
   maker.SetDefaultState(m_width, m_height);
 
-  m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
-                                                       m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  m_basicForwardPipeline.pipeline = MakeGraphicsPipeline(maker, m_device, m_pPipelineCache->Get(), m_basicForwardPipeline.layout,
+                                                         m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), m_screenRenderPass,
+                                                         {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
 }
 
 void SimpleRender::CreateUniformBuffer()
 {
-  VkMemoryRequirements memReq;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
-
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext = nullptr;
-  allocateInfo.allocationSize = memReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
-                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                          m_physicalDevice);
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
+  m_frameUniforms.resize(m_imagesNum);
+  for(auto &frame : m_frameUniforms)
+  {
+    VkMemoryRequirements memReq;
+    frame.ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext = nullptr;
+    allocateInfo.allocationSize = memReq.size;
+    allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+                                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                            m_physicalDevice);
+    VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &frame.uboAlloc));
+
+    VK_CHECK_RESULT(vkBindBufferMemory(m_device, frame.ubo, frame.uboAlloc, 0));
+
+    vkMapMemory(m_device, frame.uboAlloc, 0, sizeof(m_uniforms), 0, &frame.mappedMem);
+  }
 
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, 0));
+  for(uint32_t i = 0; i < m_imagesNum; ++i)
+    UpdateUniformBuffer(0.0f, i);
+}
 
-  vkMapMemory(m_device, m_uboAlloc, 0, sizeof(m_uniforms), 0, &m_uboMappedMem);
+void SimpleRender::DestroyUniformBuffer()
+{
+  for(auto &frame : m_frameUniforms)
+  {
+    if(frame.ubo != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, frame.ubo, nullptr);
+    if(frame.uboAlloc != VK_NULL_HANDLE)
+      vkFreeMemory(m_device, frame.uboAlloc, nullptr);
+  }
+  m_frameUniforms.clear();
+}
 
-  m_uniforms.lightPos = LiteMath::float3(0.0f, 1.0f, 1.0f);
-  m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
-  m_uniforms.animateLightColor = true;
+void SimpleRender::UpdateUniformBuffer(float a_time, uint32_t a_imageIdx)
+{
+// most uniforms are updated in GUI -> SetupGUIElements(), camera matrix in UpdateView()
+  m_uniforms.time = a_time;
+  memcpy(m_frameUniforms[a_imageIdx].mappedMem, &m_uniforms, sizeof(m_uniforms));
+}
 
-  UpdateUniformBuffer(0.0f);
+void SimpleRender::CreateFrameSyncObjects()
+{
+  m_frameFences.resize(m_framesInFlight);
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for (size_t i = 0; i < m_framesInFlight; i++)
+  {
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+  }
 }
 
-void SimpleRender::UpdateUniformBuffer(float a_time)
+void SimpleRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, uint32_t a_imageIdx,
+                                uint32_t a_firstDraw, uint32_t a_drawsNum)
 {
-// most uniforms are updated in GUI -> SetupGUIElements()
-  m_uniforms.time = a_time;
-  memcpy(m_uboMappedMem, &m_uniforms, sizeof(m_uniforms));
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
+                          &m_frameUniforms[a_imageIdx].dSet, 0, VK_NULL_HANDLE);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 1, 1,
+                          &m_instDS, 0, VK_NULL_HANDLE);
+
+  VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+  VkDeviceSize zero_offset = 0u;
+  VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+  VkBuffer indexBuf = m_pScnMgr->GetIndexBuffer();
+
+  vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+  vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
+
+  vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConst), &pushConst);
+
+  // vertex shader takes model matrices from instance matrices buffer by gl_InstanceIndex
+  const auto &draws = m_pScnMgr->GetMeshDraws();
+  const uint32_t drawEnd = static_cast<uint32_t>(std::min<size_t>(draws.size(), size_t(a_firstDraw) + a_drawsNum));
+  for (uint32_t i = a_firstDraw; i < drawEnd; ++i)
+    vkCmdDrawIndexed(a_cmdBuff, draws[i].indexCount, draws[i].instanceCount, draws[i].firstIndex, draws[i].vertexOffset,
+                     draws[i].firstInstance);
 }
 
 void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                            VkImageView a_targetImageView, VkPipeline a_pipeline)
+                                            VkImageView a_targetImageView, VkPipeline a_pipeline, uint32_t a_imageIdx)
 {
   vkResetCommandBuffer(a_cmdBuff, 0);
 
@@ -227,39 +308,51 @@ void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebu
     renderPassInfo.clearValueCount = 2;
     renderPassInfo.pClearValues = &clearValues[0];
 
-    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
-
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
-                            &m_dSet, 0, VK_NULL_HANDLE);
-
-    VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
-
-    VkDeviceSize zero_offset = 0u;
-    VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
-    VkBuffer indexBuf = m_pScnMgr->GetIndexBuffer();
-
-    vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
-    vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
-
-    for (size_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+    if(!m_parallelRecording || m_pCmdRecorder == nullptr)
     {
-      auto inst = m_pScnMgr->GetInstanceInfo(i);
-
-      pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
-      vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0,
-                         sizeof(pushConst2M), &pushConst2M);
-
-      auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
-      vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+      vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+      DrawSceneCmd(a_cmdBuff, a_pipeline, a_imageIdx, 0, UINT32_MAX);
+      vkCmdEndRenderPass(a_cmdBuff);
+    }
+    else
+    {
+      // mesh draws are split between recording threads, each one records its own secondary command buffer
+      VkCommandBufferInheritanceInfo inheritance = {};
+      inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritance.renderPass  = m_screenRenderPass;
+      inheritance.subpass     = 0;
+      inheritance.framebuffer = a_frameBuff;
+
+      const uint32_t drawsNum = static_cast<uint32_t>(m_pScnMgr->GetMeshDraws().size());
+      auto secondary = m_pCmdRecorder->Record(a_imageIdx, inheritance, drawsNum,
+        [this, a_pipeline, a_imageIdx](VkCommandBuffer a_secondary, uint32_t a_first, uint32_t a_count) {
+          // secondary command buffers don't inherit dynamic state
+          vk_utils::setDefaultViewport(a_secondary, static_cast<float>(m_width), static_cast<float>(m_height));
+          vk_utils::setDefaultScissor(a_secondary, m_width, m_height);
+          DrawSceneCmd(a_secondary, a_pipeline, a_imageIdx, a_first, a_count);
+        });
+
+      vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+      vkCmdExecuteCommands(a_cmdBuff, static_cast<uint32_t>(secondary.size()), secondary.data());
+      vkCmdEndRenderPass(a_cmdBuff);
     }
-
-    vkCmdEndRenderPass(a_cmdBuff);
   }
 
   VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
 }
 
+uint32_t SimpleRender::RecordKey() const
+{
+  // camera and GUI settings only change uniforms
+  return m_parallelRecording ? 1u : 0u;
+}
+
+void SimpleRender::MarkCommandBuffersDirty()
+{
+  // pipeline, descriptor sets, framebuffers or scene are replaced, every image is rerecorded when it is drawn next time
+  m_recordedKeys.assign(m_imagesNum, RECORD_DIRTY);
+}
+
 
 void SimpleRender::CleanupPipelineAndSwapchain()
 {
@@ -278,6 +371,7 @@ void SimpleRender::CleanupPipelineAndSwapchain()
       m_frameFences[i] = VK_NULL_HANDLE;
     }
   }
+  m_imageFences.clear();
 
   vk_utils::deleteImg(m_device, &m_depthBuffer);
 
@@ -321,26 +415,29 @@ void SimpleRender::RecreateSwapChain()
   m_depthBuffer      = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
   m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+  CreateFrameSyncObjects();
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
 
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (size_t i = 0; i < m_swapchain.GetImageCount(); ++i)
+  // new swapchain may have another number of images (after resize or vsync switch),
+  // then uniforms, their descriptor sets and recorder slots are made again for it
+  if(m_swapchain.GetImageCount() != m_imagesNum)
   {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    m_imagesNum    = m_swapchain.GetImageCount();
+    m_pCmdRecorder = std::make_unique<SecondaryCmdRecorder>(m_device, m_queueFamilyIDXs.graphics,
+                                                            std::thread::hardware_concurrency(), m_imagesNum);
+    DestroyUniformBuffer();
+    CreateUniformBuffer();
+    m_pBindings = nullptr; // descriptor pool is sized by number of images
+    SetupSimplePipeline();
   }
 
+  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_imagesNum);
+  MarkCommandBuffersDirty();
 }
 
 void SimpleRender::Cleanup()
 {
+  m_pCmdRecorder = nullptr;
   m_pGUIRender = nullptr;
   ImGui::DestroyContext();
   CleanupPipelineAndSwapchain();
@@ -361,16 +458,16 @@ void SimpleRender::Cleanup()
     m_basicForwardPipeline.layout = VK_NULL_HANDLE;
   }
 
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
+  for (auto semaphore : m_presentationResources.imageAvailable)
   {
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
-    m_presentationResources.imageAvailable = VK_NULL_HANDLE;
+    vkDestroySemaphore(m_device, semaphore, nullptr);
   }
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
+  for (auto semaphore : m_presentationResources.renderingFinished)
   {
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
-    m_presentationResources.renderingFinished = VK_NULL_HANDLE;
+    vkDestroySemaphore(m_device, semaphore, nullptr);
   }
+  m_presentationResources.imageAvailable.clear();
+  m_presentationResources.renderingFinished.clear();
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -378,17 +475,7 @@ void SimpleRender::Cleanup()
     m_commandPool = VK_NULL_HANDLE;
   }
 
-  if(m_ubo != VK_NULL_HANDLE)
-  {
-    vkDestroyBuffer(m_device, m_ubo, nullptr);
-    m_ubo = VK_NULL_HANDLE;
-  }
-
-  if(m_uboAlloc != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_uboAlloc, nullptr);
-    m_uboAlloc = VK_NULL_HANDLE;
-  }
+  DestroyUniformBuffer();
 
 //  vk_utils::deleteImg(m_device, &m_depthBuffer); // already deleted with swapchain
 
@@ -401,6 +488,9 @@ void SimpleRender::Cleanup()
   m_pBindings = nullptr;
   m_pScnMgr   = nullptr;
 
+  // written to disk here, all pipelines are created by now
+  m_pPipelineCache = nullptr;
+
   if(m_device != VK_NULL_HANDLE)
   {
     vkDestroyDevice(m_device, nullptr);
@@ -425,6 +515,9 @@ void SimpleRender::ProcessInput(const AppInput &input)
   // add keyboard controls here
   // camera movement is processed separately
 
+  if(input.keyReleased[GLFW_KEY_M])
+    m_parallelRecording = !m_parallelRecording;
+
   // recreate pipeline to reload shaders
   if(input.keyPressed[GLFW_KEY_B])
   {
@@ -434,13 +527,10 @@ void SimpleRender::ProcessInput(const AppInput &input)
     std::system("cd ../resources/shaders && python3 compile_simple_render_shaders.py");
 #endif
 
+    // pipeline is destroyed and recreated, frames in flight may still use it
+    vkDeviceWaitIdle(m_device);
     SetupSimplePipeline();
-
-    for (size_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                               m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
+    MarkCommandBuffersDirty();
   }
 
 }
@@ -454,46 +544,64 @@ void SimpleRender::UpdateCamera(const Camera* cams, uint32_t a_camsCount)
 
 void SimpleRender::UpdateView()
 {
-  const float aspect   = float(m_width) / float(m_height);
-  auto mProjFix        = OpenglToVulkanProjectionMatrixFix();
-  auto mProj           = projectionMatrix(m_cam.fov, aspect, 0.1f, 1000.0f);
-  auto mLookAt         = LiteMath::lookAt(m_cam.pos, m_cam.lookAt, m_cam.up);
-  auto mWorldViewProj  = mProjFix * mProj * mLookAt;
-  pushConst2M.projView = mWorldViewProj;
+  const float aspect      = float(m_width) / float(m_height);
+  auto mProjFix           = OpenglToVulkanProjectionMatrixFix();
+  auto mProj              = projectionMatrix(m_cam.fov, aspect, 0.1f, 1000.0f);
+  auto mLookAt            = LiteMath::lookAt(m_cam.pos, m_cam.lookAt, m_cam.up);
+  auto mWorldViewProj     = mProjFix * mProj * mLookAt;
+  m_uniforms.cameraMatrix = mWorldViewProj;
 }
 
 void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
+  m_pScnMgr->SetSceneCachePath(std::string(path) + ".scncache");
   m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
 
   CreateUniformBuffer();
   SetupSimplePipeline();
 
   UpdateView();
+  MarkCommandBuffersDirty();
+}
 
-  for (size_t i = 0; i < m_framesInFlight; ++i)
+uint32_t SimpleRender::BeginFrame(float a_time)
+{
+  const uint32_t frameId = m_presentationResources.currentFrame;
+  vkWaitForFences(m_device, 1, &m_frameFences[frameId], VK_TRUE, UINT64_MAX);
+
+  uint32_t imageIdx;
+  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable[frameId], &imageIdx);
+
+  // swapchain may return images out of order, so the image can still be used by another frame in flight
+  if (m_imageFences[imageIdx] != VK_NULL_HANDLE)
+    vkWaitForFences(m_device, 1, &m_imageFences[imageIdx], VK_TRUE, UINT64_MAX);
+  m_imageFences[imageIdx] = m_frameFences[frameId];
+  vkResetFences(m_device, 1, &m_frameFences[frameId]);
+
+  // gpu is done with resources of this image, so its uniforms and command buffers may be overwritten
+  UpdateUniformBuffer(a_time, imageIdx);
+
+  // command buffer of the image is submitted again as it is, unless something it was recorded with is changed
+  if(m_recordedKeys[imageIdx] != RecordKey())
   {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    BuildCommandBufferSimple(m_cmdBuffersDrawMain[imageIdx], m_frameBuffers[imageIdx],
+                             m_swapchain.GetAttachment(imageIdx).view, m_basicForwardPipeline.pipeline, imageIdx);
+    m_recordedKeys[imageIdx] = RecordKey();
   }
+
+  return imageIdx;
 }
 
-void SimpleRender::DrawFrameSimple()
+void SimpleRender::DrawFrameSimple(float a_time)
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
-
-  uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  const uint32_t frameId  = m_presentationResources.currentFrame;
+  const uint32_t imageIdx = BeginFrame(a_time);
 
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
+  auto currentCmdBuf = m_cmdBuffersDrawMain[imageIdx];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable[frameId]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-                           m_basicForwardPipeline.pipeline);
-
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submitInfo.waitSemaphoreCount = 1;
@@ -502,14 +610,14 @@ void SimpleRender::DrawFrameSimple()
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &currentCmdBuf;
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
+  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished[frameId]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[frameId]));
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+                                                 m_presentationResources.renderingFinished[frameId]);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -521,24 +629,21 @@ void SimpleRender::DrawFrameSimple()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
-
-  vkQueueWaitIdle(m_presentationResources.queue);
 }
 
 void SimpleRender::DrawFrame(float a_time, DrawMode a_mode)
 {
-  UpdateUniformBuffer(a_time);
   switch (a_mode)
   {
   case DrawMode::WITH_GUI:
     SetupGUIElements();
-    DrawFrameWithGUI();
+    DrawFrameWithGUI(a_time);
     break;
   case DrawMode::NO_GUI:
-    DrawFrameSimple();
+    DrawFrameSimple(a_time);
     break;
   default:
-    DrawFrameSimple();
+    DrawFrameSimple(a_time);
   }
 }
 
@@ -557,6 +662,7 @@ void SimpleRender::SetupGUIElements()
     ImGui::ColorEdit3("Meshes base color", m_uniforms.baseColor.M, ImGuiColorEditFlags_PickerHueWheel | ImGuiColorEditFlags_NoInputs);
     ImGui::Checkbox("Animate light source color", &m_uniforms.animateLightColor);
     ImGui::SliderFloat3("Light source position", m_uniforms.lightPos.M, -10.f, 10.f);
+    ImGui::Checkbox("Record scene on several threads ('M')", &m_parallelRecording);
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
@@ -573,22 +679,17 @@ void SimpleRender::SetupGUIElements()
   ImGui::Render();
 }
 
-void SimpleRender::DrawFrameWithGUI()
+void SimpleRender::DrawFrameWithGUI(float a_time)
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
-
-  uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  const uint32_t frameId  = m_presentationResources.currentFrame;
+  const uint32_t imageIdx = BeginFrame(a_time);
 
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
+  auto currentCmdBuf = m_cmdBuffersDrawMain[imageIdx];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable[frameId]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-    m_basicForwardPipeline.pipeline);
-
+  // GUI command buffers are per swapchain image, the image fence in BeginFrame keeps them from being rerecorded in use
   ImDrawData* pDrawData = ImGui::GetDrawData();
   auto currentGUICmdBuf = m_pGUIRender->BuildGUIRenderCommand(imageIdx, pDrawData);
 
@@ -602,14 +703,14 @@ void SimpleRender::DrawFrameWithGUI()
   submitInfo.commandBufferCount = submitCmdBufs.size();
   submitInfo.pCommandBuffers = submitCmdBufs.data();
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
+  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished[frameId]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[frameId]));
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-    m_presentationResources.renderingFinished);
+    m_presentationResources.renderingFinished[frameId]);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -621,6 +722,4 @@ void SimpleRender::DrawFrameWithGUI()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
-
-  vkQueueWaitIdle(m_presentationResources.queue);
 }
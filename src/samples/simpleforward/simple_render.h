@@ -6,6 +6,8 @@
 #include "../../render/scene_mgr.h"
 #include "../../render/render_common.h"
 #include "../../render/render_gui.h"
+#include "../../render/cmd_recorder.h"
+#include "../../render/pipeline_cache.h"
 #include "../../../resources/shaders/common.h"
 #include <geom/vk_mesh.h>
 #include <vk_descriptor_sets.h>
@@ -21,7 +23,8 @@ public:
   const std::string VERTEX_SHADER_PATH = "../resources/shaders/simple.vert";
   const std::string FRAGMENT_SHADER_PATH = "../resources/shaders/simple.frag";
 
-  SimpleRender(uint32_t a_width, uint32_t a_height);
+  // a_framesInFlight - how many frames cpu may record ahead of gpu, each one has its own sync objects and uniforms
+  SimpleRender(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight = 2);
   ~SimpleRender()  { Cleanup(); };
 
   inline uint32_t     GetWidth()      const override { return m_width; }
@@ -72,28 +75,43 @@ protected:
   {
     uint32_t    currentFrame      = 0u;
     VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> imageAvailable;    // per frame in flight
+    std::vector<VkSemaphore> renderingFinished;
   } m_presentationResources;
 
   std::vector<VkFence> m_frameFences;
+  std::vector<VkFence> m_imageFences; // fence of the frame which uses swapchain image now, if any
+
+  // per swapchain image, recorded once and submitted again every time the image comes back. Camera is in uniforms
+  // of the same image, so a command buffer is rerecorded only if its record key is changed or it is marked dirty
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
+  std::vector<uint32_t>        m_recordedKeys;
+  uint32_t                     m_imagesNum = 0;
+  static constexpr uint32_t    RECORD_DIRTY = UINT32_MAX;
 
+  // selects matrix of uniforms in vertex shader
   struct
   {
-    LiteMath::float4x4 projView;
-    LiteMath::float4x4 model;
-  } pushConst2M;
+    uint32_t viewId = VIEW_CAMERA;
+  } pushConst;
 
   UniformParams m_uniforms {};
-  VkBuffer m_ubo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
-  void* m_uboMappedMem = nullptr;
+
+  // every swapchain image has its own copy of uniforms, so they are updated without waiting for gpu
+  struct FrameUniforms
+  {
+    VkBuffer        ubo       = VK_NULL_HANDLE;
+    VkDeviceMemory  uboAlloc  = VK_NULL_HANDLE;
+    void*           mappedMem = nullptr;
+    VkDescriptorSet dSet      = VK_NULL_HANDLE;
+  };
+  std::vector<FrameUniforms> m_frameUniforms;
 
   pipeline_data_t m_basicForwardPipeline {};
 
-  VkDescriptorSet m_dSet = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSet m_instDS = VK_NULL_HANDLE;            // instance matrices, used by vertex shader
+  VkDescriptorSetLayout m_instDSLayout = VK_NULL_HANDLE;
   VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
 
   std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings = nullptr;
@@ -108,7 +126,7 @@ protected:
   // *** GUI
   std::shared_ptr<IRenderGUI> m_pGUIRender;
   virtual void SetupGUIElements();
-  void DrawFrameWithGUI();
+  void DrawFrameWithGUI(float a_time);
   //
 
   Camera   m_cam;
@@ -126,20 +144,35 @@ protected:
 
   std::shared_ptr<SceneManager> m_pScnMgr;
 
-  void DrawFrameSimple();
+  // scene pass can be recorded to secondary command buffers on several threads
+  std::unique_ptr<SecondaryCmdRecorder> m_pCmdRecorder;
+  bool m_parallelRecording = true;
+
+  // shared by all pipelines of the render and ImGui, kept on disk between runs
+  std::unique_ptr<PipelineCache> m_pPipelineCache;
+
+  void DrawFrameSimple(float a_time);
+  uint32_t BeginFrame(float a_time);
 
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
   void BuildCommandBufferSimple(VkCommandBuffer cmdBuff, VkFramebuffer frameBuff,
-                                VkImageView a_targetImageView, VkPipeline a_pipeline);
+                                VkImageView a_targetImageView, VkPipeline a_pipeline, uint32_t a_imageIdx);
+  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, uint32_t a_imageIdx,
+                    uint32_t a_firstDraw, uint32_t a_drawsNum);
+  // state which command buffer of an image is recorded with
+  uint32_t RecordKey() const;
+  void MarkCommandBuffersDirty();
 
   virtual void SetupSimplePipeline();
   void CleanupPipelineAndSwapchain();
   void RecreateSwapChain();
 
   void CreateUniformBuffer();
-  void UpdateUniformBuffer(float a_time);
+  void DestroyUniformBuffer();
+  void UpdateUniformBuffer(float a_time, uint32_t a_imageIdx);
+  void CreateFrameSyncObjects();
 
   virtual void Cleanup();
 
@@ -1,10 +1,12 @@
 #include <vk_pipeline.h>
 #include "simple_render_tex.h"
+#include "render/unified_memory.h"
 #include "loader_utils/images.h"
 #include "imgui/misc/cpp/imgui_stdlib.h"
 
 
-SimpleRenderTexture::SimpleRenderTexture(uint32_t a_width, uint32_t a_height) : SimpleRender(a_width, a_height)
+SimpleRenderTexture::SimpleRenderTexture(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight) :
+  SimpleRender(a_width, a_height, a_framesInFlight)
 {
 }
 
@@ -18,12 +20,7 @@ void SimpleRenderTexture::LoadScene(const char* path, bool transpose_inst_matric
   SetupSimplePipeline();
 
   UpdateView();
-
-  for (size_t i = 0; i < m_framesInFlight; ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-      m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-  }
+  MarkCommandBuffersDirty();
 }
 
 void SimpleRenderTexture::LoadTexture()
@@ -55,14 +52,17 @@ void SimpleRenderTexture::LoadTexture()
   }
 
   int mipLevels = 1;
-  m_texture = allocateColorTextureFromDataLDR(m_device, m_physicalDevice, pixels, w, h, mipLevels,
-           VK_FORMAT_R8G8B8A8_UNORM, m_pScnMgr->GetCopyHelper());
+  VkImageLayout texLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  m_texture = AllocateColorTextureLDR(m_device, m_physicalDevice, pixels, w, h, mipLevels,
+           VK_FORMAT_R8G8B8A8_UNORM, m_pScnMgr->GetCopyHelper(),
+           VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, texLayout);
   m_textureSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT,
     VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK);
 
   freeImageMemLDR(pixels);
 
-  // after texture is loaded it's in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL layout
+  // after texture is loaded it's in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL layout,
+  // or in VK_IMAGE_LAYOUT_PREINITIALIZED if it was written to unified memory directly
   // we need to change the layout suited for sampling
   auto imgCmdBuf = vk_utils::createCommandBuffer(m_device, m_commandPool);
   VkCommandBufferBeginInfo beginInfo = {};
@@ -76,7 +76,7 @@ void SimpleRenderTexture::LoadTexture()
     vk_utils::setImageLayout(
       imgCmdBuf,
       m_texture.image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      texLayout,
       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
       subresourceRange);
   }
@@ -87,17 +87,26 @@ void SimpleRenderTexture::LoadTexture()
 void SimpleRenderTexture::SetupSimplePipeline()
 {
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
-    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1}
+    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_imagesNum},
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         m_imagesNum},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1}
   };
 
   if(m_pBindings == nullptr)
     m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1000); // high max sets to allow recreation when texture is updated
 
-  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  m_pBindings->BindImage(1, m_texture.view, m_textureSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-  m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+  // camera matrix is taken by vertex shader
+  for(auto &frame : m_frameUniforms)
+  {
+    m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    m_pBindings->BindBuffer(0, frame.ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    m_pBindings->BindImage(1, m_texture.view, m_textureSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    m_pBindings->BindEnd(&frame.dSet, &m_dSetLayout);
+  }
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT);
+  m_pBindings->BindBuffer(0, m_pScnMgr->GetInstanceMatricesBuffer());
+  m_pBindings->BindEnd(&m_instDS, &m_instDSLayout);
 
   // if we are recreating pipeline (for example, to reload shaders)
   // we need to cleanup old pipeline
@@ -120,39 +129,44 @@ void SimpleRenderTexture::SetupSimplePipeline()
 
   maker.LoadShaders(m_device, shader_paths);
 
-  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
+  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout, m_instDSLayout}, sizeof(pushConst));
   maker.SetDefaultState(m_width, m_height);
 
-  m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
-    m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  m_basicForwardPipeline.pipeline = MakeGraphicsPipeline(maker, m_device, m_pPipelineCache->Get(), m_basicForwardPipeline.layout,
+    m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
 }
 
 void SimpleRenderTexture::DrawFrame(float a_time, DrawMode a_mode)
 {
   if(m_textureNeedsReload)
   {
+    // old texture may still be sampled by frames in flight
+    vkDeviceWaitIdle(m_device);
     LoadTexture();
     SetupSimplePipeline();
+    MarkCommandBuffersDirty();
     m_textureNeedsReload = false;
   }
 
-  UpdateUniformBuffer(a_time);
   switch (a_mode)
   {
   case DrawMode::WITH_GUI:
     SetupGUIElements();
-    DrawFrameWithGUI();
+    DrawFrameWithGUI(a_time);
     break;
   case DrawMode::NO_GUI:
-    DrawFrameSimple();
+    DrawFrameSimple(a_time);
     break;
   default:
-    DrawFrameSimple();
+    DrawFrameSimple(a_time);
   }
 }
 
 void SimpleRenderTexture::ProcessInput(const AppInput &input)
 {
+  if(input.keyReleased[GLFW_KEY_M])
+    m_parallelRecording = !m_parallelRecording;
+
   // recreate pipeline to reload shaders
   if(input.keyPressed[GLFW_KEY_B])
   {
@@ -162,13 +176,10 @@ void SimpleRenderTexture::ProcessInput(const AppInput &input)
     std::system("cd ../resources/shaders && python3 compile_simple_texture_shaders.py");
 #endif
 
+    // pipeline is destroyed and recreated, frames in flight may still use it
+    vkDeviceWaitIdle(m_device);
     SetupSimplePipeline();
-
-    for (size_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-        m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
+    MarkCommandBuffersDirty();
   }
 
 }
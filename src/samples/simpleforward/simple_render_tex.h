@@ -12,7 +12,7 @@ public:
   const std::string VERTEX_SHADER_PATH = "../resources/shaders/simple.vert";
   const std::string FRAGMENT_SHADER_PATH = "../resources/shaders/simple_tex.frag";
 
-  SimpleRenderTexture(uint32_t a_width, uint32_t a_height);
+  SimpleRenderTexture(uint32_t a_width, uint32_t a_height, uint32_t a_framesInFlight = 2);
   ~SimpleRenderTexture() override { Cleanup(); };
 
   void ProcessInput(const AppInput& input) override;
@@ -0,0 +1,137 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+void CameraPath::Add(const Camera* a_cams, uint32_t a_camsNum)
+{
+  PathFrame frame;
+  for(uint32_t i = 0; i < std::min(a_camsNum, uint32_t(CAMS_NUM)); ++i)
+    frame.cams[i] = a_cams[i];
+  m_frames.push_back(frame);
+}
+
+bool CameraPath::Save(const std::string &a_path) const
+{
+  std::ofstream fout(a_path);
+  if(!fout.is_open())
+    return false;
+
+  // enough digits to read exactly the same floats back
+  fout << std::setprecision(9);
+  for(const auto &frame : m_frames)
+  {
+    for(const auto &cam : frame.cams)
+    {
+      fout << cam.pos.x    << " " << cam.pos.y    << " " << cam.pos.z    << " "
+           << cam.lookAt.x << " " << cam.lookAt.y << " " << cam.lookAt.z << " "
+           << cam.up.x     << " " << cam.up.y     << " " << cam.up.z     << " " << cam.fov << " ";
+    }
+    fout << "\n";
+  }
+  return fout.good();
+}
+
+bool CameraPath::Load(const std::string &a_path)
+{
+  std::ifstream fin(a_path);
+  if(!fin.is_open())
+    return false;
+
+  m_frames.clear();
+  std::string line;
+  while(std::getline(fin, line))
+  {
+    if(line.empty())
+      continue;
+
+    std::istringstream values(line);
+    PathFrame frame;
+    for(auto &cam : frame.cams)
+    {
+      values >> cam.pos.x    >> cam.pos.y    >> cam.pos.z
+             >> cam.lookAt.x >> cam.lookAt.y >> cam.lookAt.z
+             >> cam.up.x     >> cam.up.y     >> cam.up.z     >> cam.fov;
+    }
+    if(values.fail())
+      return false;
+    m_frames.push_back(frame);
+  }
+  return true;
+}
+
+
+struct TimeStats
+{
+  size_t count = 0;
+  double minMs = 0.0, meanMs = 0.0, p95Ms = 0.0, p99Ms = 0.0, maxMs = 0.0;
+};
+
+static TimeStats ComputeStats(std::vector<double> a_ms)
+{
+  TimeStats stats;
+  a_ms.erase(std::remove_if(a_ms.begin(), a_ms.end(), [](double a_t) { return a_t < 0.0; }), a_ms.end());
+  stats.count = a_ms.size();
+  if(a_ms.empty())
+    return stats;
+
+  std::sort(a_ms.begin(), a_ms.end());
+  // nearest rank
+  auto percentile = [&a_ms](double a_p) {
+    const size_t rank = size_t(std::ceil(a_p * double(a_ms.size())));
+    return a_ms[std::min(std::max(rank, size_t(1)), a_ms.size()) - 1];
+  };
+  stats.minMs  = a_ms.front();
+  stats.maxMs  = a_ms.back();
+  stats.meanMs = std::accumulate(a_ms.begin(), a_ms.end(), 0.0) / double(a_ms.size());
+  stats.p95Ms  = percentile(0.95);
+  stats.p99Ms  = percentile(0.99);
+  return stats;
+}
+
+void FrameTimes::Add(double a_cpuMs, double a_gpuMs)
+{
+  m_cpuMs.push_back(a_cpuMs);
+  m_gpuMs.push_back(a_gpuMs);
+}
+
+void FrameTimes::Print() const
+{
+  auto print = [](const char* a_name, const TimeStats &a_stats) {
+    std::cout << a_name << ": " << a_stats.count << " frames";
+    if(a_stats.count > 0)
+    {
+      std::cout << std::fixed << std::setprecision(3) << ", min = " << a_stats.minMs << " ms, mean = " << a_stats.meanMs
+                << " ms, p95 = " << a_stats.p95Ms << " ms, p99 = " << a_stats.p99Ms << " ms, max = " << a_stats.maxMs << " ms";
+    }
+    std::cout << std::endl;
+  };
+  print("cpu", ComputeStats(m_cpuMs));
+  print("gpu", ComputeStats(m_gpuMs));
+}
+
+bool FrameTimes::Write(const std::string &a_path) const
+{
+  std::ofstream fout(a_path);
+  if(!fout.is_open())
+    return false;
+
+  fout << std::fixed << std::setprecision(4);
+  fout << "# time,frames,min_ms,mean_ms,p95_ms,p99_ms,max_ms\n";
+  auto writeStats = [&fout](const char* a_name, const TimeStats &a_stats) {
+    fout << "# " << a_name << "," << a_stats.count << "," << a_stats.minMs << "," << a_stats.meanMs << ","
+         << a_stats.p95Ms << "," << a_stats.p99Ms << "," << a_stats.maxMs << "\n";
+  };
+  writeStats("cpu", ComputeStats(m_cpuMs));
+  writeStats("gpu", ComputeStats(m_gpuMs));
+
+  fout << "frame,cpu_ms,gpu_ms\n";
+  for(size_t i = 0; i < m_cpuMs.size(); ++i)
+    fout << i << "," << m_cpuMs[i] << "," << m_gpuMs[i] << "\n";
+  return fout.good();
+}
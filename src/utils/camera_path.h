@@ -0,0 +1,59 @@
+#ifndef CHIMERA_CAMERA_PATH_H
+#define CHIMERA_CAMERA_PATH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+// cameras of every frame of a run, the main one and the light one.
+// text file has one frame per line: pos, lookAt, up and fov of both cameras
+class CameraPath
+{
+public:
+  enum {CAMS_NUM = 2};
+
+  void Add(const Camera* a_cams, uint32_t a_camsNum);
+  bool Save(const std::string &a_path) const;
+  bool Load(const std::string &a_path);
+
+  size_t        Size() const           { return m_frames.size(); }
+  const Camera* Frame(size_t a_i) const { return m_frames[a_i].cams; }
+
+private:
+  struct PathFrame
+  {
+    Camera cams[CAMS_NUM];
+  };
+  std::vector<PathFrame> m_frames;
+};
+
+// per frame times of a run with min, mean, p95, p99 and max of them.
+// cpu time is the time of DrawFrame call, gpu time is of the latest frame finished by gpu at that moment,
+// so it lags behind by number of frames in flight; negative gpu times are not counted
+class FrameTimes
+{
+public:
+  void Add(double a_cpuMs, double a_gpuMs);
+  size_t Size() const { return m_cpuMs.size(); }
+
+  void Print() const;
+  // statistics in commented header and then one csv row per frame
+  bool Write(const std::string &a_path) const;
+
+private:
+  std::vector<double> m_cpuMs;
+  std::vector<double> m_gpuMs;
+};
+
+// options of mainLoop, nothing is recorded or replayed with empty paths
+struct CameraReplay
+{
+  std::string recordPath;                // cameras of every frame are saved here on exit
+  std::string replayPath;                // cameras are taken from here instead of input, loop ends with the path
+  std::string timesPath;                 // FrameTimes of the run
+  float       timeStep = 1.0f / 60.0f;   // time of a frame in replay, so every run draws the same frames
+};
+
+#endif//CHIMERA_CAMERA_PATH_H
@@ -9,6 +9,7 @@
 #include <memory>
 #include <cstdint>
 #include <sstream>
+#include <iomanip>
 
 #include "Camera.h"
 
@@ -183,15 +184,31 @@ void setupImGuiContext(GLFWwindow* a_window)
 }
 
 
-void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI)
+void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI, const CameraReplay &a_replay)
 {
   constexpr int NAverage = 60;
   double avgTime = 0.0;
+  double avgDrawTime = 0.0; // time cpu spends in DrawFrame, including waits for gpu
   int avgCounter = 0;
   int currCam    = 0;
 
+  // replay takes cameras from the path and ignores input, time goes with fixed step
+  CameraPath replayPath, recordPath;
+  const bool replay = !a_replay.replayPath.empty();
+  if(replay)
+  {
+    if(!replayPath.Load(a_replay.replayPath) || replayPath.Size() == 0)
+    {
+      std::cout << "Can't load camera path " << a_replay.replayPath << std::endl;
+      return;
+    }
+    std::cout << "Replaying " << replayPath.Size() << " frames of " << a_replay.replayPath << std::endl;
+  }
+  FrameTimes frameTimes;
+  size_t frame = 0;
+
   double lastTime = glfwGetTime();
-  while (!glfwWindowShouldClose(window))
+  while (!glfwWindowShouldClose(window) && (!replay || frame < replayPath.Size()))
   {
     double thisTime = glfwGetTime();
     double diffTime = thisTime - lastTime;
@@ -199,18 +216,36 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
     
     g_appInput.clearKeys();
     glfwPollEvents();
-    
-    if(g_appInput.keyReleased[GLFW_KEY_L])
-      currCam = 1 - currCam;
 
-    UpdateCamera(window, g_appInput.cams[currCam], static_cast<float>(diffTime));
+    if(replay)
+    {
+      g_appInput.clearKeys();
+      for(uint32_t i = 0; i < CameraPath::CAMS_NUM; ++i)
+        g_appInput.cams[i] = replayPath.Frame(frame)[i];
+    }
+    else
+    {
+      if(g_appInput.keyReleased[GLFW_KEY_L])
+        currCam = 1 - currCam;
+
+      UpdateCamera(window, g_appInput.cams[currCam], static_cast<float>(diffTime));
+    }
+    if(!a_replay.recordPath.empty())
+      recordPath.Add(g_appInput.cams, CameraPath::CAMS_NUM);
+
+    const float frameTime = replay ? a_replay.timeStep * float(frame) : static_cast<float>(thisTime);
     
     app->ProcessInput(g_appInput);
     app->UpdateCamera(g_appInput.cams, 2);
+    const double drawStart = glfwGetTime();
     if(displayGUI)
-      app->DrawFrame(static_cast<float>(thisTime), DrawMode::WITH_GUI);
+      app->DrawFrame(frameTime, DrawMode::WITH_GUI);
     else
-      app->DrawFrame(static_cast<float>(thisTime), DrawMode::NO_GUI);
+      app->DrawFrame(frameTime, DrawMode::NO_GUI);
+    const double drawTime = glfwGetTime() - drawStart;
+    avgDrawTime += drawTime;
+    frameTimes.Add(1000.0 * drawTime, app->GetGpuFrameTime());
+    frame++;
 
     // count and print FPS
     //
@@ -220,11 +255,27 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
     {
       auto title = "test";//app->GetWindowTitle();
       std::stringstream strout;
-      strout << "FPS = " << int( 1.0/(avgTime/double(NAverage)) ) << " " << title;
+      strout << "FPS = " << int( 1.0/(avgTime/double(NAverage)) )
+             << ", frame = " << std::fixed << std::setprecision(2) << 1000.0*avgTime/double(NAverage) << " ms"
+             << ", draw = " << 1000.0*avgDrawTime/double(NAverage) << " ms " << title;
 
       glfwSetWindowTitle(window, strout.str().c_str());
-      avgTime    = 0.0;
-      avgCounter = 0;
+      avgTime     = 0.0;
+      avgDrawTime = 0.0;
+      avgCounter  = 0;
     }
   }
+
+  if(!a_replay.recordPath.empty())
+  {
+    if(recordPath.Save(a_replay.recordPath))
+      std::cout << "Camera path of " << recordPath.Size() << " frames is saved to " << a_replay.recordPath << std::endl;
+    else
+      std::cout << "Can't save camera path to " << a_replay.recordPath << std::endl;
+  }
+
+  if(replay || !a_replay.timesPath.empty())
+    frameTimes.Print();
+  if(!a_replay.timesPath.empty() && !frameTimes.Write(a_replay.timesPath))
+    std::cout << "Can't write frame times to " << a_replay.timesPath << std::endl;
 }
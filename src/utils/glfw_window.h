@@ -3,6 +3,7 @@
 
 #include "../render/render_common.h"
 #include "../render/render_gui.h"
+#include "camera_path.h"
 
 #include "GLFW/glfw3.h"
 #include <memory>
@@ -20,7 +21,9 @@ GLFWwindow * initWindow(int width, int height,
                         GLFWmousebuttonfun mouseBtn = onMouseButtonClickedBasic,
                         GLFWscrollfun mouseScroll = onMouseScrollBasic);
 
-void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI = false);
+// with a_replay cameras may be recorded or replayed and frame times are collected
+void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI = false,
+              const CameraReplay &a_replay = CameraReplay());
 
 void setupImGuiContext(GLFWwindow* a_window);
 
@@ -0,0 +1,158 @@
+#include "offscreen_loop.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  bool savePPM(const std::string &a_path, const std::vector<uint32_t> &a_pixels, uint32_t a_width, uint32_t a_height)
+  {
+    std::ofstream fout(a_path, std::ios::binary);
+    if(!fout.is_open())
+      return false;
+
+    fout << "P6\n" << a_width << " " << a_height << "\n255\n";
+    std::vector<unsigned char> rgb(a_pixels.size() * 3);
+    for(size_t i = 0; i < a_pixels.size(); ++i)
+    {
+      rgb[i * 3 + 0] = (a_pixels[i] >> 0)  & 0xFF;
+      rgb[i * 3 + 1] = (a_pixels[i] >> 8)  & 0xFF;
+      rgb[i * 3 + 2] = (a_pixels[i] >> 16) & 0xFF;
+    }
+    fout.write(reinterpret_cast<const char*>(rgb.data()), std::streamsize(rgb.size()));
+    return fout.good();
+  }
+
+  bool loadPPM(const std::string &a_path, std::vector<uint32_t> &a_pixels, uint32_t &a_width, uint32_t &a_height)
+  {
+    std::ifstream fin(a_path, std::ios::binary);
+    std::string magic;
+    uint32_t maxValue = 0;
+    fin >> magic >> a_width >> a_height >> maxValue;
+    if(!fin.good() || magic != "P6" || maxValue != 255)
+      return false;
+    fin.get(); // single whitespace before data
+
+    std::vector<unsigned char> rgb(size_t(a_width) * a_height * 3);
+    fin.read(reinterpret_cast<char*>(rgb.data()), std::streamsize(rgb.size()));
+    if(!fin.good())
+      return false;
+
+    a_pixels.resize(size_t(a_width) * a_height);
+    for(size_t i = 0; i < a_pixels.size(); ++i)
+      a_pixels[i] = uint32_t(rgb[i * 3]) | (uint32_t(rgb[i * 3 + 1]) << 8) | (uint32_t(rgb[i * 3 + 2]) << 16) | 0xFF000000u;
+    return true;
+  }
+
+  // number of pixels with any of RGB channels differing more than a_tolerance
+  size_t countMismatches(const std::vector<uint32_t> &a_pixels, const std::vector<uint32_t> &a_ref, uint32_t a_tolerance)
+  {
+    size_t mismatches = 0;
+    for(size_t i = 0; i < a_pixels.size(); ++i)
+    {
+      for(uint32_t shift = 0; shift < 24; shift += 8)
+      {
+        const int a = int((a_pixels[i] >> shift) & 0xFF);
+        const int b = int((a_ref[i] >> shift) & 0xFF);
+        if(uint32_t(std::abs(a - b)) > a_tolerance)
+        {
+          mismatches++;
+          break;
+        }
+      }
+    }
+    return mismatches;
+  }
+}
+
+int offscreenLoop(std::shared_ptr<IRender> &app, const OffscreenRun &a_run)
+{
+  const bool needLastFrame = !a_run.imagePath.empty() || !a_run.refPath.empty();
+  app->SetReadback(a_run.readback || needLastFrame);
+
+  AppInput input;
+  app->UpdateCamera(input.cams, 2);
+
+  uint32_t framesNum = a_run.framesNum;
+  CameraPath path;
+  if(!a_run.replay.replayPath.empty())
+  {
+    if(!path.Load(a_run.replay.replayPath) || path.Size() == 0)
+    {
+      std::cout << "Offscreen: can't load camera path " << a_run.replay.replayPath << std::endl;
+      return 1;
+    }
+    framesNum = uint32_t(path.Size());
+  }
+
+  std::vector<uint32_t> pixels;
+  uint32_t framesRead = 0;
+  FrameTimes frameTimes;
+
+  const auto start = std::chrono::high_resolution_clock::now();
+  for(uint32_t i = 0; i < framesNum; ++i)
+  {
+    if(path.Size() > 0)
+      app->UpdateCamera(path.Frame(i), CameraPath::CAMS_NUM);
+
+    const auto drawStart = std::chrono::high_resolution_clock::now();
+    app->DrawFrame(float(i) * a_run.replay.timeStep, DrawMode::NO_GUI);
+    const auto drawEnd = std::chrono::high_resolution_clock::now();
+    frameTimes.Add(std::chrono::duration<double, std::milli>(drawEnd - drawStart).count(), app->GetGpuFrameTime());
+
+    if(a_run.readback && app->ReadbackFrame(pixels, false))
+      framesRead++;
+  }
+  // the last frame is waited for, so all of them are counted
+  const bool lastFrameRead = app->ReadbackFrame(pixels, true);
+  const auto end = std::chrono::high_resolution_clock::now();
+
+  const double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+  std::cout << "Offscreen: " << framesNum << " frames of " << app->GetWidth() << "x" << app->GetHeight()
+            << " in " << std::fixed << std::setprecision(2) << totalMs << " ms, FPS = "
+            << 1000.0 * double(framesNum) / totalMs << ", frame = " << totalMs / double(std::max(framesNum, 1u)) << " ms";
+  if(a_run.readback)
+    std::cout << ", " << framesRead << " frames are read back";
+  std::cout << std::endl;
+
+  frameTimes.Print();
+  if(!a_run.replay.timesPath.empty() && !frameTimes.Write(a_run.replay.timesPath))
+    std::cout << "Offscreen: can't write frame times to " << a_run.replay.timesPath << std::endl;
+
+  if(!needLastFrame)
+    return 0;
+
+  if(!lastFrameRead)
+  {
+    std::cout << "Offscreen: last frame is not read back" << std::endl;
+    return 1;
+  }
+
+  if(!a_run.imagePath.empty() && !savePPM(a_run.imagePath, pixels, app->GetWidth(), app->GetHeight()))
+    std::cout << "Offscreen: can't save frame to " << a_run.imagePath << std::endl;
+
+  if(a_run.refPath.empty())
+    return 0;
+
+  std::vector<uint32_t> ref;
+  uint32_t refWidth = 0, refHeight = 0;
+  if(!loadPPM(a_run.refPath, ref, refWidth, refHeight))
+  {
+    std::cout << "Offscreen: can't load reference image " << a_run.refPath << std::endl;
+    return 1;
+  }
+  if(refWidth != app->GetWidth() || refHeight != app->GetHeight())
+  {
+    std::cout << "Offscreen: reference image is " << refWidth << "x" << refHeight << std::endl;
+    return 1;
+  }
+
+  const size_t mismatches = countMismatches(pixels, ref, a_run.tolerance);
+  std::cout << "Offscreen: " << mismatches << " pixels differ from " << a_run.refPath << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
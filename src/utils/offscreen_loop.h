@@ -0,0 +1,25 @@
+#ifndef CHIMERA_OFFSCREEN_LOOP_H
+#define CHIMERA_OFFSCREEN_LOOP_H
+
+#include "../render/render_common.h"
+#include "camera_path.h"
+
+#include <memory>
+#include <string>
+
+struct OffscreenRun
+{
+  uint32_t    framesNum = 1000;
+  bool        readback  = false; // every finished frame is read by cpu as a consumer of frames would do
+  std::string imagePath;         // last frame is saved here as binary PPM
+  std::string refPath;           // last frame is compared with this PPM image
+  uint32_t    tolerance = 2;     // channel difference which is not counted as mismatch
+  CameraReplay replay;           // camera path replaces the fixed camera, frames number is its length then
+};
+
+// renders frames of a render initialized with InitOffscreen, no window is needed.
+// Cameras and time step are fixed, so frames are the same on every run. Prints frame rate and
+// returns non-zero if the last frame doesn't match the reference image
+int offscreenLoop(std::shared_ptr<IRender> &app, const OffscreenRun &a_run);
+
+#endif//CHIMERA_OFFSCREEN_LOOP_H